@@ -0,0 +1,251 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gsm-app-history.h"
+
+/* How long each app took to register (from being started to being
+ * ready, in milliseconds) over the last few logins, kept in
+ * ~/.config/mate-session/app-history as one group per app id.  The
+ * file is read the first time it is needed and written a little after
+ * the last change, so that all the apps of a login share one write.
+ */
+
+#define GSM_APP_HISTORY_FILE         "app-history"
+/* Renamed when the latencies went from phase-relative to measured from
+ * each app's spawn, so that the old, skewed samples are left behind */
+#define GSM_APP_HISTORY_LATENCY_KEY  "SpawnToRegistrationLatency"
+#define GSM_APP_HISTORY_SIZE         10
+#define GSM_APP_HISTORY_SAVE_DELAY   5 /* seconds */
+
+/* app id -> GArray of guint, oldest first */
+static GHashTable *history = NULL;
+static char       *history_path = NULL;
+static guint       save_id = 0;
+
+static void
+load_history (void)
+{
+        GKeyFile  *keyfile;
+        char     **groups;
+        gint      *values;
+        gsize      n_values;
+        GArray    *latencies;
+        gsize      i;
+        gsize      j;
+
+        history = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) g_array_unref);
+        history_path = g_build_filename (g_get_user_config_dir (),
+                                         "mate-session",
+                                         GSM_APP_HISTORY_FILE,
+                                         NULL);
+
+        keyfile = g_key_file_new ();
+        if (! g_key_file_load_from_file (keyfile, history_path, G_KEY_FILE_NONE, NULL)) {
+                g_key_file_free (keyfile);
+                return;
+        }
+
+        groups = g_key_file_get_groups (keyfile, NULL);
+        for (i = 0; groups[i] != NULL; i++) {
+                values = g_key_file_get_integer_list (keyfile,
+                                                      groups[i],
+                                                      GSM_APP_HISTORY_LATENCY_KEY,
+                                                      &n_values,
+                                                      NULL);
+                if (values == NULL) {
+                        continue;
+                }
+
+                latencies = g_array_sized_new (FALSE, FALSE, sizeof (guint), GSM_APP_HISTORY_SIZE);
+                for (j = MAX (n_values, GSM_APP_HISTORY_SIZE) - GSM_APP_HISTORY_SIZE; j < n_values; j++) {
+                        guint value = MAX (values[j], 0);
+
+                        g_array_append_val (latencies, value);
+                }
+                g_free (values);
+
+                g_hash_table_insert (history, g_strdup (groups[i]), latencies);
+        }
+
+        g_strfreev (groups);
+        g_key_file_free (keyfile);
+}
+
+static gboolean
+save_history (gpointer data)
+{
+        GKeyFile       *keyfile;
+        GHashTableIter  iter;
+        gpointer        key;
+        gpointer        value;
+        GError         *error;
+        char           *contents;
+        char           *dir;
+        gsize           length;
+
+        save_id = 0;
+
+        keyfile = g_key_file_new ();
+
+        g_hash_table_iter_init (&iter, history);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+                GArray *latencies = value;
+
+                g_key_file_set_integer_list (keyfile,
+                                             key,
+                                             GSM_APP_HISTORY_LATENCY_KEY,
+                                             (gint *) latencies->data,
+                                             latencies->len);
+        }
+
+        contents = g_key_file_to_data (keyfile, &length, NULL);
+        g_key_file_free (keyfile);
+
+        dir = g_path_get_dirname (history_path);
+        g_mkdir_with_parents (dir, 0700);
+        g_free (dir);
+
+        error = NULL;
+        if (! g_file_set_contents (history_path, contents, length, &error)) {
+                g_warning ("GsmAppHistory: unable to save %s: %s",
+                           history_path, error->message);
+                g_error_free (error);
+        }
+
+        g_free (contents);
+
+        return FALSE;
+}
+
+void
+gsm_app_history_record_latency (const char *app_id,
+                                guint       latency)
+{
+        GArray *latencies;
+
+        g_return_if_fail (app_id != NULL);
+
+        if (history == NULL) {
+                load_history ();
+        }
+
+        latencies = g_hash_table_lookup (history, app_id);
+        if (latencies == NULL) {
+                latencies = g_array_sized_new (FALSE, FALSE, sizeof (guint), GSM_APP_HISTORY_SIZE);
+                g_hash_table_insert (history, g_strdup (app_id), latencies);
+        }
+
+        if (latencies->len >= GSM_APP_HISTORY_SIZE) {
+                g_array_remove_index (latencies, 0);
+        }
+        latency = MIN (latency, G_MAXINT);
+        g_array_append_val (latencies, latency);
+
+        g_debug ("GsmAppHistory: %s registered after %u ms", app_id, latency);
+
+        if (save_id == 0) {
+                save_id = g_timeout_add_seconds (GSM_APP_HISTORY_SAVE_DELAY,
+                                                 save_history,
+                                                 NULL);
+        }
+}
+
+/* Writes out what the delayed save would have */
+void
+gsm_app_history_flush (void)
+{
+        if (save_id == 0) {
+                return;
+        }
+
+        g_source_remove (save_id);
+        save_history (NULL);
+}
+
+static int
+compare_latency (gconstpointer a,
+                 gconstpointer b)
+{
+        guint la = *(const guint *) a;
+        guint lb = *(const guint *) b;
+
+        return (la > lb) - (la < lb);
+}
+
+/* nearest rank */
+static guint
+percentile (GArray *sorted,
+            guint   percent)
+{
+        guint rank;
+
+        rank = (percent * sorted->len + 99) / 100;
+
+        return g_array_index (sorted, guint, MAX (rank, 1) - 1);
+}
+
+/**
+ * gsm_app_history_get_latency:
+ * @app_id: an app id
+ * @n_samples: return location for the number of logins recorded
+ * @p50: return location for the median latency, in milliseconds
+ * @p95: return location for the 95th percentile, in milliseconds
+ *
+ * Return value: %FALSE if there is no history for @app_id
+ **/
+gboolean
+gsm_app_history_get_latency (const char *app_id,
+                             guint      *n_samples,
+                             guint      *p50,
+                             guint      *p95)
+{
+        GArray *latencies;
+        GArray *sorted;
+
+        g_return_val_if_fail (app_id != NULL, FALSE);
+
+        if (history == NULL) {
+                load_history ();
+        }
+
+        latencies = g_hash_table_lookup (history, app_id);
+        if (latencies == NULL || latencies->len == 0) {
+                *n_samples = *p50 = *p95 = 0;
+                return FALSE;
+        }
+
+        sorted = g_array_sized_new (FALSE, FALSE, sizeof (guint), latencies->len);
+        g_array_append_vals (sorted, latencies->data, latencies->len);
+        g_array_sort (sorted, compare_latency);
+
+        *n_samples = sorted->len;
+        *p50 = percentile (sorted, 50);
+        *p95 = percentile (sorted, 95);
+
+        g_array_unref (sorted);
+
+        return TRUE;
+}
@@ -0,0 +1,36 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __GSM_APP_HISTORY_H__
+#define __GSM_APP_HISTORY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void     gsm_app_history_record_latency (const char *app_id,
+                                         guint       latency);
+gboolean gsm_app_history_get_latency    (const char *app_id,
+                                         guint      *n_samples,
+                                         guint      *p50,
+                                         guint      *p95);
+void     gsm_app_history_flush          (void);
+
+G_END_DECLS
+
+#endif /* __GSM_APP_HISTORY_H__ */
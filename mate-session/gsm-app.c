@@ -26,8 +26,25 @@
 #include <glib.h>
 #include <string.h>
 
+#include "mdm-log.h"
+
 #include "gsm-app.h"
 #include "gsm-app-glue.h"
+#include "gsm-app-history.h"
+#include "gsm-cgroup.h"
+
+/* Autorestarted apps that keep crashing are restarted with an
+ * exponentially growing delay, jittered by up to a quarter so that
+ * apps losing the same service don't all come back in lockstep.  An
+ * app that asks for more than GSM_APP_RESTART_BUDGET restarts within
+ * GSM_APP_RESTART_WINDOW is left dead, and one that stays up for
+ * GSM_APP_RESTART_STABLE starts over with an immediate restart.
+ */
+#define GSM_APP_RESTART_BACKOFF_MIN 500   /* milliseconds */
+#define GSM_APP_RESTART_BACKOFF_MAX 30000 /* milliseconds */
+#define GSM_APP_RESTART_BUDGET      5
+#define GSM_APP_RESTART_WINDOW      60    /* seconds */
+#define GSM_APP_RESTART_STABLE      30    /* seconds */
 
 typedef struct {
         char            *id;
@@ -35,6 +52,13 @@ typedef struct {
         int              phase;
         char            *startup_id;
         DBusGConnection *connection;
+
+        guint            restart_count;
+        guint            restart_backoff;
+        guint            restart_id;
+        gint64           last_restart;
+        gint64           restart_times[GSM_APP_RESTART_BUDGET];
+        guint            restart_times_next;
 } GsmAppPrivate;
 
 enum {
@@ -243,6 +267,11 @@ gsm_app_dispose (GObject *object)
         g_free (priv->id);
         priv->id = NULL;
 
+        if (priv->restart_id > 0) {
+                g_source_remove (priv->restart_id);
+                priv->restart_id = 0;
+        }
+
         G_OBJECT_CLASS (gsm_app_parent_class)->dispose (object);
 }
 
@@ -262,6 +291,7 @@ gsm_app_class_init (GsmAppClass *klass)
         klass->impl_provides = NULL;
         klass->impl_is_running = NULL;
         klass->impl_peek_autostart_delay = NULL;
+        klass->impl_peek_launch_priority = NULL;
 
         g_object_class_install_property (object_class,
                                          PROP_PHASE,
@@ -442,6 +472,8 @@ gsm_app_start (GsmApp  *app,
         priv = gsm_app_get_instance_private (app);
         g_debug ("Starting app: %s", priv->id);
 
+        gsm_app_cancel_restart (app);
+
         return GSM_APP_GET_CLASS (app)->impl_start (app, error);
 }
 
@@ -462,14 +494,157 @@ gboolean
 gsm_app_stop (GsmApp  *app,
               GError **error)
 {
+        gsm_app_cancel_restart (app);
+
         return GSM_APP_GET_CLASS (app)->impl_stop (app, error);
 }
 
+static guint
+peek_restart_backoff (GsmAppPrivate *priv,
+                      gint64         now)
+{
+        if (priv->last_restart == 0
+            || now - priv->last_restart >= GSM_APP_RESTART_STABLE * G_USEC_PER_SEC) {
+                return 0;
+        }
+
+        return priv->restart_backoff;
+}
+
+static gboolean
+on_restart_timeout (GsmApp *app)
+{
+        GsmAppPrivate *priv;
+        GError        *error;
+
+        priv = gsm_app_get_instance_private (app);
+        priv->restart_id = 0;
+
+        /* Stability is measured from when the app is actually back, not
+         * from when the restart was scheduled */
+        priv->last_restart = g_get_monotonic_time ();
+
+        error = NULL;
+        if (! gsm_app_restart (app, &error)) {
+                g_warning ("Error on restarting session managed app: %s",
+                           error != NULL ? error->message : "unknown error");
+                g_clear_error (&error);
+        }
+
+        return FALSE;
+}
+
+/**
+ * gsm_app_schedule_restart:
+ * @app: a %GsmApp
+ * @error: return location for a #GError
+ *
+ * Restarts @app after its current backoff delay, which is zero unless
+ * @app was restarted recently.  Fails with %GSM_APP_ERROR_RESTART if
+ * @app has used up its restart budget.
+ *
+ * Return value: %TRUE if the restart was started or scheduled
+ **/
+gboolean
+gsm_app_schedule_restart (GsmApp  *app,
+                          GError **error)
+{
+        GsmAppPrivate *priv;
+        gint64         now;
+        gint64         oldest;
+        guint          backoff;
+        guint          delay;
+
+        g_return_val_if_fail (GSM_IS_APP (app), FALSE);
+
+        priv = gsm_app_get_instance_private (app);
+
+        if (priv->restart_id > 0) {
+                return TRUE;
+        }
+
+        now = g_get_monotonic_time ();
+
+        oldest = priv->restart_times[priv->restart_times_next];
+        if (oldest != 0
+            && now - oldest < GSM_APP_RESTART_WINDOW * G_USEC_PER_SEC) {
+                g_set_error (error,
+                             GSM_APP_ERROR,
+                             GSM_APP_ERROR_RESTART,
+                             "Application '%s' was restarted %d times in %d seconds, giving up",
+                             gsm_app_peek_app_id (app),
+                             GSM_APP_RESTART_BUDGET,
+                             GSM_APP_RESTART_WINDOW);
+                return FALSE;
+        }
+
+        priv->restart_times[priv->restart_times_next] = now;
+        priv->restart_times_next = (priv->restart_times_next + 1) % GSM_APP_RESTART_BUDGET;
+
+        backoff = peek_restart_backoff (priv, now);
+        delay = backoff;
+        if (backoff > 0) {
+                delay += g_random_int_range (0, backoff / 4 + 1);
+        }
+
+        priv->restart_backoff = backoff == 0 ? GSM_APP_RESTART_BACKOFF_MIN
+                                             : MIN (backoff * 2, GSM_APP_RESTART_BACKOFF_MAX);
+        priv->restart_count++;
+
+        mdm_log_debug_for ("GsmApp", NULL, priv->id,
+                           "restart %u of app %s in %u ms",
+                           priv->restart_count, priv->id, delay);
+
+        if (delay == 0) {
+                priv->last_restart = now;
+                return gsm_app_restart (app, error);
+        }
+
+        priv->restart_id = g_timeout_add (delay,
+                                          (GSourceFunc)on_restart_timeout,
+                                          app);
+
+        return TRUE;
+}
+
+void
+gsm_app_cancel_restart (GsmApp *app)
+{
+        GsmAppPrivate *priv;
+
+        g_return_if_fail (GSM_IS_APP (app));
+
+        priv = gsm_app_get_instance_private (app);
+
+        if (priv->restart_id > 0) {
+                g_debug ("GsmApp: cancelling pending restart of %s", priv->id);
+                g_source_remove (priv->restart_id);
+                priv->restart_id = 0;
+        }
+}
+
 void
 gsm_app_registered (GsmApp *app)
 {
         g_return_if_fail (GSM_IS_APP (app));
 
+        /* registering doesn't say anything about apps that tell us
+         * themselves when they are ready */
+        if (GSM_APP_GET_CLASS (app)->impl_notifies_ready
+            && GSM_APP_GET_CLASS (app)->impl_notifies_ready (app)) {
+                g_debug ("GsmApp: %s registered, waiting for it to be ready",
+                         gsm_app_peek_id (app));
+                return;
+        }
+
+        g_signal_emit (app, signals[REGISTERED], 0);
+}
+
+void
+gsm_app_ready (GsmApp *app)
+{
+        g_return_if_fail (GSM_IS_APP (app));
+
         g_signal_emit (app, signals[REGISTERED], 0);
 }
 
@@ -485,6 +660,18 @@ gsm_app_peek_autostart_delay (GsmApp *app)
         }
 }
 
+int
+gsm_app_peek_launch_priority (GsmApp *app)
+{
+        g_return_val_if_fail (GSM_IS_APP (app), 0);
+
+        if (GSM_APP_GET_CLASS (app)->impl_peek_launch_priority) {
+                return GSM_APP_GET_CLASS (app)->impl_peek_launch_priority (app);
+        } else {
+                return 0;
+        }
+}
+
 void
 gsm_app_exited (GsmApp *app)
 {
@@ -536,3 +723,69 @@ gsm_app_get_phase (GsmApp     *app,
         *phase = priv->phase;
         return TRUE;
 }
+
+gboolean
+gsm_app_get_restart_count (GsmApp     *app,
+                           guint      *count,
+                           GError    **error)
+{
+        GsmAppPrivate *priv;
+        g_return_val_if_fail (GSM_IS_APP (app), FALSE);
+
+        priv = gsm_app_get_instance_private (app);
+        *count = priv->restart_count;
+        return TRUE;
+}
+
+gboolean
+gsm_app_get_restart_backoff (GsmApp     *app,
+                             guint      *backoff,
+                             GError    **error)
+{
+        GsmAppPrivate *priv;
+        g_return_val_if_fail (GSM_IS_APP (app), FALSE);
+
+        priv = gsm_app_get_instance_private (app);
+        *backoff = peek_restart_backoff (priv, g_get_monotonic_time ());
+        return TRUE;
+}
+
+gboolean
+gsm_app_get_resource_usage (GsmApp     *app,
+                            guint64    *memory_current,
+                            guint64    *cpu_usage,
+                            GError    **error)
+{
+        const char *cgroup;
+
+        g_return_val_if_fail (GSM_IS_APP (app), FALSE);
+
+        cgroup = NULL;
+        if (GSM_APP_GET_CLASS (app)->impl_peek_cgroup) {
+                cgroup = GSM_APP_GET_CLASS (app)->impl_peek_cgroup (app);
+        }
+
+        if (cgroup == NULL
+            || ! gsm_cgroup_get_stats (cgroup, memory_current, cpu_usage)) {
+                g_set_error (error,
+                             GSM_APP_ERROR,
+                             GSM_APP_ERROR_GENERAL,
+                             "Application is not running in a cgroup of its own");
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+gboolean
+gsm_app_get_registration_latency (GsmApp     *app,
+                                  guint      *n_samples,
+                                  guint      *p50,
+                                  guint      *p95,
+                                  GError    **error)
+{
+        g_return_val_if_fail (GSM_IS_APP (app), FALSE);
+
+        gsm_app_history_get_latency (gsm_app_peek_app_id (app), n_samples, p50, p95);
+        return TRUE;
+}
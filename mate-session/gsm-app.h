@@ -52,6 +52,7 @@ struct _GsmAppClass
         gboolean    (*impl_stop)                      (GsmApp     *app,
                                                        GError    **error);
         int         (*impl_peek_autostart_delay)      (GsmApp     *app);
+        int         (*impl_peek_launch_priority)      (GsmApp     *app);
         gboolean    (*impl_provides)                  (GsmApp     *app,
                                                        const char *service);
         gboolean    (*impl_has_autostart_condition)   (GsmApp     *app,
@@ -62,6 +63,8 @@ struct _GsmAppClass
         const char *(*impl_get_app_id)                (GsmApp     *app);
         gboolean    (*impl_is_disabled)               (GsmApp     *app);
         gboolean    (*impl_is_conditionally_disabled) (GsmApp     *app);
+        const char *(*impl_peek_cgroup)               (GsmApp     *app);
+        gboolean    (*impl_notifies_ready)            (GsmApp     *app);
 };
 
 typedef enum
@@ -69,6 +72,7 @@ typedef enum
         GSM_APP_ERROR_GENERAL = 0,
         GSM_APP_ERROR_START,
         GSM_APP_ERROR_STOP,
+        GSM_APP_ERROR_RESTART,
         GSM_APP_NUM_ERRORS
 } GsmAppError;
 
@@ -91,6 +95,9 @@ gboolean         gsm_app_restart                        (GsmApp     *app,
                                                          GError    **error);
 gboolean         gsm_app_stop                           (GsmApp     *app,
                                                          GError    **error);
+gboolean         gsm_app_schedule_restart               (GsmApp     *app,
+                                                         GError    **error);
+void             gsm_app_cancel_restart                 (GsmApp     *app);
 gboolean         gsm_app_is_running                     (GsmApp     *app);
 
 void             gsm_app_exited                         (GsmApp     *app);
@@ -101,7 +108,9 @@ gboolean         gsm_app_provides                       (GsmApp     *app,
 gboolean         gsm_app_has_autostart_condition        (GsmApp     *app,
                                                          const char *condition);
 void             gsm_app_registered                     (GsmApp     *app);
+void             gsm_app_ready                          (GsmApp     *app);
 int              gsm_app_peek_autostart_delay           (GsmApp     *app);
+int              gsm_app_peek_launch_priority           (GsmApp     *app);
 
 /* exported to bus */
 gboolean         gsm_app_get_app_id                     (GsmApp     *app,
@@ -113,6 +122,21 @@ gboolean         gsm_app_get_startup_id                 (GsmApp     *app,
 gboolean         gsm_app_get_phase                      (GsmApp     *app,
                                                          guint      *phase,
                                                          GError    **error);
+gboolean         gsm_app_get_restart_count              (GsmApp     *app,
+                                                         guint      *count,
+                                                         GError    **error);
+gboolean         gsm_app_get_restart_backoff            (GsmApp     *app,
+                                                         guint      *backoff,
+                                                         GError    **error);
+gboolean         gsm_app_get_resource_usage             (GsmApp     *app,
+                                                         guint64    *memory_current,
+                                                         guint64    *cpu_usage,
+                                                         GError    **error);
+gboolean         gsm_app_get_registration_latency       (GsmApp     *app,
+                                                         guint      *n_samples,
+                                                         guint      *p50,
+                                                         guint      *p95,
+                                                         GError    **error);
 
 G_END_DECLS
 
@@ -22,23 +22,33 @@
 #include <config.h>
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <errno.h>
 /* Needed for FreeBSD */
 #include <signal.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include <glib.h>
 #include <gio/gio.h>
 
 #include "gsm-autostart-app.h"
+#include "gsm-cgroup.h"
+#include "gsm-condition.h"
+#include "gsm-notify-socket.h"
+#include "gsm-prefetch.h"
 #include "gsm-util.h"
-
-#ifdef __GNUC__
-#define UNUSED_VARIABLE __attribute__ ((unused))
-#else
-#define UNUSED_VARIABLE
-#endif
+#include "gsm-window-watch.h"
+#include "mdm-log.h"
+#include "mdm-signal-handler.h"
 
 enum {
         AUTOSTART_LAUNCH_SPAWN = 0,
@@ -56,28 +66,80 @@ enum {
 
 #define GSM_SESSION_CLIENT_DBUS_INTERFACE "org.mate.SessionClient"
 
+/* How long a spawned app gets between SIGTERM and SIGKILL, in seconds */
+#define GSM_AUTOSTART_APP_STOP_TIMEOUT     3
+#define GSM_AUTOSTART_APP_MAX_STOP_TIMEOUT 10
+
+/* X-MATE-Autostart-Nice and X-MATE-Autostart-IOClass are applied in
+ * the child before it execs.  While demoted (Application phase apps
+ * until shortly after the session is running, if demote-startup-apps
+ * is set), apps without an explicit class run as SCHED_BATCH in the
+ * idle I/O class.  Unlike a higher nice value, both can be undone
+ * without privileges.
+ */
+#if defined(__linux__) && defined(SYS_ioprio_set) && defined(SYS_ioprio_get)
+#define HAVE_IOPRIO 1
+#define IOPRIO_WHO_PROCESS    1
+#define IOPRIO_CLASS_SHIFT    13
+#define IOPRIO_CLASS_BE       2
+#define IOPRIO_CLASS_IDLE     3
+#define IOPRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+#endif
+
+#if defined(__linux__) && !defined(SCHED_BATCH)
+#define SCHED_BATCH 3
+#endif
+
+typedef struct {
+        gboolean set_nice;
+        int      nice;
+        int      ioprio;              /* 0 means inherit */
+        gboolean batch;
+        char    *cgroup_procs;        /* cgroup to join, if delegated */
+} SpawnSetup;
+
 typedef struct {
         char                 *desktop_filename;
         char                 *desktop_id;
         char                 *startup_id;
 
         EggDesktopFile       *desktop_file;
+        GKeyFile             *desktop_key_file;
 
         /* desktop file state */
         char                 *condition_string;
         gboolean              condition;
         gboolean              autorestart;
         int                   autostart_delay;
-
-        GFileMonitor         *condition_monitor;
-        GSettings            *condition_settings;
+        int                   stop_timeout;
+        gboolean              has_nice;
+        int                   nice;
+        int                   ioprio;
+        gboolean              demoted;
+        guint64               memory_max;
+        guint64               cpu_weight;
+        gboolean              ready_notify;
+        gboolean              ready_window;
+        int                   launch_priority;
+        SpawnSetup            spawn_setup;
+
+        guint                 condition_kind;
+        GsmCondition         *condition_source;
+        gulong                condition_handler_id;
 
         int                   launch_type;
         GPid                  pid;
+        MdmSignalHandler     *signal_handler;
         guint                 child_watch_id;
-
-        GDBusConnection      *connection;
-        GDBusProxy           *proxy;
+        char                 *cgroup;
+        gboolean              cgroup_delegated;
+        gboolean              stopping;
+        gboolean              notify_active;
+        guint                 notify_watch_id;
+        guint                 window_watch_id;
+
+        gint64                activation_start;
+        gint64                activation_latency;
 } GsmAutostartAppPrivate;
 
 enum {
@@ -87,7 +149,8 @@ enum {
 
 enum {
         PROP_0,
-        PROP_DESKTOP_FILENAME
+        PROP_DESKTOP_FILENAME,
+        PROP_DESKTOP_KEY_FILE
 };
 
 static guint signals[LAST_SIGNAL] = { 0 };
@@ -102,9 +165,9 @@ gsm_autostart_app_init (GsmAutostartApp *app)
         priv = gsm_autostart_app_get_instance_private (app);
 
         priv->pid = -1;
-        priv->condition_monitor = NULL;
         priv->condition = FALSE;
         priv->autostart_delay = -1;
+        priv->stop_timeout = GSM_AUTOSTART_APP_STOP_TIMEOUT;
 }
 
 static gboolean
@@ -186,87 +249,35 @@ parse_condition_string (const char *condition_string,
         return (kind != GSM_CONDITION_UNKNOWN);
 }
 
-static void
-if_exists_condition_cb (GFileMonitor     *monitor,
-                        GFile            *file,
-                        GFile            *other_file,
-                        GFileMonitorEvent event,
-                        GsmApp           *app)
-{
-        GsmAutostartAppPrivate *priv;
-        gboolean                condition = FALSE;
-
-        priv = gsm_autostart_app_get_instance_private (GSM_AUTOSTART_APP(app));
-
-        switch (event) {
-        case G_FILE_MONITOR_EVENT_CREATED:
-                condition = TRUE;
-                break;
-        case G_FILE_MONITOR_EVENT_DELETED:
-                condition = FALSE;
-                break;
-        default:
-                /* Ignore any other monitor event */
-                return;
-        }
-
-        /* Emit only if the condition actually changed */
-        if (condition != priv->condition) {
-                priv->condition = condition;
-                g_signal_emit (app, signals[CONDITION_CHANGED], 0, condition);
-        }
-}
-
-static void
-unless_exists_condition_cb (GFileMonitor     *monitor,
-                            GFile            *file,
-                            GFile            *other_file,
-                            GFileMonitorEvent event,
-                            GsmApp           *app)
+static gboolean
+condition_from_source (GsmAutostartApp *app,
+                       gboolean         value)
 {
         GsmAutostartAppPrivate *priv;
-        gboolean                condition = FALSE;
 
-        priv = gsm_autostart_app_get_instance_private (GSM_AUTOSTART_APP(app));
+        priv = gsm_autostart_app_get_instance_private (app);
 
-        switch (event) {
-        case G_FILE_MONITOR_EVENT_CREATED:
-                condition = FALSE;
-                break;
-        case G_FILE_MONITOR_EVENT_DELETED:
-                condition = TRUE;
-                break;
-        default:
-                /* Ignore any other monitor event */
-                return;
+        if (priv->condition_kind == GSM_CONDITION_UNLESS_EXISTS) {
+                return !value;
         }
 
-        /* Emit only if the condition actually changed */
-        if (condition != priv->condition) {
-                priv->condition = condition;
-                g_signal_emit (app, signals[CONDITION_CHANGED], 0, condition);
-        }
+        return value;
 }
 
 static void
-gsettings_condition_cb (GSettings  *settings,
-                        const char *key,
-                        gpointer    user_data)
+condition_source_changed_cb (GsmCondition    *source,
+                             gboolean         value,
+                             GsmAutostartApp *app)
 {
-        GsmApp                 *app;
         GsmAutostartAppPrivate *priv;
         gboolean                condition;
 
-        g_return_if_fail (GSM_IS_APP (user_data));
-
-        app = GSM_APP (user_data);
-
-        priv = gsm_autostart_app_get_instance_private (GSM_AUTOSTART_APP(app));
+        priv = gsm_autostart_app_get_instance_private (app);
 
-        condition = g_settings_get_boolean (settings, key);
+        condition = condition_from_source (app, value);
 
         g_debug ("GsmAutostartApp: app:%s condition changed condition:%d",
-                 gsm_app_peek_id (app),
+                 gsm_app_peek_id (GSM_APP (app)),
                  condition);
 
         /* Emit only if the condition actually changed */
@@ -276,51 +287,20 @@ gsettings_condition_cb (GSettings  *settings,
         }
 }
 
-static gboolean
-setup_gsettings_condition_monitor (GsmAutostartApp *app,
-                                   const char      *key)
+static void
+clear_condition_source (GsmAutostartApp *app)
 {
-        GSettingsSchemaSource *source;
-        GSettingsSchema *schema;
-        GSettings *settings;
-        char **elems;
-        gboolean retval = FALSE;
-        char *signal;
         GsmAutostartAppPrivate *priv;
 
-        elems = g_strsplit (key, " ", 2);
-
         priv = gsm_autostart_app_get_instance_private (app);
 
-        if (elems == NULL)
-                goto out;
-
-        if (elems[0] == NULL || elems[1] == NULL)
-	        goto out;
-
-        source = g_settings_schema_source_get_default ();
-
-        schema = g_settings_schema_source_lookup (source, elems[0], TRUE);
-
-        if (schema == NULL)
-                goto out;
-
-        settings = g_settings_new_full (schema, NULL, NULL);
-        g_settings_schema_unref (schema);
-
-        signal = g_strdup_printf ("changed::%s", elems[1]);
-        g_signal_connect (G_OBJECT (settings), signal,
-                          G_CALLBACK (gsettings_condition_cb), app);
-        g_free (signal);
-
-        retval = g_settings_get_boolean (settings, elems[1]);
-
-        priv->condition_settings = settings;
-
-out:
-        g_strfreev (elems);
-
-        return retval;
+        if (priv->condition_source != NULL) {
+                g_signal_handler_disconnect (priv->condition_source,
+                                             priv->condition_handler_id);
+                g_object_unref (priv->condition_source);
+                priv->condition_source = NULL;
+                priv->condition_handler_id = 0;
+        }
 }
 
 static void
@@ -329,85 +309,153 @@ setup_condition_monitor (GsmAutostartApp *app)
         guint    kind;
         char    *key;
         gboolean res;
-        gboolean UNUSED_VARIABLE disabled;
         GsmAutostartAppPrivate *priv;
 
         priv = gsm_autostart_app_get_instance_private (app);
 
-        if (priv->condition_monitor != NULL) {
-                g_file_monitor_cancel (priv->condition_monitor);
-        }
-
-        if (priv->condition_settings != NULL) {
-                g_object_unref (priv->condition_settings);
-                priv->condition_settings = NULL;
-        }
+        clear_condition_source (app);
+        priv->condition_kind = GSM_CONDITION_NONE;
 
         if (priv->condition_string == NULL) {
                 return;
         }
 
-        /* if it is disabled outright there is no point in monitoring */
-        if (is_disabled (GSM_APP (app))) {
-                return;
-        }
-
+        /* the condition string is only parsed here, the result is
+         * kept for is_conditionally_disabled() */
         key = NULL;
         res = parse_condition_string (priv->condition_string, &kind, &key);
-        if (! res) {
-                g_free (key);
-                return;
-        }
+        priv->condition_kind = res ? kind : GSM_CONDITION_UNKNOWN;
 
-        if (key == NULL) {
+        /* if it is disabled outright there is no point in monitoring */
+        if (! res || key == NULL || is_disabled (GSM_APP (app))) {
+                g_free (key);
                 return;
         }
 
-        if (kind == GSM_CONDITION_IF_EXISTS) {
-                char  *file_path;
-                GFile *file;
+        if (kind == GSM_CONDITION_IF_EXISTS
+            || kind == GSM_CONDITION_UNLESS_EXISTS) {
+                char *file_path;
 
                 file_path = g_build_filename (g_get_user_config_dir (), key, NULL);
+                priv->condition_source = gsm_condition_get_for_file (file_path);
+                g_free (file_path);
+        } else if (kind == GSM_CONDITION_MATE
+                   || kind == GSM_CONDITION_GSETTINGS) {
+                char **elems;
 
-                disabled = !g_file_test (file_path, G_FILE_TEST_EXISTS);
+                elems = g_strsplit (key, " ", 2);
+                if (elems[0] != NULL && elems[1] != NULL) {
+                        priv->condition_source = gsm_condition_get_for_setting (elems[0],
+                                                                                elems[1]);
+                }
+                g_strfreev (elems);
+        }
 
-                file = g_file_new_for_path (file_path);
-                priv->condition_monitor = g_file_monitor_file (file, 0, NULL, NULL);
+        if (priv->condition_source != NULL) {
+                priv->condition_handler_id = g_signal_connect (priv->condition_source,
+                                                               "changed",
+                                                               G_CALLBACK (condition_source_changed_cb),
+                                                               app);
+                priv->condition = condition_from_source (app,
+                                                         gsm_condition_get_value (priv->condition_source));
+        }
 
-                g_signal_connect (priv->condition_monitor, "changed",
-                                  G_CALLBACK (if_exists_condition_cb),
-                                  app);
+        g_free (key);
+}
 
-                g_object_unref (file);
-                g_free (file_path);
-        } else if (kind == GSM_CONDITION_UNLESS_EXISTS) {
-                char  *file_path;
-                GFile *file;
+/* "best-effort", "best-effort:<level>" or "idle"; the realtime class
+ * would need privileges we don't have */
+static int
+parse_io_class (GsmAutostartApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+        char                   *value;
+#ifdef HAVE_IOPRIO
+        char                   *level;
+#endif
+        int                     ioprio;
 
-                file_path = g_build_filename (g_get_user_config_dir (), key, NULL);
+        priv = gsm_autostart_app_get_instance_private (app);
 
-                disabled = g_file_test (file_path, G_FILE_TEST_EXISTS);
+        value = egg_desktop_file_get_string (priv->desktop_file,
+                                             GSM_AUTOSTART_APP_IO_CLASS_KEY,
+                                             NULL);
+        if (value == NULL) {
+                return 0;
+        }
 
-                file = g_file_new_for_path (file_path);
-                priv->condition_monitor = g_file_monitor_file (file, 0, NULL, NULL);
+        ioprio = 0;
 
-                g_signal_connect (priv->condition_monitor, "changed",
-                                  G_CALLBACK (unless_exists_condition_cb),
-                                  app);
+#ifdef HAVE_IOPRIO
+        level = strchr (value, ':');
+        if (level != NULL) {
+                *level++ = '\0';
+        }
 
-                g_object_unref (file);
-                g_free (file_path);
-        } else if (kind == GSM_CONDITION_MATE) {
-                disabled = !setup_gsettings_condition_monitor (app, key);
-        } else if (kind == GSM_CONDITION_GSETTINGS) {
-                disabled = !setup_gsettings_condition_monitor (app, key);
+        if (strcmp (value, "best-effort") == 0) {
+                ioprio = IOPRIO_VALUE (IOPRIO_CLASS_BE,
+                                       level != NULL ? CLAMP (atoi (level), 0, 7) : 4);
+        } else if (strcmp (value, "idle") == 0) {
+                ioprio = IOPRIO_VALUE (IOPRIO_CLASS_IDLE, 0);
         } else {
-                disabled = TRUE;
+                g_warning ("Invalid %s '%s' for %s",
+                           GSM_AUTOSTART_APP_IO_CLASS_KEY,
+                           value,
+                           gsm_app_peek_id (GSM_APP (app)));
         }
+#endif
 
-        g_free (key);
+        g_free (value);
 
-        /* FIXME: cache the disabled value? */
+        return ioprio;
+}
+
+/* bytes, with an optional K, M, G or T suffix; 0 means no limit */
+static guint64
+parse_memory_max (GsmAutostartApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+        char                   *value;
+        char                   *end;
+        guint64                 bytes;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        value = egg_desktop_file_get_string (priv->desktop_file,
+                                             GSM_AUTOSTART_APP_MEMORY_MAX_KEY,
+                                             NULL);
+        if (value == NULL) {
+                return 0;
+        }
+
+        bytes = g_ascii_strtoull (value, &end, 10);
+        switch (g_ascii_toupper (*end)) {
+        case 'T':
+                bytes *= 1024;
+                /* fall through */
+        case 'G':
+                bytes *= 1024;
+                /* fall through */
+        case 'M':
+                bytes *= 1024;
+                /* fall through */
+        case 'K':
+                bytes *= 1024;
+                break;
+        case '\0':
+                break;
+        default:
+                g_warning ("Invalid %s '%s' for %s",
+                           GSM_AUTOSTART_APP_MEMORY_MAX_KEY,
+                           value,
+                           gsm_app_peek_id (GSM_APP (app)));
+                bytes = 0;
+                break;
+        }
+
+        g_free (value);
+
+        return bytes;
 }
 
 static gboolean
@@ -416,6 +464,7 @@ load_desktop_file (GsmAutostartApp *app)
         char    *dbus_name;
         char    *startup_id;
         char    *phase_str;
+        char    *value;
         int      phase;
         gboolean res;
         GsmAutostartAppPrivate *priv;
@@ -486,6 +535,55 @@ load_desktop_file (GsmAutostartApp *app)
                 priv->autorestart = FALSE;
         }
 
+        if (egg_desktop_file_has_key (priv->desktop_file,
+                                      GSM_AUTOSTART_APP_STOP_TIMEOUT_KEY,
+                                      NULL)) {
+                priv->stop_timeout = egg_desktop_file_get_integer (priv->desktop_file,
+                                                                   GSM_AUTOSTART_APP_STOP_TIMEOUT_KEY,
+                                                                   NULL);
+                priv->stop_timeout = CLAMP (priv->stop_timeout, 0, GSM_AUTOSTART_APP_MAX_STOP_TIMEOUT);
+        }
+
+        priv->has_nice = egg_desktop_file_has_key (priv->desktop_file,
+                                                   GSM_AUTOSTART_APP_NICE_KEY,
+                                                   NULL);
+        if (priv->has_nice) {
+                priv->nice = egg_desktop_file_get_integer (priv->desktop_file,
+                                                           GSM_AUTOSTART_APP_NICE_KEY,
+                                                           NULL);
+                priv->nice = CLAMP (priv->nice, -20, 19);
+        }
+
+        priv->ioprio = parse_io_class (app);
+
+        priv->memory_max = parse_memory_max (app);
+
+        priv->cpu_weight = 0;
+        if (egg_desktop_file_has_key (priv->desktop_file,
+                                      GSM_AUTOSTART_APP_CPU_WEIGHT_KEY,
+                                      NULL)) {
+                priv->cpu_weight = CLAMP (egg_desktop_file_get_integer (priv->desktop_file,
+                                                                        GSM_AUTOSTART_APP_CPU_WEIGHT_KEY,
+                                                                        NULL),
+                                          1, 10000);
+        }
+
+        /* "registration" (the default), "notify", for apps that send
+         * READY=1 to $NOTIFY_SOCKET once they are up, or "window", for
+         * apps that are ready once they map their first window, even
+         * if they register later */
+        value = egg_desktop_file_get_string (priv->desktop_file,
+                                             GSM_AUTOSTART_APP_READY_KEY,
+                                             NULL);
+        priv->ready_notify = (g_strcmp0 (value, "notify") == 0);
+        priv->ready_window = (g_strcmp0 (value, "window") == 0);
+        g_free (value);
+
+        /* apps with a higher priority are launched first in their phase */
+        priv->launch_priority = egg_desktop_file_get_integer (priv->desktop_file,
+                                                              GSM_AUTOSTART_APP_PRIORITY_KEY,
+                                                              NULL);
+
         g_free (priv->condition_string);
         priv->condition_string = egg_desktop_file_get_string (priv->desktop_file,
                                                               "AutostartCondition",
@@ -516,37 +614,70 @@ load_desktop_file (GsmAutostartApp *app)
 }
 
 static void
-gsm_autostart_app_set_desktop_filename (GsmAutostartApp *app,
-                                        const char      *desktop_filename)
+load_desktop_entry (GsmAutostartApp *app)
 {
         GError *error;
         GsmAutostartAppPrivate *priv;
 
         priv = gsm_autostart_app_get_instance_private (app);
 
-        if (priv->desktop_file != NULL) {
-                egg_desktop_file_free (priv->desktop_file);
-                priv->desktop_file = NULL;
-                g_free (priv->desktop_id);
-        }
-
-        if (desktop_filename == NULL) {
+        if (priv->desktop_filename == NULL) {
                 return;
         }
 
-        priv->desktop_id = g_path_get_basename (desktop_filename);
+        priv->desktop_id = g_path_get_basename (priv->desktop_filename);
 
         error = NULL;
-        priv->desktop_file = egg_desktop_file_new (desktop_filename, &error);
+        if (priv->desktop_key_file != NULL) {
+                /* already parsed by the caller; the desktop file takes
+                 * ownership of the key file */
+                priv->desktop_file = egg_desktop_file_new_from_key_file (priv->desktop_key_file,
+                                                                         priv->desktop_filename,
+                                                                         &error);
+                priv->desktop_key_file = NULL;
+        } else {
+                priv->desktop_file = egg_desktop_file_new (priv->desktop_filename, &error);
+        }
+
         if (priv->desktop_file == NULL) {
                 g_warning ("Could not parse desktop file %s: %s",
-                           desktop_filename,
+                           priv->desktop_filename,
                            error->message);
                 g_error_free (error);
                 return;
         }
 }
 
+static void
+gsm_autostart_app_set_desktop_filename (GsmAutostartApp *app,
+                                        const char      *desktop_filename)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        g_free (priv->desktop_filename);
+        priv->desktop_filename = g_strdup (desktop_filename);
+}
+
+static void
+gsm_autostart_app_set_desktop_key_file (GsmAutostartApp *app,
+                                        GKeyFile        *key_file)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        if (priv->desktop_key_file != NULL) {
+                g_key_file_unref (priv->desktop_key_file);
+                priv->desktop_key_file = NULL;
+        }
+
+        if (key_file != NULL) {
+                priv->desktop_key_file = g_key_file_ref (key_file);
+        }
+}
+
 static void
 gsm_autostart_app_set_property (GObject      *object,
                                 guint         prop_id,
@@ -561,6 +692,9 @@ gsm_autostart_app_set_property (GObject      *object,
         case PROP_DESKTOP_FILENAME:
                 gsm_autostart_app_set_desktop_filename (self, g_value_get_string (value));
                 break;
+        case PROP_DESKTOP_KEY_FILE:
+                gsm_autostart_app_set_desktop_key_file (self, g_value_get_boxed (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
                 break;
@@ -610,10 +744,7 @@ gsm_autostart_app_dispose (GObject *object)
                 priv->condition_string = NULL;
         }
 
-        if (priv->condition_settings) {
-                g_object_unref (priv->condition_settings);
-                priv->condition_settings = NULL;
-        }
+        clear_condition_source (GSM_AUTOSTART_APP (object));
 
         if (priv->desktop_file) {
                 egg_desktop_file_free (priv->desktop_file);
@@ -625,23 +756,40 @@ gsm_autostart_app_dispose (GObject *object)
                 priv->desktop_id = NULL;
         }
 
-        if (priv->child_watch_id > 0) {
-                g_source_remove (priv->child_watch_id);
-                priv->child_watch_id = 0;
+        g_free (priv->cgroup);
+        priv->cgroup = NULL;
+        g_free (priv->spawn_setup.cgroup_procs);
+        priv->spawn_setup.cgroup_procs = NULL;
+
+        if (priv->notify_watch_id > 0) {
+                gsm_notify_socket_remove_watch (priv->notify_watch_id);
+                priv->notify_watch_id = 0;
         }
 
-        if (priv->proxy != NULL) {
-                g_object_unref (priv->proxy);
-                priv->proxy = NULL;
+        if (priv->window_watch_id > 0) {
+                gsm_window_watch_remove (priv->window_watch_id);
+                priv->window_watch_id = 0;
         }
 
-        if (priv->connection != NULL) {
-                g_object_unref (priv->connection);
-                priv->connection = NULL;
+        if (priv->desktop_filename) {
+                g_free (priv->desktop_filename);
+                priv->desktop_filename = NULL;
         }
 
-        if (priv->condition_monitor) {
-                g_file_monitor_cancel (priv->condition_monitor);
+        if (priv->desktop_key_file) {
+                g_key_file_unref (priv->desktop_key_file);
+                priv->desktop_key_file = NULL;
+        }
+
+        if (priv->child_watch_id > 0) {
+                mdm_signal_handler_remove_child_watch (priv->signal_handler,
+                                                       priv->child_watch_id);
+                priv->child_watch_id = 0;
+        }
+
+        if (priv->signal_handler != NULL) {
+                g_object_unref (priv->signal_handler);
+                priv->signal_handler = NULL;
         }
 
         G_OBJECT_CLASS (gsm_autostart_app_parent_class)->dispose (object);
@@ -667,10 +815,6 @@ is_running (GsmApp *app)
 static gboolean
 is_conditionally_disabled (GsmApp *app)
 {
-        gboolean                res;
-        gboolean                disabled;
-        char                   *key;
-        guint                   kind;
         GsmAutostartAppPrivate *priv;
 
         priv = gsm_autostart_app_get_instance_private (GSM_AUTOSTART_APP(app));
@@ -680,49 +824,16 @@ is_conditionally_disabled (GsmApp *app)
                 return FALSE;
         }
 
-        key = NULL;
-        res = parse_condition_string (priv->condition_string, &kind, &key);
-        if (! res) {
-                g_free (key);
-                return TRUE;
-        }
-
-        if (key == NULL) {
+        /* unparsable, or not monitored because the app is disabled */
+        if (priv->condition_source == NULL) {
                 return TRUE;
         }
 
-        if (kind == GSM_CONDITION_IF_EXISTS) {
-                char *file_path;
-
-                file_path = g_build_filename (g_get_user_config_dir (), key, NULL);
-                disabled = !g_file_test (file_path, G_FILE_TEST_EXISTS);
-                g_free (file_path);
-        } else if (kind == GSM_CONDITION_UNLESS_EXISTS) {
-                char *file_path;
-
-                file_path = g_build_filename (g_get_user_config_dir (), key, NULL);
-                disabled = g_file_test (file_path, G_FILE_TEST_EXISTS);
-                g_free (file_path);
-        } else if (kind == GSM_CONDITION_MATE && priv->condition_settings != NULL) {
-                char **elems;
-                elems = g_strsplit (key, " ", 2);
-                disabled = !g_settings_get_boolean (priv->condition_settings, elems[1]);
-                g_strfreev (elems);
-        } else if (kind == GSM_CONDITION_GSETTINGS && priv->condition_settings != NULL) {
-                char **elems;
-                elems = g_strsplit (key, " ", 2);
-                disabled = !g_settings_get_boolean (priv->condition_settings, elems[1]);
-                g_strfreev (elems);
-        } else {
-                disabled = TRUE;
-        }
-
         /* Set initial condition */
-        priv->condition = !disabled;
+        priv->condition = condition_from_source (GSM_AUTOSTART_APP (app),
+                                                 gsm_condition_get_value (priv->condition_source));
 
-        g_free (key);
-
-        return disabled;
+        return !priv->condition;
 }
 
 static void
@@ -746,37 +857,65 @@ app_exited (GPid             pid,
         priv->pid = -1;
         priv->child_watch_id = 0;
 
+        if (priv->notify_watch_id > 0) {
+                gsm_notify_socket_remove_watch (priv->notify_watch_id);
+                priv->notify_watch_id = 0;
+        }
+
+        if (priv->window_watch_id > 0) {
+                gsm_window_watch_remove (priv->window_watch_id);
+                priv->window_watch_id = 0;
+        }
+        priv->notify_active = FALSE;
+
+        if (priv->cgroup != NULL) {
+                /* whatever it forked goes with it when we stop it, but
+                 * apps are free to leave daemons behind on their own */
+                if (priv->stopping) {
+                        gsm_cgroup_kill (priv->cgroup, SIGKILL);
+                }
+                if (priv->cgroup_delegated) {
+                        gsm_cgroup_remove (priv->cgroup);
+                }
+                g_free (priv->cgroup);
+                priv->cgroup = NULL;
+        }
+        priv->stopping = FALSE;
+
+        /* an app reaped behind our back may well have crashed */
         if (WIFEXITED (status)) {
                 gsm_app_exited (GSM_APP (app));
-        } else if (WIFSIGNALED (status)) {
+        } else {
                 gsm_app_died (GSM_APP (app));
         }
 }
 
+/* SIGTERM, then SIGKILL once the app's stop timeout has passed; both
+ * go through the child watch, so they can't hit a recycled pid */
 static int
-_signal_pid (int pid,
-             int signal)
+_terminate_app (GsmAutostartApp *app)
 {
-        int status = -1;
+        GsmAutostartAppPrivate *priv;
+        int                     status;
+
+        priv = gsm_autostart_app_get_instance_private (app);
 
-        /* perhaps block sigchld */
-        g_debug ("GsmAutostartApp: sending signal %d to process %d", signal, pid);
         errno = 0;
-        status = kill (pid, signal);
+        status = mdm_signal_handler_terminate_child (priv->signal_handler,
+                                                     priv->child_watch_id,
+                                                     priv->stop_timeout * 1000);
 
         if (status < 0) {
                 if (errno == ESRCH) {
                         g_warning ("Child process %d was already dead.",
-                                   (int)pid);
+                                   (int)priv->pid);
                 } else {
                         g_warning ("Couldn't kill child process %d: %s",
-                                   pid,
+                                   priv->pid,
                                    g_strerror (errno));
                 }
         }
 
-        /* perhaps unblock sigchld */
-
         return status;
 }
 
@@ -797,7 +936,12 @@ autostart_app_stop_spawn (GsmAutostartApp *app,
                 return FALSE;
         }
 
-        res = _signal_pid (priv->pid, SIGTERM);
+        priv->stopping = TRUE;
+
+        res = _terminate_app (app);
+        if (priv->cgroup != NULL) {
+                gsm_cgroup_kill (priv->cgroup, SIGTERM);
+        }
         if (res != 0) {
                 g_set_error (error,
                              GSM_APP_ERROR,
@@ -845,15 +989,236 @@ gsm_autostart_app_stop (GsmApp  *app,
         return ret;
 }
 
+/* runs in the child, between fork and exec */
+static void
+spawn_child_setup (gpointer data)
+{
+        SpawnSetup *setup = data;
+        int         fd;
+
+        if (setup->cgroup_procs != NULL) {
+                fd = open (setup->cgroup_procs, O_WRONLY | O_CLOEXEC);
+                if (fd >= 0) {
+                        if (write (fd, "0", 1) < 0) {
+                                /* stay in our cgroup */
+                        }
+                        close (fd);
+                }
+        }
+
+        if (setup->set_nice) {
+                setpriority (PRIO_PROCESS, 0, setup->nice);
+        }
+#ifdef HAVE_IOPRIO
+        if (setup->ioprio != 0) {
+                syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, setup->ioprio);
+        }
+#endif
+#ifdef SCHED_BATCH
+        if (setup->batch) {
+                struct sched_param param = { 0 };
+
+                sched_setscheduler (0, SCHED_BATCH, &param);
+        }
+#endif
+}
+
+static void
+setup_spawn_priority (GsmAutostartApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+        SpawnSetup             *setup;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+        setup = &priv->spawn_setup;
+
+        setup->set_nice = priv->has_nice;
+        setup->nice = priv->nice;
+        setup->ioprio = priv->ioprio;
+        setup->batch = FALSE;
+
+        /* an app that asks for a priority of its own keeps it entirely */
+        if (priv->demoted && ! priv->has_nice && priv->ioprio == 0) {
+#ifdef HAVE_IOPRIO
+                setup->ioprio = IOPRIO_VALUE (IOPRIO_CLASS_IDLE, 0);
+#endif
+                setup->batch = TRUE;
+        }
+}
+
+#ifdef __linux__
+static void
+restore_thread_priority (pid_t tid,
+                         int   ioprio)
+{
+        struct sched_param param = { 0 };
+
+        if (sched_getscheduler (tid) == SCHED_BATCH) {
+                sched_setscheduler (tid, SCHED_OTHER, &param);
+        }
+#ifdef HAVE_IOPRIO
+        if (syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid) == IOPRIO_VALUE (IOPRIO_CLASS_IDLE, 0)) {
+                syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, ioprio);
+        }
+#endif
+}
+#endif
+
+/* Undo the demotion on every thread of the app; what it may have
+ * spawned itself in the meantime keeps the demoted priority. */
+static void
+restore_spawn_priority (GsmAutostartApp *app)
+{
+#ifdef __linux__
+        GsmAutostartAppPrivate *priv;
+        char                   *path;
+        DIR                    *dir;
+        struct dirent          *entry;
+        int                     ioprio;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        if (priv->pid <= 0
+            || (! priv->spawn_setup.batch
+                && priv->spawn_setup.ioprio == priv->ioprio)) {
+                return;
+        }
+
+        ioprio = priv->ioprio;
+#ifdef HAVE_IOPRIO
+        if (ioprio == 0) {
+                ioprio = syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+        }
+#endif
+
+        path = g_strdup_printf ("/proc/%d/task", (int) priv->pid);
+        dir = opendir (path);
+        g_free (path);
+
+        if (dir == NULL) {
+                return;
+        }
+
+        while ((entry = readdir (dir)) != NULL) {
+                if (entry->d_name[0] != '.') {
+                        restore_thread_priority (atoi (entry->d_name), ioprio);
+                }
+        }
+
+        closedir (dir);
+
+        g_debug ("GsmAutostartApp: %s (pid:%d) no longer demoted",
+                 priv->desktop_id, (int) priv->pid);
+#endif
+}
+
+void
+gsm_autostart_app_set_demoted (GsmAutostartApp *app,
+                               gboolean         demoted)
+{
+        GsmAutostartAppPrivate *priv;
+
+        g_return_if_fail (GSM_IS_AUTOSTART_APP (app));
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        if (priv->demoted == demoted) {
+                return;
+        }
+
+        priv->demoted = demoted;
+
+        if (! demoted) {
+                restore_spawn_priority (app);
+        }
+}
+
+static char *
+get_cgroup_name (GsmAutostartApp *app)
+{
+        static guint            serial = 0;
+        GsmAutostartAppPrivate *priv;
+        char                   *base;
+        char                   *name;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        base = g_strdup (priv->desktop_id != NULL ? priv->desktop_id : "unknown");
+        if (g_str_has_suffix (base, ".desktop")) {
+                base[strlen (base) - strlen (".desktop")] = '\0';
+        }
+        g_strcanon (base,
+                    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_.:-",
+                    '_');
+
+        name = g_strdup_printf ("app-mate-%s-%d-%u", base, (int) getpid (), ++serial);
+        g_free (base);
+
+        return name;
+}
+
+typedef struct {
+        GsmAutostartApp *app;
+        GPid             pid;
+} ScopeData;
+
+static void
+on_scope_started (const char *path,
+                  ScopeData  *data)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (data->app);
+
+        /* The app may have exited, or even been restarted, meanwhile;
+         * the scope is only ours if it was made for the current pid */
+        if (path != NULL && data->pid == priv->pid && priv->cgroup == NULL) {
+                g_debug ("GsmAutostartApp: %s (pid:%d) runs in %s",
+                         priv->desktop_id, (int) priv->pid, path);
+                priv->cgroup = g_strdup (path);
+        }
+
+        g_object_unref (data->app);
+        g_free (data);
+}
+
+static void
+on_app_ready (GsmAutostartApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        gsm_notify_socket_remove_watch (priv->notify_watch_id);
+        priv->notify_watch_id = 0;
+
+        gsm_app_ready (GSM_APP (app));
+}
+
+static void
+on_app_window_mapped (GsmAutostartApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        gsm_window_watch_remove (priv->window_watch_id);
+        priv->window_watch_id = 0;
+
+        gsm_app_ready (GSM_APP (app));
+}
+
 static gboolean
 autostart_app_start_spawn (GsmAutostartApp *app,
                            GError         **error)
 {
-        char            *env[2] = { NULL, NULL };
+        char            *env[3] = { NULL, NULL, NULL };
+        const char      *notify_socket;
         gboolean         success;
         GError          *local_error;
         const char      *startup_id;
         char            *command;
+        char            *cgroup_name;
         GsmAutostartAppPrivate *priv;
 
         startup_id = gsm_app_peek_startup_id (GSM_APP (app));
@@ -862,6 +1227,17 @@ autostart_app_start_spawn (GsmAutostartApp *app,
 
         env[0] = g_strdup_printf ("DESKTOP_AUTOSTART_ID=%s", startup_id);
 
+        /* without the socket, fall back to waiting for registration */
+        notify_socket = NULL;
+        if (priv->ready_notify) {
+                priv->notify_watch_id = gsm_notify_socket_add_watch ((GsmNotifyReadyFunc)on_app_ready,
+                                                                     app);
+                notify_socket = gsm_notify_socket_peek_path (priv->notify_watch_id);
+        }
+        if (notify_socket != NULL) {
+                env[1] = g_strdup_printf ("NOTIFY_SOCKET=%s", notify_socket);
+        }
+
         local_error = NULL;
         command = egg_desktop_file_parse_exec (priv->desktop_file,
                                                NULL,
@@ -876,6 +1252,18 @@ autostart_app_start_spawn (GsmAutostartApp *app,
         g_debug ("GsmAutostartApp: starting %s: command=%s startup-id=%s", priv->desktop_id, command, startup_id);
         g_free (command);
 
+        setup_spawn_priority (app);
+
+        cgroup_name = get_cgroup_name (app);
+        g_free (priv->cgroup);
+        priv->cgroup = gsm_cgroup_create (cgroup_name, priv->memory_max, priv->cpu_weight);
+        priv->cgroup_delegated = (priv->cgroup != NULL);
+        g_free (priv->spawn_setup.cgroup_procs);
+        priv->spawn_setup.cgroup_procs = NULL;
+        if (priv->cgroup != NULL) {
+                priv->spawn_setup.cgroup_procs = g_build_filename (priv->cgroup, "cgroup.procs", NULL);
+        }
+
         g_free (priv->startup_id);
         local_error = NULL;
         success = egg_desktop_file_launch (priv->desktop_file,
@@ -883,31 +1271,83 @@ autostart_app_start_spawn (GsmAutostartApp *app,
                                            &local_error,
                                            EGG_DESKTOP_FILE_LAUNCH_PUTENV, env,
                                            EGG_DESKTOP_FILE_LAUNCH_FLAGS, G_SPAWN_DO_NOT_REAP_CHILD,
+                                           EGG_DESKTOP_FILE_LAUNCH_SETUP_FUNC, spawn_child_setup, &priv->spawn_setup,
                                            EGG_DESKTOP_FILE_LAUNCH_RETURN_PID, &priv->pid,
                                            EGG_DESKTOP_FILE_LAUNCH_RETURN_STARTUP_ID, &priv->startup_id,
                                            NULL);
         g_free (env[0]);
+        g_free (env[1]);
 
         if (success) {
                 g_debug ("GsmAutostartApp: started pid:%d", priv->pid);
-                priv->child_watch_id = g_child_watch_add (priv->pid,
-                                                          (GChildWatchFunc)app_exited,
-                                                          app);
+                gsm_prefetch_watch_pid (priv->pid, gsm_app_peek_phase (GSM_APP (app)));
+                if (priv->signal_handler == NULL) {
+                        priv->signal_handler = mdm_signal_handler_new ();
+                }
+                priv->child_watch_id = mdm_signal_handler_add_child_watch (priv->signal_handler,
+                                                                           priv->pid,
+                                                                           (GChildWatchFunc)app_exited,
+                                                                           app);
+
+                priv->notify_active = (notify_socket != NULL);
+
+                if (priv->ready_window) {
+                        priv->window_watch_id = gsm_window_watch_add (priv->pid,
+                                                                      (GsmWindowMappedFunc)on_app_window_mapped,
+                                                                      app);
+                }
+
+                if (! priv->cgroup_delegated) {
+                        ScopeData *data;
+
+                        data = g_new0 (ScopeData, 1);
+                        data->app = g_object_ref (app);
+                        data->pid = priv->pid;
+                        gsm_cgroup_start_scope (cgroup_name,
+                                                priv->pid,
+                                                priv->memory_max,
+                                                priv->cpu_weight,
+                                                (GsmCgroupScopeFunc)on_scope_started,
+                                                data);
+                }
         } else {
                 g_set_error (error,
                              GSM_APP_ERROR,
                              GSM_APP_ERROR_START,
                              "Unable to start application: %s", local_error->message);
                 g_error_free (local_error);
+
+                if (priv->notify_watch_id > 0) {
+                        gsm_notify_socket_remove_watch (priv->notify_watch_id);
+                        priv->notify_watch_id = 0;
+                }
+
+                if (priv->cgroup != NULL) {
+                        gsm_cgroup_remove (priv->cgroup);
+                        g_free (priv->cgroup);
+                        priv->cgroup = NULL;
+                }
         }
 
+        g_free (cgroup_name);
+
         return success;
 }
 
+/* D-Bus activated apps all share the session bus connection, which is
+ * fetched asynchronously the first time one is started; the Start
+ * calls are then sent without waiting on one another.  Calling Start
+ * directly on the connection spares the proxy, and with it the
+ * property fetch that would already have activated the service.
+ */
+static GDBusConnection *activation_bus = NULL;
+static GSList          *pending_activations = NULL;
+static gboolean         activation_bus_requested = FALSE;
+
 static void
-start_notify (GObject *source_object,
+start_notify (GObject      *source_object,
               GAsyncResult *res,
-              gpointer data)
+              gpointer      data)
 {
         GsmAutostartApp *app;
         GsmAutostartAppPrivate *priv;
@@ -918,48 +1358,32 @@ start_notify (GObject *source_object,
         priv = gsm_autostart_app_get_instance_private (app);
 
         error = NULL;
-        if (priv->proxy == NULL)
-                return;
-
-        variant = g_dbus_proxy_call_finish (priv->proxy, res, &error);
+        variant = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
         if (variant == NULL) {
                 g_warning ("GsmAutostartApp: Error starting application: %s", error->message);
                 g_error_free (error);
-                return;
         } else {
-                g_debug ("GsmAutostartApp: Started application %s", priv->desktop_id);
+                priv->activation_latency = g_get_monotonic_time () - priv->activation_start;
+                mdm_log_debug_for ("GsmAutostartApp", NULL, gsm_app_peek_id (GSM_APP (app)),
+                                   "Started application %s in %" G_GINT64_FORMAT " ms",
+                                   priv->desktop_id,
+                                   priv->activation_latency / 1000);
                 g_variant_unref (variant);
         }
 
-        g_object_unref (priv->proxy);
-        priv->proxy = NULL;
-
-        g_object_unref (priv->connection);
-        priv->connection = NULL;
+        g_object_unref (app);
 }
 
-static gboolean
-autostart_app_start_activate (GsmAutostartApp  *app,
-                              GError          **error)
+static void
+send_start_call (GsmAutostartApp *app)
 {
         const char      *name;
         char            *path;
         char            *arguments;
-        GError          *local_error;
         GsmAutostartAppPrivate *priv;
 
         priv = gsm_autostart_app_get_instance_private (app);
 
-        local_error = NULL;
-        priv->connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &local_error);
-        if (priv->connection == NULL) {
-                if (local_error != NULL) {
-                        g_warning ("error getting session bus: %s", local_error->message);
-                }
-                g_propagate_error (error, local_error);
-                return FALSE;
-        }
-
         name = gsm_app_peek_startup_id (GSM_APP (app));
         g_assert (name != NULL);
 
@@ -975,32 +1399,103 @@ autostart_app_start_activate (GsmAutostartApp  *app,
                                                  GSM_AUTOSTART_APP_DBUS_ARGS_KEY,
                                                  NULL);
 
-        local_error = NULL;
-        priv->proxy = g_dbus_proxy_new_sync (priv->connection,
-                                             G_DBUS_PROXY_FLAGS_NONE,
-                                             NULL,
-                                             name,
-                                             path,
-                                             GSM_SESSION_CLIENT_DBUS_INTERFACE,
-                                             NULL,
-                                             &local_error);
-        if (priv->proxy == NULL) {
-                g_propagate_error (error, local_error);
-                return FALSE;
+        g_dbus_connection_call (activation_bus,
+                                name,
+                                path,
+                                GSM_SESSION_CLIENT_DBUS_INTERFACE,
+                                "Start",
+                                g_variant_new ("(s)", arguments != NULL ? arguments : ""),
+                                NULL,
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                NULL,
+                                start_notify,
+                                g_object_ref (app));
+
+        g_free (path);
+        g_free (arguments);
+}
+
+static void
+on_activation_bus_ready (GObject      *source_object,
+                         GAsyncResult *res,
+                         gpointer      data)
+{
+        GError *error;
+        GSList *apps;
+        GSList *l;
+
+        activation_bus_requested = FALSE;
+
+        apps = g_slist_reverse (pending_activations);
+        pending_activations = NULL;
+
+        error = NULL;
+        activation_bus = g_bus_get_finish (res, &error);
+        if (activation_bus == NULL) {
+                g_warning ("error getting session bus: %s", error->message);
+                g_error_free (error);
         }
 
-        g_dbus_proxy_call (priv->proxy,
-                           "Start",
-                           g_variant_new ("(s)", arguments),
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
+        /* The start already "succeeded", so a failure has to be
+         * reported the way an app that went away is */
+        for (l = apps; l != NULL; l = l->next) {
+                if (activation_bus != NULL) {
+                        send_start_call (l->data);
+                } else {
+                        gsm_app_exited (GSM_APP (l->data));
+                }
+                g_object_unref (l->data);
+        }
+        g_slist_free (apps);
+}
+
+static gboolean
+autostart_app_start_activate (GsmAutostartApp  *app,
+                              GError          **error)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (app);
+        priv->activation_start = g_get_monotonic_time ();
+
+        if (activation_bus != NULL) {
+                send_start_call (app);
+                return TRUE;
+        }
+
+        pending_activations = g_slist_prepend (pending_activations, g_object_ref (app));
+
+        if (! activation_bus_requested) {
+                activation_bus_requested = TRUE;
+                g_bus_get (G_BUS_TYPE_SESSION,
                            NULL,
-                           (GAsyncReadyCallback) start_notify,
-                           app);
+                           on_activation_bus_ready,
+                           NULL);
+        }
 
         return TRUE;
 }
 
+/**
+ * gsm_autostart_app_get_activation_latency:
+ * @app: a #GsmAutostartApp
+ *
+ * Return value: how long the last D-Bus activation of @app took to be
+ * answered, in milliseconds, or 0 if it never was
+ **/
+guint
+gsm_autostart_app_get_activation_latency (GsmAutostartApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+
+        g_return_val_if_fail (GSM_IS_AUTOSTART_APP (app), 0);
+
+        priv = gsm_autostart_app_get_instance_private (app);
+
+        return MIN (priv->activation_latency / 1000, G_MAXUINT);
+}
+
 static gboolean
 gsm_autostart_app_start (GsmApp  *app,
                          GError **error)
@@ -1053,6 +1548,36 @@ gsm_autostart_app_restart (GsmApp  *app,
         return TRUE;
 }
 
+static gboolean
+gsm_autostart_app_notifies_ready (GsmApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (GSM_AUTOSTART_APP (app));
+
+        return priv->notify_active;
+}
+
+static int
+gsm_autostart_app_peek_launch_priority (GsmApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (GSM_AUTOSTART_APP (app));
+
+        return priv->launch_priority;
+}
+
+static const char *
+gsm_autostart_app_peek_cgroup (GsmApp *app)
+{
+        GsmAutostartAppPrivate *priv;
+
+        priv = gsm_autostart_app_get_instance_private (GSM_AUTOSTART_APP (app));
+
+        return priv->cgroup;
+}
+
 static gboolean
 gsm_autostart_app_provides (GsmApp     *app,
                             const char *service)
@@ -1187,6 +1712,8 @@ gsm_autostart_app_constructor (GType                  type,
                                                                                                n_construct_properties,
                                                                                                construct_properties));
 
+        load_desktop_entry (app);
+
         if (! load_desktop_file (app)) {
                 g_object_unref (app);
                 app = NULL;
@@ -1216,7 +1743,10 @@ gsm_autostart_app_class_init (GsmAutostartAppClass *klass)
         app_class->impl_has_autostart_condition = gsm_autostart_app_has_autostart_condition;
         app_class->impl_get_app_id = gsm_autostart_app_get_app_id;
         app_class->impl_get_autorestart = gsm_autostart_app_get_autorestart;
+        app_class->impl_peek_cgroup = gsm_autostart_app_peek_cgroup;
+        app_class->impl_notifies_ready = gsm_autostart_app_notifies_ready;
         app_class->impl_peek_autostart_delay = gsm_autostart_app_peek_autostart_delay;
+        app_class->impl_peek_launch_priority = gsm_autostart_app_peek_launch_priority;
 
         g_object_class_install_property (object_class,
                                          PROP_DESKTOP_FILENAME,
@@ -1224,7 +1754,14 @@ gsm_autostart_app_class_init (GsmAutostartAppClass *klass)
                                                               "Desktop filename",
                                                               "Freedesktop .desktop file",
                                                               NULL,
-                                                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+                                                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        g_object_class_install_property (object_class,
+                                         PROP_DESKTOP_KEY_FILE,
+                                         g_param_spec_boxed ("desktop-key-file",
+                                                             "Desktop key file",
+                                                             "Already parsed contents of the .desktop file",
+                                                             G_TYPE_KEY_FILE,
+                                                             G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
         signals[CONDITION_CHANGED] =
                 g_signal_new ("condition-changed",
                               G_OBJECT_CLASS_TYPE (object_class),
@@ -1248,3 +1785,17 @@ gsm_autostart_app_new (const char *desktop_file)
 
         return GSM_APP (app);
 }
+
+GsmApp *
+gsm_autostart_app_new_from_key_file (const char *desktop_file,
+                                     GKeyFile   *key_file)
+{
+        GsmAutostartApp *app;
+
+        app = g_object_new (GSM_TYPE_AUTOSTART_APP,
+                            "desktop-filename", desktop_file,
+                            "desktop-key-file", key_file,
+                            NULL);
+
+        return GSM_APP (app);
+}
@@ -41,6 +41,12 @@ struct _GsmAutostartAppClass
 };
 
 GsmApp *gsm_autostart_app_new                (const char *desktop_file);
+GsmApp *gsm_autostart_app_new_from_key_file  (const char *desktop_file,
+                                              GKeyFile   *key_file);
+
+void    gsm_autostart_app_set_demoted        (GsmAutostartApp *app,
+                                              gboolean         demoted);
+guint   gsm_autostart_app_get_activation_latency (GsmAutostartApp *app);
 
 #define GSM_AUTOSTART_APP_ENABLED_KEY     "X-MATE-Autostart-enabled"
 #define GSM_AUTOSTART_APP_PHASE_KEY       "X-MATE-Autostart-Phase"
@@ -52,6 +58,13 @@ GsmApp *gsm_autostart_app_new                (const char *desktop_file);
 #define GSM_AUTOSTART_APP_DBUS_ARGS_KEY   "X-MATE-DBus-Start-Arguments"
 #define GSM_AUTOSTART_APP_DISCARD_KEY     "X-MATE-Autostart-discard-exec"
 #define GSM_AUTOSTART_APP_DELAY_KEY       "X-MATE-Autostart-Delay"
+#define GSM_AUTOSTART_APP_STOP_TIMEOUT_KEY "X-MATE-Autostart-StopTimeout"
+#define GSM_AUTOSTART_APP_NICE_KEY        "X-MATE-Autostart-Nice"
+#define GSM_AUTOSTART_APP_IO_CLASS_KEY    "X-MATE-Autostart-IOClass"
+#define GSM_AUTOSTART_APP_MEMORY_MAX_KEY  "X-MATE-Autostart-MemoryMax"
+#define GSM_AUTOSTART_APP_CPU_WEIGHT_KEY  "X-MATE-Autostart-CPUWeight"
+#define GSM_AUTOSTART_APP_READY_KEY       "X-MATE-Autostart-Ready"
+#define GSM_AUTOSTART_APP_PRIORITY_KEY    "X-MATE-Autostart-Priority"
 
 G_END_DECLS
 
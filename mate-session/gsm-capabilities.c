@@ -0,0 +1,720 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#ifdef HAVE_SYSTEMD
+#include <systemd/sd-login.h>
+#include "gsm-systemd.h"
+#endif
+#include "mdm.h"
+
+#include "gsm-capabilities.h"
+
+#define SD_NAME              "org.freedesktop.login1"
+#define SD_PATH              "/org/freedesktop/login1"
+#define SD_INTERFACE         "org.freedesktop.login1.Manager"
+
+#define CK_NAME              "org.freedesktop.ConsoleKit"
+#define CK_MANAGER_PATH      "/org/freedesktop/ConsoleKit/Manager"
+#define CK_MANAGER_INTERFACE "org.freedesktop.ConsoleKit.Manager"
+#define CK_SEAT_INTERFACE    "org.freedesktop.ConsoleKit.Seat"
+#define CK_SESSION_INTERFACE "org.freedesktop.ConsoleKit.Session"
+
+#define DBUS_PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+
+/* The logout dialog wants to know which of suspend, hibernate, user
+ * switching, reboot and shutdown it can offer.  Instead of asking
+ * logind (or ConsoleKit) one blocking question after another when the
+ * dialog is built, all the questions are sent at once when the session
+ * starts, and again whenever logind tells us something may have
+ * changed.  The dialog then only reads the cached answers.
+ */
+
+struct _GsmCapabilities
+{
+        GObject          parent;
+
+        gboolean         use_logind;
+        GDBusConnection *connection;
+        GCancellable    *cancellable;
+
+        guint            name_watch_id;
+        guint            sleep_signal_id;
+        guint            shutdown_signal_id;
+        guint            properties_signal_id;
+
+        gboolean         known [GSM_CAPABILITY_LAST];
+        gboolean         value [GSM_CAPABILITY_LAST];
+
+        gboolean         mdm_known;
+        MdmLogoutAction  mdm_actions;
+};
+
+typedef struct {
+        GsmCapability  capability;
+        const char    *logind_method;
+        const char    *ck_method;
+} CapabilityQuery;
+
+static const CapabilityQuery queries[] = {
+        { GSM_CAPABILITY_SUSPEND,   "CanSuspend",   "CanSuspend" },
+        { GSM_CAPABILITY_HIBERNATE, "CanHibernate", "CanHibernate" },
+        { GSM_CAPABILITY_REBOOT,    "CanReboot",    "CanRestart" },
+        { GSM_CAPABILITY_SHUTDOWN,  "CanPowerOff",  "CanStop" }
+};
+
+static const char *capability_names[GSM_CAPABILITY_LAST] = {
+        "suspend",
+        "hibernate",
+        "switch-user",
+        "reboot",
+        "shutdown"
+};
+
+typedef struct {
+        GsmCapabilities *capabilities;
+        GsmCapability    capability;
+        GCancellable    *cancellable;
+} QueryData;
+
+G_DEFINE_TYPE (GsmCapabilities, gsm_capabilities, G_TYPE_OBJECT)
+
+static QueryData *
+query_data_new (GsmCapabilities *capabilities,
+                GsmCapability    capability)
+{
+        QueryData *data;
+
+        data = g_new0 (QueryData, 1);
+        data->capabilities = g_object_ref (capabilities);
+        data->capability = capability;
+        data->cancellable = g_object_ref (capabilities->cancellable);
+
+        return data;
+}
+
+static void
+query_data_free (QueryData *data)
+{
+        g_object_unref (data->cancellable);
+        g_object_unref (data->capabilities);
+        g_free (data);
+}
+
+static void
+set_answer (GsmCapabilities *capabilities,
+            GsmCapability    capability,
+            gboolean         value)
+{
+        g_debug ("GsmCapabilities: %s is %savailable",
+                 capability_names[capability], value ? "" : "not ");
+
+        capabilities->known[capability] = TRUE;
+        capabilities->value[capability] = value;
+}
+
+static void
+forget_answers (GsmCapabilities *capabilities)
+{
+        int i;
+
+        for (i = 0; i < GSM_CAPABILITY_LAST; i++) {
+                capabilities->known[i] = FALSE;
+                capabilities->value[i] = FALSE;
+        }
+}
+
+/* logind answers "yes", "no", "challenge" or "na"; older ConsoleKit
+ * versions answer with a boolean for some of the questions */
+static gboolean
+answer_from_reply (GVariant *reply)
+{
+        GVariant *child;
+        gboolean  ret;
+
+        ret = FALSE;
+        child = g_variant_get_child_value (reply, 0);
+
+        if (g_variant_is_of_type (child, G_VARIANT_TYPE_BOOLEAN)) {
+                ret = g_variant_get_boolean (child);
+        } else if (g_variant_is_of_type (child, G_VARIANT_TYPE_STRING)) {
+                const char *answer;
+
+                answer = g_variant_get_string (child, NULL);
+                ret = g_strcmp0 (answer, "yes") == 0 ||
+                      g_strcmp0 (answer, "challenge") == 0;
+        }
+
+        g_variant_unref (child);
+
+        return ret;
+}
+
+static void
+query_failed (QueryData *data,
+              GError    *error)
+{
+        /* A cancelled query was superseded by a newer refresh */
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                g_warning ("Could not query %s capability: %s",
+                           capability_names[data->capability],
+                           error->message);
+                set_answer (data->capabilities, data->capability, FALSE);
+        }
+
+        g_error_free (error);
+}
+
+static void
+on_query_finished (GObject      *source,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+        QueryData *data = user_data;
+        GVariant  *reply;
+        GError    *error;
+
+        error = NULL;
+        reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source),
+                                               result,
+                                               &error);
+        if (reply == NULL) {
+                query_failed (data, error);
+        } else {
+                set_answer (data->capabilities,
+                            data->capability,
+                            answer_from_reply (reply));
+                g_variant_unref (reply);
+        }
+
+        query_data_free (data);
+}
+
+static void
+start_query (GsmCapabilities       *capabilities,
+             const CapabilityQuery *query)
+{
+        QueryData *data;
+
+        data = query_data_new (capabilities, query->capability);
+
+        if (capabilities->use_logind) {
+                g_dbus_connection_call (capabilities->connection,
+                                        SD_NAME,
+                                        SD_PATH,
+                                        SD_INTERFACE,
+                                        query->logind_method,
+                                        NULL,
+                                        NULL,
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1,
+                                        data->cancellable,
+                                        on_query_finished,
+                                        data);
+        } else {
+                g_dbus_connection_call (capabilities->connection,
+                                        CK_NAME,
+                                        CK_MANAGER_PATH,
+                                        CK_MANAGER_INTERFACE,
+                                        query->ck_method,
+                                        NULL,
+                                        NULL,
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1,
+                                        data->cancellable,
+                                        on_query_finished,
+                                        data);
+        }
+}
+
+#ifdef HAVE_SYSTEMD
+static gboolean
+logind_can_switch_user (void)
+{
+        char *session_id = NULL;
+        char *seat_id = NULL;
+        int   ret;
+
+        /* libsystemd only looks at /run, there is no bus round-trip */
+        sd_pid_get_session (getpid (), &session_id);
+        if (session_id == NULL) {
+                return FALSE;
+        }
+
+        sd_session_get_seat (session_id, &seat_id);
+        ret = sd_seat_can_multi_session (seat_id);
+
+        g_free (session_id);
+        g_free (seat_id);
+
+        return ret > 0;
+}
+#endif
+
+static void
+on_ck_seat_id (GObject      *source,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+        QueryData  *data = user_data;
+        GVariant   *reply;
+        GError     *error;
+        const char *seat_id;
+
+        error = NULL;
+        reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source),
+                                               result,
+                                               &error);
+        if (reply == NULL) {
+                query_failed (data, error);
+                query_data_free (data);
+                return;
+        }
+
+        g_variant_get (reply, "(&o)", &seat_id);
+        if (seat_id[0] == '\0') {
+                g_debug ("GsmCapabilities: seat id is not set; can't switch sessions");
+                set_answer (data->capabilities, data->capability, FALSE);
+                g_variant_unref (reply);
+                query_data_free (data);
+                return;
+        }
+
+        g_dbus_connection_call (G_DBUS_CONNECTION (source),
+                                CK_NAME,
+                                seat_id,
+                                CK_SEAT_INTERFACE,
+                                "CanActivateSessions",
+                                NULL,
+                                G_VARIANT_TYPE ("(b)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                data->cancellable,
+                                on_query_finished,
+                                data);
+        g_variant_unref (reply);
+}
+
+static void
+on_ck_current_session (GObject      *source,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+        QueryData  *data = user_data;
+        GVariant   *reply;
+        GError     *error;
+        const char *session_id;
+
+        error = NULL;
+        reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source),
+                                               result,
+                                               &error);
+        if (reply == NULL) {
+                query_failed (data, error);
+                query_data_free (data);
+                return;
+        }
+
+        g_variant_get (reply, "(&o)", &session_id);
+        g_dbus_connection_call (G_DBUS_CONNECTION (source),
+                                CK_NAME,
+                                session_id,
+                                CK_SESSION_INTERFACE,
+                                "GetSeatId",
+                                NULL,
+                                G_VARIANT_TYPE ("(o)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                data->cancellable,
+                                on_ck_seat_id,
+                                data);
+        g_variant_unref (reply);
+}
+
+static void
+start_switch_user_query (GsmCapabilities *capabilities)
+{
+#ifdef HAVE_SYSTEMD
+        if (capabilities->use_logind) {
+                set_answer (capabilities,
+                            GSM_CAPABILITY_SWITCH_USER,
+                            logind_can_switch_user ());
+                return;
+        }
+#endif
+
+        g_dbus_connection_call (capabilities->connection,
+                                CK_NAME,
+                                CK_MANAGER_PATH,
+                                CK_MANAGER_INTERFACE,
+                                "GetCurrentSession",
+                                NULL,
+                                G_VARIANT_TYPE ("(o)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                capabilities->cancellable,
+                                on_ck_current_session,
+                                query_data_new (capabilities,
+                                                GSM_CAPABILITY_SWITCH_USER));
+}
+
+static void
+cancel_queries (GsmCapabilities *capabilities)
+{
+        if (capabilities->cancellable != NULL) {
+                g_cancellable_cancel (capabilities->cancellable);
+                g_object_unref (capabilities->cancellable);
+                capabilities->cancellable = NULL;
+        }
+}
+
+static void
+on_mdm_actions (MdmLogoutAction available_actions,
+                gpointer        user_data)
+{
+        GsmCapabilities *capabilities = user_data;
+
+        g_debug ("GsmCapabilities: MDM logout actions: %x", available_actions);
+
+        capabilities->mdm_known = TRUE;
+        capabilities->mdm_actions = available_actions;
+}
+
+static void
+query_mdm_actions (GsmCapabilities *capabilities)
+{
+        mdm_query_logout_actions (on_mdm_actions, capabilities);
+}
+
+void
+gsm_capabilities_refresh (GsmCapabilities *capabilities)
+{
+        guint i;
+
+        g_return_if_fail (GSM_IS_CAPABILITIES (capabilities));
+
+        /* Not connected yet; we get back here once the name shows up */
+        if (capabilities->connection == NULL) {
+                return;
+        }
+
+        g_debug ("GsmCapabilities: refreshing power capabilities");
+
+        /* Keep serving the old answers until the new ones arrive */
+        cancel_queries (capabilities);
+        capabilities->cancellable = g_cancellable_new ();
+
+        for (i = 0; i < G_N_ELEMENTS (queries); i++) {
+                start_query (capabilities, &queries[i]);
+        }
+        start_switch_user_query (capabilities);
+
+        query_mdm_actions (capabilities);
+}
+
+gboolean
+gsm_capabilities_get (GsmCapabilities *capabilities,
+                      GsmCapability    capability)
+{
+        MdmLogoutAction mdm_action;
+
+        g_return_val_if_fail (GSM_IS_CAPABILITIES (capabilities), FALSE);
+        g_return_val_if_fail (capability < GSM_CAPABILITY_LAST, FALSE);
+
+        /* Never block on the bus here; until the answer arrives the
+         * action is simply not offered */
+        if (!capabilities->known[capability]) {
+                g_debug ("GsmCapabilities: no answer for %s yet, assuming no",
+                         capability_names[capability]);
+        }
+
+        if (capabilities->value[capability]) {
+                return TRUE;
+        }
+
+        /* MDM can still reboot or shut down for us */
+        switch (capability) {
+        case GSM_CAPABILITY_REBOOT:
+                mdm_action = MDM_LOGOUT_ACTION_REBOOT;
+                break;
+        case GSM_CAPABILITY_SHUTDOWN:
+                mdm_action = MDM_LOGOUT_ACTION_SHUTDOWN;
+                break;
+        default:
+                return FALSE;
+        }
+
+        if (!capabilities->mdm_known) {
+                g_debug ("GsmCapabilities: MDM has not answered yet, assuming no");
+                return FALSE;
+        }
+
+        return (capabilities->mdm_actions & mdm_action) != 0;
+}
+
+/* logind properties that change what the Can* methods answer; others,
+ * such as IdleHint, change all the time */
+static const char *logind_capability_properties[] = {
+        "BlockInhibited",
+        "DelayInhibited",
+        "PreparingForShutdown",
+        "PreparingForSleep",
+        "ScheduledShutdown",
+        "SleepOperation",
+        NULL
+};
+
+static gboolean
+is_capability_property (const char *property)
+{
+        return g_strv_contains (logind_capability_properties, property);
+}
+
+static gboolean
+properties_affect_answers (GVariant *parameters)
+{
+        GVariantIter *changed;
+        GVariantIter *invalidated;
+        const char   *property;
+        gboolean      affected;
+
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)"))) {
+                return FALSE;
+        }
+
+        affected = FALSE;
+        g_variant_get (parameters, "(&sa{sv}as)", NULL, &changed, &invalidated);
+
+        while (!affected && g_variant_iter_next (changed, "{&sv}", &property, NULL)) {
+                affected = is_capability_property (property);
+        }
+        while (!affected && g_variant_iter_next (invalidated, "&s", &property)) {
+                affected = is_capability_property (property);
+        }
+
+        g_variant_iter_free (changed);
+        g_variant_iter_free (invalidated);
+
+        return affected;
+}
+
+static void
+on_logind_signal (GDBusConnection *connection,
+                  const char      *sender_name,
+                  const char      *object_path,
+                  const char      *interface_name,
+                  const char      *signal_name,
+                  GVariant        *parameters,
+                  gpointer         user_data)
+{
+        GsmCapabilities *capabilities = user_data;
+        gboolean         active;
+
+        if (g_strcmp0 (signal_name, "PropertiesChanged") == 0) {
+                if (properties_affect_answers (parameters)) {
+                        gsm_capabilities_refresh (capabilities);
+                }
+                return;
+        }
+
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)"))) {
+                return;
+        }
+
+        /* PrepareForSleep and PrepareForShutdown are sent with TRUE on
+         * the way down and with FALSE once resumed or cancelled */
+        g_variant_get (parameters, "(b)", &active);
+        if (!active) {
+                gsm_capabilities_refresh (capabilities);
+        }
+}
+
+static void
+on_name_appeared (GDBusConnection *connection,
+                  const char      *name,
+                  const char      *name_owner,
+                  gpointer         user_data)
+{
+        GsmCapabilities *capabilities = user_data;
+
+        g_debug ("GsmCapabilities: %s appeared", name);
+        gsm_capabilities_refresh (capabilities);
+}
+
+static void
+on_name_vanished (GDBusConnection *connection,
+                  const char      *name,
+                  gpointer         user_data)
+{
+        GsmCapabilities *capabilities = user_data;
+
+        g_debug ("GsmCapabilities: %s vanished", name);
+
+        /* Ask again, the slow way, if someone needs an answer before
+         * the service comes back */
+        cancel_queries (capabilities);
+        forget_answers (capabilities);
+}
+
+static void
+subscribe_logind_signals (GsmCapabilities *capabilities)
+{
+        capabilities->sleep_signal_id =
+                g_dbus_connection_signal_subscribe (capabilities->connection,
+                                                    SD_NAME,
+                                                    SD_INTERFACE,
+                                                    "PrepareForSleep",
+                                                    SD_PATH,
+                                                    NULL,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    on_logind_signal,
+                                                    capabilities,
+                                                    NULL);
+        capabilities->shutdown_signal_id =
+                g_dbus_connection_signal_subscribe (capabilities->connection,
+                                                    SD_NAME,
+                                                    SD_INTERFACE,
+                                                    "PrepareForShutdown",
+                                                    SD_PATH,
+                                                    NULL,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    on_logind_signal,
+                                                    capabilities,
+                                                    NULL);
+        capabilities->properties_signal_id =
+                g_dbus_connection_signal_subscribe (capabilities->connection,
+                                                    SD_NAME,
+                                                    DBUS_PROPERTIES_INTERFACE,
+                                                    "PropertiesChanged",
+                                                    SD_PATH,
+                                                    SD_INTERFACE,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    on_logind_signal,
+                                                    capabilities,
+                                                    NULL);
+}
+
+static void
+on_bus_ready (GObject      *source,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+        GsmCapabilities *capabilities = user_data;
+        GError          *error;
+
+        error = NULL;
+        capabilities->connection = g_bus_get_finish (result, &error);
+        if (capabilities->connection == NULL) {
+                g_warning ("Could not connect to the system bus: %s",
+                           error->message);
+                g_error_free (error);
+                g_object_unref (capabilities);
+                return;
+        }
+
+        if (capabilities->use_logind) {
+                subscribe_logind_signals (capabilities);
+        }
+
+        /* The first refresh happens when the watch reports the name */
+        capabilities->name_watch_id =
+                g_bus_watch_name_on_connection (capabilities->connection,
+                                                capabilities->use_logind ? SD_NAME : CK_NAME,
+                                                G_BUS_NAME_WATCHER_FLAGS_AUTO_START,
+                                                on_name_appeared,
+                                                on_name_vanished,
+                                                capabilities,
+                                                NULL);
+
+        g_object_unref (capabilities);
+}
+
+static void
+gsm_capabilities_finalize (GObject *object)
+{
+        GsmCapabilities *capabilities;
+
+        capabilities = GSM_CAPABILITIES (object);
+
+        cancel_queries (capabilities);
+
+        if (capabilities->name_watch_id != 0) {
+                g_bus_unwatch_name (capabilities->name_watch_id);
+        }
+
+        if (capabilities->connection != NULL) {
+                if (capabilities->sleep_signal_id != 0) {
+                        g_dbus_connection_signal_unsubscribe (capabilities->connection,
+                                                              capabilities->sleep_signal_id);
+                }
+                if (capabilities->shutdown_signal_id != 0) {
+                        g_dbus_connection_signal_unsubscribe (capabilities->connection,
+                                                              capabilities->shutdown_signal_id);
+                }
+                if (capabilities->properties_signal_id != 0) {
+                        g_dbus_connection_signal_unsubscribe (capabilities->connection,
+                                                              capabilities->properties_signal_id);
+                }
+                g_object_unref (capabilities->connection);
+        }
+
+        G_OBJECT_CLASS (gsm_capabilities_parent_class)->finalize (object);
+}
+
+static void
+gsm_capabilities_class_init (GsmCapabilitiesClass *klass)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = gsm_capabilities_finalize;
+}
+
+static void
+gsm_capabilities_init (GsmCapabilities *capabilities)
+{
+#ifdef HAVE_SYSTEMD
+        capabilities->use_logind = LOGIND_RUNNING ();
+#endif
+
+        /* MDM is asked right away, independently of the system bus */
+        query_mdm_actions (capabilities);
+
+        g_bus_get (G_BUS_TYPE_SYSTEM,
+                   NULL,
+                   on_bus_ready,
+                   g_object_ref (capabilities));
+}
+
+GsmCapabilities *
+gsm_get_capabilities (void)
+{
+        static GsmCapabilities *capabilities = NULL;
+
+        if (capabilities == NULL) {
+                capabilities = g_object_new (GSM_TYPE_CAPABILITIES, NULL);
+        }
+
+        return g_object_ref (capabilities);
+}
@@ -0,0 +1,46 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __GSM_CAPABILITIES_H__
+#define __GSM_CAPABILITIES_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GSM_TYPE_CAPABILITIES         (gsm_capabilities_get_type ())
+G_DECLARE_FINAL_TYPE (GsmCapabilities, gsm_capabilities, GSM, CAPABILITIES, GObject)
+
+typedef enum {
+        GSM_CAPABILITY_SUSPEND = 0,
+        GSM_CAPABILITY_HIBERNATE,
+        GSM_CAPABILITY_SWITCH_USER,
+        GSM_CAPABILITY_REBOOT,
+        GSM_CAPABILITY_SHUTDOWN,
+        GSM_CAPABILITY_LAST
+} GsmCapability;
+
+GsmCapabilities * gsm_get_capabilities       (void);
+
+gboolean          gsm_capabilities_get       (GsmCapabilities *capabilities,
+                                              GsmCapability    capability);
+void              gsm_capabilities_refresh   (GsmCapabilities *capabilities);
+
+G_END_DECLS
+
+#endif /* __GSM_CAPABILITIES_H__ */
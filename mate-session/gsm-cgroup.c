@@ -0,0 +1,522 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "gsm-cgroup.h"
+
+/* Every spawned app gets a cgroup (v2) of its own, for accounting, for
+ * limits and to be able to stop it together with whatever it forked.
+ *
+ * If the cgroup we run in was delegated to us (we are a systemd user
+ * service with Delegate=yes, or MATE_SESSION_CGROUP_ROOT points to a
+ * delegated or fake tree), we move our own processes into a leaf and
+ * create the app cgroups next to it, and the child joins its cgroup
+ * before it execs.  Otherwise the systemd user manager is asked for a
+ * transient scope holding the app once it is spawned.
+ * MATE_SESSION_SYSTEMD_NAME can point that request at a stand-in for
+ * systemd on the session bus.
+ */
+
+#define CGROUP_MOUNT          "/sys/fs/cgroup"
+#define CGROUP_LEAF           "session-manager"
+
+#define SYSTEMD_NAME          "org.freedesktop.systemd1"
+#define SYSTEMD_PATH          "/org/freedesktop/systemd1"
+#define SYSTEMD_INTERFACE     "org.freedesktop.systemd1.Manager"
+
+/* how long to wait for systemd to actually move the app */
+#define SCOPE_POLL_INTERVAL   100 /* milliseconds */
+#define SCOPE_POLL_TRIES      20
+
+typedef struct {
+        char               *unit;
+        GPid                pid;
+        GsmCgroupScopeFunc  func;
+        gpointer            user_data;
+        guint               tries;
+} ScopeData;
+
+static gboolean  initialized = FALSE;
+static char     *delegated_root = NULL;
+
+static gboolean
+write_file (const char *path,
+            const char *value)
+{
+        int      fd;
+        gssize   len;
+        gboolean ret;
+
+        fd = open (path, O_WRONLY | O_CLOEXEC | O_CREAT, 0644);
+        if (fd < 0) {
+                return FALSE;
+        }
+
+        len = strlen (value);
+        ret = (write (fd, value, len) == len);
+        close (fd);
+
+        return ret;
+}
+
+static gboolean
+write_cgroup_file (const char *dir,
+                   const char *file,
+                   const char *value)
+{
+        char     *path;
+        gboolean  ret;
+
+        path = g_build_filename (dir, file, NULL);
+        ret = write_file (path, value);
+        if (! ret) {
+                g_debug ("GsmCgroup: unable to write '%s' to %s: %s",
+                         value, path, g_strerror (errno));
+        }
+        g_free (path);
+
+        return ret;
+}
+
+/* our cgroup, from the "0::/path" line of /proc/<pid>/cgroup */
+static char *
+get_cgroup_of_pid (GPid pid)
+{
+        char  *path;
+        char  *contents;
+        char **lines;
+        char  *ret;
+        int    i;
+
+        if (pid > 0) {
+                path = g_strdup_printf ("/proc/%d/cgroup", (int) pid);
+        } else {
+                path = g_strdup ("/proc/self/cgroup");
+        }
+
+        ret = NULL;
+        if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+                g_free (path);
+                return NULL;
+        }
+        g_free (path);
+
+        lines = g_strsplit (contents, "\n", -1);
+        for (i = 0; lines[i] != NULL; i++) {
+                if (g_str_has_prefix (lines[i], "0::/")) {
+                        ret = g_build_filename (CGROUP_MOUNT, lines[i] + 3, NULL);
+                        break;
+                }
+        }
+
+        g_strfreev (lines);
+        g_free (contents);
+
+        return ret;
+}
+
+static void
+move_processes (const char *from,
+                const char *to)
+{
+        char  *path;
+        char  *contents;
+        char **pids;
+        int    i;
+
+        path = g_build_filename (from, "cgroup.procs", NULL);
+        if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+                g_free (path);
+                return;
+        }
+        g_free (path);
+
+        pids = g_strsplit (contents, "\n", -1);
+        for (i = 0; pids[i] != NULL; i++) {
+                if (pids[i][0] != '\0') {
+                        write_cgroup_file (to, "cgroup.procs", pids[i]);
+                }
+        }
+
+        g_strfreev (pids);
+        g_free (contents);
+}
+
+static void
+init_delegation (void)
+{
+        const char *root;
+        char       *own;
+        char       *path;
+        char       *leaf;
+        gboolean    writable;
+
+        initialized = TRUE;
+
+        root = g_getenv ("MATE_SESSION_CGROUP_ROOT");
+        if (root != NULL && root[0] != '\0') {
+                delegated_root = g_strdup (root);
+                return;
+        }
+
+        own = get_cgroup_of_pid (0);
+        if (own == NULL) {
+                return;
+        }
+
+        path = g_build_filename (own, "cgroup.subtree_control", NULL);
+        writable = (access (path, W_OK) == 0);
+        g_free (path);
+
+        if (! writable) {
+                g_debug ("GsmCgroup: %s is not delegated to us", own);
+                g_free (own);
+                return;
+        }
+
+        /* processes may only live in leaves once controllers are
+         * enabled for the children */
+        leaf = g_build_filename (own, CGROUP_LEAF, NULL);
+        if (g_mkdir (leaf, 0755) < 0 && errno != EEXIST) {
+                g_warning ("GsmCgroup: unable to create %s: %s", leaf, g_strerror (errno));
+                g_free (leaf);
+                g_free (own);
+                return;
+        }
+        move_processes (own, leaf);
+        g_free (leaf);
+
+        write_cgroup_file (own, "cgroup.subtree_control", "+memory");
+        write_cgroup_file (own, "cgroup.subtree_control", "+cpu");
+
+        g_debug ("GsmCgroup: creating app cgroups in %s", own);
+        delegated_root = own;
+}
+
+static void
+set_limits (const char *path,
+            guint64     memory_max,
+            guint64     cpu_weight)
+{
+        char value[32];
+
+        if (memory_max > 0) {
+                g_snprintf (value, sizeof (value), "%" G_GUINT64_FORMAT, memory_max);
+                write_cgroup_file (path, "memory.max", value);
+        }
+
+        if (cpu_weight > 0) {
+                g_snprintf (value, sizeof (value), "%" G_GUINT64_FORMAT, cpu_weight);
+                write_cgroup_file (path, "cpu.weight", value);
+        }
+}
+
+/**
+ * gsm_cgroup_create:
+ * @name: name of the new cgroup
+ * @memory_max: memory.max, or 0 for no limit
+ * @cpu_weight: cpu.weight, or 0 for the default
+ *
+ * Creates a cgroup in the subtree delegated to us.
+ *
+ * Return value: the path of the new cgroup, or %NULL if we don't have
+ * a delegated subtree
+ **/
+char *
+gsm_cgroup_create (const char *name,
+                   guint64     memory_max,
+                   guint64     cpu_weight)
+{
+        char *path;
+
+        if (! initialized) {
+                init_delegation ();
+        }
+
+        if (delegated_root == NULL) {
+                return NULL;
+        }
+
+        path = g_build_filename (delegated_root, name, NULL);
+        if (g_mkdir (path, 0755) < 0 && errno != EEXIST) {
+                g_warning ("GsmCgroup: unable to create %s: %s", path, g_strerror (errno));
+                g_free (path);
+                return NULL;
+        }
+
+        set_limits (path, memory_max, cpu_weight);
+
+        return path;
+}
+
+static void
+scope_data_free (ScopeData *data)
+{
+        g_free (data->unit);
+        g_free (data);
+}
+
+static gboolean
+poll_scope (ScopeData *data)
+{
+        char *path;
+
+        path = get_cgroup_of_pid (data->pid);
+
+        if (path != NULL && g_str_has_suffix (path, data->unit)) {
+                data->func (path, data->user_data);
+        } else if (path != NULL && ++data->tries < SCOPE_POLL_TRIES) {
+                g_free (path);
+                return TRUE;
+        } else {
+                g_debug ("GsmCgroup: pid %d never showed up in %s",
+                         (int) data->pid, data->unit);
+                data->func (NULL, data->user_data);
+        }
+
+        g_free (path);
+        scope_data_free (data);
+
+        return FALSE;
+}
+
+static void
+on_start_transient_unit_finished (GObject      *source,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+        ScopeData *data = user_data;
+        GVariant  *reply;
+        GError    *error;
+
+        error = NULL;
+        reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+        if (reply == NULL) {
+                g_debug ("GsmCgroup: unable to start %s: %s", data->unit, error->message);
+                g_error_free (error);
+                data->func (NULL, data->user_data);
+                scope_data_free (data);
+                return;
+        }
+        g_variant_unref (reply);
+
+        /* the reply only means the job was queued */
+        if (poll_scope (data)) {
+                g_timeout_add (SCOPE_POLL_INTERVAL, (GSourceFunc) poll_scope, data);
+        }
+}
+
+/**
+ * gsm_cgroup_start_scope:
+ * @name: name of the scope, without the ".scope" suffix
+ * @pid: the process to put in the scope
+ * @memory_max: MemoryMax=, or 0 for no limit
+ * @cpu_weight: CPUWeight=, or 0 for the default
+ * @func: called with the cgroup of the scope, or %NULL on failure
+ * @user_data: data for @func
+ *
+ * Asks the systemd user manager to move @pid into a transient scope.
+ **/
+void
+gsm_cgroup_start_scope (const char         *name,
+                        GPid                pid,
+                        guint64             memory_max,
+                        guint64             cpu_weight,
+                        GsmCgroupScopeFunc  func,
+                        gpointer            user_data)
+{
+        GDBusConnection *connection;
+        GVariantBuilder  properties;
+        GVariantBuilder  aux;
+        ScopeData       *data;
+        const char      *bus_name;
+
+        connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+        if (connection == NULL) {
+                func (NULL, user_data);
+                return;
+        }
+
+        bus_name = g_getenv ("MATE_SESSION_SYSTEMD_NAME");
+        if (bus_name == NULL || bus_name[0] == '\0') {
+                bus_name = SYSTEMD_NAME;
+        }
+
+        data = g_new0 (ScopeData, 1);
+        data->unit = g_strconcat (name, ".scope", NULL);
+        data->pid = pid;
+        data->func = func;
+        data->user_data = user_data;
+
+        g_variant_builder_init (&properties, G_VARIANT_TYPE ("a(sv)"));
+        g_variant_builder_add (&properties, "(sv)", "PIDs",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                          &pid, 1, sizeof (guint32)));
+        if (memory_max > 0) {
+                g_variant_builder_add (&properties, "(sv)", "MemoryMax",
+                                       g_variant_new_uint64 (memory_max));
+        }
+        if (cpu_weight > 0) {
+                g_variant_builder_add (&properties, "(sv)", "CPUWeight",
+                                       g_variant_new_uint64 (cpu_weight));
+        }
+        g_variant_builder_init (&aux, G_VARIANT_TYPE ("a(sa(sv))"));
+
+        g_dbus_connection_call (connection,
+                                bus_name,
+                                SYSTEMD_PATH,
+                                SYSTEMD_INTERFACE,
+                                "StartTransientUnit",
+                                g_variant_new ("(ssa(sv)a(sa(sv)))",
+                                               data->unit,
+                                               "fail",
+                                               &properties,
+                                               &aux),
+                                G_VARIANT_TYPE ("(o)"),
+                                G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                -1,
+                                NULL,
+                                on_start_transient_unit_finished,
+                                data);
+
+        g_object_unref (connection);
+}
+
+static gboolean
+read_uint64 (const char *path,
+             guint64    *value)
+{
+        char     *contents;
+        gboolean  ret;
+
+        if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+                return FALSE;
+        }
+
+        ret = g_ascii_isdigit (contents[0]);
+        if (ret) {
+                *value = g_ascii_strtoull (contents, NULL, 10);
+        }
+        g_free (contents);
+
+        return ret;
+}
+
+gboolean
+gsm_cgroup_get_stats (const char *path,
+                      guint64    *memory_current,
+                      guint64    *cpu_usage)
+{
+        char      *file;
+        char      *contents;
+        char      *usage;
+        gboolean   ret;
+
+        file = g_build_filename (path, "memory.current", NULL);
+        ret = read_uint64 (file, memory_current);
+        g_free (file);
+
+        if (! ret) {
+                return FALSE;
+        }
+
+        file = g_build_filename (path, "cpu.stat", NULL);
+        ret = g_file_get_contents (file, &contents, NULL, NULL);
+        g_free (file);
+
+        if (! ret) {
+                return FALSE;
+        }
+
+        *cpu_usage = 0;
+        usage = strstr (contents, "usage_usec ");
+        if (usage != NULL) {
+                *cpu_usage = g_ascii_strtoull (usage + strlen ("usage_usec "), NULL, 10);
+        }
+        g_free (contents);
+
+        return TRUE;
+}
+
+/**
+ * gsm_cgroup_kill:
+ * @path: a cgroup
+ * @signal_number: the signal to send
+ *
+ * Sends @signal_number to every process in @path.
+ **/
+void
+gsm_cgroup_kill (const char *path,
+                 int         signal_number)
+{
+        char  *file;
+        char  *contents;
+        char **pids;
+        int    i;
+
+        /* atomic, and it also catches processes forking meanwhile */
+        if (signal_number == SIGKILL) {
+                file = g_build_filename (path, "cgroup.kill", NULL);
+                if (g_file_test (file, G_FILE_TEST_EXISTS)
+                    && write_file (file, "1")) {
+                        g_free (file);
+                        return;
+                }
+                g_free (file);
+        }
+
+        file = g_build_filename (path, "cgroup.procs", NULL);
+        if (! g_file_get_contents (file, &contents, NULL, NULL)) {
+                g_free (file);
+                return;
+        }
+        g_free (file);
+
+        pids = g_strsplit (contents, "\n", -1);
+        for (i = 0; pids[i] != NULL; i++) {
+                if (pids[i][0] != '\0') {
+                        kill ((pid_t) atoi (pids[i]), signal_number);
+                }
+        }
+
+        g_strfreev (pids);
+        g_free (contents);
+}
+
+/* only succeeds once the cgroup is empty */
+void
+gsm_cgroup_remove (const char *path)
+{
+        if (g_rmdir (path) < 0 && errno != ENOENT) {
+                g_debug ("GsmCgroup: not removing %s: %s", path, g_strerror (errno));
+        }
+}
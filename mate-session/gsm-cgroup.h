@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __GSM_CGROUP_H__
+#define __GSM_CGROUP_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (* GsmCgroupScopeFunc) (const char *path,
+                                     gpointer    user_data);
+
+char    *gsm_cgroup_create       (const char         *name,
+                                  guint64             memory_max,
+                                  guint64             cpu_weight);
+void     gsm_cgroup_start_scope  (const char         *name,
+                                  GPid                pid,
+                                  guint64             memory_max,
+                                  guint64             cpu_weight,
+                                  GsmCgroupScopeFunc  func,
+                                  gpointer            user_data);
+gboolean gsm_cgroup_get_stats    (const char         *path,
+                                  guint64            *memory_current,
+                                  guint64            *cpu_usage);
+void     gsm_cgroup_kill         (const char         *path,
+                                  int                 signal_number);
+void     gsm_cgroup_remove       (const char         *path);
+
+G_END_DECLS
+
+#endif /* __GSM_CGROUP_H__ */
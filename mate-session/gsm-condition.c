@@ -0,0 +1,312 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "gsm-condition.h"
+
+/* A GsmCondition is the thing an AutostartCondition looks at: whether
+ * a file exists, or the value of a boolean setting.  Conditions are
+ * shared, so that all the apps testing the same file or key use one
+ * monitor and one cached value, and apps watching keys of the same
+ * schema share one GSettings object.
+ */
+
+struct _GsmCondition
+{
+        GObject       parent;
+        char         *id;
+        gboolean      value;
+
+        GFileMonitor *monitor;
+
+        GSettings    *settings;
+        char         *key;
+        gulong        settings_handler_id;
+};
+
+enum {
+        CHANGED,
+        LAST_SIGNAL
+};
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
+/* id -> GsmCondition and schema id -> GSettings; neither holds a
+ * reference, entries go away with the object */
+static GHashTable *conditions = NULL;
+static GHashTable *schema_settings = NULL;
+
+G_DEFINE_TYPE (GsmCondition, gsm_condition, G_TYPE_OBJECT)
+
+static GsmCondition *
+lookup_condition (const char *id)
+{
+        GsmCondition *condition;
+
+        if (conditions == NULL) {
+                return NULL;
+        }
+
+        condition = g_hash_table_lookup (conditions, id);
+        if (condition != NULL) {
+                g_object_ref (condition);
+        }
+
+        return condition;
+}
+
+static void
+register_condition (GsmCondition *condition)
+{
+        if (conditions == NULL) {
+                conditions = g_hash_table_new (g_str_hash, g_str_equal);
+        }
+
+        g_hash_table_insert (conditions, condition->id, condition);
+}
+
+static void
+set_value (GsmCondition *condition,
+           gboolean      value)
+{
+        /* Emit only if the condition actually changed */
+        if (condition->value == value) {
+                return;
+        }
+
+        g_debug ("GsmCondition: %s changed to %d", condition->id, value);
+
+        condition->value = value;
+        g_signal_emit (condition, signals [CHANGED], 0, value);
+}
+
+static void
+on_file_monitor_changed (GFileMonitor      *monitor,
+                         GFile             *file,
+                         GFile             *other_file,
+                         GFileMonitorEvent  event,
+                         GsmCondition      *condition)
+{
+        switch (event) {
+        case G_FILE_MONITOR_EVENT_CREATED:
+                set_value (condition, TRUE);
+                break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+                set_value (condition, FALSE);
+                break;
+        default:
+                /* Ignore any other monitor event */
+                break;
+        }
+}
+
+static void
+on_settings_changed (GSettings    *settings,
+                     const char   *key,
+                     GsmCondition *condition)
+{
+        set_value (condition, g_settings_get_boolean (settings, key));
+}
+
+static void
+schema_settings_finalized (gpointer  data,
+                           GObject  *where_the_object_was)
+{
+        g_hash_table_remove (schema_settings, data);
+}
+
+static GSettings *
+get_settings_for_schema (const char *schema_id)
+{
+        GSettingsSchemaSource *source;
+        GSettingsSchema       *schema;
+        GSettings             *settings;
+        char                  *id;
+
+        if (schema_settings == NULL) {
+                schema_settings = g_hash_table_new_full (g_str_hash,
+                                                         g_str_equal,
+                                                         g_free,
+                                                         NULL);
+        }
+
+        settings = g_hash_table_lookup (schema_settings, schema_id);
+        if (settings != NULL) {
+                return g_object_ref (settings);
+        }
+
+        source = g_settings_schema_source_get_default ();
+        schema = g_settings_schema_source_lookup (source, schema_id, TRUE);
+        if (schema == NULL) {
+                return NULL;
+        }
+
+        settings = g_settings_new_full (schema, NULL, NULL);
+        g_settings_schema_unref (schema);
+
+        id = g_strdup (schema_id);
+        g_hash_table_insert (schema_settings, id, settings);
+        g_object_weak_ref (G_OBJECT (settings), schema_settings_finalized, id);
+
+        return settings;
+}
+
+GsmCondition *
+gsm_condition_get_for_file (const char *path)
+{
+        GsmCondition *condition;
+        GFile        *file;
+        char         *id;
+
+        g_return_val_if_fail (path != NULL, NULL);
+
+        id = g_strconcat ("file:", path, NULL);
+
+        condition = lookup_condition (id);
+        if (condition != NULL) {
+                g_free (id);
+                return condition;
+        }
+
+        condition = g_object_new (GSM_TYPE_CONDITION, NULL);
+        condition->id = id;
+        condition->value = g_file_test (path, G_FILE_TEST_EXISTS);
+
+        file = g_file_new_for_path (path);
+        condition->monitor = g_file_monitor_file (file, 0, NULL, NULL);
+        if (condition->monitor != NULL) {
+                g_signal_connect (condition->monitor, "changed",
+                                  G_CALLBACK (on_file_monitor_changed),
+                                  condition);
+        }
+        g_object_unref (file);
+
+        register_condition (condition);
+
+        return condition;
+}
+
+GsmCondition *
+gsm_condition_get_for_setting (const char *schema_id,
+                               const char *key)
+{
+        GsmCondition *condition;
+        GSettings    *settings;
+        char         *id;
+        char         *signal;
+
+        g_return_val_if_fail (schema_id != NULL, NULL);
+        g_return_val_if_fail (key != NULL, NULL);
+
+        id = g_strdup_printf ("gsettings:%s %s", schema_id, key);
+
+        condition = lookup_condition (id);
+        if (condition != NULL) {
+                g_free (id);
+                return condition;
+        }
+
+        settings = get_settings_for_schema (schema_id);
+        if (settings == NULL) {
+                g_free (id);
+                return NULL;
+        }
+
+        condition = g_object_new (GSM_TYPE_CONDITION, NULL);
+        condition->id = id;
+        condition->settings = settings;
+        condition->key = g_strdup (key);
+
+        signal = g_strdup_printf ("changed::%s", key);
+        condition->settings_handler_id = g_signal_connect (settings, signal,
+                                                           G_CALLBACK (on_settings_changed),
+                                                           condition);
+        g_free (signal);
+
+        condition->value = g_settings_get_boolean (settings, key);
+
+        register_condition (condition);
+
+        return condition;
+}
+
+gboolean
+gsm_condition_get_value (GsmCondition *condition)
+{
+        g_return_val_if_fail (GSM_IS_CONDITION (condition), FALSE);
+
+        return condition->value;
+}
+
+static void
+gsm_condition_finalize (GObject *object)
+{
+        GsmCondition *condition;
+
+        condition = GSM_CONDITION (object);
+
+        if (conditions != NULL && condition->id != NULL) {
+                g_hash_table_remove (conditions, condition->id);
+        }
+
+        if (condition->monitor != NULL) {
+                g_file_monitor_cancel (condition->monitor);
+                g_object_unref (condition->monitor);
+        }
+
+        if (condition->settings != NULL) {
+                g_signal_handler_disconnect (condition->settings,
+                                             condition->settings_handler_id);
+                g_object_unref (condition->settings);
+        }
+
+        g_free (condition->key);
+        g_free (condition->id);
+
+        G_OBJECT_CLASS (gsm_condition_parent_class)->finalize (object);
+}
+
+static void
+gsm_condition_class_init (GsmConditionClass *klass)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = gsm_condition_finalize;
+
+        signals [CHANGED] =
+                g_signal_new ("changed",
+                              G_TYPE_FROM_CLASS (object_class),
+                              G_SIGNAL_RUN_LAST,
+                              0,
+                              NULL,
+                              NULL,
+                              g_cclosure_marshal_VOID__BOOLEAN,
+                              G_TYPE_NONE,
+                              1, G_TYPE_BOOLEAN);
+}
+
+static void
+gsm_condition_init (GsmCondition *condition)
+{
+}
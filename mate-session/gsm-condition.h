@@ -0,0 +1,37 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __GSM_CONDITION_H__
+#define __GSM_CONDITION_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GSM_TYPE_CONDITION            (gsm_condition_get_type ())
+G_DECLARE_FINAL_TYPE (GsmCondition, gsm_condition, GSM, CONDITION, GObject)
+
+GsmCondition * gsm_condition_get_for_file      (const char   *path);
+GsmCondition * gsm_condition_get_for_setting   (const char   *schema_id,
+                                                const char   *key);
+
+gboolean       gsm_condition_get_value         (GsmCondition *condition);
+
+G_END_DECLS
+
+#endif /* __GSM_CONDITION_H__ */
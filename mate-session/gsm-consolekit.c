@@ -27,9 +27,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gi18n.h>
-
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-lowlevel.h>
+#include <gio/gio.h>
 
 #include "gsm-marshal.h"
 #include "gsm-consolekit.h"
@@ -40,15 +38,33 @@
 
 #define CK_MANAGER_PATH      "/org/freedesktop/ConsoleKit/Manager"
 #define CK_MANAGER_INTERFACE "org.freedesktop.ConsoleKit.Manager"
-#define CK_SEAT_INTERFACE    "org.freedesktop.ConsoleKit.Seat"
 #define CK_SESSION_INTERFACE "org.freedesktop.ConsoleKit.Session"
 
+/* The proxies for the manager and for our session are set up
+ * asynchronously when the object is created, and kept.  The session
+ * type and idle hint are cached, the latter kept up to date from
+ * IdleHintChanged.  The only thing ever waited for is the session
+ * type, once, if it is asked for before the set up is done: deciding
+ * whether this is a login window can't be put off.
+ */
+
+#define CK_SESSION_TYPE_TIMEOUT 1000 /* milliseconds */
+
 typedef struct
 {
-        DBusGConnection *dbus_connection;
-        DBusGProxy      *bus_proxy;
-        DBusGProxy      *ck_proxy;
-        guint32          is_connected : 1;
+        GCancellable    *cancellable;
+        GDBusProxy      *ck_proxy;
+        GDBusProxy      *session_proxy;
+        gboolean         is_connected;
+
+        char            *session_type;
+        gboolean         session_type_fetched;
+
+        gboolean         session_idle_known;
+        gboolean         session_idle;
+
+        gboolean         idle_hint_pending;
+        gboolean         idle_hint;
 } GsmConsolekitPrivate;
 
 enum {
@@ -66,17 +82,7 @@ static guint signals[LAST_SIGNAL] = { 0 };
 
 static void     gsm_consolekit_finalize     (GObject            *object);
 
-static void     gsm_consolekit_free_dbus    (GsmConsolekit      *manager);
-
-static DBusHandlerResult gsm_consolekit_dbus_filter (DBusConnection *connection,
-                                                     DBusMessage    *message,
-                                                     void           *user_data);
-
-static void     gsm_consolekit_on_name_owner_changed (DBusGProxy        *bus_proxy,
-                                                      const char        *name,
-                                                      const char        *prev_owner,
-                                                      const char        *new_owner,
-                                                      GsmConsolekit   *manager);
+static void     gsm_consolekit_sync_idle_hint (GsmConsolekit    *manager);
 
 G_DEFINE_TYPE_WITH_PRIVATE (GsmConsolekit, gsm_consolekit, G_TYPE_OBJECT);
 
@@ -148,204 +154,285 @@ gsm_consolekit_class_init (GsmConsolekitClass *manager_class)
 
 }
 
-static DBusHandlerResult
-gsm_consolekit_dbus_filter (DBusConnection *connection,
-                            DBusMessage    *message,
-                            void           *user_data)
+static void
+gsm_consolekit_update_is_connected (GsmConsolekit *manager)
 {
-        GsmConsolekit *manager;
+        GsmConsolekitPrivate *priv;
+        char                 *name_owner;
+        gboolean              is_connected;
 
-        manager = GSM_CONSOLEKIT (user_data);
+        priv = gsm_consolekit_get_instance_private (manager);
 
-        if (dbus_message_is_signal (message,
-                                    DBUS_INTERFACE_LOCAL, "Disconnected") &&
-            strcmp (dbus_message_get_path (message), DBUS_PATH_LOCAL) == 0) {
-                gsm_consolekit_free_dbus (manager);
-                /* let other filters get this disconnected signal, so that they
-                 * can handle it too */
+        name_owner = NULL;
+        if (priv->ck_proxy != NULL) {
+                name_owner = g_dbus_proxy_get_name_owner (priv->ck_proxy);
         }
 
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        is_connected = (name_owner != NULL);
+        g_free (name_owner);
+
+        if (priv->is_connected != is_connected) {
+                priv->is_connected = is_connected;
+                g_object_notify (G_OBJECT (manager), "is-connected");
+        }
 }
 
-static gboolean
-gsm_consolekit_ensure_ck_connection (GsmConsolekit  *manager,
-                                     GError        **error)
+static void
+gsm_consolekit_on_name_owner_notify (GDBusProxy    *proxy,
+                                     GParamSpec    *pspec,
+                                     GsmConsolekit *manager)
 {
-        GError  *connection_error;
-        gboolean is_connected;
         GsmConsolekitPrivate *priv;
 
-        connection_error = NULL;
         priv = gsm_consolekit_get_instance_private (manager);
 
-        if (priv->dbus_connection == NULL) {
-                DBusConnection *connection;
+        gsm_consolekit_update_is_connected (manager);
 
-                priv->dbus_connection = dbus_g_bus_get (DBUS_BUS_SYSTEM,
-                                                        &connection_error);
+        /* A restarted ConsoleKit knows nothing about our idle hint */
+        priv->session_idle_known = FALSE;
+}
 
-                if (priv->dbus_connection == NULL) {
-                        g_propagate_error (error, connection_error);
-                        is_connected = FALSE;
-                        goto out;
-                }
+static void
+gsm_consolekit_on_session_signal (GDBusProxy    *proxy,
+                                  const char    *sender_name,
+                                  const char    *signal_name,
+                                  GVariant      *parameters,
+                                  GsmConsolekit *manager)
+{
+        GsmConsolekitPrivate *priv;
 
-                connection = dbus_g_connection_get_connection (priv->dbus_connection);
-                dbus_connection_set_exit_on_disconnect (connection, FALSE);
-                dbus_connection_add_filter (connection,
-                                            gsm_consolekit_dbus_filter,
-                                            manager, NULL);
+        if (g_strcmp0 (signal_name, "IdleHintChanged") != 0 ||
+            !g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)"))) {
+                return;
         }
 
-        if (priv->bus_proxy == NULL) {
-                priv->bus_proxy =
-                        dbus_g_proxy_new_for_name_owner (priv->dbus_connection,
-                                                         DBUS_SERVICE_DBUS,
-                                                         DBUS_PATH_DBUS,
-                                                         DBUS_INTERFACE_DBUS,
-                                                         &connection_error);
-
-                if (priv->bus_proxy == NULL) {
-                        g_propagate_error (error, connection_error);
-                        is_connected = FALSE;
-                        goto out;
-                }
+        priv = gsm_consolekit_get_instance_private (manager);
 
-                dbus_g_proxy_add_signal (priv->bus_proxy,
-                                         "NameOwnerChanged",
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
-                                         G_TYPE_INVALID);
-
-                dbus_g_proxy_connect_signal (priv->bus_proxy,
-                                             "NameOwnerChanged",
-                                             G_CALLBACK (gsm_consolekit_on_name_owner_changed),
-                                             manager, NULL);
-        }
+        g_variant_get (parameters, "(b)", &priv->session_idle);
+        priv->session_idle_known = TRUE;
+}
 
-        if (priv->ck_proxy == NULL) {
-                priv->ck_proxy =
-                        dbus_g_proxy_new_for_name_owner (priv->dbus_connection,
-                                                         "org.freedesktop.ConsoleKit",
-                                                         "/org/freedesktop/ConsoleKit/Manager",
-                                                         "org.freedesktop.ConsoleKit.Manager",
-                                                         &connection_error);
-
-                if (priv->ck_proxy == NULL) {
-                        g_propagate_error (error, connection_error);
-                        is_connected = FALSE;
-                        goto out;
-                }
-        }
+static void
+gsm_consolekit_set_ck_proxy (GsmConsolekit *manager,
+                             GDBusProxy    *proxy)
+{
+        GsmConsolekitPrivate *priv;
 
-        is_connected = TRUE;
+        priv = gsm_consolekit_get_instance_private (manager);
 
-out:
-        if (priv->is_connected != is_connected) {
-                priv->is_connected = is_connected;
-                g_object_notify (G_OBJECT (manager), "is-connected");
-        }
+        priv->ck_proxy = proxy;
+        g_signal_connect (proxy,
+                          "notify::g-name-owner",
+                          G_CALLBACK (gsm_consolekit_on_name_owner_notify),
+                          manager);
+
+        gsm_consolekit_update_is_connected (manager);
+}
+
+static void
+on_get_session_type_finished (GObject      *source,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+        GsmConsolekitPrivate *priv;
+        GVariant             *reply;
+        GError               *error;
 
-        if (!is_connected) {
-                if (priv->dbus_connection == NULL) {
-                        if (priv->bus_proxy != NULL) {
-                                g_object_unref (priv->bus_proxy);
-                                priv->bus_proxy = NULL;
-                        }
-
-                        if (priv->ck_proxy != NULL) {
-                                g_object_unref (priv->ck_proxy);
-                                priv->ck_proxy = NULL;
-                        }
-                } else if (priv->bus_proxy == NULL) {
-                        if (priv->ck_proxy != NULL) {
-                                g_object_unref (priv->ck_proxy);
-                                priv->ck_proxy = NULL;
-                        }
+        error = NULL;
+        reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+        if (reply == NULL) {
+                if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        g_warning ("Unable to determine session type: %s", error->message);
                 }
+                g_error_free (error);
+                return;
         }
 
-        return is_connected;
+        priv = gsm_consolekit_get_instance_private (GSM_CONSOLEKIT (user_data));
+
+        if (priv->session_type == NULL) {
+                g_variant_get (reply, "(s)", &priv->session_type);
+        }
+        g_variant_unref (reply);
 }
 
 static void
-gsm_consolekit_on_name_owner_changed (DBusGProxy    *bus_proxy,
-                                      const char    *name,
-                                      const char    *prev_owner,
-                                      const char    *new_owner,
-                                      GsmConsolekit *manager)
+gsm_consolekit_set_session_proxy (GsmConsolekit *manager,
+                                  GDBusProxy    *proxy)
 {
         GsmConsolekitPrivate *priv;
 
-        if (name != NULL && strcmp (name, "org.freedesktop.ConsoleKit") != 0) {
-                return;
+        priv = gsm_consolekit_get_instance_private (manager);
+
+        priv->session_proxy = proxy;
+        g_signal_connect (proxy,
+                          "g-signal",
+                          G_CALLBACK (gsm_consolekit_on_session_signal),
+                          manager);
+
+        /* Things that don't change during the session */
+        g_dbus_proxy_call (proxy,
+                           "GetSessionType",
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           priv->cancellable,
+                           on_get_session_type_finished,
+                           manager);
+
+        if (priv->idle_hint_pending) {
+                gsm_consolekit_sync_idle_hint (manager);
         }
+}
 
-        priv = gsm_consolekit_get_instance_private (manager);
+static void
+on_session_proxy_ready (GObject      *source,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+        GDBusProxy *proxy;
+        GError     *error;
 
-        if (priv->ck_proxy != NULL) {
-                g_object_unref (priv->ck_proxy);
-                priv->ck_proxy = NULL;
+        error = NULL;
+        proxy = g_dbus_proxy_new_finish (result, &error);
+        if (proxy == NULL) {
+                if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        g_warning ("Unable to determine session: %s", error->message);
+                }
+                g_error_free (error);
+                return;
         }
 
-        gsm_consolekit_ensure_ck_connection (manager, NULL);
+        gsm_consolekit_set_session_proxy (GSM_CONSOLEKIT (user_data), proxy);
 }
 
 static void
-gsm_consolekit_init (GsmConsolekit *manager)
+on_get_current_session_finished (GObject      *source,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
 {
-        GError *error;
+        GsmConsolekitPrivate *priv;
+        GVariant             *reply;
+        GError               *error;
+        const char           *session_id;
 
         error = NULL;
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
+        reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+        if (reply == NULL) {
+                if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        g_warning ("Unable to determine session: %s", error->message);
+                }
                 g_error_free (error);
+                return;
+        }
+
+        priv = gsm_consolekit_get_instance_private (GSM_CONSOLEKIT (user_data));
+
+        g_variant_get (reply, "(&o)", &session_id);
+        if (priv->session_proxy == NULL) {
+                g_dbus_proxy_new (g_dbus_proxy_get_connection (G_DBUS_PROXY (source)),
+                                  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                  NULL,
+                                  CK_NAME,
+                                  session_id,
+                                  CK_SESSION_INTERFACE,
+                                  priv->cancellable,
+                                  on_session_proxy_ready,
+                                  user_data);
         }
+        g_variant_unref (reply);
 }
 
 static void
-gsm_consolekit_free_dbus (GsmConsolekit *manager)
+on_ck_proxy_ready (GObject      *source,
+                   GAsyncResult *result,
+                   gpointer      user_data)
 {
+        GsmConsolekit        *manager;
         GsmConsolekitPrivate *priv;
+        GDBusProxy           *proxy;
+        GError               *error;
 
-        priv = gsm_consolekit_get_instance_private (manager);
-        if (priv->bus_proxy != NULL) {
-                g_object_unref (priv->bus_proxy);
-                priv->bus_proxy = NULL;
+        error = NULL;
+        proxy = g_dbus_proxy_new_for_bus_finish (result, &error);
+        if (proxy == NULL) {
+                if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        g_warning ("Could not connect to ConsoleKit: %s",
+                                   error->message);
+                }
+                g_error_free (error);
+                return;
         }
 
-        if (priv->ck_proxy != NULL) {
-                g_object_unref (priv->ck_proxy);
-                priv->ck_proxy = NULL;
-        }
+        manager = GSM_CONSOLEKIT (user_data);
+        priv = gsm_consolekit_get_instance_private (manager);
 
-        if (priv->dbus_connection != NULL) {
-                DBusConnection *connection;
-                connection = dbus_g_connection_get_connection (priv->dbus_connection);
-                dbus_connection_remove_filter (connection,
-                                               gsm_consolekit_dbus_filter,
-                                               manager);
+        gsm_consolekit_set_ck_proxy (manager, proxy);
 
-                dbus_g_connection_unref (priv->dbus_connection);
-                priv->dbus_connection = NULL;
+        if (priv->session_proxy != NULL) {
+                return;
         }
+
+        g_dbus_proxy_call (proxy,
+                           "GetCurrentSession",
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           priv->cancellable,
+                           on_get_current_session_finished,
+                           manager);
+}
+
+static void
+gsm_consolekit_init (GsmConsolekit *manager)
+{
+        GsmConsolekitPrivate *priv;
+
+        priv = gsm_consolekit_get_instance_private (manager);
+
+        priv->cancellable = g_cancellable_new ();
+
+        g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                                  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                  NULL,
+                                  CK_NAME,
+                                  CK_MANAGER_PATH,
+                                  CK_MANAGER_INTERFACE,
+                                  priv->cancellable,
+                                  on_ck_proxy_ready,
+                                  manager);
 }
 
 static void
 gsm_consolekit_finalize (GObject *object)
 {
-        GsmConsolekit *manager;
-        GObjectClass  *parent_class;
+        GsmConsolekit        *manager;
+        GsmConsolekitPrivate *priv;
+        GObjectClass         *parent_class;
 
         manager = GSM_CONSOLEKIT (object);
+        priv = gsm_consolekit_get_instance_private (manager);
 
         parent_class = G_OBJECT_CLASS (gsm_consolekit_parent_class);
 
-        gsm_consolekit_free_dbus (manager);
+        g_cancellable_cancel (priv->cancellable);
+        g_object_unref (priv->cancellable);
+
+        if (priv->ck_proxy != NULL) {
+                g_signal_handlers_disconnect_by_func (priv->ck_proxy,
+                                                      gsm_consolekit_on_name_owner_notify,
+                                                      manager);
+                g_object_unref (priv->ck_proxy);
+        }
+
+        if (priv->session_proxy != NULL) {
+                g_signal_handlers_disconnect_by_func (priv->session_proxy,
+                                                      gsm_consolekit_on_session_signal,
+                                                      manager);
+                g_object_unref (priv->session_proxy);
+        }
+
+        g_free (priv->session_type);
 
         if (parent_class->finalize != NULL) {
                 parent_class->finalize (object);
@@ -420,408 +507,234 @@ emit_stop_complete (GsmConsolekit *manager,
         }
 }
 
-void
-gsm_consolekit_attempt_restart (GsmConsolekit *manager)
-{
-        gboolean res;
-        GError  *error;
-        GsmConsolekitPrivate *priv;
-
-        error = NULL;
-        priv = gsm_consolekit_get_instance_private (manager);
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
-                emit_restart_complete (manager, error);
-                g_error_free (error);
-                return;
-        }
+typedef enum {
+        CK_REQUEST_RESTART,
+        CK_REQUEST_STOP,
+        CK_REQUEST_SUSPEND,
+        CK_REQUEST_HIBERNATE
+} CkRequest;
 
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "Restart",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_INVALID,
-                                              G_TYPE_INVALID);
+typedef struct {
+        GsmConsolekit *manager;
+        CkRequest      request;
+        const char    *method;
+        GVariant      *parameters;
+} CkRequestData;
 
-        if (!res) {
-                g_warning ("Unable to restart system: %s", error->message);
+static void
+emit_request_complete (GsmConsolekit *manager,
+                       CkRequest      request,
+                       GError        *error)
+{
+        switch (request) {
+        case CK_REQUEST_RESTART:
                 emit_restart_complete (manager, error);
-                g_error_free (error);
-        } else {
-                emit_restart_complete (manager, NULL);
+                break;
+        case CK_REQUEST_STOP:
+                emit_stop_complete (manager, error);
+                break;
+        default:
+                /* Nobody waits for suspend or hibernate */
+                break;
         }
 }
 
-void
-gsm_consolekit_attempt_stop (GsmConsolekit *manager)
+static void
+on_request_finished (GObject      *source,
+                     GAsyncResult *result,
+                     gpointer      user_data)
 {
-        gboolean res;
-        GError  *error;
-        GsmConsolekitPrivate *priv;
+        CkRequestData *data = user_data;
+        GVariant      *reply;
+        GError        *error;
 
         error = NULL;
-        priv = gsm_consolekit_get_instance_private (manager);
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
+        reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+        if (reply == NULL) {
+                g_warning ("Unable to %s system: %s",
+                           data->request == CK_REQUEST_RESTART ? "restart" :
+                           data->request == CK_REQUEST_STOP ? "stop" :
+                           data->request == CK_REQUEST_SUSPEND ? "suspend" : "hibernate",
                            error->message);
-                emit_stop_complete (manager, error);
+                emit_request_complete (data->manager, data->request, error);
                 g_error_free (error);
-                return;
+        } else {
+                g_variant_unref (reply);
+                emit_request_complete (data->manager, data->request, NULL);
         }
 
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "Stop",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_INVALID,
-                                              G_TYPE_INVALID);
+        g_object_unref (data->manager);
+        g_free (data);
+}
 
-        if (!res) {
-                g_warning ("Unable to stop system: %s", error->message);
-                emit_stop_complete (manager, error);
-                g_error_free (error);
-        } else {
-                emit_stop_complete (manager, NULL);
-        }
+static void
+send_request (GDBusConnection *connection,
+              CkRequestData   *data)
+{
+        GVariant *parameters;
+
+        /* The call owns the (floating) parameters from here on */
+        parameters = data->parameters;
+        data->parameters = NULL;
+
+        /* These may wait for the user to authenticate, so there is no
+         * timeout; the reply is handled whenever it comes */
+        g_dbus_connection_call (connection,
+                                CK_NAME,
+                                CK_MANAGER_PATH,
+                                CK_MANAGER_INTERFACE,
+                                data->method,
+                                parameters,
+                                NULL,
+                                G_DBUS_CALL_FLAGS_NONE,
+                                G_MAXINT,
+                                NULL,
+                                on_request_finished,
+                                data);
 }
 
-void
-gsm_consolekit_attempt_suspend (GsmConsolekit *manager)
+static void
+on_system_bus_ready (GObject      *source,
+                     GAsyncResult *result,
+                     gpointer      user_data)
 {
-        gboolean res;
-        GError  *error;
-        GsmConsolekitPrivate *priv;
+        CkRequestData   *data = user_data;
+        GDBusConnection *connection;
+        GError          *error;
 
         error = NULL;
-        priv = gsm_consolekit_get_instance_private (manager);
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
+        connection = g_bus_get_finish (result, &error);
+        if (connection == NULL) {
                 g_warning ("Could not connect to ConsoleKit: %s",
                            error->message);
+                emit_request_complete (data->manager, data->request, error);
                 g_error_free (error);
+                if (data->parameters != NULL) {
+                        g_variant_unref (g_variant_ref_sink (data->parameters));
+                }
+                g_object_unref (data->manager);
+                g_free (data);
                 return;
         }
 
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "Suspend",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_BOOLEAN, TRUE, /* interactive */
-                                              G_TYPE_INVALID,
-                                              G_TYPE_INVALID);
-
-        if (!res) {
-                g_warning ("Unable to suspend system: %s", error->message);
-                g_error_free (error);
-        }
+        send_request (connection, data);
+        g_object_unref (connection);
 }
 
-void
-gsm_consolekit_attempt_hibernate (GsmConsolekit *manager)
+static void
+gsm_consolekit_attempt (GsmConsolekit *manager,
+                        CkRequest      request,
+                        const char    *method,
+                        GVariant      *parameters)
 {
-        gboolean res;
-        GError  *error;
         GsmConsolekitPrivate *priv;
+        CkRequestData        *data;
 
-        error = NULL;
         priv = gsm_consolekit_get_instance_private (manager);
 
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
-                g_error_free (error);
-                return;
-        }
-
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "Hibernate",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_BOOLEAN, TRUE, /* interactive */
-                                              G_TYPE_INVALID,
-                                              G_TYPE_INVALID);
+        data = g_new0 (CkRequestData, 1);
+        data->manager = g_object_ref (manager);
+        data->request = request;
+        data->method = method;
+        data->parameters = parameters;
 
-
-        if (!res) {
-                g_warning ("Unable to hibernate system: %s", error->message);
-                g_error_free (error);
+        /* The proxy may not be set up yet; never wait for it */
+        if (priv->ck_proxy != NULL) {
+                send_request (g_dbus_proxy_get_connection (priv->ck_proxy), data);
+        } else {
+                g_bus_get (G_BUS_TYPE_SYSTEM, NULL, on_system_bus_ready, data);
         }
 }
 
-static gboolean
-get_current_session_id (DBusConnection *connection,
-                        char          **session_id)
+void
+gsm_consolekit_attempt_restart (GsmConsolekit *manager)
 {
-        DBusError       local_error;
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        gboolean        ret;
-        DBusMessageIter iter;
-        const char     *value;
-
-        ret = FALSE;
-        reply = NULL;
-
-        dbus_error_init (&local_error);
-        message = dbus_message_new_method_call (CK_NAME,
-                                                CK_MANAGER_PATH,
-                                                CK_MANAGER_INTERFACE,
-                                                "GetCurrentSession");
-        if (message == NULL) {
-                goto out;
-        }
-
-        dbus_error_init (&local_error);
-        reply = dbus_connection_send_with_reply_and_block (connection,
-                                                           message,
-                                                           -1,
-                                                           &local_error);
-        if (reply == NULL) {
-                if (dbus_error_is_set (&local_error)) {
-                        g_warning ("Unable to determine session: %s", local_error.message);
-                        dbus_error_free (&local_error);
-                        goto out;
-                }
-        }
-
-        dbus_message_iter_init (reply, &iter);
-        dbus_message_iter_get_basic (&iter, &value);
-        if (session_id != NULL) {
-                *session_id = g_strdup (value);
-        }
-
-        ret = TRUE;
-out:
-        if (message != NULL) {
-                dbus_message_unref (message);
-        }
-        if (reply != NULL) {
-                dbus_message_unref (reply);
-        }
-
-        return ret;
+        gsm_consolekit_attempt (manager, CK_REQUEST_RESTART, "Restart", NULL);
 }
 
-static gboolean
-get_seat_id_for_session (DBusConnection *connection,
-                         const char     *session_id,
-                         char          **seat_id)
+void
+gsm_consolekit_attempt_stop (GsmConsolekit *manager)
 {
-        DBusError       local_error;
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        gboolean        ret;
-        DBusMessageIter iter;
-        const char     *value;
-
-        ret = FALSE;
-        reply = NULL;
-
-        dbus_error_init (&local_error);
-        message = dbus_message_new_method_call (CK_NAME,
-                                                session_id,
-                                                CK_SESSION_INTERFACE,
-                                                "GetSeatId");
-        if (message == NULL) {
-                goto out;
-        }
-
-        dbus_error_init (&local_error);
-        reply = dbus_connection_send_with_reply_and_block (connection,
-                                                           message,
-                                                           -1,
-                                                           &local_error);
-        if (reply == NULL) {
-                if (dbus_error_is_set (&local_error)) {
-                        g_warning ("Unable to determine seat: %s", local_error.message);
-                        dbus_error_free (&local_error);
-                        goto out;
-                }
-        }
-
-        dbus_message_iter_init (reply, &iter);
-        dbus_message_iter_get_basic (&iter, &value);
-        if (seat_id != NULL) {
-                *seat_id = g_strdup (value);
-        }
-
-        ret = TRUE;
-out:
-        if (message != NULL) {
-                dbus_message_unref (message);
-        }
-        if (reply != NULL) {
-                dbus_message_unref (reply);
-        }
-
-        return ret;
+        gsm_consolekit_attempt (manager, CK_REQUEST_STOP, "Stop", NULL);
 }
 
-static char *
-get_current_seat_id (DBusConnection *connection)
+void
+gsm_consolekit_attempt_suspend (GsmConsolekit *manager)
 {
-        gboolean res;
-        char    *session_id;
-        char    *seat_id;
-
-        session_id = NULL;
-        seat_id = NULL;
-
-        res = get_current_session_id (connection, &session_id);
-        if (res) {
-                res = get_seat_id_for_session (connection, session_id, &seat_id);
-        }
-        g_free (session_id);
-
-        return seat_id;
+        gsm_consolekit_attempt (manager, CK_REQUEST_SUSPEND, "Suspend",
+                                g_variant_new ("(b)", TRUE)); /* interactive */
 }
 
 void
-gsm_consolekit_set_session_idle (GsmConsolekit *manager,
-                                 gboolean       is_idle)
+gsm_consolekit_attempt_hibernate (GsmConsolekit *manager)
 {
-        gboolean        res;
-        GError         *error;
-        char           *session_id;
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        DBusError       dbus_error;
-        DBusMessageIter iter;
-        GsmConsolekitPrivate *priv;
+        gsm_consolekit_attempt (manager, CK_REQUEST_HIBERNATE, "Hibernate",
+                                g_variant_new ("(b)", TRUE)); /* interactive */
+}
 
-        error = NULL;
-        priv = gsm_consolekit_get_instance_private (manager);
+static void
+on_set_idle_hint_finished (GObject      *source,
+                           GAsyncResult *result,
+                           gpointer      user_data)
+{
+        GVariant *reply;
+        GError   *error;
 
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
+        error = NULL;
+        reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+        if (reply == NULL) {
+                if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        g_debug ("Could not update ConsoleKit idle status: %s", error->message);
+                }
                 g_error_free (error);
                 return;
         }
 
-        session_id = NULL;
-        res = get_current_session_id (dbus_g_connection_get_connection (priv->dbus_connection),
-                                      &session_id);
-        if (!res) {
-                goto out;
-        }
-
-
-        g_debug ("Updating ConsoleKit idle status: %d", is_idle);
-        message = dbus_message_new_method_call (CK_NAME,
-                                                session_id,
-                                                CK_SESSION_INTERFACE,
-                                                "SetIdleHint");
-        if (message == NULL) {
-                g_debug ("Couldn't allocate the D-Bus message");
-                return;
-        }
-
-        dbus_message_iter_init_append (message, &iter);
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &is_idle);
-
-        /* FIXME: use async? */
-        dbus_error_init (&dbus_error);
-        reply = dbus_connection_send_with_reply_and_block (dbus_g_connection_get_connection (priv->dbus_connection),
-                                                           message,
-                                                           -1,
-                                                           &dbus_error);
-        dbus_message_unref (message);
-
-        if (reply != NULL) {
-                dbus_message_unref (reply);
-        }
-
-        if (dbus_error_is_set (&dbus_error)) {
-                g_debug ("%s raised:\n %s\n\n", dbus_error.name, dbus_error.message);
-                dbus_error_free (&dbus_error);
-        }
-
-out:
-        g_free (session_id);
+        g_variant_unref (reply);
 }
 
-static gboolean
-seat_can_activate_sessions (DBusConnection *connection,
-                            const char     *seat_id)
+static void
+gsm_consolekit_sync_idle_hint (GsmConsolekit *manager)
 {
-        DBusError       local_error;
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        DBusMessageIter iter;
-        gboolean        can_activate;
-
-        can_activate = FALSE;
-        reply = NULL;
-
-        dbus_error_init (&local_error);
-        message = dbus_message_new_method_call (CK_NAME,
-                                                seat_id,
-                                                CK_SEAT_INTERFACE,
-                                                "CanActivateSessions");
-        if (message == NULL) {
-                goto out;
-        }
+        GsmConsolekitPrivate *priv;
 
-        dbus_error_init (&local_error);
-        reply = dbus_connection_send_with_reply_and_block (connection,
-                                                           message,
-                                                           -1,
-                                                           &local_error);
-        if (reply == NULL) {
-                if (dbus_error_is_set (&local_error)) {
-                        g_warning ("Unable to activate session: %s", local_error.message);
-                        dbus_error_free (&local_error);
-                        goto out;
-                }
-        }
+        priv = gsm_consolekit_get_instance_private (manager);
 
-        dbus_message_iter_init (reply, &iter);
-        dbus_message_iter_get_basic (&iter, &can_activate);
+        priv->idle_hint_pending = FALSE;
 
-out:
-        if (message != NULL) {
-                dbus_message_unref (message);
-        }
-        if (reply != NULL) {
-                dbus_message_unref (reply);
+        /* ConsoleKit already knows */
+        if (priv->session_idle_known && priv->session_idle == priv->idle_hint) {
+                return;
         }
 
-        return can_activate;
+        g_debug ("Updating ConsoleKit idle status: %d", priv->idle_hint);
+        g_dbus_proxy_call (priv->session_proxy,
+                           "SetIdleHint",
+                           g_variant_new ("(b)", priv->idle_hint),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           priv->cancellable,
+                           on_set_idle_hint_finished,
+                           NULL);
 }
 
-gboolean
-gsm_consolekit_can_switch_user (GsmConsolekit *manager)
+void
+gsm_consolekit_set_session_idle (GsmConsolekit *manager,
+                                 gboolean       is_idle)
 {
-        GError  *error;
-        char    *seat_id;
-        gboolean ret;
         GsmConsolekitPrivate *priv;
 
-        error = NULL;
         priv = gsm_consolekit_get_instance_private (manager);
 
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
-                g_error_free (error);
-                return FALSE;
-        }
+        priv->idle_hint = is_idle;
 
-        seat_id = get_current_seat_id (dbus_g_connection_get_connection (priv->dbus_connection));
-        if (seat_id == NULL || seat_id[0] == '\0') {
-                g_debug ("seat id is not set; can't switch sessions");
-                return FALSE;
+        if (priv->session_proxy == NULL) {
+                /* Sent as soon as we know our session */
+                priv->idle_hint_pending = TRUE;
+                return;
         }
 
-        ret = seat_can_activate_sessions (dbus_g_connection_get_connection (priv->dbus_connection),
-                                          seat_id);
-        g_free (seat_id);
-
-        return ret;
+        gsm_consolekit_sync_idle_hint (manager);
 }
 
 gboolean
@@ -844,227 +757,90 @@ gsm_consolekit_get_stop_privileges (GsmConsolekit *manager)
         return TRUE;
 }
 
-gboolean
-gsm_consolekit_can_restart (GsmConsolekit *manager)
+static char *
+fetch_session_type (void)
 {
-        gboolean res;
-        gboolean can_restart;
-        GError  *error;
-        GsmConsolekitPrivate *priv;
-
-        error = NULL;
-        priv = gsm_consolekit_get_instance_private (manager);
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
-                g_error_free (error);
-                return FALSE;
-        }
-
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "CanRestart",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_INVALID,
-                                              G_TYPE_BOOLEAN, &can_restart,
-                                              G_TYPE_INVALID);
-        if (res == FALSE) {
-                g_warning ("Could not make DBUS call: %s",
-                           error->message);
-                g_error_free (error);
-                return FALSE;
-        }
-
-        return can_restart;
-}
+        GDBusConnection *connection;
+        GVariant        *reply;
+        GError          *error;
+        char            *session_id;
+        char            *session_type;
 
-gboolean
-gsm_consolekit_can_stop (GsmConsolekit *manager)
-{
-        gboolean res;
-        gboolean can_stop;
-        GError  *error;
-        GsmConsolekitPrivate *priv;
+        session_id = NULL;
+        session_type = NULL;
 
         error = NULL;
-        priv = gsm_consolekit_get_instance_private (manager);
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
-                g_error_free (error);
-                return FALSE;
-        }
-
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "CanStop",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_INVALID,
-                                              G_TYPE_BOOLEAN, &can_stop,
-                                              G_TYPE_INVALID);
-
-        if (res == FALSE) {
-                g_warning ("Could not make DBUS call: %s",
-                           error->message);
-                g_error_free (error);
-                return FALSE;
-        }
-
-        return can_stop;
-}
-
-gboolean
-gsm_consolekit_can_suspend (GsmConsolekit *manager)
-{
-        gboolean res;
-        gboolean can_suspend;
-        gchar *retval;
-        GError *error = NULL;
-        GsmConsolekitPrivate *priv;
-
-        priv = gsm_consolekit_get_instance_private (manager);
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
+        connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+        if (connection == NULL) {
+                g_warning ("Could not connect to ConsoleKit: %s", error->message);
                 g_error_free (error);
-                return FALSE;
-        }
-
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "CanSuspend",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_INVALID,
-                                              G_TYPE_STRING, &retval,
-                                              G_TYPE_INVALID);
-
-        if (res == FALSE) {
-                g_warning ("Could not make DBUS call: %s",
-                           error->message);
-                g_error_free (error);
-                return FALSE;
+                return NULL;
+        }
+
+        reply = g_dbus_connection_call_sync (connection,
+                                             CK_NAME,
+                                             CK_MANAGER_PATH,
+                                             CK_MANAGER_INTERFACE,
+                                             "GetCurrentSession",
+                                             NULL,
+                                             G_VARIANT_TYPE ("(o)"),
+                                             G_DBUS_CALL_FLAGS_NONE,
+                                             CK_SESSION_TYPE_TIMEOUT,
+                                             NULL,
+                                             &error);
+        if (reply == NULL) {
+                goto out;
         }
 
-        can_suspend = g_strcmp0 (retval, "yes") == 0 ||
-                      g_strcmp0 (retval, "challenge") == 0;
-
-        g_free (retval);
-        return can_suspend;
-}
-
-gboolean
-gsm_consolekit_can_hibernate (GsmConsolekit *manager)
-{
-        gboolean res;
-        gboolean can_hibernate;
-        gchar *retval;
-        GError *error = NULL;
-        GsmConsolekitPrivate *priv;
-
-        priv = gsm_consolekit_get_instance_private (manager);
-
-        if (!gsm_consolekit_ensure_ck_connection (manager, &error)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           error->message);
-                g_error_free (error);
-                return FALSE;
+        g_variant_get (reply, "(o)", &session_id);
+        g_variant_unref (reply);
+
+        reply = g_dbus_connection_call_sync (connection,
+                                             CK_NAME,
+                                             session_id,
+                                             CK_SESSION_INTERFACE,
+                                             "GetSessionType",
+                                             NULL,
+                                             G_VARIANT_TYPE ("(s)"),
+                                             G_DBUS_CALL_FLAGS_NONE,
+                                             CK_SESSION_TYPE_TIMEOUT,
+                                             NULL,
+                                             &error);
+        if (reply == NULL) {
+                goto out;
         }
 
-        res = dbus_g_proxy_call_with_timeout (priv->ck_proxy,
-                                              "CanHibernate",
-                                              INT_MAX,
-                                              &error,
-                                              G_TYPE_INVALID,
-                                              G_TYPE_STRING, &retval,
-                                              G_TYPE_INVALID);
+        g_variant_get (reply, "(s)", &session_type);
+        g_variant_unref (reply);
 
-        if (res == FALSE) {
-                g_warning ("Could not make DBUS call: %s",
-                           error->message);
+ out:
+        if (error != NULL) {
+                g_warning ("Unable to determine session type: %s", error->message);
                 g_error_free (error);
-                return FALSE;
         }
+        g_free (session_id);
+        g_object_unref (connection);
 
-        can_hibernate = g_strcmp0 (retval, "yes") == 0 ||
-                        g_strcmp0 (retval, "challenge") == 0;
-
-        g_free (retval);
-        return can_hibernate;
+        return session_type;
 }
 
 gchar *
 gsm_consolekit_get_current_session_type (GsmConsolekit *manager)
 {
-        GError *gerror;
-        DBusConnection *connection;
-        DBusError error;
-        DBusMessage *message = NULL;
-        DBusMessage *reply = NULL;
-        gchar *session_id;
-        gchar *ret;
-        DBusMessageIter iter;
-        const char *value;
         GsmConsolekitPrivate *priv;
 
-        session_id = NULL;
-        ret = NULL;
-        gerror = NULL;
         priv = gsm_consolekit_get_instance_private (manager);
 
-        if (!gsm_consolekit_ensure_ck_connection (manager, &gerror)) {
-                g_warning ("Could not connect to ConsoleKit: %s",
-                           gerror->message);
-                g_error_free (gerror);
-                goto out;
-        }
-
-        connection = dbus_g_connection_get_connection (priv->dbus_connection);
-        if (!get_current_session_id (connection, &session_id)) {
-                goto out;
+        /* Asked before the asynchronous set up got there; read it once,
+         * with a short timeout, rather than guess */
+        if (priv->session_type == NULL && !priv->session_type_fetched) {
+                priv->session_type_fetched = TRUE;
+                priv->session_type = fetch_session_type ();
         }
 
-        dbus_error_init (&error);
-        message = dbus_message_new_method_call (CK_NAME,
-                                                session_id,
-                                                CK_SESSION_INTERFACE,
-                                                "GetSessionType");
-        if (message == NULL) {
-                goto out;
-        }
-
-        reply = dbus_connection_send_with_reply_and_block (connection,
-                                                           message,
-                                                           -1,
-                                                           &error);
-
-        if (reply == NULL) {
-                if (dbus_error_is_set (&error)) {
-                        g_warning ("Unable to determine session type: %s", error.message);
-                        dbus_error_free (&error);
-                }
-                goto out;
-        }
-
-        dbus_message_iter_init (reply, &iter);
-        dbus_message_iter_get_basic (&iter, &value);
-        ret = g_strdup (value);
-
-out:
-        if (message != NULL) {
-                dbus_message_unref (message);
-        }
-        if (reply != NULL) {
-                dbus_message_unref (reply);
-        }
-        g_free (session_id);
-
-        return ret;
+        return g_strdup (priv->session_type);
 }
 
-
 GsmConsolekit *
 gsm_get_consolekit (void)
 {
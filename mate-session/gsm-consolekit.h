@@ -60,20 +60,10 @@ GQuark           gsm_consolekit_error_quark     (void);
 
 GsmConsolekit   *gsm_consolekit_new             (void) G_GNUC_MALLOC;
 
-gboolean         gsm_consolekit_can_switch_user (GsmConsolekit *manager);
-
 gboolean         gsm_consolekit_get_restart_privileges (GsmConsolekit *manager);
 
 gboolean         gsm_consolekit_get_stop_privileges    (GsmConsolekit *manager);
 
-gboolean         gsm_consolekit_can_stop        (GsmConsolekit *manager);
-
-gboolean         gsm_consolekit_can_restart     (GsmConsolekit *manager);
-
-gboolean         gsm_consolekit_can_suspend     (GsmConsolekit *manager);
-
-gboolean         gsm_consolekit_can_hibernate   (GsmConsolekit *manager);
-
 void             gsm_consolekit_attempt_stop    (GsmConsolekit *manager);
 
 void             gsm_consolekit_attempt_restart (GsmConsolekit *manager);
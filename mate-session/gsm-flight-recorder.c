@@ -0,0 +1,250 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gsm-flight-recorder.h"
+
+/* The flight recorder keeps the last few hundred interesting events
+ * (phase changes, clients and inhibitors coming and going, end-session
+ * responses) in a fixed array, whether or not debugging is enabled.
+ * Recording an event is a couple of stores; the ring is only turned
+ * into text when it is dumped, on a crash or on SIGUSR1/SIGUSR2.
+ *
+ * Dumping may happen from a signal handler, so it only uses
+ * async-signal-safe calls and formats numbers by hand.
+ */
+
+#define FLIGHT_RECORDER_SIZE     512 /* must be a power of two */
+#define FLIGHT_RECORDER_MASK     (FLIGHT_RECORDER_SIZE - 1)
+#define FLIGHT_RECORDER_TEXT_LEN 80
+
+typedef struct {
+        guint   sequence;
+        guint16 event;
+        gint32  arg;
+        gint64  time;
+        char    text[FLIGHT_RECORDER_TEXT_LEN];
+} FlightRecord;
+
+static FlightRecord records[FLIGHT_RECORDER_SIZE];
+static guint        next_sequence = 0;
+static char        *dump_path = NULL;
+
+static const char *event_names[GSM_FLIGHT_EVENT_LAST] = {
+        "phase",
+        "client-added",
+        "client-removed",
+        "inhibitor-added",
+        "inhibitor-removed",
+        "query-end-session",
+        "end-session-response",
+        "logout-request",
+        "signal"
+};
+
+void
+gsm_flight_recorder_init (void)
+{
+        char *dir;
+
+        if (dump_path != NULL) {
+                return;
+        }
+
+        dir = g_build_filename (g_get_user_cache_dir (), "mate-session", NULL);
+        g_mkdir_with_parents (dir, 0700);
+        dump_path = g_build_filename (dir, "flight-recorder.log", NULL);
+        g_free (dir);
+}
+
+void
+gsm_flight_recorder_record (GsmFlightEvent  event,
+                            int             arg,
+                            const char     *text)
+{
+        FlightRecord *record;
+        guint         sequence;
+
+        sequence = (guint) g_atomic_int_add (&next_sequence, 1);
+        record = &records[sequence & FLIGHT_RECORDER_MASK];
+
+        /* 0 marks the slot as being written */
+        g_atomic_int_set (&record->sequence, 0);
+        record->event = event;
+        record->arg = arg;
+        record->time = g_get_monotonic_time ();
+        if (text != NULL) {
+                g_strlcpy (record->text, text, sizeof (record->text));
+        } else {
+                record->text[0] = '\0';
+        }
+        g_atomic_int_set (&record->sequence, sequence + 1);
+}
+
+typedef struct {
+        char  data[256];
+        gsize len;
+} LineBuffer;
+
+static void
+line_append (LineBuffer *line,
+             const char *str)
+{
+        while (*str != '\0' && line->len < sizeof (line->data) - 1) {
+                line->data[line->len++] = *str++;
+        }
+}
+
+static void
+line_append_uint (LineBuffer *line,
+                  guint64     value,
+                  int         min_digits)
+{
+        char digits[24];
+        int  n = 0;
+
+        do {
+                digits[n++] = '0' + (value % 10);
+                value /= 10;
+        } while (value > 0 || n < min_digits);
+
+        while (n > 0 && line->len < sizeof (line->data) - 1) {
+                line->data[line->len++] = digits[--n];
+        }
+}
+
+static void
+line_append_int (LineBuffer *line,
+                 gint64      value)
+{
+        if (value < 0) {
+                line_append (line, "-");
+                line_append_uint (line, (guint64) -value, 1);
+        } else {
+                line_append_uint (line, (guint64) value, 1);
+        }
+}
+
+static gboolean
+line_write (int         fd,
+            LineBuffer *line)
+{
+        gsize written = 0;
+
+        line->data[line->len++] = '\n';
+        while (written < line->len) {
+                ssize_t res;
+
+                res = write (fd, line->data + written, line->len - written);
+                if (res <= 0) {
+                        return FALSE;
+                }
+                written += res;
+        }
+        line->len = 0;
+
+        return TRUE;
+}
+
+/* Writes the recorded events, oldest first, to
+ * ~/.cache/mate-session/flight-recorder.log.  Safe to call from a
+ * signal handler.
+ */
+gboolean
+gsm_flight_recorder_dump (int signal_number)
+{
+        LineBuffer      line;
+        struct timespec now;
+        guint           last;
+        guint           first;
+        guint           i;
+        int             fd;
+
+        if (dump_path == NULL) {
+                return FALSE;
+        }
+
+        fd = open (dump_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd == -1) {
+                return FALSE;
+        }
+
+        clock_gettime (CLOCK_MONOTONIC, &now);
+
+        line.len = 0;
+        line_append (&line, "mate-session flight recorder, pid ");
+        line_append_uint (&line, getpid (), 1);
+        line_append (&line, ", signal ");
+        line_append_int (&line, signal_number);
+        line_append (&line, ", now ");
+        line_append_uint (&line, now.tv_sec, 1);
+        line_append (&line, ".");
+        line_append_uint (&line, now.tv_nsec / 1000, 6);
+        line_write (fd, &line);
+
+        last = (guint) g_atomic_int_get (&next_sequence);
+        first = last > FLIGHT_RECORDER_SIZE ? last - FLIGHT_RECORDER_SIZE : 0;
+
+        for (i = first; i != last; i++) {
+                FlightRecord *record = &records[i & FLIGHT_RECORDER_MASK];
+                char          text[FLIGHT_RECORDER_TEXT_LEN];
+                guint16       event;
+                gint32        arg;
+                gint64        time;
+
+                event = record->event;
+                arg = record->arg;
+                time = record->time;
+                memcpy (text, record->text, sizeof (text));
+                text[sizeof (text) - 1] = '\0';
+
+                /* skip slots that were overwritten or are being written */
+                if ((guint) g_atomic_int_get (&record->sequence) != i + 1) {
+                        continue;
+                }
+
+                line_append_uint (&line, time / G_USEC_PER_SEC, 1);
+                line_append (&line, ".");
+                line_append_uint (&line, time % G_USEC_PER_SEC, 6);
+                line_append (&line, " ");
+                line_append (&line, event < GSM_FLIGHT_EVENT_LAST ? event_names[event] : "?");
+                line_append (&line, " ");
+                line_append_int (&line, arg);
+                if (text[0] != '\0') {
+                        line_append (&line, " ");
+                        line_append (&line, text);
+                }
+
+                if (!line_write (fd, &line)) {
+                        break;
+                }
+        }
+
+        close (fd);
+
+        return TRUE;
+}
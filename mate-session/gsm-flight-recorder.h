@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __GSM_FLIGHT_RECORDER_H__
+#define __GSM_FLIGHT_RECORDER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+        GSM_FLIGHT_EVENT_PHASE = 0,
+        GSM_FLIGHT_EVENT_CLIENT_ADDED,
+        GSM_FLIGHT_EVENT_CLIENT_REMOVED,
+        GSM_FLIGHT_EVENT_INHIBITOR_ADDED,
+        GSM_FLIGHT_EVENT_INHIBITOR_REMOVED,
+        GSM_FLIGHT_EVENT_QUERY_END_SESSION,
+        GSM_FLIGHT_EVENT_END_SESSION_RESPONSE,
+        GSM_FLIGHT_EVENT_LOGOUT_REQUEST,
+        GSM_FLIGHT_EVENT_SIGNAL,
+        GSM_FLIGHT_EVENT_LAST
+} GsmFlightEvent;
+
+void     gsm_flight_recorder_init   (void);
+void     gsm_flight_recorder_record (GsmFlightEvent  event,
+                                     int             arg,
+                                     const char     *text);
+gboolean gsm_flight_recorder_dump   (int             signal_number);
+
+G_END_DECLS
+
+#endif /* __GSM_FLIGHT_RECORDER_H__ */
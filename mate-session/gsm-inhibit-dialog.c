@@ -700,6 +700,52 @@ on_store_inhibitor_removed (GsmStore          *store,
         }
 }
 
+static void
+on_store_inhibitor_items_changed (GsmStore           *store,
+                                  const char * const *added,
+                                  const char * const *removed,
+                                  GsmInhibitDialog   *dialog)
+{
+        GtkTreeIter   iter;
+        gboolean      changed;
+        int           i;
+
+        g_debug ("GsmInhibitDialog: inhibitors changed");
+
+        if (dialog->is_done) {
+                return;
+        }
+
+        changed = FALSE;
+
+        for (i = 0; removed[i] != NULL; i++) {
+                if (find_inhibitor (dialog, removed[i], &iter)) {
+                        gtk_list_store_remove (dialog->list_store, &iter);
+                        changed = TRUE;
+                }
+        }
+
+        for (i = 0; added[i] != NULL; i++) {
+                GsmInhibitor *inhibitor;
+
+                inhibitor = (GsmInhibitor *)gsm_store_lookup (store, added[i]);
+                if (inhibitor != NULL && ! find_inhibitor (dialog, added[i], &iter)) {
+                        add_inhibitor (dialog, inhibitor);
+                        changed = TRUE;
+                }
+        }
+
+        if (changed) {
+                update_dialog_text (dialog);
+        }
+
+        /* if there are no inhibitors left then trigger response */
+        if (removed[0] != NULL
+            && ! gtk_tree_model_get_iter_first (GTK_TREE_MODEL (dialog->list_store), &iter)) {
+                gtk_dialog_response (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT);
+        }
+}
+
 static void
 gsm_inhibit_dialog_set_inhibitor_store (GsmInhibitDialog *dialog,
                                         GsmStore         *store)
@@ -717,6 +763,9 @@ gsm_inhibit_dialog_set_inhibitor_store (GsmInhibitDialog *dialog,
                 g_signal_handlers_disconnect_by_func (dialog->inhibitors,
                                                       on_store_inhibitor_removed,
                                                       dialog);
+                g_signal_handlers_disconnect_by_func (dialog->inhibitors,
+                                                      on_store_inhibitor_items_changed,
+                                                      dialog);
 
                 g_object_unref (dialog->inhibitors);
         }
@@ -735,6 +784,10 @@ gsm_inhibit_dialog_set_inhibitor_store (GsmInhibitDialog *dialog,
                                   "removed",
                                   G_CALLBACK (on_store_inhibitor_removed),
                                   dialog);
+                g_signal_connect (dialog->inhibitors,
+                                  "items-changed",
+                                  G_CALLBACK (on_store_inhibitor_items_changed),
+                                  dialog);
         }
 }
 
@@ -1001,6 +1054,9 @@ gsm_inhibit_dialog_dispose (GObject *object)
                 g_signal_handlers_disconnect_by_func (dialog->inhibitors,
                                                       on_store_inhibitor_removed,
                                                       dialog);
+                g_signal_handlers_disconnect_by_func (dialog->inhibitors,
+                                                      on_store_inhibitor_items_changed,
+                                                      dialog);
 
                 g_object_unref (dialog->inhibitors);
                 dialog->inhibitors = NULL;
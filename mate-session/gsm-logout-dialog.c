@@ -32,7 +32,7 @@
 #include "gsm-systemd.h"
 #endif
 #include "gsm-consolekit.h"
-#include "mdm.h"
+#include "gsm-capabilities.h"
 #include "gsm-util.h"
 
 #define GSM_ICON_LOGOUT   "system-log-out"
@@ -53,10 +53,7 @@ struct _GsmLogoutDialog
 {
         GtkDialog            parent;
         GsmDialogLogoutType  type;
-#ifdef HAVE_SYSTEMD
-        GsmSystemd          *systemd;
-#endif
-        GsmConsolekit       *consolekit;
+        GsmCapabilities     *capabilities;
 
         GtkWidget           *primary_label;
         GtkWidget           *secondary_label;
@@ -112,12 +109,8 @@ gsm_logout_dialog_init (GsmLogoutDialog *logout_dialog)
         gtk_window_set_skip_taskbar_hint (GTK_WINDOW (logout_dialog), TRUE);
         gtk_window_set_keep_above (GTK_WINDOW (logout_dialog), TRUE);
         gtk_window_stick (GTK_WINDOW (logout_dialog));
-#ifdef HAVE_SYSTEMD
-        if (LOGIND_RUNNING())
-            logout_dialog->systemd = gsm_get_systemd ();
-        else
-#endif
-        logout_dialog->consolekit = gsm_get_consolekit ();
+
+        logout_dialog->capabilities = gsm_get_capabilities ();
 
         g_signal_connect (logout_dialog,
                           "destroy",
@@ -138,16 +131,9 @@ gsm_logout_dialog_destroy (GsmLogoutDialog *logout_dialog,
                 g_source_remove (logout_dialog->timeout_id);
                 logout_dialog->timeout_id = 0;
         }
-#ifdef HAVE_SYSTEMD
-        if (logout_dialog->systemd) {
-                g_object_unref (logout_dialog->systemd);
-                logout_dialog->systemd = NULL;
-        }
-#endif
-
-        if (logout_dialog->consolekit) {
-                g_object_unref (logout_dialog->consolekit);
-                logout_dialog->consolekit = NULL;
+        if (logout_dialog->capabilities) {
+                g_object_unref (logout_dialog->capabilities);
+                logout_dialog->capabilities = NULL;
         }
 
         current_dialog = NULL;
@@ -156,29 +142,15 @@ gsm_logout_dialog_destroy (GsmLogoutDialog *logout_dialog,
 static gboolean
 gsm_logout_supports_system_suspend (GsmLogoutDialog *logout_dialog)
 {
-        gboolean ret;
-        ret = FALSE;
-#ifdef HAVE_SYSTEMD
-        if (LOGIND_RUNNING())
-            ret = gsm_systemd_can_suspend (logout_dialog->systemd);
-        else
-#endif
-        ret = gsm_consolekit_can_suspend (logout_dialog->consolekit);
-        return ret;
+        return gsm_capabilities_get (logout_dialog->capabilities,
+                                     GSM_CAPABILITY_SUSPEND);
 }
 
 static gboolean
 gsm_logout_supports_system_hibernate (GsmLogoutDialog *logout_dialog)
 {
-        gboolean ret;
-        ret = FALSE;
-#ifdef HAVE_SYSTEMD
-        if (LOGIND_RUNNING())
-            ret = gsm_systemd_can_hibernate (logout_dialog->systemd);
-        else
-#endif
-        ret = gsm_consolekit_can_hibernate (logout_dialog->consolekit);
-        return ret;
+        return gsm_capabilities_get (logout_dialog->capabilities,
+                                     GSM_CAPABILITY_HIBERNATE);
 }
 
 static gboolean
@@ -194,12 +166,8 @@ gsm_logout_supports_switch_user (GsmLogoutDialog *logout_dialog)
         g_object_unref (settings);
 
         if (!locked) {
-#ifdef HAVE_SYSTEMD
-            if (LOGIND_RUNNING())
-                ret = gsm_systemd_can_switch_user (logout_dialog->systemd);
-            else
-#endif
-            ret = gsm_consolekit_can_switch_user (logout_dialog->consolekit);
+                ret = gsm_capabilities_get (logout_dialog->capabilities,
+                                            GSM_CAPABILITY_SWITCH_USER);
         }
 
         return ret;
@@ -208,38 +176,15 @@ gsm_logout_supports_switch_user (GsmLogoutDialog *logout_dialog)
 static gboolean
 gsm_logout_supports_reboot (GsmLogoutDialog *logout_dialog)
 {
-        gboolean ret;
-
-#ifdef HAVE_SYSTEMD
-        if (LOGIND_RUNNING())
-            ret = gsm_systemd_can_restart (logout_dialog->systemd);
-        else
-#endif
-        ret = gsm_consolekit_can_restart (logout_dialog->consolekit);
-        if (!ret) {
-                ret = mdm_supports_logout_action (MDM_LOGOUT_ACTION_REBOOT);
-        }
-
-        return ret;
+        return gsm_capabilities_get (logout_dialog->capabilities,
+                                     GSM_CAPABILITY_REBOOT);
 }
 
 static gboolean
 gsm_logout_supports_shutdown (GsmLogoutDialog *logout_dialog)
 {
-        gboolean ret;
-
-#ifdef HAVE_SYSTEMD
-        if (LOGIND_RUNNING())
-            ret = gsm_systemd_can_stop (logout_dialog->systemd);
-        else
-#endif
-        ret = gsm_consolekit_can_stop (logout_dialog->consolekit);
-
-        if (!ret) {
-                ret = mdm_supports_logout_action (MDM_LOGOUT_ACTION_SHUTDOWN);
-        }
-
-        return ret;
+        return gsm_capabilities_get (logout_dialog->capabilities,
+                                     GSM_CAPABILITY_SHUTDOWN);
 }
 
 static void
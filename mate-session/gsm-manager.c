@@ -48,6 +48,10 @@
 #include "gsm-store.h"
 #include "gsm-inhibitor.h"
 #include "gsm-presence.h"
+#include "mdm-log.h"
+#include "gsm-flight-recorder.h"
+#include "gsm-prefetch.h"
+#include "gsm-app-history.h"
 
 #include "gsm-xsmp-client.h"
 #include "gsm-dbus-client.h"
@@ -63,6 +67,7 @@
 #include "gsm-systemd.h"
 #endif
 #include "gsm-session-save.h"
+#include "gsm-capabilities.h"
 
 #define GSM_MANAGER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GSM_TYPE_MANAGER, GsmManagerPrivate))
 
@@ -71,11 +76,35 @@
 
 #define GSM_MANAGER_PHASE_TIMEOUT 30 /* seconds */
 
+/* Once an app has registered in enough past logins, it is only waited
+ * for until well past its usual 95th percentile; it can still register
+ * after the phase has moved on */
+#define GSM_MANAGER_DEADLINE_MIN_SAMPLES 3
+#define GSM_MANAGER_DEADLINE_MIN         2000 /* milliseconds */
+#define GSM_MANAGER_DEADLINE_SLACK       1000 /* milliseconds */
+
 /* In the exit phase, all apps were already given the chance to inhibit the session end
  * At that stage we don't want to wait much for apps to respond, we want to exit, and fast.
  */
 #define GSM_MANAGER_EXIT_PHASE_TIMEOUT 1 /* seconds */
 
+/* Spawned apps get SIGKILL after their own stop timeout (at most 10
+ * seconds), so this only guards against apps that never report back */
+#define GSM_MANAGER_EXIT_APPS_TIMEOUT 12 /* seconds */
+
+/* The application phase doesn't wait for its apps, so the session is
+ * "running" as soon as they are spawned; keep them demoted while they
+ * start up */
+#define GSM_MANAGER_UNDEMOTE_DELAY 10 /* seconds */
+
+/* X-MATE-Autostart-Delay is only a minimum: past it, delayed apps are
+ * started one at a time, and only while the CPU and I/O pressure (the
+ * share of the last 10 seconds in which some task was stalled) are low,
+ * or once they have waited long enough anyway */
+#define GSM_MANAGER_DELAYED_START_INTERVAL 1    /* seconds */
+#define GSM_MANAGER_DELAYED_START_MAX_WAIT 30   /* seconds */
+#define GSM_MANAGER_PRESSURE_THRESHOLD     10.0 /* percent */
+
 #define MDM_FLEXISERVER_COMMAND "mdmflexiserver"
 #define MDM_FLEXISERVER_ARGS    "--startnew Standard"
 
@@ -91,6 +120,8 @@
 #define SESSION_SCHEMA               "org.mate.session"
 #define KEY_IDLE_DELAY               "idle-delay"
 #define KEY_AUTOSAVE                 "auto-save-session"
+#define KEY_DEMOTE_STARTUP_APPS      "demote-startup-apps"
+#define KEY_ORDER_STARTUP_APPS       "order-startup-apps"
 
 #define SCREENSAVER_SCHEMA           "org.mate.screensaver"
 #define KEY_SLEEP_LOCK               "lock-enabled"
@@ -123,7 +154,15 @@ typedef struct {
         /* Current status */
         GsmManagerPhase         phase;
         guint                   phase_timeout_id;
+        gint64                  phase_start;
+        guint                   undemote_id;
         GSList                 *pending_apps;
+        /* DelayedStart, earliest first */
+        GSList                 *delayed_starts;
+        guint                   delayed_start_id;
+        gint64                  delayed_start_last;
+        /* GsmApp -> start time of apps whose registration is timed */
+        GHashTable             *app_start_times;
         GsmManagerLogoutMode    logout_mode;
         GSList                 *query_clients;
         guint                   query_timeout_id;
@@ -233,7 +272,8 @@ _debug_client (const char *id,
                GsmClient  *client,
                GsmManager *manager)
 {
-        g_debug ("GsmManager: Client %s", gsm_client_peek_id (client));
+        mdm_log_debug_for ("GsmManager", gsm_client_peek_id (client), NULL,
+                           "Client %s", gsm_client_peek_id (client));
         return FALSE;
 }
 
@@ -321,7 +361,8 @@ app_condition_changed (GsmApp     *app,
                         GError  *error = NULL;
                         gboolean UNUSED_VARIABLE res;
 
-                        g_debug ("GsmManager: starting app '%s'", gsm_app_peek_id (app));
+                        mdm_log_debug_for ("GsmManager", NULL, gsm_app_peek_id (app),
+                                           "starting app '%s'", gsm_app_peek_id (app));
 
                         res = gsm_app_start (app, &error);
                         if (error != NULL) {
@@ -330,7 +371,8 @@ app_condition_changed (GsmApp     *app,
                                 g_error_free (error);
                         }
                 } else {
-                        g_debug ("GsmManager: not starting - app still running '%s'", gsm_app_peek_id (app));
+                        mdm_log_debug_for ("GsmManager", NULL, gsm_app_peek_id (app),
+                                           "not starting - app still running '%s'", gsm_app_peek_id (app));
                 }
         } else {
                 GError  *error;
@@ -343,7 +385,8 @@ app_condition_changed (GsmApp     *app,
                         priv->condition_clients =
                                 g_slist_prepend (priv->condition_clients, client);
 
-                        g_debug ("GsmManager: stopping client %s for app", gsm_client_peek_id (client));
+                        mdm_log_debug_for ("GsmManager", gsm_client_peek_id (client), gsm_app_peek_id (app),
+                                           "stopping client %s for app", gsm_client_peek_id (client));
 
                         error = NULL;
                         res = gsm_client_stop (client, &error);
@@ -353,7 +396,8 @@ app_condition_changed (GsmApp     *app,
                                 g_error_free (error);
                         }
                 } else {
-                        g_debug ("GsmManager: stopping app %s", gsm_app_peek_id (app));
+                        mdm_log_debug_for ("GsmManager", NULL, gsm_app_peek_id (app),
+                                           "stopping app %s", gsm_app_peek_id (app));
 
                         /* If we don't have a client then we should try to kill the app,
                          * if it is running */
@@ -531,10 +575,14 @@ gsm_manager_quit (GsmManager *manager)
         }
 }
 
+static void app_registered (GsmApp     *app,
+                            GsmManager *manager);
+
 static void
 end_phase (GsmManager *manager)
 {
         GsmManagerPrivate *priv;
+        GSList *l;
         gboolean start_next_phase = TRUE;
 
         priv = gsm_manager_get_instance_private (manager);
@@ -542,6 +590,9 @@ end_phase (GsmManager *manager)
         g_debug ("GsmManager: ending phase %s\n",
                  phase_num_to_name (priv->phase));
 
+        for (l = priv->pending_apps; l != NULL; l = l->next) {
+                g_signal_handlers_disconnect_by_func (l->data, app_registered, manager);
+        }
         g_slist_free (priv->pending_apps);
         priv->pending_apps = NULL;
 
@@ -611,10 +662,57 @@ app_registered (GsmApp     *app,
         }
 }
 
+/* milliseconds after the start of the phase */
+static guint
+get_registration_deadline (GsmApp *app)
+{
+        guint n_samples;
+        guint p50;
+        guint p95;
+        guint deadline;
+
+        deadline = GSM_MANAGER_PHASE_TIMEOUT * 1000;
+
+        if (gsm_app_history_get_latency (gsm_app_peek_app_id (app), &n_samples, &p50, &p95)
+            && n_samples >= GSM_MANAGER_DEADLINE_MIN_SAMPLES) {
+                deadline = CLAMP (MIN (p95, deadline) * 2 + GSM_MANAGER_DEADLINE_SLACK,
+                                  GSM_MANAGER_DEADLINE_MIN,
+                                  deadline);
+        }
+
+        return deadline;
+}
+
+static gboolean on_phase_timeout (GsmManager *manager);
+
+static void
+schedule_phase_timeout (GsmManager *manager)
+{
+        GsmManagerPrivate *priv;
+        GSList *a;
+        guint   deadline;
+        gint64  elapsed;
+
+        priv = gsm_manager_get_instance_private (manager);
+
+        deadline = G_MAXUINT;
+        for (a = priv->pending_apps; a; a = a->next) {
+                deadline = MIN (deadline, get_registration_deadline (a->data));
+        }
+
+        elapsed = (g_get_monotonic_time () - priv->phase_start) / 1000;
+
+        priv->phase_timeout_id = g_timeout_add (deadline > elapsed ? deadline - elapsed : 0,
+                                                (GSourceFunc)on_phase_timeout,
+                                                manager);
+}
+
 static gboolean
 on_phase_timeout (GsmManager *manager)
 {
         GSList *a;
+        GSList *next;
+        gint64  elapsed;
         GsmManagerPrivate *priv;
 
         priv = gsm_manager_get_instance_private (manager);
@@ -627,12 +725,26 @@ on_phase_timeout (GsmManager *manager)
         case GSM_MANAGER_PHASE_PANEL:
         case GSM_MANAGER_PHASE_DESKTOP:
         case GSM_MANAGER_PHASE_APPLICATION:
-                for (a = priv->pending_apps; a; a = a->next) {
+                elapsed = (g_get_monotonic_time () - priv->phase_start) / 1000;
+
+                for (a = priv->pending_apps; a; a = next) {
+                        next = a->next;
+
+                        if (get_registration_deadline (a->data) > elapsed) {
+                                continue;
+                        }
+
                         g_warning ("Application '%s' failed to register before timeout",
                                    gsm_app_peek_app_id (a->data));
                         g_signal_handlers_disconnect_by_func (a->data, app_registered, manager);
+                        priv->pending_apps = g_slist_delete_link (priv->pending_apps, a);
                         /* FIXME: what if the app was filling in a required slot? */
                 }
+
+                if (priv->pending_apps != NULL) {
+                        schedule_phase_timeout (manager);
+                        return FALSE;
+                }
                 break;
         case GSM_MANAGER_PHASE_RUNNING:
                 break;
@@ -640,6 +752,11 @@ on_phase_timeout (GsmManager *manager)
         case GSM_MANAGER_PHASE_END_SESSION:
                 break;
         case GSM_MANAGER_PHASE_EXIT:
+                for (a = priv->pending_apps; a; a = a->next) {
+                        g_warning ("Application '%s' did not exit before timeout",
+                                   gsm_app_peek_app_id (a->data));
+                        g_signal_handlers_disconnect_by_func (a->data, app_registered, manager);
+                }
                 break;
         default:
                 g_assert_not_reached ();
@@ -651,6 +768,157 @@ on_phase_timeout (GsmManager *manager)
         return FALSE;
 }
 
+typedef struct {
+        GsmApp *app;
+        gint64  not_before;
+} DelayedStart;
+
+static int
+compare_delayed_start (gconstpointer a,
+                       gconstpointer b)
+{
+        const DelayedStart *da = a;
+        const DelayedStart *db = b;
+
+        return (da->not_before > db->not_before) - (da->not_before < db->not_before);
+}
+
+/* "some avg10=1.23 avg60=..." in /proc/pressure/<resource> */
+static double
+read_pressure (const char *resource)
+{
+        char   *path;
+        char   *contents;
+        char   *p;
+        double  pressure;
+
+        path = g_build_filename ("/proc/pressure", resource, NULL);
+        if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+                g_free (path);
+                return 0.0;
+        }
+        g_free (path);
+
+        pressure = 0.0;
+        p = strstr (contents, "some avg10=");
+        if (p != NULL) {
+                pressure = g_ascii_strtod (p + strlen ("some avg10="), NULL);
+        }
+        g_free (contents);
+
+        return pressure;
+}
+
+static gboolean on_delayed_start_timeout (GsmManager *manager);
+
+static void
+schedule_delayed_start (GsmManager *manager,
+                        gint64      earliest)
+{
+        GsmManagerPrivate *priv;
+        DelayedStart *next;
+        gint64        wait;
+
+        priv = gsm_manager_get_instance_private (manager);
+
+        if (priv->delayed_start_id > 0) {
+                g_source_remove (priv->delayed_start_id);
+                priv->delayed_start_id = 0;
+        }
+
+        if (priv->delayed_starts == NULL) {
+                return;
+        }
+
+        /* one at a time, however early the next one was due */
+        if (priv->delayed_start_last > 0) {
+                earliest = MAX (earliest,
+                                priv->delayed_start_last + GSM_MANAGER_DELAYED_START_INTERVAL * G_USEC_PER_SEC);
+        }
+
+        next = priv->delayed_starts->data;
+        wait = MAX (next->not_before, earliest) - g_get_monotonic_time ();
+
+        priv->delayed_start_id = g_timeout_add (MAX (wait, 0) / 1000,
+                                                (GSourceFunc)on_delayed_start_timeout,
+                                                manager);
+}
+
+static gboolean _autostart_delay_timeout (GsmApp *app);
+
+static gboolean
+on_delayed_start_timeout (GsmManager *manager)
+{
+        GsmManagerPrivate *priv;
+        DelayedStart *next;
+        gint64        now;
+        double        cpu;
+        double        io;
+
+        priv = gsm_manager_get_instance_private (manager);
+        priv->delayed_start_id = 0;
+
+        now = g_get_monotonic_time ();
+        next = priv->delayed_starts->data;
+
+        if (next->not_before > now) {
+                schedule_delayed_start (manager, 0);
+                return FALSE;
+        }
+
+        cpu = read_pressure ("cpu");
+        io = read_pressure ("io");
+
+        if ((cpu >= GSM_MANAGER_PRESSURE_THRESHOLD || io >= GSM_MANAGER_PRESSURE_THRESHOLD)
+            && now < next->not_before + GSM_MANAGER_DELAYED_START_MAX_WAIT * G_USEC_PER_SEC) {
+                g_debug ("GsmManager: holding back %s (cpu pressure %.1f%%, io pressure %.1f%%)",
+                         gsm_app_peek_app_id (next->app), cpu, io);
+                schedule_delayed_start (manager,
+                                        now + GSM_MANAGER_DELAYED_START_INTERVAL * G_USEC_PER_SEC);
+                return FALSE;
+        }
+
+        priv->delayed_starts = g_slist_delete_link (priv->delayed_starts,
+                                                    priv->delayed_starts);
+
+        g_debug ("GsmManager: starting delayed app %s after %" G_GINT64_FORMAT " ms past its delay",
+                 gsm_app_peek_app_id (next->app),
+                 (now - next->not_before) / 1000);
+        _autostart_delay_timeout (next->app);
+        g_free (next);
+
+        priv->delayed_start_last = now;
+        schedule_delayed_start (manager, 0);
+
+        return FALSE;
+}
+
+static void
+queue_delayed_start (GsmManager *manager,
+                     GsmApp     *app,
+                     int         delay)
+{
+        GsmManagerPrivate *priv;
+        DelayedStart *entry;
+
+        priv = gsm_manager_get_instance_private (manager);
+
+        entry = g_new0 (DelayedStart, 1);
+        entry->app = g_object_ref (app);
+        entry->not_before = g_get_monotonic_time () + delay * G_USEC_PER_SEC;
+
+        priv->delayed_starts = g_slist_insert_sorted (priv->delayed_starts,
+                                                      entry,
+                                                      compare_delayed_start);
+
+        /* an app due before the others moves the timer forward; the
+         * interval after the last start is still kept */
+        if (priv->delayed_start_id == 0
+            || priv->delayed_starts->data == entry) {
+                schedule_delayed_start (manager, 0);
+        }
+}
+
 static gboolean
 _autostart_delay_timeout (GsmApp *app)
 {
@@ -675,6 +943,41 @@ _autostart_delay_timeout (GsmApp *app)
         return FALSE;
 }
 
+static void
+forget_app_start_time (GsmApp     *app,
+                       GsmManager *manager);
+
+static void
+record_app_latency (GsmApp     *app,
+                    GsmManager *manager)
+{
+        GsmManagerPrivate *priv;
+        gint64 *start;
+
+        priv = gsm_manager_get_instance_private (manager);
+
+        start = g_hash_table_lookup (priv->app_start_times, app);
+        if (start != NULL) {
+                gsm_app_history_record_latency (gsm_app_peek_app_id (app),
+                                                (g_get_monotonic_time () - *start) / 1000);
+        }
+
+        forget_app_start_time (app, manager);
+}
+
+static void
+forget_app_start_time (GsmApp     *app,
+                       GsmManager *manager)
+{
+        GsmManagerPrivate *priv;
+
+        priv = gsm_manager_get_instance_private (manager);
+
+        g_signal_handlers_disconnect_by_func (app, record_app_latency, manager);
+        g_signal_handlers_disconnect_by_func (app, forget_app_start_time, manager);
+        g_hash_table_remove (priv->app_start_times, app);
+}
+
 static gboolean
 _start_app (const char *id,
             GsmApp     *app,
@@ -683,6 +986,8 @@ _start_app (const char *id,
         GError  *error;
         gboolean res;
         int      delay;
+        gint64   spawned;
+        gint64  *start;
         GsmManagerPrivate *priv;
 
         priv = gsm_manager_get_instance_private (manager);
@@ -706,13 +1011,20 @@ _start_app (const char *id,
 
         delay = gsm_app_peek_autostart_delay (app);
         if (delay > 0) {
-                g_timeout_add_seconds (delay,
-                                       (GSourceFunc)_autostart_delay_timeout,
-                                       g_object_ref (app));
+                queue_delayed_start (manager, app, delay);
                 g_debug ("GsmManager: %s is scheduled to start in %d seconds", id, delay);
                 goto out;
         }
 
+        if (priv->phase == GSM_MANAGER_PHASE_APPLICATION
+            && GSM_IS_AUTOSTART_APP (app)
+            && g_settings_get_boolean (priv->settings_session,
+                                       KEY_DEMOTE_STARTUP_APPS)) {
+                gsm_autostart_app_set_demoted (GSM_AUTOSTART_APP (app), TRUE);
+        }
+
+        spawned = g_get_monotonic_time ();
+
         error = NULL;
         res = gsm_app_start (app, &error);
         if (!res) {
@@ -736,26 +1048,150 @@ _start_app (const char *id,
                                   G_CALLBACK (app_registered),
                                   manager);
                 priv->pending_apps = g_slist_prepend (priv->pending_apps, app);
+
+                /* timed separately, since registering late still counts */
+                if (g_hash_table_lookup (priv->app_start_times, app) == NULL) {
+                        g_signal_connect (app,
+                                          "registered",
+                                          G_CALLBACK (record_app_latency),
+                                          manager);
+                        g_signal_connect (app,
+                                          "exited",
+                                          G_CALLBACK (forget_app_start_time),
+                                          manager);
+                }
+                /* from this app's own spawn, not from the phase start,
+                 * so the apps launched before it don't count */
+                start = g_new (gint64, 1);
+                *start = spawned;
+                g_hash_table_replace (priv->app_start_times, g_object_ref (app), start);
         }
  out:
         return FALSE;
 }
 
+static gboolean
+_undemote_app (const char *id,
+               GsmApp     *app,
+               gpointer    user_data)
+{
+        if (GSM_IS_AUTOSTART_APP (app)) {
+                gsm_autostart_app_set_demoted (GSM_AUTOSTART_APP (app), FALSE);
+        }
+        return FALSE;
+}
+
+static gboolean
+on_undemote_timeout (GsmManager *manager)
+{
+        GsmManagerPrivate *priv;
+
+        priv = gsm_manager_get_instance_private (manager);
+        priv->undemote_id = 0;
+
+        gsm_store_foreach (priv->apps,
+                           (GsmStoreFunc)_undemote_app,
+                           NULL);
+
+        return FALSE;
+}
+
+typedef struct {
+        GsmApp *app;
+        int     priority;
+        guint   latency;
+} LaunchOrder;
+
+typedef struct {
+        GArray *order;
+        int     phase;
+} LaunchOrderData;
+
+static gboolean
+_collect_launch_order (const char      *id,
+                       GsmApp          *app,
+                       LaunchOrderData *data)
+{
+        LaunchOrder  entry;
+        guint        n_samples;
+        guint        p95;
+
+        if (gsm_app_peek_phase (app) != data->phase) {
+                return FALSE;
+        }
+
+        entry.app = app;
+        entry.priority = gsm_app_peek_launch_priority (app);
+
+        /* an app never timed before might be the slowest of all, unless
+         * it was D-Bus activated already and we know how long that took */
+        if (! gsm_app_history_get_latency (gsm_app_peek_app_id (app),
+                                           &n_samples, &entry.latency, &p95)) {
+                entry.latency = G_MAXUINT;
+                if (GSM_IS_AUTOSTART_APP (app)
+                    && gsm_autostart_app_get_activation_latency (GSM_AUTOSTART_APP (app)) > 0) {
+                        entry.latency = gsm_autostart_app_get_activation_latency (GSM_AUTOSTART_APP (app));
+                }
+        }
+
+        g_array_append_val (data->order, entry);
+
+        return FALSE;
+}
+
+static int
+compare_launch_order (gconstpointer a,
+                      gconstpointer b)
+{
+        const LaunchOrder *la = a;
+        const LaunchOrder *lb = b;
+
+        if (la->priority != lb->priority) {
+                return (lb->priority > la->priority) - (lb->priority < la->priority);
+        }
+
+        return (lb->latency > la->latency) - (lb->latency < la->latency);
+}
+
 static void
 do_phase_startup (GsmManager *manager)
 {
         GsmManagerPrivate *priv;
+        LaunchOrderData    data;
+        GArray            *order;
+        guint              i;
 
         priv = gsm_manager_get_instance_private (manager);
+
+        /* The phase is held until its slowest app registers, so start
+         * the apps that took longest to register (median over past
+         * logins) first.  The store is a hash table, so without this
+         * the order is arbitrary.  Only this phase's apps are sorted;
+         * _start_app() would skip the others anyway. */
+        order = g_array_new (FALSE, FALSE, sizeof (LaunchOrder));
+        data.order = order;
+        data.phase = priv->phase;
         gsm_store_foreach (priv->apps,
-                           (GsmStoreFunc)_start_app,
-                           manager);
+                           (GsmStoreFunc)_collect_launch_order,
+                           &data);
+
+        if (! g_settings_get_boolean (priv->settings_session, KEY_ORDER_STARTUP_APPS)) {
+                for (i = 0; i < order->len; i++) {
+                        g_array_index (order, LaunchOrder, i).latency = 0;
+                }
+        }
+        g_array_sort (order, compare_launch_order);
+
+        for (i = 0; i < order->len; i++) {
+                GsmApp *app = g_array_index (order, LaunchOrder, i).app;
+
+                _start_app (gsm_app_peek_id (app), app, manager);
+        }
+        g_array_free (order, TRUE);
 
         if (priv->pending_apps != NULL) {
                 if (priv->phase < GSM_MANAGER_PHASE_APPLICATION) {
-                        priv->phase_timeout_id = g_timeout_add_seconds (GSM_MANAGER_PHASE_TIMEOUT,
-                                                                        (GSourceFunc)on_phase_timeout,
-                                                                        manager);
+                        schedule_phase_timeout (manager);
                 }
         } else {
                 end_phase (manager);
@@ -785,7 +1221,8 @@ _client_end_session (GsmClient            *client,
                 g_error_free (error);
                 /* FIXME: what should we do if we can't communicate with client? */
         } else {
-                g_debug ("GsmManager: adding client to end-session clients: %s", gsm_client_peek_id (client));
+                mdm_log_debug_for ("GsmManager", gsm_client_peek_id (client), NULL,
+                                   "adding client to end-session clients: %s", gsm_client_peek_id (client));
                 priv->query_clients = g_slist_prepend (priv->query_clients,
                                                        client);
         }
@@ -801,6 +1238,15 @@ _client_end_session_helper (const char           *id,
         return _client_end_session (client, data);
 }
 
+static gboolean
+_cancel_app_restart (const char *id,
+                     GsmApp     *app,
+                     gpointer    user_data)
+{
+        gsm_app_cancel_restart (app);
+        return FALSE;
+}
+
 static void
 do_phase_end_session (GsmManager *manager)
 {
@@ -818,6 +1264,12 @@ do_phase_end_session (GsmManager *manager)
                 data.flags |= GSM_CLIENT_END_SESSION_FLAG_SAVE;
         }
 
+        /* the logout can no longer be cancelled, so apps waiting out
+         * a restart backoff stay down */
+        gsm_store_foreach (priv->apps,
+                           (GsmStoreFunc)_cancel_app_restart,
+                           NULL);
+
         if (priv->phase_timeout_id > 0) {
                 g_source_remove (priv->phase_timeout_id);
                 priv->phase_timeout_id = 0;
@@ -884,7 +1336,8 @@ _client_stop (const char *id,
                 g_error_free (error);
                 /* FIXME: what should we do if we can't communicate with client? */
         } else {
-                g_debug ("GsmManager: stopped client: %s", gsm_client_peek_id (client));
+                mdm_log_debug_for ("GsmManager", gsm_client_peek_id (client), NULL,
+                                   "stopped client: %s", gsm_client_peek_id (client));
         }
 
         return FALSE;
@@ -935,6 +1388,42 @@ maybe_restart_user_bus (GsmManager *manager)
 }
 #endif
 
+static gboolean
+_app_stop_for_exit (const char *id,
+                    GsmApp     *app,
+                    GsmManager *manager)
+{
+        GsmManagerPrivate *priv;
+        GError            *error;
+
+        if (!gsm_app_is_running (app)) {
+                return FALSE;
+        }
+
+        priv = gsm_manager_get_instance_private (manager);
+
+        error = NULL;
+        if (!gsm_app_stop (app, &error)) {
+                g_debug ("GsmManager: unable to stop app %s: %s",
+                         gsm_app_peek_id (app),
+                         error->message);
+                g_error_free (error);
+                return FALSE;
+        }
+
+        priv->pending_apps = g_slist_prepend (priv->pending_apps, app);
+        g_signal_connect (app,
+                          "exited",
+                          G_CALLBACK (app_registered),
+                          manager);
+        g_signal_connect (app,
+                          "died",
+                          G_CALLBACK (app_registered),
+                          manager);
+
+        return FALSE;
+}
+
 static void
 do_phase_exit (GsmManager *manager)
 {
@@ -951,7 +1440,23 @@ do_phase_exit (GsmManager *manager)
         maybe_restart_user_bus (manager);
 #endif
 
-        end_phase (manager);
+        /* Terminate the apps we spawned that are still around, and
+         * wait for them; each gets SIGKILL after its stop timeout */
+        gsm_store_foreach (priv->apps,
+                           (GsmStoreFunc)_app_stop_for_exit,
+                           manager);
+
+        if (priv->pending_apps == NULL) {
+                end_phase (manager);
+                return;
+        }
+
+        g_debug ("GsmManager: waiting for %u apps to exit",
+                 g_slist_length (priv->pending_apps));
+
+        priv->phase_timeout_id = g_timeout_add_seconds (GSM_MANAGER_EXIT_APPS_TIMEOUT,
+                                                        (GSourceFunc)on_phase_timeout,
+                                                        manager);
 }
 
 static gboolean
@@ -972,7 +1477,11 @@ _client_query_end_session (const char           *id,
                 g_error_free (error);
                 /* FIXME: what should we do if we can't communicate with client? */
         } else {
-                g_debug ("GsmManager: adding client to query clients: %s", gsm_client_peek_id (client));
+                mdm_log_debug_for ("GsmManager", gsm_client_peek_id (client), NULL,
+                                   "adding client to query clients: %s", gsm_client_peek_id (client));
+                gsm_flight_recorder_record (GSM_FLIGHT_EVENT_QUERY_END_SESSION,
+                                            data->flags,
+                                            gsm_client_peek_id (client));
                 priv->query_clients = g_slist_prepend (priv->query_clients, client);
         }
 
@@ -1258,10 +1767,16 @@ manager_attempt_hibernate (GsmManager *manager)
         }
         else {
 #endif
-        GsmConsolekit *consolekit;
+        GsmConsolekit   *consolekit;
+        GsmCapabilities *capabilities;
+        gboolean         can_hibernate;
+
         consolekit = gsm_get_consolekit ();
 
-        gboolean can_hibernate = gsm_consolekit_can_hibernate (consolekit);
+        capabilities = gsm_get_capabilities ();
+        can_hibernate = gsm_capabilities_get (capabilities, GSM_CAPABILITY_HIBERNATE);
+        g_object_unref (capabilities);
+
         if (can_hibernate) {
                 /* lock the screen before we suspend */
                 manager_perhaps_lock (manager);
@@ -1290,10 +1805,16 @@ manager_attempt_suspend (GsmManager *manager)
         }
         else {
 #endif
-        GsmConsolekit *consolekit;
+        GsmConsolekit   *consolekit;
+        GsmCapabilities *capabilities;
+        gboolean         can_suspend;
+
         consolekit = gsm_get_consolekit ();
 
-        gboolean can_suspend = gsm_consolekit_can_suspend (consolekit);
+        capabilities = gsm_get_capabilities ();
+        can_suspend = gsm_capabilities_get (capabilities, GSM_CAPABILITY_SUSPEND);
+        g_object_unref (capabilities);
+
         if (can_suspend) {
                 /* lock the screen before we suspend */
                 manager_perhaps_lock (manager);
@@ -1577,10 +2098,15 @@ start_phase (GsmManager *manager)
 
         priv = gsm_manager_get_instance_private (manager);
 
+        mdm_log_set_phase (phase_num_to_name (priv->phase));
+        gsm_flight_recorder_record (GSM_FLIGHT_EVENT_PHASE,
+                                    priv->phase,
+                                    phase_num_to_name (priv->phase));
         g_debug ("GsmManager: starting phase %s\n",
                  phase_num_to_name (priv->phase));
 
         /* reset state */
+        priv->phase_start = g_get_monotonic_time ();
         g_slist_free (priv->pending_apps);
         priv->pending_apps = NULL;
         g_slist_free (priv->query_clients);
@@ -1604,11 +2130,19 @@ start_phase (GsmManager *manager)
         case GSM_MANAGER_PHASE_PANEL:
         case GSM_MANAGER_PHASE_DESKTOP:
         case GSM_MANAGER_PHASE_APPLICATION:
+                /* read the next phase in while this one starts */
+                gsm_prefetch_phase (priv->phase);
+                gsm_prefetch_phase (priv->phase + 1);
                 do_phase_startup (manager);
                 break;
         case GSM_MANAGER_PHASE_RUNNING:
                 g_signal_emit (manager, signals[SESSION_RUNNING], 0);
                 update_idle (manager);
+                gsm_xsmp_client_allow_initial_saves ();
+                gsm_prefetch_session_running ();
+                priv->undemote_id = g_timeout_add_seconds (GSM_MANAGER_UNDEMOTE_DELAY,
+                                                           (GSourceFunc)on_undemote_timeout,
+                                                           manager);
                 break;
         case GSM_MANAGER_PHASE_QUERY_END_SESSION:
                 do_phase_query_end_session (manager);
@@ -1668,10 +2202,16 @@ debug_app_summary (GsmManager *manager)
 void
 gsm_manager_start (GsmManager *manager)
 {
+        GsmCapabilities *capabilities;
+
         g_debug ("GsmManager: GSM starting to manage");
 
         g_return_if_fail (GSM_IS_MANAGER (manager));
 
+        /* Start asking what the logout dialog will be able to offer */
+        capabilities = gsm_get_capabilities ();
+        g_object_unref (capabilities);
+
         gsm_manager_set_phase (manager, GSM_MANAGER_PHASE_INITIALIZATION);
         debug_app_summary (manager);
         start_phase (manager);
@@ -1802,7 +2342,8 @@ _disconnect_client (GsmManager *manager,
         GsmClientRestartStyle client_restart_hint;
         GsmManagerPrivate *priv;
 
-        g_debug ("GsmManager: disconnect client: %s", gsm_client_peek_id (client));
+        mdm_log_debug_for ("GsmManager", gsm_client_peek_id (client), NULL,
+                           "disconnect client: %s", gsm_client_peek_id (client));
 
         /* take a ref so it doesn't get finalized */
         g_object_ref (client);
@@ -1892,7 +2433,7 @@ _disconnect_client (GsmManager *manager,
         g_debug ("GsmManager: restarting app");
 
         error = NULL;
-        res = gsm_app_restart (app, &error);
+        res = gsm_app_schedule_restart (app, &error);
         if (error != NULL) {
                 g_warning ("Error on restarting session managed app: %s", error->message);
                 g_error_free (error);
@@ -1957,13 +2498,17 @@ remove_clients_for_connection (GsmManager *manager,
         data.manager = manager;
         priv = gsm_manager_get_instance_private (manager);
 
-        /* disconnect dbus clients for name */
+        /* disconnect dbus clients for name; coalesce the inhibitors
+         * dropped along with them */
+        gsm_store_begin_batch (priv->inhibitors);
         gsm_store_foreach_remove (priv->clients,
                                   (GsmStoreFunc)_disconnect_dbus_client,
                                   &data);
+        gsm_store_end_batch (priv->inhibitors);
 
         if (priv->phase >= GSM_MANAGER_PHASE_QUERY_END_SESSION
-            && gsm_store_size (priv->clients) == 0) {
+            && gsm_store_size (priv->clients) == 0
+            && priv->pending_apps == NULL) {
                 g_debug ("GsmManager: last client disconnected - exiting");
                 end_phase (manager);
         }
@@ -2019,11 +2564,17 @@ bus_name_owner_changed (DBusGProxy  *bus_proxy,
                         const char  *new_service_name,
                         GsmManager  *manager)
 {
+        GsmManagerPrivate *priv;
+
+        priv = gsm_manager_get_instance_private (manager);
+
         if (strlen (new_service_name) == 0
             && strlen (old_service_name) > 0) {
                 /* service removed */
+                gsm_store_begin_batch (priv->inhibitors);
                 remove_inhibitors_for_connection (manager, old_service_name);
                 remove_clients_for_connection (manager, old_service_name);
+                gsm_store_end_batch (priv->inhibitors);
         } else if (strlen (old_service_name) == 0
                    && strlen (new_service_name) > 0) {
                 /* service added */
@@ -2145,7 +2696,8 @@ on_client_disconnected (GsmClient  *client,
         _disconnect_client (manager, client);
         gsm_store_remove (priv->clients, gsm_client_peek_id (client));
         if (priv->phase >= GSM_MANAGER_PHASE_QUERY_END_SESSION
-            && gsm_store_size (priv->clients) == 0) {
+            && gsm_store_size (priv->clients) == 0
+            && priv->pending_apps == NULL) {
                 g_debug ("GsmManager: last client disconnected - exiting");
                 end_phase (manager);
         }
@@ -2300,6 +2852,9 @@ _handle_client_end_session_response (GsmManager *manager,
         }
 
         g_debug ("GsmManager: Response from end session request: is-ok=%d do-last=%d cancel=%d reason=%s", is_ok, do_last, cancel, reason ? reason :"");
+        gsm_flight_recorder_record (GSM_FLIGHT_EVENT_END_SESSION_RESPONSE,
+                                    (is_ok ? 1 : 0) | (do_last ? 2 : 0) | (cancel ? 4 : 0),
+                                    gsm_client_peek_id (client));
 
         if (cancel) {
                 cancel_end_session (manager);
@@ -2421,7 +2976,8 @@ on_store_client_added (GsmStore   *store,
 {
         GsmClient *client;
 
-        g_debug ("GsmManager: Client added: %s", id);
+        mdm_log_debug_for ("GsmManager", id, NULL, "Client added: %s", id);
+        gsm_flight_recorder_record (GSM_FLIGHT_EVENT_CLIENT_ADDED, 0, id);
 
         client = (GsmClient *)gsm_store_lookup (store, id);
 
@@ -2451,11 +3007,31 @@ on_store_client_removed (GsmStore   *store,
                          const char *id,
                          GsmManager *manager)
 {
-        g_debug ("GsmManager: Client removed: %s", id);
+        mdm_log_debug_for ("GsmManager", id, NULL, "Client removed: %s", id);
+        gsm_flight_recorder_record (GSM_FLIGHT_EVENT_CLIENT_REMOVED, 0, id);
 
         g_signal_emit (manager, signals [CLIENT_REMOVED], 0, id);
 }
 
+static void
+on_store_client_items_changed (GsmStore           *store,
+                               const char * const *added,
+                               const char * const *removed,
+                               GsmManager         *manager)
+{
+        int i;
+
+        for (i = 0; removed[i] != NULL; i++) {
+                on_store_client_removed (store, removed[i], manager);
+        }
+
+        for (i = 0; added[i] != NULL; i++) {
+                if (gsm_store_lookup (store, added[i]) != NULL) {
+                        on_store_client_added (store, added[i], manager);
+                }
+        }
+}
+
 static void
 gsm_manager_set_client_store (GsmManager *manager,
                               GsmStore   *store)
@@ -2476,6 +3052,9 @@ gsm_manager_set_client_store (GsmManager *manager,
                 g_signal_handlers_disconnect_by_func (priv->clients,
                                                       on_store_client_removed,
                                                       manager);
+                g_signal_handlers_disconnect_by_func (priv->clients,
+                                                      on_store_client_items_changed,
+                                                      manager);
 
                 g_object_unref (priv->clients);
         }
@@ -2494,6 +3073,10 @@ gsm_manager_set_client_store (GsmManager *manager,
                                   "removed",
                                   G_CALLBACK (on_store_client_removed),
                                   manager);
+                g_signal_connect (priv->clients,
+                                  "items-changed",
+                                  G_CALLBACK (on_store_client_items_changed),
+                                  manager);
         }
 }
 
@@ -2569,12 +3152,33 @@ gsm_manager_constructor (GType                  type,
         return G_OBJECT (manager);
 }
 
+static void
+record_inhibitor_added (GsmStore   *store,
+                        const char *id)
+{
+        GsmInhibitor *inhibitor;
+        char          text[80];
+
+        inhibitor = (GsmInhibitor *) gsm_store_lookup (store, id);
+        if (inhibitor == NULL) {
+                gsm_flight_recorder_record (GSM_FLIGHT_EVENT_INHIBITOR_ADDED, 0, id);
+                return;
+        }
+
+        g_snprintf (text, sizeof (text), "%s %s",
+                    id, gsm_inhibitor_peek_app_id (inhibitor));
+        gsm_flight_recorder_record (GSM_FLIGHT_EVENT_INHIBITOR_ADDED,
+                                    gsm_inhibitor_peek_flags (inhibitor),
+                                    text);
+}
+
 static void
 on_store_inhibitor_added (GsmStore   *store,
                           const char *id,
                           GsmManager *manager)
 {
         g_debug ("GsmManager: Inhibitor added: %s", id);
+        record_inhibitor_added (store, id);
         g_signal_emit (manager, signals [INHIBITOR_ADDED], 0, id);
         update_idle (manager);
 }
@@ -2585,10 +3189,34 @@ on_store_inhibitor_removed (GsmStore   *store,
                             GsmManager *manager)
 {
         g_debug ("GsmManager: Inhibitor removed: %s", id);
+        gsm_flight_recorder_record (GSM_FLIGHT_EVENT_INHIBITOR_REMOVED, 0, id);
         g_signal_emit (manager, signals [INHIBITOR_REMOVED], 0, id);
         update_idle (manager);
 }
 
+static void
+on_store_inhibitor_items_changed (GsmStore           *store,
+                                  const char * const *added,
+                                  const char * const *removed,
+                                  GsmManager         *manager)
+{
+        int i;
+
+        for (i = 0; removed[i] != NULL; i++) {
+                g_debug ("GsmManager: Inhibitor removed: %s", removed[i]);
+                gsm_flight_recorder_record (GSM_FLIGHT_EVENT_INHIBITOR_REMOVED, 0, removed[i]);
+                g_signal_emit (manager, signals [INHIBITOR_REMOVED], 0, removed[i]);
+        }
+
+        for (i = 0; added[i] != NULL; i++) {
+                g_debug ("GsmManager: Inhibitor added: %s", added[i]);
+                record_inhibitor_added (store, added[i]);
+                g_signal_emit (manager, signals [INHIBITOR_ADDED], 0, added[i]);
+        }
+
+        update_idle (manager);
+}
+
 static void
 gsm_manager_dispose (GObject *object)
 {
@@ -2599,6 +3227,41 @@ gsm_manager_dispose (GObject *object)
 
         priv = gsm_manager_get_instance_private (manager);
 
+        if (priv->undemote_id > 0) {
+                g_source_remove (priv->undemote_id);
+                priv->undemote_id = 0;
+        }
+
+        if (priv->delayed_start_id > 0) {
+                g_source_remove (priv->delayed_start_id);
+                priv->delayed_start_id = 0;
+        }
+
+        while (priv->delayed_starts != NULL) {
+                DelayedStart *entry = priv->delayed_starts->data;
+
+                g_object_unref (entry->app);
+                g_free (entry);
+                priv->delayed_starts = g_slist_delete_link (priv->delayed_starts,
+                                                            priv->delayed_starts);
+        }
+
+        if (priv->app_start_times != NULL) {
+                GHashTableIter iter;
+                gpointer       app;
+
+                g_hash_table_iter_init (&iter, priv->app_start_times);
+                while (g_hash_table_iter_next (&iter, &app, NULL)) {
+                        g_signal_handlers_disconnect_by_func (app, record_app_latency, manager);
+                        g_signal_handlers_disconnect_by_func (app, forget_app_start_time, manager);
+                }
+                g_hash_table_destroy (priv->app_start_times);
+                priv->app_start_times = NULL;
+        }
+
+        /* Short sessions end before the delayed save */
+        gsm_app_history_flush ();
+
         if (priv->clients != NULL) {
                 g_signal_handlers_disconnect_by_func (priv->clients,
                                                       on_store_client_added,
@@ -2606,6 +3269,9 @@ gsm_manager_dispose (GObject *object)
                 g_signal_handlers_disconnect_by_func (priv->clients,
                                                       on_store_client_removed,
                                                       manager);
+                g_signal_handlers_disconnect_by_func (priv->clients,
+                                                      on_store_client_items_changed,
+                                                      manager);
                 g_object_unref (priv->clients);
                 priv->clients = NULL;
         }
@@ -2622,6 +3288,9 @@ gsm_manager_dispose (GObject *object)
                 g_signal_handlers_disconnect_by_func (priv->inhibitors,
                                                       on_store_inhibitor_removed,
                                                       manager);
+                g_signal_handlers_disconnect_by_func (priv->inhibitors,
+                                                      on_store_inhibitor_items_changed,
+                                                      manager);
 
                 g_object_unref (priv->inhibitors);
                 priv->inhibitors = NULL;
@@ -2801,6 +3470,10 @@ on_presence_status_changed (GsmPresence  *presence,
                             guint         status,
                             GsmManager   *manager)
 {
+        if (status == GSM_PRESENCE_STATUS_IDLE) {
+                gsm_xsmp_client_allow_initial_saves ();
+        }
+
 #ifdef HAVE_SYSTEMD
         if (LOGIND_RUNNING()) {
                 GsmSystemd *systemd;
@@ -2851,6 +3524,10 @@ gsm_manager_init (GsmManager *manager)
         else
                 priv->settings_screensaver = NULL;
 
+        priv->app_start_times = g_hash_table_new_full (NULL, NULL,
+                                                       g_object_unref,
+                                                       g_free);
+
         priv->inhibitors = gsm_store_new ();
         g_signal_connect (priv->inhibitors,
                           "added",
@@ -2860,6 +3537,10 @@ gsm_manager_init (GsmManager *manager)
                           "removed",
                           G_CALLBACK (on_store_inhibitor_removed),
                           manager);
+        g_signal_connect (priv->inhibitors,
+                          "items-changed",
+                          G_CALLBACK (on_store_inhibitor_items_changed),
+                          manager);
 
         priv->apps = gsm_store_new ();
 
@@ -3343,6 +4024,7 @@ request_logout (GsmManager            *manager,
         GsmManagerPrivate *priv;
 
         g_debug ("GsmManager: requesting logout");
+        gsm_flight_recorder_record (GSM_FLIGHT_EVENT_LOGOUT_REQUEST, mode, NULL);
 
         priv = gsm_manager_get_instance_private (manager);
 
@@ -3543,6 +4225,7 @@ gsm_manager_set_phase (GsmManager      *manager,
 
         priv = gsm_manager_get_instance_private (manager);
         priv->phase = phase;
+        mdm_log_set_phase (phase_num_to_name (phase));
         return (TRUE);
 }
 
@@ -3650,35 +4333,23 @@ gsm_manager_can_shutdown (GsmManager *manager,
                           gboolean   *shutdown_available,
                           GError    **error)
 {
-        GsmConsolekit *consolekit;
-#ifdef HAVE_SYSTEMD
-        GsmSystemd *systemd;
-#endif
+        GsmCapabilities *capabilities;
+
         g_debug ("GsmManager: CanShutdown called");
 
         g_return_val_if_fail (GSM_IS_MANAGER (manager), FALSE);
 
+        capabilities = gsm_get_capabilities ();
+        *shutdown_available = gsm_capabilities_get (capabilities, GSM_CAPABILITY_SHUTDOWN)
+                              || gsm_capabilities_get (capabilities, GSM_CAPABILITY_REBOOT)
+                              || gsm_capabilities_get (capabilities, GSM_CAPABILITY_SUSPEND)
+                              || gsm_capabilities_get (capabilities, GSM_CAPABILITY_HIBERNATE);
+        g_object_unref (capabilities);
+
 #ifdef HAVE_SYSTEMD
-        if (LOGIND_RUNNING()) {
-                systemd = gsm_get_systemd ();
-                *shutdown_available = gsm_systemd_can_stop (systemd)
-                                      || gsm_systemd_can_restart (systemd)
-                                      || gsm_systemd_can_suspend (systemd)
-                                      || gsm_systemd_can_hibernate (systemd);
-                g_object_unref (systemd);
-        }
-        else {
-#endif
-        consolekit = gsm_get_consolekit ();
-        *shutdown_available = !_log_out_is_locked_down (manager) &&
-                              (gsm_consolekit_can_stop (consolekit)
-                               || gsm_consolekit_can_restart (consolekit)
-                               || gsm_consolekit_can_suspend (consolekit)
-                               || gsm_consolekit_can_hibernate (consolekit));
-        g_object_unref (consolekit);
-#ifdef HAVE_SYSTEMD
-        }
+        if (!LOGIND_RUNNING())
 #endif
+        *shutdown_available = *shutdown_available && !_log_out_is_locked_down (manager);
 
         return TRUE;
 }
@@ -4079,6 +4750,212 @@ gsm_manager_get_inhibitors (GsmManager *manager,
         return TRUE;
 }
 
+/* a(oa{sv}): each object path with a snapshot of what its getters
+ * return, so that listing them takes a single call */
+#define GSM_MANAGER_TYPE_DETAILS        (dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE))
+#define GSM_MANAGER_TYPE_OBJECT_DETAILS (dbus_g_type_get_struct ("GValueArray", DBUS_TYPE_G_OBJECT_PATH, GSM_MANAGER_TYPE_DETAILS, G_TYPE_INVALID))
+
+typedef struct {
+        GPtrArray *array;
+        guint      flags;
+} ListDetailsData;
+
+static void
+free_details_value (GValue *value)
+{
+        g_value_unset (value);
+        g_free (value);
+}
+
+static GHashTable *
+details_new (void)
+{
+        return g_hash_table_new_full (g_str_hash, g_str_equal,
+                                      NULL,
+                                      (GDestroyNotify) free_details_value);
+}
+
+static void
+details_add_string (GHashTable *details,
+                    const char *key,
+                    GType       type,
+                    const char *str)
+{
+        GValue *value;
+
+        value = g_new0 (GValue, 1);
+        g_value_init (value, type);
+        if (type == G_TYPE_STRING) {
+                g_value_set_string (value, str != NULL ? str : "");
+        } else {
+                g_value_set_boxed (value, str);
+        }
+        g_hash_table_insert (details, (char *) key, value);
+}
+
+static void
+details_add_uint (GHashTable *details,
+                  const char *key,
+                  guint       number)
+{
+        GValue *value;
+
+        value = g_new0 (GValue, 1);
+        g_value_init (value, G_TYPE_UINT);
+        g_value_set_uint (value, number);
+        g_hash_table_insert (details, (char *) key, value);
+}
+
+static void
+list_details_add (GPtrArray  *array,
+                  const char *id,
+                  GHashTable *details)
+{
+        GValue entry = G_VALUE_INIT;
+
+        g_value_init (&entry, GSM_MANAGER_TYPE_OBJECT_DETAILS);
+        g_value_take_boxed (&entry,
+                            dbus_g_type_specialized_construct (GSM_MANAGER_TYPE_OBJECT_DETAILS));
+        dbus_g_type_struct_set (&entry,
+                                0, id,
+                                1, details,
+                                G_MAXUINT);
+        g_ptr_array_add (array, g_value_dup_boxed (&entry));
+        g_value_unset (&entry);
+
+        g_hash_table_unref (details);
+}
+
+static gboolean
+listify_client_details (const char      *id,
+                        GsmClient       *client,
+                        ListDetailsData *data)
+{
+        GHashTable *details;
+        guint       pid;
+
+        details = details_new ();
+        details_add_string (details, "AppId", G_TYPE_STRING,
+                            gsm_client_peek_app_id (client));
+        details_add_string (details, "StartupId", G_TYPE_STRING,
+                            gsm_client_peek_startup_id (client));
+        details_add_uint (details, "RestartStyleHint",
+                          gsm_client_peek_restart_style_hint (client));
+        details_add_uint (details, "Status",
+                          gsm_client_peek_status (client));
+        if (gsm_client_get_unix_process_id (client, &pid, NULL)) {
+                details_add_uint (details, "UnixProcessId", pid);
+        }
+
+        list_details_add (data->array, id, details);
+
+        return FALSE;
+}
+
+static gboolean
+listify_inhibitor_details (const char      *id,
+                           GsmInhibitor    *inhibitor,
+                           ListDetailsData *data)
+{
+        GHashTable *details;
+        const char *client_id;
+
+        if (data->flags != 0
+            && (gsm_inhibitor_peek_flags (inhibitor) & data->flags) == 0) {
+                return FALSE;
+        }
+
+        details = details_new ();
+        details_add_string (details, "AppId", G_TYPE_STRING,
+                            gsm_inhibitor_peek_app_id (inhibitor));
+        details_add_string (details, "Reason", G_TYPE_STRING,
+                            gsm_inhibitor_peek_reason (inhibitor));
+        details_add_uint (details, "Flags",
+                          gsm_inhibitor_peek_flags (inhibitor));
+        details_add_uint (details, "ToplevelXid",
+                          gsm_inhibitor_peek_toplevel_xid (inhibitor));
+
+        /* object paths are not allowed to be blank */
+        client_id = gsm_inhibitor_peek_client_id (inhibitor);
+        if (! IS_STRING_EMPTY (client_id)) {
+                details_add_string (details, "ClientId", DBUS_TYPE_G_OBJECT_PATH,
+                                    client_id);
+        }
+
+        list_details_add (data->array, id, details);
+
+        return FALSE;
+}
+
+gboolean
+gsm_manager_get_client_details (GsmManager *manager,
+                                GPtrArray **clients,
+                                GError    **error)
+{
+        GsmManagerPrivate *priv;
+        ListDetailsData    data;
+
+        g_return_val_if_fail (GSM_IS_MANAGER (manager), FALSE);
+
+        if (clients == NULL) {
+                return FALSE;
+        }
+
+        data.array = g_ptr_array_new ();
+        data.flags = 0;
+
+        priv = gsm_manager_get_instance_private (manager);
+        gsm_store_foreach (priv->clients,
+                           (GsmStoreFunc) listify_client_details,
+                           &data);
+
+        *clients = data.array;
+
+        return TRUE;
+}
+
+gboolean
+gsm_manager_get_inhibitor_details (GsmManager *manager,
+                                   guint       flags,
+                                   GPtrArray **inhibitors,
+                                   GError    **error)
+{
+        GsmManagerPrivate *priv;
+        ListDetailsData    data;
+
+        g_return_val_if_fail (GSM_IS_MANAGER (manager), FALSE);
+
+        if (inhibitors == NULL) {
+                return FALSE;
+        }
+
+        data.array = g_ptr_array_new ();
+        data.flags = flags;
+
+        priv = gsm_manager_get_instance_private (manager);
+        gsm_store_foreach (priv->inhibitors,
+                           (GsmStoreFunc) listify_inhibitor_details,
+                           &data);
+
+        *inhibitors = data.array;
+
+        return TRUE;
+}
+
+gboolean
+gsm_manager_get_initial_save_stats (GsmManager *manager,
+                                    guint      *count,
+                                    guint      *total_time,
+                                    guint      *max_time,
+                                    GError    **error)
+{
+        g_return_val_if_fail (GSM_IS_MANAGER (manager), FALSE);
+
+        gsm_xsmp_client_get_initial_save_stats (count, total_time, max_time);
+
+        return TRUE;
+}
+
 
 static gboolean
 _app_has_autostart_condition (const char *id,
@@ -4228,6 +5105,129 @@ gsm_manager_add_autostart_apps_from_dir (GsmManager *manager,
         return TRUE;
 }
 
+static gboolean
+_collect_app_id (const char *id,
+                 GsmApp     *app,
+                 GHashTable *app_ids)
+{
+        const char *app_id;
+
+        app_id = gsm_app_peek_app_id (app);
+        if (!IS_STRING_EMPTY (app_id)) {
+                g_hash_table_add (app_ids, g_strdup (app_id));
+        }
+
+        return FALSE;
+}
+
+gboolean
+gsm_manager_add_autostart_apps_from_manifest (GsmManager *manager,
+                                              const char *path)
+{
+        GKeyFile   *manifest;
+        GHashTable *app_ids;
+        char       *dir;
+        char      **groups;
+        gsize       n_groups;
+        gsize       i;
+        GError     *error;
+        GsmManagerPrivate *priv;
+
+        g_return_val_if_fail (GSM_IS_MANAGER (manager), FALSE);
+        g_return_val_if_fail (path != NULL, FALSE);
+
+        priv = gsm_manager_get_instance_private (manager);
+
+        manifest = g_key_file_new ();
+
+        error = NULL;
+        if (!g_key_file_load_from_file (manifest, path, G_KEY_FILE_NONE, &error)) {
+                g_debug ("GsmManager: unable to load %s: %s", path, error->message);
+                g_error_free (error);
+                g_key_file_free (manifest);
+                return FALSE;
+        }
+
+        g_debug ("GsmManager: *** Adding autostart apps from %s", path);
+
+        /* a single pass over the store instead of one
+         * find_app_for_app_id() scan per app */
+        app_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        gsm_store_foreach (priv->apps,
+                           (GsmStoreFunc)_collect_app_id,
+                           app_ids);
+
+        dir = g_path_get_dirname (path);
+        groups = g_key_file_get_groups (manifest, &n_groups);
+
+        for (i = 0; i < n_groups; i++) {
+                GKeyFile *key_file;
+                GsmApp   *app;
+                char    **keys;
+                char     *app_id;
+                char     *desktop_file;
+                gsize     j;
+
+                /* the group name is the startup id, which is also what
+                 * the saved .desktop file, and so the app-id, is named
+                 * after */
+                app_id = g_strdup_printf ("%s.desktop", groups[i]);
+                if (g_hash_table_contains (app_ids, app_id)) {
+                        g_debug ("GsmManager: not adding app: app-id %s already exists", app_id);
+                        g_free (app_id);
+                        continue;
+                }
+
+                key_file = g_key_file_new ();
+                keys = g_key_file_get_keys (manifest, groups[i], NULL, NULL);
+                for (j = 0; keys != NULL && keys[j] != NULL; j++) {
+                        char *value;
+
+                        value = g_key_file_get_value (manifest, groups[i], keys[j], NULL);
+                        if (value != NULL) {
+                                g_key_file_set_value (key_file,
+                                                      G_KEY_FILE_DESKTOP_GROUP,
+                                                      keys[j],
+                                                      value);
+                                g_free (value);
+                        }
+                }
+                g_strfreev (keys);
+
+                desktop_file = g_build_filename (dir, app_id, NULL);
+                app = gsm_autostart_app_new_from_key_file (desktop_file, key_file);
+                /* the app owns the key file now */
+                g_key_file_unref (key_file);
+
+                if (app == NULL) {
+                        g_warning ("could not read %s from %s", groups[i], path);
+                } else if (IS_STRING_EMPTY (gsm_app_peek_id (app))) {
+                        g_debug ("GsmManager: not adding app: no id");
+                        g_object_unref (app);
+                } else if (gsm_store_lookup (priv->apps, gsm_app_peek_id (app)) != NULL) {
+                        /* gsm_store_add() would silently replace it */
+                        g_debug ("GsmManager: not adding app: already added");
+                        g_object_unref (app);
+                } else {
+                        g_debug ("GsmManager: read %s", desktop_file);
+                        gsm_store_add (priv->apps, gsm_app_peek_id (app), G_OBJECT (app));
+                        g_hash_table_add (app_ids, app_id);
+                        app_id = NULL;
+                        g_object_unref (app);
+                }
+
+                g_free (desktop_file);
+                g_free (app_id);
+        }
+
+        g_strfreev (groups);
+        g_free (dir);
+        g_hash_table_destroy (app_ids);
+        g_key_file_free (manifest);
+
+        return TRUE;
+}
+
 gboolean
 gsm_manager_is_session_running (GsmManager *manager,
                                 gboolean *running,
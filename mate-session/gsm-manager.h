@@ -107,6 +107,8 @@ gboolean            gsm_manager_add_autostart_app              (GsmManager     *
                                                                 const char     *provides);
 gboolean            gsm_manager_add_autostart_apps_from_dir    (GsmManager     *manager,
                                                                 const char     *path);
+gboolean            gsm_manager_add_autostart_apps_from_manifest (GsmManager   *manager,
+                                                                const char     *path);
 gboolean            gsm_manager_add_legacy_session_apps        (GsmManager     *manager,
                                                                 const char     *path);
 
@@ -168,6 +170,18 @@ gboolean            gsm_manager_get_clients                    (GsmManager     *
 gboolean            gsm_manager_get_inhibitors                 (GsmManager     *manager,
                                                                 GPtrArray     **inhibitors,
                                                                 GError        **error);
+gboolean            gsm_manager_get_client_details             (GsmManager     *manager,
+                                                                GPtrArray     **clients,
+                                                                GError        **error);
+gboolean            gsm_manager_get_inhibitor_details          (GsmManager     *manager,
+                                                                guint           flags,
+                                                                GPtrArray     **inhibitors,
+                                                                GError        **error);
+gboolean            gsm_manager_get_initial_save_stats         (GsmManager     *manager,
+                                                                guint          *count,
+                                                                guint          *total_time,
+                                                                guint          *max_time,
+                                                                GError        **error);
 gboolean            gsm_manager_is_autostart_condition_handled (GsmManager     *manager,
                                                                 const char     *condition,
                                                                 gboolean       *handled,
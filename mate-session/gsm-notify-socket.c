@@ -0,0 +1,227 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+
+#include "gsm-notify-socket.h"
+
+/* Datagram sockets speaking the sd_notify() protocol, so that an app
+ * (or a wrapper script running systemd-notify) can say READY=1 without
+ * being a session client.  Each watch gets a socket of its own, so the
+ * sender is known from the socket it wrote to: a wrapper's
+ * systemd-notify has usually exited by the time its message is read,
+ * which rules out looking the sender up by pid.  The sockets live in a
+ * directory only the user can get into.
+ */
+
+#define NOTIFY_MAX_MESSAGE 4096
+
+typedef struct {
+        guint               id;
+        int                 fd;
+        char               *path;
+        guint               source_id;
+        GsmNotifyReadyFunc  func;
+        gpointer            user_data;
+} NotifyWatch;
+
+static GSList *watches = NULL;
+static guint   next_watch_id = 1;
+
+static void
+notify_watch_free (NotifyWatch *watch)
+{
+        if (watch->source_id > 0) {
+                g_source_remove (watch->source_id);
+        }
+
+        if (watch->fd >= 0) {
+                close (watch->fd);
+        }
+
+        if (watch->path != NULL) {
+                g_unlink (watch->path);
+                g_free (watch->path);
+        }
+
+        g_free (watch);
+}
+
+static gboolean
+on_notify_readable (gint          fd,
+                    GIOCondition  condition,
+                    NotifyWatch  *watch)
+{
+        char            buf[NOTIFY_MAX_MESSAGE + 1];
+        char          **lines;
+        gssize          len;
+        int             i;
+
+        len = recv (fd, buf, NOTIFY_MAX_MESSAGE, MSG_DONTWAIT);
+        if (len < 0) {
+                if (errno != EAGAIN && errno != EINTR) {
+                        g_warning ("GsmNotifySocket: recv failed: %s", g_strerror (errno));
+                }
+                return TRUE;
+        }
+        buf[len] = '\0';
+
+        lines = g_strsplit (buf, "\n", -1);
+        for (i = 0; lines[i] != NULL; i++) {
+                if (g_str_has_prefix (lines[i], "STATUS=")) {
+                        g_debug ("GsmNotifySocket: %s: %s",
+                                 watch->path, lines[i] + strlen ("STATUS="));
+                } else if (strcmp (lines[i], "READY=1") == 0) {
+                        g_debug ("GsmNotifySocket: %s: ready", watch->path);
+                        /* the callback may well remove the watch */
+                        watch->func (watch->user_data);
+                        break;
+                }
+        }
+        g_strfreev (lines);
+
+        return TRUE;
+}
+
+static gboolean
+open_socket (NotifyWatch *watch)
+{
+        struct sockaddr_un addr;
+        char              *dir;
+
+        dir = g_build_filename (g_get_user_runtime_dir (), "mate-session", NULL);
+        g_mkdir_with_parents (dir, 0700);
+        watch->path = g_strdup_printf ("%s/notify-%d-%u", dir, (int) getpid (), watch->id);
+        g_free (dir);
+
+        if (strlen (watch->path) >= sizeof (addr.sun_path)) {
+                g_warning ("GsmNotifySocket: path %s is too long", watch->path);
+                return FALSE;
+        }
+
+        watch->fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (watch->fd < 0) {
+                g_warning ("GsmNotifySocket: unable to create socket: %s", g_strerror (errno));
+                return FALSE;
+        }
+
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strcpy (addr.sun_path, watch->path);
+
+        g_unlink (watch->path);
+        if (bind (watch->fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+                g_warning ("GsmNotifySocket: unable to set up %s: %s",
+                           watch->path, g_strerror (errno));
+                /* nothing of ours to unlink */
+                g_free (watch->path);
+                watch->path = NULL;
+                return FALSE;
+        }
+
+        watch->source_id = g_unix_fd_add (watch->fd,
+                                          G_IO_IN,
+                                          (GUnixFDSourceFunc) on_notify_readable,
+                                          watch);
+
+        return TRUE;
+}
+
+/**
+ * gsm_notify_socket_add_watch:
+ * @func: called when READY=1 arrives
+ * @user_data: data for @func
+ *
+ * Creates a socket for one app; hand its path to the app in
+ * NOTIFY_SOCKET.
+ *
+ * Return value: the watch id, or 0 if there is no socket
+ **/
+guint
+gsm_notify_socket_add_watch (GsmNotifyReadyFunc  func,
+                             gpointer            user_data)
+{
+        NotifyWatch *watch;
+
+        g_return_val_if_fail (func != NULL, 0);
+
+        watch = g_new0 (NotifyWatch, 1);
+        watch->id = next_watch_id++;
+        watch->fd = -1;
+        watch->func = func;
+        watch->user_data = user_data;
+
+        if (! open_socket (watch)) {
+                notify_watch_free (watch);
+                return 0;
+        }
+
+        watches = g_slist_prepend (watches, watch);
+
+        return watch->id;
+}
+
+const char *
+gsm_notify_socket_peek_path (guint id)
+{
+        GSList *l;
+
+        for (l = watches; l != NULL; l = l->next) {
+                NotifyWatch *watch = l->data;
+
+                if (watch->id == id) {
+                        return watch->path;
+                }
+        }
+
+        return NULL;
+}
+
+void
+gsm_notify_socket_remove_watch (guint id)
+{
+        GSList *l;
+
+        for (l = watches; l != NULL; l = l->next) {
+                NotifyWatch *watch = l->data;
+
+                if (watch->id == id) {
+                        watches = g_slist_delete_link (watches, l);
+                        notify_watch_free (watch);
+                        return;
+                }
+        }
+}
+
+void
+gsm_notify_socket_shutdown (void)
+{
+        g_slist_free_full (watches, (GDestroyNotify) notify_watch_free);
+        watches = NULL;
+}
@@ -0,0 +1,36 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __GSM_NOTIFY_SOCKET_H__
+#define __GSM_NOTIFY_SOCKET_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (* GsmNotifyReadyFunc) (gpointer user_data);
+
+guint       gsm_notify_socket_add_watch    (GsmNotifyReadyFunc  func,
+                                            gpointer            user_data);
+const char *gsm_notify_socket_peek_path    (guint               id);
+void        gsm_notify_socket_remove_watch (guint               id);
+void        gsm_notify_socket_shutdown     (void);
+
+G_END_DECLS
+
+#endif /* __GSM_NOTIFY_SOCKET_H__ */
@@ -0,0 +1,455 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "gsm-prefetch.h"
+
+/* Login is mostly spent waiting for the disk: each autostart app
+ * faults in its binary, libraries and data files as it starts, one
+ * app after the other.  When the login-prefetch setting is on, the
+ * files mapped by the apps we spawn are sampled from /proc/<pid>/maps
+ * during login and saved, per startup phase, next to the saved
+ * session.  On the next login a thread asks the kernel to read the
+ * files of phase N+1 in while the apps of phase N are starting.
+ *
+ * Only mapped files show up in /proc/<pid>/maps, which covers what
+ * matters most (executables, libraries, caches, fonts) without the
+ * privileges fanotify would need.
+ */
+
+#define GSM_SCHEMA                    "org.mate.session"
+#define KEY_LOGIN_PREFETCH            "login-prefetch"
+
+#define GSM_PREFETCH_PROFILE          "login-profile"
+#define GSM_PREFETCH_FILES_KEY        "Files"
+
+#define GSM_PREFETCH_SAMPLE_INTERVAL  2                   /* seconds */
+#define GSM_PREFETCH_SETTLE_TIME      10                  /* seconds */
+#define GSM_PREFETCH_MAX_FILES        2048
+#define GSM_PREFETCH_MAX_BYTES        (256 * 1024 * 1024)
+
+/* only the startup phases are recorded and prefetched */
+#define GSM_PREFETCH_NUM_PHASES       GSM_MANAGER_PHASE_RUNNING
+
+/* pushed on the queue after the last phase */
+#define GSM_PREFETCH_DONE             GINT_TO_POINTER (GSM_PREFETCH_NUM_PHASES + 1)
+
+typedef struct {
+        GPid            pid;
+        GsmManagerPhase phase;
+} WatchedPid;
+
+static gboolean     enabled = FALSE;
+static char        *profile_path = NULL;
+
+/* prefetch thread; it owns the loaded profile */
+static GAsyncQueue *requests = NULL;
+static guint        requested = 0;
+static gboolean     requests_done = FALSE;
+
+/* recording, main thread only */
+static gboolean     recording = FALSE;
+static GSList      *watched = NULL;
+static GHashTable  *seen = NULL;
+static GPtrArray   *recorded[GSM_PREFETCH_NUM_PHASES];
+static guint        n_recorded = 0;
+static guint        sample_id = 0;
+static guint        settle_id = 0;
+
+static gboolean
+ignore_path (const char *path)
+{
+        static const char *prefixes[] = {
+                "/dev/", "/proc/", "/sys/", "/run/", "/tmp/", "/memfd:", NULL
+        };
+        int i;
+
+        if (g_str_has_suffix (path, " (deleted)")) {
+                return TRUE;
+        }
+
+        for (i = 0; prefixes[i] != NULL; i++) {
+                if (g_str_has_prefix (path, prefixes[i])) {
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+static gboolean
+sample_pid (WatchedPid *watch)
+{
+        char        *maps;
+        FILE        *file;
+        char         line[PATH_MAX + 128];
+        char        *path;
+        struct stat  buf;
+
+        maps = g_strdup_printf ("/proc/%d/maps", (int) watch->pid);
+        file = fopen (maps, "re");
+        g_free (maps);
+
+        if (file == NULL) {
+                return FALSE;
+        }
+
+        while (fgets (line, sizeof (line), file) != NULL
+               && n_recorded < GSM_PREFETCH_MAX_FILES) {
+                /* the path is the only field that can contain a '/' */
+                path = strchr (line, '/');
+                if (path == NULL) {
+                        continue;
+                }
+                g_strchomp (path);
+
+                if (ignore_path (path)
+                    || g_hash_table_contains (seen, path)) {
+                        continue;
+                }
+
+                if (g_stat (path, &buf) != 0 || ! S_ISREG (buf.st_mode)) {
+                        continue;
+                }
+
+                path = g_strdup (path);
+                g_hash_table_add (seen, path);
+                g_ptr_array_add (recorded[watch->phase], path);
+                n_recorded++;
+        }
+
+        fclose (file);
+
+        return TRUE;
+}
+
+static gboolean
+on_sample_timeout (gpointer data)
+{
+        GSList *l;
+        GSList *next;
+
+        for (l = watched; l != NULL; l = next) {
+                WatchedPid *watch = l->data;
+
+                next = l->next;
+
+                /* gone, or already exec'd something else we can't see */
+                if (! sample_pid (watch)) {
+                        watched = g_slist_delete_link (watched, l);
+                        g_free (watch);
+                }
+        }
+
+        if (watched == NULL) {
+                sample_id = 0;
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static void
+save_profile (void)
+{
+        GKeyFile *keyfile;
+        GError   *error;
+        char     *data;
+        gsize     length;
+        char     *dir;
+        char     *group;
+        int       i;
+
+        keyfile = g_key_file_new ();
+
+        for (i = 0; i < GSM_PREFETCH_NUM_PHASES; i++) {
+                if (recorded[i]->len == 0) {
+                        continue;
+                }
+
+                group = g_strdup_printf ("Phase %d", i);
+                g_key_file_set_string_list (keyfile,
+                                            group,
+                                            GSM_PREFETCH_FILES_KEY,
+                                            (const char * const *) recorded[i]->pdata,
+                                            recorded[i]->len);
+                g_free (group);
+        }
+
+        data = g_key_file_to_data (keyfile, &length, NULL);
+        g_key_file_free (keyfile);
+
+        dir = g_path_get_dirname (profile_path);
+        g_mkdir_with_parents (dir, 0700);
+        g_free (dir);
+
+        error = NULL;
+        if (! g_file_set_contents (profile_path, data, length, &error)) {
+                g_warning ("GsmPrefetch: unable to save %s: %s",
+                           profile_path, error->message);
+                g_error_free (error);
+        } else {
+                g_debug ("GsmPrefetch: recorded %u files to %s",
+                         n_recorded, profile_path);
+        }
+
+        g_free (data);
+}
+
+static gboolean
+on_settle_timeout (gpointer data)
+{
+        int i;
+
+        settle_id = 0;
+
+        if (sample_id > 0) {
+                g_source_remove (sample_id);
+                sample_id = 0;
+        }
+
+        on_sample_timeout (NULL);
+        save_profile ();
+
+        g_slist_free_full (watched, g_free);
+        watched = NULL;
+
+        for (i = 0; i < GSM_PREFETCH_NUM_PHASES; i++) {
+                g_ptr_array_free (recorded[i], TRUE);
+                recorded[i] = NULL;
+        }
+        g_hash_table_destroy (seen);
+        seen = NULL;
+
+        recording = FALSE;
+
+        return FALSE;
+}
+
+static char ***
+load_profile (void)
+{
+        GKeyFile  *keyfile;
+        char    ***files;
+        char      *group;
+        int        i;
+
+        files = g_new0 (char **, GSM_PREFETCH_NUM_PHASES);
+
+        keyfile = g_key_file_new ();
+        if (! g_key_file_load_from_file (keyfile, profile_path, G_KEY_FILE_NONE, NULL)) {
+                g_key_file_free (keyfile);
+                return files;
+        }
+
+        for (i = 0; i < GSM_PREFETCH_NUM_PHASES; i++) {
+                group = g_strdup_printf ("Phase %d", i);
+                files[i] = g_key_file_get_string_list (keyfile,
+                                                       group,
+                                                       GSM_PREFETCH_FILES_KEY,
+                                                       NULL,
+                                                       NULL);
+                g_free (group);
+        }
+
+        g_key_file_free (keyfile);
+
+        return files;
+}
+
+static gsize
+prefetch_files (char  **files,
+                gsize   budget)
+{
+        struct stat buf;
+        gsize       total;
+        int         fd;
+        int         i;
+
+        total = 0;
+
+        for (i = 0; files[i] != NULL && total < budget; i++) {
+                fd = open (files[i], O_RDONLY | O_CLOEXEC | O_NOCTTY);
+                if (fd < 0) {
+                        continue;
+                }
+
+                if (fstat (fd, &buf) == 0 && S_ISREG (buf.st_mode)) {
+#ifdef POSIX_FADV_WILLNEED
+                        posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+                        total += buf.st_size;
+                }
+
+                close (fd);
+        }
+
+        return total;
+}
+
+static gpointer
+prefetch_thread (gpointer data)
+{
+        GAsyncQueue  *queue = data;
+        char       ***files;
+        gpointer      request;
+        gsize         total;
+        int           phase;
+
+        files = load_profile ();
+        total = 0;
+
+        while ((request = g_async_queue_pop (queue)) != GSM_PREFETCH_DONE) {
+                phase = GPOINTER_TO_INT (request) - 1;
+
+                if (files[phase] == NULL || total >= GSM_PREFETCH_MAX_BYTES) {
+                        continue;
+                }
+
+                total += prefetch_files (files[phase], GSM_PREFETCH_MAX_BYTES - total);
+                g_debug ("GsmPrefetch: phase %d prefetched, %" G_GSIZE_FORMAT " bytes so far",
+                         phase, total);
+        }
+
+        for (phase = 0; phase < GSM_PREFETCH_NUM_PHASES; phase++) {
+                g_strfreev (files[phase]);
+        }
+        g_free (files);
+
+        g_async_queue_unref (queue);
+
+        return NULL;
+}
+
+void
+gsm_prefetch_init (void)
+{
+        GSettings *settings;
+        GError    *error;
+        GThread   *thread;
+        int        i;
+
+        settings = g_settings_new (GSM_SCHEMA);
+        enabled = g_settings_get_boolean (settings, KEY_LOGIN_PREFETCH);
+        g_object_unref (settings);
+
+        if (! enabled) {
+                return;
+        }
+
+        profile_path = g_build_filename (g_get_user_config_dir (),
+                                         "mate-session",
+                                         GSM_PREFETCH_PROFILE,
+                                         NULL);
+
+        /* the thread keeps its own reference until it is done */
+        requests = g_async_queue_new ();
+
+        error = NULL;
+        thread = g_thread_try_new ("gsm-prefetch",
+                                   prefetch_thread,
+                                   g_async_queue_ref (requests),
+                                   &error);
+        if (thread == NULL) {
+                g_warning ("GsmPrefetch: unable to start thread: %s", error->message);
+                g_error_free (error);
+                g_async_queue_unref (requests);
+                g_async_queue_unref (requests);
+                requests = NULL;
+                requests_done = TRUE;
+        } else {
+                g_thread_unref (thread);
+        }
+
+        seen = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, NULL);
+        for (i = 0; i < GSM_PREFETCH_NUM_PHASES; i++) {
+                recorded[i] = g_ptr_array_new_with_free_func (g_free);
+        }
+        recording = TRUE;
+}
+
+void
+gsm_prefetch_phase (GsmManagerPhase phase)
+{
+        if (! enabled || requests_done) {
+                return;
+        }
+
+        if (phase >= GSM_PREFETCH_NUM_PHASES) {
+                g_async_queue_push (requests, GSM_PREFETCH_DONE);
+                g_async_queue_unref (requests);
+                requests_done = TRUE;
+                return;
+        }
+
+        if (requested & (1 << phase)) {
+                return;
+        }
+
+        requested |= 1 << phase;
+        g_async_queue_push (requests, GINT_TO_POINTER (phase + 1));
+}
+
+void
+gsm_prefetch_watch_pid (GPid            pid,
+                        GsmManagerPhase phase)
+{
+        WatchedPid *watch;
+
+        if (! recording || pid <= 0 || phase >= GSM_PREFETCH_NUM_PHASES) {
+                return;
+        }
+
+        watch = g_new0 (WatchedPid, 1);
+        watch->pid = pid;
+        watch->phase = phase;
+        watched = g_slist_prepend (watched, watch);
+
+        if (sample_id == 0) {
+                sample_id = g_timeout_add_seconds (GSM_PREFETCH_SAMPLE_INTERVAL,
+                                                   on_sample_timeout,
+                                                   NULL);
+        }
+}
+
+void
+gsm_prefetch_session_running (void)
+{
+        gsm_prefetch_phase (GSM_MANAGER_PHASE_RUNNING);
+
+        if (! recording || settle_id > 0) {
+                return;
+        }
+
+        /* let the last apps finish starting before saving */
+        settle_id = g_timeout_add_seconds (GSM_PREFETCH_SETTLE_TIME,
+                                           on_settle_timeout,
+                                           NULL);
+}
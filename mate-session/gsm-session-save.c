@@ -20,6 +20,9 @@
 
 #include <config.h>
 
+#include <stdio.h>
+#include <string.h>
+
 #include <glib.h>
 #include <glib/gstdio.h>
 
@@ -29,28 +32,456 @@
 
 #include "gsm-session-save.h"
 
-static gboolean gsm_session_clear_saved_session (const char *directory,
-                                                 GHashTable *discard_hash);
+/* The saved session directory holds one <startup-id>.desktop file per
+ * client, plus a journal recording which of those files are live, a
+ * checksum of their contents and their discard command.  Each save
+ * appends "add", "update" and "remove" records for the clients that
+ * actually changed, so an auto-save only touches those files and never
+ * has to reparse the previous snapshot to find its discard commands.
+ * The journal is rewritten from scratch once it grows too long.
+ *
+ * Whenever the set of saved clients changes, all of them are also
+ * packed into a single manifest keyed by startup id, so that restoring
+ * the session at login reads one file instead of one per client.
+ */
+#define GSM_SESSION_JOURNAL_FILE        "session.journal"
+#define GSM_SESSION_JOURNAL_MIN_RECORDS 64
+
+typedef struct {
+        char *checksum;
+        char *discard_exec;
+} SavedClient;
+
+/* startup id -> SavedClient, mirrors the replayed journal */
+static GHashTable *saved_clients = NULL;
+static guint       journal_records = 0;
+static gboolean    journal_needs_compaction = FALSE;
 
 typedef struct {
-        char        *dir;
-        GHashTable  *discard_hash;
+        const char  *dir;
+        GHashTable  *seen;
+        GString     *journal;
+        guint        n_records;
+        GPtrArray   *stale_discards;
+        GKeyFile    *manifest;
+        gboolean     manifest_stale;
         GError     **error;
 } SessionSaveData;
 
+static SavedClient *
+saved_client_new (const char *checksum,
+                  const char *discard_exec)
+{
+        SavedClient *saved;
+
+        saved = g_slice_new0 (SavedClient);
+        saved->checksum = g_strdup (checksum);
+        saved->discard_exec = g_strdup (discard_exec);
+
+        return saved;
+}
+
+static void
+saved_client_free (SavedClient *saved)
+{
+        g_free (saved->checksum);
+        g_free (saved->discard_exec);
+        g_slice_free (SavedClient, saved);
+}
+
+static char *
+get_client_file_path (const char *dir,
+                      const char *startup_id)
+{
+        char *filename;
+        char *path;
+
+        filename = g_strdup_printf ("%s.desktop", startup_id);
+        path = g_build_filename (dir, filename, NULL);
+        g_free (filename);
+
+        return path;
+}
+
+static void
+journal_add_record (GString    *journal,
+                    const char *op,
+                    const char *startup_id,
+                    const char *checksum,
+                    const char *discard_exec)
+{
+        char *escaped_id;
+        char *escaped_discard;
+
+        escaped_id = g_strescape (startup_id, NULL);
+
+        if (checksum == NULL) {
+                g_string_append_printf (journal, "%s\t%s\n", op, escaped_id);
+                g_free (escaped_id);
+                return;
+        }
+
+        escaped_discard = g_strescape (discard_exec ? discard_exec : "", NULL);
+        g_string_append_printf (journal, "%s\t%s\t%s\t%s\n",
+                                op, escaped_id, checksum, escaped_discard);
+
+        g_free (escaped_discard);
+        g_free (escaped_id);
+}
+
+static void
+journal_replay_record (const char *line)
+{
+        char **fields;
+        char  *startup_id;
+        char  *discard_exec;
+        guint  n_fields;
+
+        fields = g_strsplit (line, "\t", 4);
+        n_fields = g_strv_length (fields);
+
+        if (n_fields < 2) {
+                goto out;
+        }
+
+        startup_id = g_strcompress (fields[1]);
+
+        if (strcmp (fields[0], "remove") == 0) {
+                g_hash_table_remove (saved_clients, startup_id);
+                g_free (startup_id);
+        } else if (n_fields == 4
+                   && (strcmp (fields[0], "add") == 0
+                       || strcmp (fields[0], "update") == 0)) {
+                discard_exec = g_strcompress (fields[3]);
+                g_hash_table_replace (saved_clients,
+                                      startup_id,
+                                      saved_client_new (fields[2],
+                                                        IS_STRING_EMPTY (discard_exec) ? NULL : discard_exec));
+                g_free (discard_exec);
+        } else {
+                g_free (startup_id);
+                goto out;
+        }
+
+        journal_records++;
+
+out:
+        g_strfreev (fields);
+}
+
+static void
+journal_import_directory (const char *directory)
+{
+        GDir       *dir;
+        const char *filename;
+
+        g_debug ("GsmSessionSave: no journal, importing saved session from %s",
+                 directory);
+
+        dir = g_dir_open (directory, 0, NULL);
+        if (dir == NULL) {
+                return;
+        }
+
+        while ((filename = g_dir_read_name (dir))) {
+                GKeyFile *key_file;
+                char     *path;
+                char     *contents;
+                gsize     length;
+                char     *checksum;
+                char     *discard_exec;
+
+                if (!g_str_has_suffix (filename, ".desktop")) {
+                        continue;
+                }
+
+                path = g_build_filename (directory, filename, NULL);
+
+                if (!g_file_get_contents (path, &contents, &length, NULL)) {
+                        g_free (path);
+                        continue;
+                }
+
+                key_file = g_key_file_new ();
+                discard_exec = NULL;
+                if (g_key_file_load_from_data (key_file, contents, length,
+                                               G_KEY_FILE_NONE, NULL)) {
+                        discard_exec = g_key_file_get_string (key_file,
+                                                              G_KEY_FILE_DESKTOP_GROUP,
+                                                              GSM_AUTOSTART_APP_DISCARD_KEY,
+                                                              NULL);
+                }
+
+                checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+                                                        (const guchar *) contents,
+                                                        length);
+
+                g_hash_table_replace (saved_clients,
+                                      g_strndup (filename,
+                                                 strlen (filename) - strlen (".desktop")),
+                                      saved_client_new (checksum, discard_exec));
+
+                g_free (checksum);
+                g_free (discard_exec);
+                g_key_file_free (key_file);
+                g_free (contents);
+                g_free (path);
+        }
+
+        g_dir_close (dir);
+
+        journal_needs_compaction = TRUE;
+}
+
+static void
+journal_load (const char *directory)
+{
+        char   *path;
+        char   *contents;
+        gsize   length;
+        char  **lines;
+        int     i;
+
+        if (saved_clients != NULL) {
+                return;
+        }
+
+        saved_clients = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free,
+                                               (GDestroyNotify) saved_client_free);
+        journal_records = 0;
+
+        path = g_build_filename (directory, GSM_SESSION_JOURNAL_FILE, NULL);
+
+        if (!g_file_get_contents (path, &contents, &length, NULL)) {
+                journal_import_directory (directory);
+                g_free (path);
+                return;
+        }
+
+        lines = g_strsplit (contents, "\n", -1);
+        for (i = 0; lines[i] != NULL; i++) {
+                if (lines[i][0] != '\0') {
+                        journal_replay_record (lines[i]);
+                }
+        }
+        g_strfreev (lines);
+
+        /* a torn final record would swallow the next append */
+        if (length > 0 && contents[length - 1] != '\n') {
+                journal_needs_compaction = TRUE;
+        }
+
+        g_debug ("GsmSessionSave: replayed %u journal records, %u saved clients",
+                 journal_records, g_hash_table_size (saved_clients));
+
+        g_free (contents);
+        g_free (path);
+}
+
+static gboolean
+journal_append (const char *directory,
+                GString    *journal)
+{
+        char     *path;
+        FILE     *fp;
+        gboolean  ret;
+
+        if (journal->len == 0) {
+                return TRUE;
+        }
+
+        ret = FALSE;
+
+        path = g_build_filename (directory, GSM_SESSION_JOURNAL_FILE, NULL);
+
+        fp = g_fopen (path, "a");
+        if (fp == NULL) {
+                g_warning ("GsmSessionSave: unable to open %s for appending", path);
+                goto out;
+        }
+
+        if (fwrite (journal->str, 1, journal->len, fp) != journal->len) {
+                g_warning ("GsmSessionSave: unable to append to %s", path);
+                fclose (fp);
+                goto out;
+        }
+
+        ret = (fclose (fp) == 0);
+
+out:
+        g_free (path);
+
+        return ret;
+}
+
+static void
+journal_compact (const char *directory)
+{
+        GHashTableIter  iter;
+        gpointer        key;
+        gpointer        value;
+        GString        *journal;
+        char           *path;
+        GDir           *dir;
+        const char     *filename;
+        GError         *error;
+
+        g_debug ("GsmSessionSave: compacting journal (%u records, %u saved clients)",
+                 journal_records, g_hash_table_size (saved_clients));
+
+        journal = g_string_new (NULL);
+
+        g_hash_table_iter_init (&iter, saved_clients);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+                SavedClient *saved = value;
+
+                journal_add_record (journal, "add", key,
+                                    saved->checksum, saved->discard_exec);
+        }
+
+        path = g_build_filename (directory, GSM_SESSION_JOURNAL_FILE, NULL);
+
+        error = NULL;
+        g_file_set_contents (path, journal->str, journal->len, &error);
+        if (error) {
+                g_warning ("GsmSessionSave: unable to rewrite %s: %s",
+                           path, error->message);
+                g_error_free (error);
+                goto out;
+        }
+
+        journal_records = g_hash_table_size (saved_clients);
+        journal_needs_compaction = FALSE;
+
+        /* drop files left behind by an interrupted save */
+        dir = g_dir_open (directory, 0, NULL);
+        if (dir == NULL) {
+                goto out;
+        }
+
+        while ((filename = g_dir_read_name (dir))) {
+                char *startup_id;
+
+                if (!g_str_has_suffix (filename, ".desktop")) {
+                        continue;
+                }
+
+                startup_id = g_strndup (filename,
+                                        strlen (filename) - strlen (".desktop"));
+
+                if (!g_hash_table_contains (saved_clients, startup_id)) {
+                        char *orphan = g_build_filename (directory, filename, NULL);
+
+                        g_debug ("GsmSessionSave: removing orphaned '%s'", orphan);
+                        g_unlink (orphan);
+                        g_free (orphan);
+                }
+
+                g_free (startup_id);
+        }
+
+        g_dir_close (dir);
+
+out:
+        g_free (path);
+        g_string_free (journal, TRUE);
+}
+
+static void
+manifest_invalidate (SessionSaveData *data)
+{
+        char *path;
+
+        if (data->manifest_stale) {
+                return;
+        }
+
+        /* don't let a save interrupted half-way leave a manifest
+         * that disagrees with the client files */
+        path = g_build_filename (data->dir, GSM_SESSION_MANIFEST_FILE, NULL);
+        g_unlink (path);
+        g_free (path);
+
+        data->manifest_stale = TRUE;
+}
+
+static void
+manifest_add_client (GKeyFile   *manifest,
+                     const char *startup_id,
+                     GKeyFile   *keyfile)
+{
+        char  **keys;
+        gsize   i;
+
+        keys = g_key_file_get_keys (keyfile, G_KEY_FILE_DESKTOP_GROUP, NULL, NULL);
+        if (keys == NULL) {
+                return;
+        }
+
+        for (i = 0; keys[i] != NULL; i++) {
+                char *value;
+
+                value = g_key_file_get_value (keyfile,
+                                              G_KEY_FILE_DESKTOP_GROUP,
+                                              keys[i],
+                                              NULL);
+                if (value != NULL) {
+                        g_key_file_set_value (manifest, startup_id, keys[i], value);
+                        g_free (value);
+                }
+        }
+
+        g_strfreev (keys);
+}
+
+static void
+manifest_write (SessionSaveData *data)
+{
+        char   *path;
+        char   *contents;
+        gsize   length;
+        GError *error;
+
+        path = g_build_filename (data->dir, GSM_SESSION_MANIFEST_FILE, NULL);
+
+        if (!data->manifest_stale && g_file_test (path, G_FILE_TEST_EXISTS)) {
+                g_free (path);
+                return;
+        }
+
+        contents = g_key_file_to_data (data->manifest, &length, NULL);
+
+        error = NULL;
+        g_file_set_contents (path, contents, length, &error);
+        if (error) {
+                g_warning ("GsmSessionSave: unable to write %s: %s",
+                           path, error->message);
+                g_error_free (error);
+        } else {
+                g_debug ("GsmSessionSave: packed %u clients into %s",
+                         g_hash_table_size (saved_clients), path);
+        }
+
+        g_free (contents);
+        g_free (path);
+}
+
 static gboolean
 save_one_client (char            *id,
                  GObject         *object,
                  SessionSaveData *data)
 {
-        GsmClient  *client;
-        GKeyFile   *keyfile;
-        char       *path = NULL;
-        char       *filename = NULL;
-        char       *contents = NULL;
-        gsize       length = 0;
-        char       *discard_exec;
-        GError     *local_error;
+        GsmClient   *client;
+        GKeyFile    *keyfile;
+        SavedClient *saved;
+        const char  *startup_id;
+        char        *path = NULL;
+        char        *contents = NULL;
+        char        *checksum = NULL;
+        gsize        length = 0;
+        char        *discard_exec = NULL;
+        GError      *local_error;
 
         client = GSM_CLIENT (object);
 
@@ -68,10 +499,24 @@ save_one_client (char            *id,
                 goto out;
         }
 
-        filename = g_strdup_printf ("%s.desktop",
-                                    gsm_client_peek_startup_id (client));
+        startup_id = gsm_client_peek_startup_id (client);
+        path = get_client_file_path (data->dir, startup_id);
+        checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+                                                (const guchar *) contents,
+                                                length);
 
-        path = g_build_filename (data->dir, filename, NULL);
+        g_hash_table_add (data->seen, g_strdup (startup_id));
+        manifest_add_client (data->manifest, startup_id, keyfile);
+
+        saved = g_hash_table_lookup (saved_clients, startup_id);
+        if (saved != NULL
+            && strcmp (saved->checksum, checksum) == 0
+            && g_file_test (path, G_FILE_TEST_EXISTS)) {
+                g_debug ("GsmSessionSave: client %s unchanged", id);
+                goto out;
+        }
+
+        manifest_invalidate (data);
 
         g_file_set_contents (path,
                              contents,
@@ -86,26 +531,39 @@ save_one_client (char            *id,
                                               G_KEY_FILE_DESKTOP_GROUP,
                                               GSM_AUTOSTART_APP_DISCARD_KEY,
                                               NULL);
-        if (discard_exec) {
-                g_hash_table_insert (data->discard_hash,
-                                     discard_exec, discard_exec);
+
+        if (saved != NULL
+            && saved->discard_exec != NULL
+            && g_strcmp0 (saved->discard_exec, discard_exec) != 0) {
+                g_ptr_array_add (data->stale_discards,
+                                 g_strdup (saved->discard_exec));
         }
 
-        g_debug ("GsmSessionSave: saved client %s to %s", id, filename);
+        journal_add_record (data->journal,
+                            saved != NULL ? "update" : "add",
+                            startup_id, checksum, discard_exec);
+
+        data->n_records++;
+
+        g_hash_table_replace (saved_clients,
+                              g_strdup (startup_id),
+                              saved_client_new (checksum, discard_exec));
+
+        g_debug ("GsmSessionSave: saved client %s to %s", id, path);
 
 out:
         if (keyfile != NULL) {
                 g_key_file_free (keyfile);
         }
 
+        g_free (discard_exec);
+        g_free (checksum);
         g_free (contents);
-        g_free (filename);
         g_free (path);
 
         /* in case of any error, stop saving session */
         if (local_error) {
                 g_propagate_error (data->error, local_error);
-                g_error_free (local_error);
 
                 return TRUE;
         }
@@ -113,142 +571,156 @@ out:
         return FALSE;
 }
 
-void
-gsm_session_save (GsmStore  *client_store,
-                  GError   **error)
+static void
+remove_unsaved_clients (SessionSaveData *data)
 {
-        const char      *save_dir;
-        char            *tmp_dir;
-        SessionSaveData  data;
+        GHashTableIter iter;
+        gpointer       key;
+        gpointer       value;
 
-        g_debug ("GsmSessionSave: Saving session");
+        g_hash_table_iter_init (&iter, saved_clients);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+                SavedClient *saved = value;
+                char        *path;
 
-        save_dir = gsm_util_get_saved_session_dir ();
-        if (save_dir == NULL) {
-                g_warning ("GsmSessionSave: cannot create saved session directory");
-                return;
-        }
+                if (g_hash_table_contains (data->seen, key)) {
+                        continue;
+                }
 
-        tmp_dir = gsm_util_get_empty_tmp_session_dir ();
-        if (tmp_dir == NULL) {
-                g_warning ("GsmSessionSave: cannot create new saved session directory");
-                return;
-        }
+                manifest_invalidate (data);
 
-        /* save the session in a temp directory, and remember the discard
-         * commands */
-        data.dir = tmp_dir;
-        data.discard_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                   g_free, NULL);
-        data.error = error;
+                path = get_client_file_path (data->dir, key);
 
-        gsm_store_foreach (client_store,
-                           (GsmStoreFunc) save_one_client,
-                           &data);
+                g_debug ("GsmSessionSave: removing '%s' from saved session", path);
 
-        if (!*error) {
-                /* remove the old saved session */
-                gsm_session_clear_saved_session (save_dir, data.discard_hash);
+                if (g_unlink (path) != 0 && g_file_test (path, G_FILE_TEST_EXISTS)) {
+                        g_warning ("GsmSessionSave: unable to remove %s", path);
+                }
+                g_free (path);
 
-                /* rename the temp session dir */
-                if (g_file_test (save_dir, G_FILE_TEST_IS_DIR))
-                        g_rmdir (save_dir);
-                g_rename (tmp_dir, save_dir);
-        } else {
-                g_warning ("GsmSessionSave: error saving session: %s", (*error)->message);
-                /* FIXME: we should create a hash table filled with the discard
-                 * commands that are in desktop files from save_dir. */
-                gsm_session_clear_saved_session (tmp_dir, NULL);
-                g_rmdir (tmp_dir);
-        }
+                if (saved->discard_exec != NULL) {
+                        g_ptr_array_add (data->stale_discards,
+                                         g_strdup (saved->discard_exec));
+                }
 
-        g_hash_table_destroy (data.discard_hash);
-        g_free (tmp_dir);
+                journal_add_record (data->journal, "remove", key, NULL, NULL);
+                data->n_records++;
+
+                g_hash_table_iter_remove (&iter);
+        }
 }
 
-static gboolean
-gsm_session_clear_one_client (const char *filename,
-                              GHashTable *discard_hash)
+static void
+run_stale_discards (GPtrArray *stale_discards)
 {
-        gboolean  result = TRUE;
-        GKeyFile *key_file = NULL;
-        char     *discard_exec = NULL;
+        GHashTable     *live_discards;
+        GHashTableIter  iter;
+        gpointer        value;
+        guint           i;
 
-        g_debug ("GsmSessionSave: removing '%s' from saved session", filename);
+        if (stale_discards->len == 0) {
+                return;
+        }
 
-        key_file = g_key_file_new ();
-        if (g_key_file_load_from_file (key_file, filename,
-                                       G_KEY_FILE_NONE, NULL)) {
-                char **argv;
-                int    argc;
+        /* a discard command still referenced by a saved client must
+         * not be run, it would destroy that client's state */
+        live_discards = g_hash_table_new (g_str_hash, g_str_equal);
 
-                discard_exec = g_key_file_get_string (key_file,
-                                                      G_KEY_FILE_DESKTOP_GROUP,
-                                                      GSM_AUTOSTART_APP_DISCARD_KEY,
-                                                      NULL);
-                if (!discard_exec)
-                        goto out;
+        g_hash_table_iter_init (&iter, saved_clients);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                SavedClient *saved = value;
 
-                if (g_hash_table_lookup (discard_hash, discard_exec))
-                        goto out;
+                if (saved->discard_exec != NULL) {
+                        g_hash_table_add (live_discards, saved->discard_exec);
+                }
+        }
 
-                if (!g_shell_parse_argv (discard_exec, &argc, &argv, NULL))
-                        goto out;
+        for (i = 0; i < stale_discards->len; i++) {
+                const char  *discard_exec = g_ptr_array_index (stale_discards, i);
+                char       **argv;
+                int          argc;
 
-                result = g_spawn_async (NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
-                                        NULL, NULL, NULL, NULL) && result;
+                if (g_hash_table_contains (live_discards, discard_exec)) {
+                        continue;
+                }
 
-                g_strfreev (argv);
-        } else {
-                result = FALSE;
-        }
+                /* don't run the same command twice in one save */
+                g_hash_table_add (live_discards, (gpointer) discard_exec);
 
-out:
-        if (key_file)
-                g_key_file_free (key_file);
-        if (discard_exec)
-                g_free (discard_exec);
+                if (!g_shell_parse_argv (discard_exec, &argc, &argv, NULL)) {
+                        continue;
+                }
 
-        result = (g_unlink (filename) == 0) && result;
+                g_debug ("GsmSessionSave: running discard command '%s'", discard_exec);
 
-        return result;
+                g_spawn_async (NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+                               NULL, NULL, NULL, NULL);
+
+                g_strfreev (argv);
+        }
+
+        g_hash_table_destroy (live_discards);
 }
 
-static gboolean
-gsm_session_clear_saved_session (const char *directory,
-                                 GHashTable *discard_hash)
+void
+gsm_session_save (GsmStore  *client_store,
+                  GError   **error)
 {
-        GDir       *dir;
-        const char *filename;
-        gboolean    result = TRUE;
-        GError     *error;
+        const char      *save_dir;
+        SessionSaveData  data;
+        guint            n_saved;
 
-        g_debug ("GsmSessionSave: clearing currently saved session at %s",
-                 directory);
+        g_debug ("GsmSessionSave: Saving session");
 
-        if (directory == NULL) {
-                return FALSE;
+        save_dir = gsm_util_get_saved_session_dir ();
+        if (save_dir == NULL) {
+                g_warning ("GsmSessionSave: cannot create saved session directory");
+                return;
         }
 
-        error = NULL;
-        dir = g_dir_open (directory, 0, &error);
-        if (error) {
-                g_warning ("GsmSessionSave: error loading saved session directory: %s", error->message);
-                g_error_free (error);
-                return FALSE;
-        }
+        journal_load (save_dir);
 
-        while ((filename = g_dir_read_name (dir))) {
-                char *path = g_build_filename (directory,
-                                               filename, NULL);
+        data.dir = save_dir;
+        data.seen = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, NULL);
+        data.journal = g_string_new (NULL);
+        data.n_records = 0;
+        data.stale_discards = g_ptr_array_new_with_free_func (g_free);
+        data.manifest = g_key_file_new ();
+        data.manifest_stale = FALSE;
+        data.error = error;
 
-                result = gsm_session_clear_one_client (path, discard_hash)
-                         && result;
+        gsm_store_foreach (client_store,
+                           (GsmStoreFunc) save_one_client,
+                           &data);
 
-                g_free (path);
+        if (!*error) {
+                remove_unsaved_clients (&data);
+                manifest_write (&data);
+        } else {
+                /* keep the clients we did not get to; what was already
+                 * written is recorded below so the journal stays in
+                 * sync with the directory.  Without a manifest the next
+                 * login reads the client files one by one. */
+                manifest_invalidate (&data);
+                g_warning ("GsmSessionSave: error saving session: %s", (*error)->message);
         }
 
-        g_dir_close (dir);
+        if (!journal_append (save_dir, data.journal)) {
+                journal_needs_compaction = TRUE;
+        }
+        journal_records += data.n_records;
+
+        n_saved = g_hash_table_size (saved_clients);
+        if (journal_needs_compaction
+            || journal_records > MAX (GSM_SESSION_JOURNAL_MIN_RECORDS, 2 * n_saved)) {
+                journal_compact (save_dir);
+        }
+
+        run_stale_discards (data.stale_discards);
 
-        return result;
+        g_key_file_free (data.manifest);
+        g_ptr_array_free (data.stale_discards, TRUE);
+        g_string_free (data.journal, TRUE);
+        g_hash_table_destroy (data.seen);
 }
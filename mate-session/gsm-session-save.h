@@ -28,6 +28,9 @@
 extern "C" {
 #endif
 
+/* packed copy of all saved clients, one group per startup id */
+#define GSM_SESSION_MANIFEST_FILE "session.manifest"
+
 void      gsm_session_save                 (GsmStore  *client_store,
                                             GError   **error);
 
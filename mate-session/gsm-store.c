@@ -31,16 +31,24 @@
 #include <glib-object.h>
 
 #include "gsm-store.h"
+#include "gsm-marshal.h"
+#include "mdm-log.h"
 
 typedef struct
 {
         GHashTable *objects;
         gboolean    locked;
+
+        /* changes held back until the outermost end_batch() */
+        guint       batch_depth;
+        GHashTable *batch_added;
+        GHashTable *batch_removed;
 } GsmStorePrivate;
 
 enum {
         ADDED,
         REMOVED,
+        ITEMS_CHANGED,
         LAST_SIGNAL
 };
 
@@ -74,6 +82,112 @@ gsm_store_size (GsmStore    *store)
         return g_hash_table_size (priv->objects);
 }
 
+static void
+batch_record_added (GsmStorePrivate *priv,
+                    const char      *id)
+{
+        if (priv->batch_added == NULL) {
+                priv->batch_added = g_hash_table_new_full (g_str_hash,
+                                                           g_str_equal,
+                                                           g_free,
+                                                           NULL);
+        }
+
+        g_hash_table_add (priv->batch_added, g_strdup (id));
+}
+
+static void
+batch_record_removed (GsmStorePrivate *priv,
+                      const char      *id)
+{
+        /* nobody has seen an object that comes and goes within
+         * one batch */
+        if (priv->batch_added != NULL
+            && g_hash_table_remove (priv->batch_added, id)) {
+                return;
+        }
+
+        if (priv->batch_removed == NULL) {
+                priv->batch_removed = g_hash_table_new_full (g_str_hash,
+                                                             g_str_equal,
+                                                             g_free,
+                                                             NULL);
+        }
+
+        g_hash_table_add (priv->batch_removed, g_strdup (id));
+}
+
+static char **
+batch_steal_ids (GHashTable **table)
+{
+        char **ids;
+
+        if (*table == NULL) {
+                return g_new0 (char *, 1);
+        }
+
+        ids = (char **) g_hash_table_get_keys_as_array (*table, NULL);
+        g_hash_table_steal_all (*table);
+        g_hash_table_destroy (*table);
+        *table = NULL;
+
+        return ids;
+}
+
+/**
+ * gsm_store_begin_batch:
+ * @store: a #GsmStore
+ *
+ * Holds back the "added" and "removed" signals until the matching
+ * gsm_store_end_batch(), which reports all changes at once through
+ * "items-changed".  Batches may be nested.
+ */
+void
+gsm_store_begin_batch (GsmStore *store)
+{
+        GsmStorePrivate *priv;
+
+        g_return_if_fail (GSM_IS_STORE (store));
+
+        priv = gsm_store_get_instance_private (store);
+        priv->batch_depth++;
+}
+
+void
+gsm_store_end_batch (GsmStore *store)
+{
+        GsmStorePrivate *priv;
+        char           **added;
+        char           **removed;
+
+        g_return_if_fail (GSM_IS_STORE (store));
+
+        priv = gsm_store_get_instance_private (store);
+        g_return_if_fail (priv->batch_depth > 0);
+
+        priv->batch_depth--;
+        if (priv->batch_depth > 0) {
+                return;
+        }
+
+        if (priv->batch_added == NULL && priv->batch_removed == NULL) {
+                return;
+        }
+
+        /* steal the pending ids first, handlers may start a new batch */
+        added = batch_steal_ids (&priv->batch_added);
+        removed = batch_steal_ids (&priv->batch_removed);
+
+        if (added[0] != NULL || removed[0] != NULL) {
+                g_debug ("GsmStore: emitting items-changed (%u added, %u removed)",
+                         g_strv_length (added), g_strv_length (removed));
+                g_signal_emit (store, signals [ITEMS_CHANGED], 0, added, removed);
+        }
+
+        g_strfreev (added);
+        g_strfreev (removed);
+}
+
 gboolean
 gsm_store_remove (GsmStore   *store,
                   const char *id)
@@ -98,7 +212,11 @@ gsm_store_remove (GsmStore   *store,
         removed = g_hash_table_remove (priv->objects, id_copy);
         g_assert (removed);
 
-        g_signal_emit (store, signals [REMOVED], 0, id_copy);
+        if (priv->batch_depth > 0) {
+                batch_record_removed (priv, id_copy);
+        } else {
+                g_signal_emit (store, signals [REMOVED], 0, id_copy);
+        }
 
         g_object_unref (found);
         g_free (id_copy);
@@ -158,10 +276,9 @@ gsm_store_lookup (GsmStore   *store,
 
 typedef struct
 {
-        GsmStoreFunc func;
-        gpointer     user_data;
-        GsmStore    *store;
-        GList       *removed;
+        GsmStoreFunc     func;
+        gpointer         user_data;
+        GsmStorePrivate *priv;
 } WrapperData;
 
 static gboolean
@@ -173,7 +290,7 @@ foreach_remove_wrapper (const char  *id,
 
         res = (data->func) (id, object, data->user_data);
         if (res) {
-                data->removed = g_list_prepend (data->removed, g_strdup (id));
+                batch_record_removed (data->priv, id);
         }
 
         return res;
@@ -192,24 +309,18 @@ gsm_store_foreach_remove (GsmStore    *store,
         g_return_val_if_fail (func != NULL, 0);
         priv = gsm_store_get_instance_private (store);
 
-        data.store = store;
+        data.priv = priv;
         data.user_data = user_data;
         data.func = func;
-        data.removed = NULL;
+
+        /* all removals are reported in a single items-changed */
+        gsm_store_begin_batch (store);
 
         ret = g_hash_table_foreach_remove (priv->objects,
                                            (GHRFunc)foreach_remove_wrapper,
                                            &data);
 
-        while (data.removed != NULL) {
-                char *id;
-                id = data.removed->data;
-                g_debug ("GsmStore: emitting removed for %s", id);
-                g_signal_emit (store, signals [REMOVED], 0, id);
-                g_free (data.removed->data);
-                data.removed->data = NULL;
-                data.removed = g_list_delete_link (data.removed, data.removed);
-        }
+        gsm_store_end_batch (store);
 
         return ret;
 }
@@ -252,13 +363,17 @@ gsm_store_add (GsmStore   *store,
                 return FALSE;
         }
 
-        g_debug ("GsmStore: Adding object id %s to store", id);
+        mdm_log_debug_for ("GsmStore", NULL, NULL, "Adding object id %s to store", id);
 
         g_hash_table_insert (priv->objects,
                              g_strdup (id),
                              g_object_ref (object));
 
-        g_signal_emit (store, signals [ADDED], 0, id);
+        if (priv->batch_depth > 0) {
+                batch_record_added (priv, id);
+        } else {
+                g_signal_emit (store, signals [ADDED], 0, id);
+        }
 
         return TRUE;
 }
@@ -371,6 +486,16 @@ gsm_store_class_init (GsmStoreClass *klass)
                               g_cclosure_marshal_VOID__STRING,
                               G_TYPE_NONE,
                               1, G_TYPE_STRING);
+        signals [ITEMS_CHANGED] =
+                g_signal_new ("items-changed",
+                              G_TYPE_FROM_CLASS (object_class),
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (GsmStoreClass, items_changed),
+                              NULL,
+                              NULL,
+                              gsm_marshal_VOID__BOXED_BOXED,
+                              G_TYPE_NONE,
+                              2, G_TYPE_STRV, G_TYPE_STRV);
         g_object_class_install_property (object_class,
                                          PROP_LOCKED,
                                          g_param_spec_boolean ("locked",
@@ -383,7 +508,7 @@ gsm_store_class_init (GsmStoreClass *klass)
 static void
 _destroy_object (GObject *object)
 {
-        g_debug ("GsmStore: Unreffing object: %p", object);
+        mdm_log_debug_for ("GsmStore", NULL, NULL, "Unreffing object: %p", object);
         g_object_unref (object);
 }
 
@@ -415,6 +540,13 @@ gsm_store_finalize (GObject *object)
 
         g_hash_table_destroy (priv->objects);
 
+        if (priv->batch_added != NULL) {
+                g_hash_table_destroy (priv->batch_added);
+        }
+        if (priv->batch_removed != NULL) {
+                g_hash_table_destroy (priv->batch_removed);
+        }
+
         G_OBJECT_CLASS (gsm_store_parent_class)->finalize (object);
 }
 
@@ -37,6 +37,9 @@ struct _GsmStoreClass
                                     const char *id);
         void          (* removed)  (GsmStore   *store,
                                     const char *id);
+        void          (* items_changed) (GsmStore           *store,
+                                         const char * const *added,
+                                         const char * const *removed);
 };
 
 typedef enum
@@ -63,6 +66,8 @@ gboolean            gsm_store_add                      (GsmStore    *store,
                                                         const char  *id,
                                                         GObject     *object);
 void                gsm_store_clear                    (GsmStore    *store);
+void                gsm_store_begin_batch              (GsmStore    *store);
+void                gsm_store_end_batch                (GsmStore    *store);
 gboolean            gsm_store_remove                   (GsmStore    *store,
                                                         const char  *id);
 
@@ -27,9 +27,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gi18n.h>
-
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-lowlevel.h>
+#include <gio/gio.h>
 
 #ifdef HAVE_SYSTEMD
 #include <systemd/sd-login.h>
@@ -44,12 +42,22 @@
 #define SD_SEAT_INTERFACE    "org.freedesktop.login1.Seat"
 #define SD_SESSION_INTERFACE "org.freedesktop.login1.Session"
 
+/* The proxies for the logind manager and for our own session are
+ * created asynchronously when the object is created and then kept;
+ * GDBusProxy caches the session properties and keeps them up to date
+ * from PropertiesChanged.  Everything that doesn't need an answer is
+ * sent without waiting for one.
+ */
+
 typedef struct
 {
-    DBusGConnection *dbus_connection;
-    DBusGProxy      *bus_proxy;
-    DBusGProxy      *sd_proxy;
-    guint32          is_connected : 1;
+    GCancellable    *cancellable;
+    GDBusProxy      *sd_proxy;
+    GDBusProxy      *session_proxy;
+    gboolean         is_connected;
+
+    gboolean         idle_hint_pending;
+    gboolean         idle_hint;
 } GsmSystemdPrivate;
 
 enum {
@@ -67,17 +75,7 @@ static guint signals[LAST_SIGNAL] = { 0 };
 
 static void     gsm_systemd_finalize     (GObject         *object);
 
-static void     gsm_systemd_free_dbus    (GsmSystemd      *manager);
-
-static DBusHandlerResult gsm_systemd_dbus_filter (DBusConnection *connection,
-                                                     DBusMessage    *message,
-                                                     void           *user_data);
-
-static void     gsm_systemd_on_name_owner_changed (DBusGProxy       *bus_proxy,
-                                                   const char       *name,
-                                                   const char       *prev_owner,
-                                                   const char       *new_owner,
-                                                   GsmSystemd       *manager);
+static void     gsm_systemd_sync_idle_hint (GsmSystemd    *manager);
 
 G_DEFINE_TYPE_WITH_PRIVATE (GsmSystemd, gsm_systemd, G_TYPE_OBJECT);
 
@@ -148,203 +146,211 @@ gsm_systemd_class_init (GsmSystemdClass *manager_class)
                           3, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN, G_TYPE_POINTER);
 }
 
-static DBusHandlerResult
-gsm_systemd_dbus_filter (DBusConnection *connection,
-                         DBusMessage    *message,
-                         void           *user_data)
+static void
+gsm_systemd_update_is_connected (GsmSystemd *manager)
 {
-    GsmSystemd *manager;
+    GsmSystemdPrivate *priv;
+    gchar             *name_owner;
+    gboolean           is_connected;
 
-    manager = GSM_SYSTEMD (user_data);
+    priv = gsm_systemd_get_instance_private (manager);
 
-    if (dbus_message_is_signal (message,
-                                DBUS_INTERFACE_LOCAL, "Disconnected") &&
-        strcmp (dbus_message_get_path (message), DBUS_PATH_LOCAL) == 0) {
-            gsm_systemd_free_dbus (manager);
-            return DBUS_HANDLER_RESULT_HANDLED;
+    name_owner = NULL;
+    if (priv->sd_proxy != NULL) {
+        name_owner = g_dbus_proxy_get_name_owner (priv->sd_proxy);
     }
 
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    is_connected = (name_owner != NULL);
+    g_free (name_owner);
+
+    if (priv->is_connected != is_connected) {
+        priv->is_connected = is_connected;
+        g_object_notify (G_OBJECT (manager), "is-connected");
+    }
 }
 
-static gboolean
-gsm_systemd_ensure_sd_connection (GsmSystemd  *manager,
-                                  GError     **error)
+static void
+gsm_systemd_on_name_owner_notify (GDBusProxy *proxy,
+                                  GParamSpec *pspec,
+                                  GsmSystemd *manager)
 {
-    GError  *connection_error;
-    gboolean is_connected;
-    GsmSystemdPrivate *priv;
+    gsm_systemd_update_is_connected (manager);
+}
 
-    connection_error = NULL;
+static void
+gsm_systemd_set_sd_proxy (GsmSystemd *manager,
+                          GDBusProxy *proxy)
+{
+    GsmSystemdPrivate *priv;
 
     priv = gsm_systemd_get_instance_private (manager);
 
-    if (priv->dbus_connection == NULL) {
-        DBusConnection *connection;
+    priv->sd_proxy = proxy;
+    g_signal_connect (proxy,
+                      "notify::g-name-owner",
+                      G_CALLBACK (gsm_systemd_on_name_owner_notify),
+                      manager);
 
-        priv->dbus_connection = dbus_g_bus_get (DBUS_BUS_SYSTEM,
-                                                &connection_error);
-
-        if (priv->dbus_connection == NULL) {
-            g_propagate_error (error, connection_error);
-            is_connected = FALSE;
-            goto out;
-        }
-
-        connection = dbus_g_connection_get_connection (priv->dbus_connection);
-        dbus_connection_set_exit_on_disconnect (connection, FALSE);
-        dbus_connection_add_filter (connection,
-                                    gsm_systemd_dbus_filter,
-                                    manager, NULL);
-    }
-
-    if (priv->bus_proxy == NULL) {
-        priv->bus_proxy =
-            dbus_g_proxy_new_for_name_owner (priv->dbus_connection,
-                                             DBUS_SERVICE_DBUS,
-                                             DBUS_PATH_DBUS,
-                                             DBUS_INTERFACE_DBUS,
-                                             &connection_error);
-
-        if (priv->bus_proxy == NULL) {
-            g_propagate_error (error, connection_error);
-            is_connected = FALSE;
-            goto out;
-        }
+    gsm_systemd_update_is_connected (manager);
+}
 
-        dbus_g_proxy_add_signal (priv->bus_proxy,
-                                 "NameOwnerChanged",
-                                 G_TYPE_STRING,
-                                 G_TYPE_STRING,
-                                 G_TYPE_STRING,
-                                 G_TYPE_INVALID);
-
-        dbus_g_proxy_connect_signal (priv->bus_proxy,
-                                     "NameOwnerChanged",
-                                     G_CALLBACK (gsm_systemd_on_name_owner_changed),
-                                     manager, NULL);
-    }
+static void
+on_session_proxy_ready (GObject      *source,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+    GsmSystemd        *manager;
+    GsmSystemdPrivate *priv;
+    GDBusProxy        *proxy;
+    GError            *error;
 
-    if (priv->sd_proxy == NULL) {
-        priv->sd_proxy =
-                dbus_g_proxy_new_for_name_owner (priv->dbus_connection,
-                                                 SD_NAME,
-                                                 SD_PATH,
-                                                 SD_INTERFACE,
-                                                 &connection_error);
-
-        if (priv->sd_proxy == NULL) {
-            g_propagate_error (error, connection_error);
-            is_connected = FALSE;
-            goto out;
+    error = NULL;
+    proxy = g_dbus_proxy_new_finish (result, &error);
+    if (proxy == NULL) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_warning ("Could not get the Systemd session: %s",
+                       error->message);
         }
+        g_error_free (error);
+        return;
     }
 
-    is_connected = TRUE;
+    manager = GSM_SYSTEMD (user_data);
+    priv = gsm_systemd_get_instance_private (manager);
 
-out:
-    if (priv->is_connected != is_connected) {
-        priv->is_connected = is_connected;
-        g_object_notify (G_OBJECT (manager), "is-connected");
-    }
+    priv->session_proxy = proxy;
 
-    if (!is_connected) {
-        if (priv->dbus_connection == NULL) {
-            if (priv->bus_proxy != NULL) {
-                g_object_unref (priv->bus_proxy);
-                priv->bus_proxy = NULL;
-            }
-
-            if (priv->sd_proxy != NULL) {
-                g_object_unref (priv->sd_proxy);
-                priv->sd_proxy = NULL;
-            }
-        } else if (priv->bus_proxy == NULL) {
-            if (priv->sd_proxy != NULL) {
-                g_object_unref (priv->sd_proxy);
-                priv->sd_proxy = NULL;
-            }
-        }
+    if (priv->idle_hint_pending) {
+        gsm_systemd_sync_idle_hint (manager);
     }
-
-    return is_connected;
 }
 
 static void
-gsm_systemd_on_name_owner_changed (DBusGProxy    *bus_proxy,
-                                   const char    *name,
-                                   const char    *prev_owner,
-                                   const char    *new_owner,
-                                   GsmSystemd    *manager)
+on_get_session_finished (GObject      *source,
+                         GAsyncResult *result,
+                         gpointer      user_data)
 {
     GsmSystemdPrivate *priv;
+    GVariant          *reply;
+    GError            *error;
+    const char        *session_path;
 
-    priv = gsm_systemd_get_instance_private (manager);
-    if (name != NULL && g_strcmp0 (name, SD_NAME) != 0) {
+    error = NULL;
+    reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+    if (reply == NULL) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_warning ("Unable to get session path: %s", error->message);
+        }
+        g_error_free (error);
         return;
     }
 
-    if (priv->sd_proxy != NULL) {
-        g_object_unref (priv->sd_proxy);
-        priv->sd_proxy = NULL;
-    }
+    priv = gsm_systemd_get_instance_private (GSM_SYSTEMD (user_data));
 
-    gsm_systemd_ensure_sd_connection (manager, NULL);
+    g_variant_get (reply, "(&o)", &session_path);
+    g_dbus_proxy_new (g_dbus_proxy_get_connection (G_DBUS_PROXY (source)),
+                      G_DBUS_PROXY_FLAGS_NONE,
+                      NULL,
+                      SD_NAME,
+                      session_path,
+                      SD_SESSION_INTERFACE,
+                      priv->cancellable,
+                      on_session_proxy_ready,
+                      user_data);
+    g_variant_unref (reply);
 }
 
 static void
-gsm_systemd_init (GsmSystemd *manager)
+on_sd_proxy_ready (GObject      *source,
+                   GAsyncResult *result,
+                   gpointer      user_data)
 {
-    GError *error;
+    GsmSystemd        *manager;
+    GsmSystemdPrivate *priv;
+    GDBusProxy        *proxy;
+    GError            *error;
+    gchar             *session_id = NULL;
 
     error = NULL;
-
-    if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-        g_warning ("Could not connect to Systemd: %s",
-                   error->message);
+    proxy = g_dbus_proxy_new_for_bus_finish (result, &error);
+    if (proxy == NULL) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_warning ("Could not connect to Systemd: %s",
+                       error->message);
+        }
         g_error_free (error);
+        return;
+    }
+
+    manager = GSM_SYSTEMD (user_data);
+    priv = gsm_systemd_get_instance_private (manager);
+
+    gsm_systemd_set_sd_proxy (manager, proxy);
+
+#ifdef HAVE_SYSTEMD
+    sd_pid_get_session (getpid (), &session_id);
+#endif
+
+    if (session_id == NULL) {
+        return;
     }
+
+    g_dbus_proxy_call (priv->sd_proxy,
+                       "GetSession",
+                       g_variant_new ("(s)", session_id),
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       priv->cancellable,
+                       on_get_session_finished,
+                       manager);
+    g_free (session_id);
 }
 
 static void
-gsm_systemd_free_dbus (GsmSystemd *manager)
+gsm_systemd_init (GsmSystemd *manager)
 {
     GsmSystemdPrivate *priv;
 
     priv = gsm_systemd_get_instance_private (manager);
-    if (priv->bus_proxy != NULL) {
-        g_object_unref (priv->bus_proxy);
-        priv->bus_proxy = NULL;
-    }
-
-    if (priv->sd_proxy != NULL) {
-        g_object_unref (priv->sd_proxy);
-        priv->sd_proxy = NULL;
-    }
-
-    if (priv->dbus_connection != NULL) {
-        DBusConnection *connection;
-        connection = dbus_g_connection_get_connection (priv->dbus_connection);
-        dbus_connection_remove_filter (connection,
-                                       gsm_systemd_dbus_filter,
-                                       manager);
 
-        dbus_g_connection_unref (priv->dbus_connection);
-        priv->dbus_connection = NULL;
-    }
+    priv->cancellable = g_cancellable_new ();
+
+    g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                              G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                              NULL,
+                              SD_NAME,
+                              SD_PATH,
+                              SD_INTERFACE,
+                              priv->cancellable,
+                              on_sd_proxy_ready,
+                              manager);
 }
 
 static void
 gsm_systemd_finalize (GObject *object)
 {
-    GsmSystemd *manager;
-    GObjectClass  *parent_class;
+    GsmSystemd        *manager;
+    GsmSystemdPrivate *priv;
+    GObjectClass      *parent_class;
 
     manager = GSM_SYSTEMD (object);
+    priv = gsm_systemd_get_instance_private (manager);
 
     parent_class = G_OBJECT_CLASS (gsm_systemd_parent_class);
 
-    gsm_systemd_free_dbus (manager);
+    g_cancellable_cancel (priv->cancellable);
+    g_object_unref (priv->cancellable);
+
+    if (priv->sd_proxy != NULL) {
+        g_signal_handlers_disconnect_by_func (priv->sd_proxy,
+                                              gsm_systemd_on_name_owner_notify,
+                                              manager);
+        g_object_unref (priv->sd_proxy);
+    }
+
+    if (priv->session_proxy != NULL) {
+        g_object_unref (priv->session_proxy);
+    }
 
     if (parent_class->finalize != NULL) {
         parent_class->finalize (object);
@@ -503,228 +509,229 @@ gsm_systemd_is_last_session_for_user (GsmSystemd *manager)
         return is_last_session;
 }
 
-void
-gsm_systemd_attempt_restart (GsmSystemd *manager)
-{
-    gboolean res;
-    GError  *error;
-    GsmSystemdPrivate *priv;
+typedef enum {
+    SD_REQUEST_RESTART,
+    SD_REQUEST_STOP,
+    SD_REQUEST_SUSPEND,
+    SD_REQUEST_HIBERNATE
+} SdRequest;
 
-    error = NULL;
-    priv = gsm_systemd_get_instance_private (manager);
+typedef struct {
+    GsmSystemd *manager;
+    SdRequest   request;
+    const char *method;
+} SdRequestData;
 
-    if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-        g_warning ("Could not connect to Systemd: %s",
-                   error->message);
+static void
+emit_request_complete (GsmSystemd *manager,
+                       SdRequest   request,
+                       GError     *error)
+{
+    switch (request) {
+    case SD_REQUEST_RESTART:
         emit_restart_complete (manager, error);
-        g_error_free (error);
-        return;
+        break;
+    case SD_REQUEST_STOP:
+        emit_stop_complete (manager, error);
+        break;
+    default:
+        /* Nobody waits for suspend or hibernate */
+        break;
     }
+}
 
-    res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                          "Reboot",
-                                          INT_MAX,
-                                          &error,
-                                          G_TYPE_BOOLEAN, TRUE, /* interactive */
-                                          G_TYPE_INVALID,
-                                          G_TYPE_INVALID);
+static void
+on_request_finished (GObject      *source,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+    SdRequestData *data = user_data;
+    GVariant      *reply;
+    GError        *error;
 
-    if (!res) {
-        g_warning ("Unable to restart system: %s", error->message);
-        emit_restart_complete (manager, error);
+    error = NULL;
+    reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+    if (reply == NULL) {
+        g_warning ("Unable to %s system: %s",
+                   data->request == SD_REQUEST_RESTART ? "restart" :
+                   data->request == SD_REQUEST_STOP ? "stop" :
+                   data->request == SD_REQUEST_SUSPEND ? "suspend" : "hibernate",
+                   error->message);
+        emit_request_complete (data->manager, data->request, error);
         g_error_free (error);
     } else {
-        emit_restart_complete (manager, NULL);
+        g_variant_unref (reply);
+        emit_request_complete (data->manager, data->request, NULL);
     }
+
+    g_object_unref (data->manager);
+    g_free (data);
 }
 
-void
-gsm_systemd_attempt_stop (GsmSystemd *manager)
+static void
+send_request (GDBusConnection *connection,
+              SdRequestData   *data)
 {
-    gboolean res;
-    GError  *error;
-    GsmSystemdPrivate *priv;
+    /* Interactive requests may wait for the user to authenticate, so
+     * there is no timeout; the reply is handled whenever it comes */
+    g_dbus_connection_call (connection,
+                            SD_NAME,
+                            SD_PATH,
+                            SD_INTERFACE,
+                            data->method,
+                            g_variant_new ("(b)", TRUE), /* interactive */
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            G_MAXINT,
+                            NULL,
+                            on_request_finished,
+                            data);
+}
 
-    error = NULL;
-    priv = gsm_systemd_get_instance_private (manager);
+static void
+on_system_bus_ready (GObject      *source,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+    SdRequestData   *data = user_data;
+    GDBusConnection *connection;
+    GError          *error;
 
-    if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
+    error = NULL;
+    connection = g_bus_get_finish (result, &error);
+    if (connection == NULL) {
         g_warning ("Could not connect to Systemd: %s",
                    error->message);
-        emit_stop_complete (manager, error);
+        emit_request_complete (data->manager, data->request, error);
         g_error_free (error);
+        g_object_unref (data->manager);
+        g_free (data);
         return;
     }
 
-    res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                          "PowerOff",
-                                          INT_MAX,
-                                          &error,
-                                          G_TYPE_BOOLEAN, TRUE, /* interactive */
-                                          G_TYPE_INVALID,
-                                          G_TYPE_INVALID);
-
-    if (!res) {
-        g_warning ("Unable to stop system: %s", error->message);
-        emit_stop_complete (manager, error);
-        g_error_free (error);
-    } else {
-        emit_stop_complete (manager, NULL);
-    }
+    send_request (connection, data);
+    g_object_unref (connection);
 }
 
 static void
-gsm_systemd_get_session_path (DBusConnection  *connection,
-                              char           **session_path)
+gsm_systemd_attempt (GsmSystemd *manager,
+                     SdRequest   request,
+                     const char *method)
 {
-    DBusError       local_error;
-    DBusMessage    *message;
-    DBusMessage    *reply;
-    DBusMessageIter iter;
-    gchar          *session_id = NULL;
-
-#ifdef HAVE_SYSTEMD
-    sd_pid_get_session (getpid (), &session_id);
-#endif
-
-    if (session_id == NULL)
-        return;
-
-    reply = NULL;
+    GsmSystemdPrivate *priv;
+    SdRequestData     *data;
 
-    dbus_error_init (&local_error);
-    message = dbus_message_new_method_call (SD_NAME,
-                                            SD_PATH,
-                                            SD_INTERFACE,
-                                            "GetSession");
-    if (message == NULL) {
-            goto out;
-    }
+    priv = gsm_systemd_get_instance_private (manager);
 
-    dbus_message_iter_init_append (message, &iter);
-    dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &session_id);
+    data = g_new0 (SdRequestData, 1);
+    data->manager = g_object_ref (manager);
+    data->request = request;
+    data->method = method;
 
-    dbus_error_init (&local_error);
-    reply = dbus_connection_send_with_reply_and_block (connection,
-                                                       message,
-                                                       -1,
-                                                       &local_error);
-    if (reply == NULL) {
-        if (dbus_error_is_set (&local_error)) {
-            g_warning ("Unable to get session path: %s", local_error.message);
-            dbus_error_free (&local_error);
-            goto out;
-        }
+    /* The proxy may not be set up yet; never wait for it */
+    if (priv->sd_proxy != NULL) {
+        send_request (g_dbus_proxy_get_connection (priv->sd_proxy), data);
+    } else {
+        g_bus_get (G_BUS_TYPE_SYSTEM, NULL, on_system_bus_ready, data);
     }
+}
 
-    dbus_message_iter_init (reply, &iter);
-    dbus_message_iter_get_basic (&iter, session_path);
+void
+gsm_systemd_attempt_restart (GsmSystemd *manager)
+{
+    gsm_systemd_attempt (manager, SD_REQUEST_RESTART, "Reboot");
+}
 
-out:
-    if (message != NULL) {
-        dbus_message_unref (message);
-    }
-    if (reply != NULL) {
-        dbus_message_unref (reply);
-    }
-    if (session_id != NULL) {
-        g_free (session_id);
-    }
+void
+gsm_systemd_attempt_stop (GsmSystemd *manager)
+{
+    gsm_systemd_attempt (manager, SD_REQUEST_STOP, "PowerOff");
 }
 
+void
+gsm_systemd_attempt_hibernate (GsmSystemd *manager)
+{
+    gsm_systemd_attempt (manager, SD_REQUEST_HIBERNATE, "Hibernate");
+}
 
 void
-gsm_systemd_set_session_idle (GsmSystemd *manager,
-                              gboolean       is_idle)
+gsm_systemd_attempt_suspend (GsmSystemd *manager)
 {
-    GError         *error;
-    char           *session_path = NULL;
-    DBusMessage    *message;
-    DBusMessage    *reply;
-    DBusError       dbus_error;
-    DBusMessageIter iter;
-    GsmSystemdPrivate *priv;
+    gsm_systemd_attempt (manager, SD_REQUEST_SUSPEND, "Suspend");
+}
 
-    error = NULL;
-    priv = gsm_systemd_get_instance_private (manager);
+static void
+on_set_idle_hint_finished (GObject      *source,
+                           GAsyncResult *result,
+                           gpointer      user_data)
+{
+    GVariant *reply;
+    GError   *error;
 
-    if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-        g_warning ("Could not connect to Systemd: %s",
-                   error->message);
+    error = NULL;
+    reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+    if (reply == NULL) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_debug ("Could not update Systemd idle status: %s", error->message);
+        }
         g_error_free (error);
         return;
     }
 
-    gsm_systemd_get_session_path (dbus_g_connection_get_connection (priv->dbus_connection), &session_path);
+    g_variant_unref (reply);
+}
 
-    g_return_if_fail (session_path != NULL);
+static void
+gsm_systemd_sync_idle_hint (GsmSystemd *manager)
+{
+    GsmSystemdPrivate *priv;
+    GVariant          *cached;
 
-    g_debug ("Updating Systemd idle status: %d", is_idle);
-    message = dbus_message_new_method_call (SD_NAME,
-                                            session_path,
-                                            SD_SESSION_INTERFACE,
-                                            "SetIdleHint");
-    if (message == NULL) {
-            g_debug ("Couldn't allocate the D-Bus message");
-            return;
-    }
+    priv = gsm_systemd_get_instance_private (manager);
 
-    dbus_message_iter_init_append (message, &iter);
-    dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &is_idle);
+    priv->idle_hint_pending = FALSE;
 
-    /* FIXME: use async? */
-    dbus_error_init (&dbus_error);
-    reply = dbus_connection_send_with_reply_and_block (dbus_g_connection_get_connection (priv->dbus_connection),
-                                                       message,
-                                                       -1,
-                                                       &dbus_error);
-    dbus_message_unref (message);
+    /* logind already knows */
+    cached = g_dbus_proxy_get_cached_property (priv->session_proxy, "IdleHint");
+    if (cached != NULL) {
+        gboolean current;
 
-    if (reply != NULL) {
-        dbus_message_unref (reply);
-    }
+        current = g_variant_get_boolean (cached);
+        g_variant_unref (cached);
 
-    if (dbus_error_is_set (&dbus_error)) {
-        g_debug ("%s raised:\n %s\n\n", dbus_error.name, dbus_error.message);
-        dbus_error_free (&dbus_error);
+        if (current == priv->idle_hint) {
+            return;
+        }
     }
+
+    g_debug ("Updating Systemd idle status: %d", priv->idle_hint);
+    g_dbus_proxy_call (priv->session_proxy,
+                       "SetIdleHint",
+                       g_variant_new ("(b)", priv->idle_hint),
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       priv->cancellable,
+                       on_set_idle_hint_finished,
+                       NULL);
 }
 
-gboolean
-gsm_systemd_can_switch_user (GsmSystemd *manager)
+void
+gsm_systemd_set_session_idle (GsmSystemd *manager,
+                              gboolean       is_idle)
 {
-    GError  *error;
-    char    *session_id = NULL;
-#ifdef HAVE_SYSTEMD
-    char    *seat_id = NULL;
-#endif
-    int      ret = 0;
-
-    error = NULL;
-
-    if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-        g_warning ("Could not connect to Systemd: %s",
-                   error->message);
-        g_error_free (error);
-        return FALSE;
-    }
-
-#ifdef HAVE_SYSTEMD
-    sd_pid_get_session (getpid (), &session_id);
-#endif
+    GsmSystemdPrivate *priv;
 
-    if (session_id == NULL)
-        return FALSE;
+    priv = gsm_systemd_get_instance_private (manager);
 
-#ifdef HAVE_SYSTEMD
-    sd_session_get_seat (session_id, &seat_id);
-    ret = sd_seat_can_multi_session (seat_id);
+    priv->idle_hint = is_idle;
 
-    g_free (session_id);
-    g_free (seat_id);
-#endif
+    if (priv->session_proxy == NULL) {
+        /* Sent as soon as we know our session */
+        priv->idle_hint_pending = TRUE;
+        return;
+    }
 
-    return ret > 0;
+    gsm_systemd_sync_idle_hint (manager);
 }
 
 gboolean
@@ -747,245 +754,27 @@ gsm_systemd_get_stop_privileges (GsmSystemd *manager)
     return TRUE;
 }
 
-gboolean
-gsm_systemd_can_restart (GsmSystemd *manager)
-{
-    gboolean res;
-    gchar   *value;
-    gboolean can_restart;
-    GError  *error;
-    GsmSystemdPrivate *priv;
-
-    error = NULL;
-    priv = gsm_systemd_get_instance_private (manager);
-
-    if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-        g_warning ("Could not connect to Systemd: %s",
-                   error->message);
-        g_error_free (error);
-        return FALSE;
-    }
-
-    res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                          "CanReboot",
-                                          INT_MAX,
-                                          &error,
-                                          G_TYPE_INVALID,
-                                          G_TYPE_STRING, &value,
-                                          G_TYPE_INVALID);
-    if (res == FALSE) {
-        g_warning ("Could not make DBUS call: %s",
-                   error->message);
-        g_error_free (error);
-        return FALSE;
-    }
-
-    can_restart = g_strcmp0 (value, "yes") == 0 ||
-                  g_strcmp0 (value, "challenge") == 0;
-    g_free (value);
-    return can_restart;
-}
-
-gboolean
-gsm_systemd_can_stop (GsmSystemd *manager)
-{
-    gboolean res;
-    gchar   *value;
-    gboolean can_stop;
-    GError  *error;
-    GsmSystemdPrivate *priv;
-
-    error = NULL;
-    priv = gsm_systemd_get_instance_private (manager);
-
-    if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-        g_warning ("Could not connect to Systemd: %s",
-                   error->message);
-        g_error_free (error);
-        return FALSE;
-    }
-
-    res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                          "CanPowerOff",
-                                          INT_MAX,
-                                          &error,
-                                          G_TYPE_INVALID,
-                                          G_TYPE_STRING, &value,
-                                          G_TYPE_INVALID);
-
-    if (res == FALSE) {
-        g_warning ("Could not make DBUS call: %s",
-                   error->message);
-        g_error_free (error);
-        return FALSE;
-    }
-
-    can_stop = g_strcmp0 (value, "yes") == 0 ||
-               g_strcmp0 (value, "challenge") == 0;
-    g_free (value);
-    return can_stop;
-}
-
-gboolean
-gsm_systemd_can_hibernate (GsmSystemd *manager)
-{
-  gboolean res;
-  gchar   *value;
-  gboolean can_hibernate;
-  GError  *error;
-  GsmSystemdPrivate *priv;
-
-  error = NULL;
-  priv = gsm_systemd_get_instance_private (manager);
-
-  if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-    g_warning ("Could not connect to Systemd: %s",
-               error->message);
-    g_error_free (error);
-    return FALSE;
-  }
-
-  res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                        "CanHibernate",
-                                        INT_MAX,
-                                        &error,
-                                        G_TYPE_INVALID,
-                                        G_TYPE_STRING, &value,
-                                        G_TYPE_INVALID);
-  if (res == FALSE) {
-    g_warning ("Could not make DBUS call: %s",
-               error->message);
-    g_error_free (error);
-    return FALSE;
-  }
-
-  can_hibernate = g_strcmp0 (value, "yes") == 0 ||
-  g_strcmp0 (value, "challenge") == 0;
-  g_free (value);
-  return can_hibernate;
-}
-
-gboolean
-gsm_systemd_can_suspend (GsmSystemd *manager)
-{
-  gboolean res;
-  gchar   *value;
-  gboolean can_suspend;
-  GError  *error;
-  GsmSystemdPrivate *priv;
-
-  error = NULL;
-  priv = gsm_systemd_get_instance_private (manager);
-
-  if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-    g_warning ("Could not connect to Systemd: %s",
-               error->message);
-    g_error_free (error);
-    return FALSE;
-  }
-
-  res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                        "CanSuspend",
-                                        INT_MAX,
-                                        &error,
-                                        G_TYPE_INVALID,
-                                        G_TYPE_STRING, &value,
-                                        G_TYPE_INVALID);
-  if (res == FALSE) {
-    g_warning ("Could not make DBUS call: %s",
-               error->message);
-    g_error_free (error);
-    return FALSE;
-  }
-
-  can_suspend = g_strcmp0 (value, "yes") == 0 ||
-  g_strcmp0 (value, "challenge") == 0;
-  g_free (value);
-  return can_suspend;
-}
-
-void
-gsm_systemd_attempt_hibernate (GsmSystemd *manager)
-{
-  gboolean res;
-  GError  *error;
-  GsmSystemdPrivate *priv;
-
-  error = NULL;
-  priv = gsm_systemd_get_instance_private (manager);
-
-  if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-    g_warning ("Could not connect to Systemd: %s",
-               error->message);
-    g_error_free (error);
-    return;
-  }
-
-  res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                        "Hibernate",
-                                        INT_MAX,
-                                        &error,
-                                        G_TYPE_BOOLEAN, TRUE, /* interactive */
-                                        G_TYPE_INVALID,
-                                        G_TYPE_INVALID);
-  if (res == FALSE) {
-    g_warning ("Could not make DBUS call: %s",
-               error->message);
-    g_error_free (error);
-    return;
-  }
-
-}
-
-void
-gsm_systemd_attempt_suspend (GsmSystemd *manager)
-{
-  gboolean res;
-  GError  *error;
-  GsmSystemdPrivate *priv;
-
-  error = NULL;
-  priv = gsm_systemd_get_instance_private (manager);
-
-  if (!gsm_systemd_ensure_sd_connection (manager, &error)) {
-    g_warning ("Could not connect to Systemd: %s",
-               error->message);
-    g_error_free (error);
-    return;
-  }
-
-  res = dbus_g_proxy_call_with_timeout (priv->sd_proxy,
-                                        "Suspend",
-                                        INT_MAX,
-                                        &error,
-                                        G_TYPE_BOOLEAN, TRUE, /* interactive */
-                                        G_TYPE_INVALID,
-                                        G_TYPE_INVALID);
-  if (res == FALSE) {
-    g_warning ("Could not make DBUS call: %s",
-               error->message);
-    g_error_free (error);
-    return;
-  }
-}
-
 gchar *
 gsm_systemd_get_current_session_type (GsmSystemd *manager)
 {
-    GError   *gerror;
+    GsmSystemdPrivate *priv;
     gchar    *session_id = NULL;
     gchar    *session_class = NULL;
 #ifdef HAVE_SYSTEMD
     int       res;
 #endif
 
-    gerror = NULL;
+    priv = gsm_systemd_get_instance_private (manager);
 
-    if (!gsm_systemd_ensure_sd_connection (manager, &gerror)) {
-        g_warning ("Could not connect to Systemd: %s",
-                   gerror->message);
-        g_error_free (gerror);
-        return NULL;
+    if (priv->session_proxy != NULL) {
+        GVariant *cached;
+
+        cached = g_dbus_proxy_get_cached_property (priv->session_proxy, "Class");
+        if (cached != NULL) {
+            session_class = g_variant_dup_string (cached, NULL);
+            g_variant_unref (cached);
+            return session_class;
+        }
     }
 
 #ifdef HAVE_SYSTEMD
@@ -997,12 +786,12 @@ gsm_systemd_get_current_session_type (GsmSystemd *manager)
 
 #ifdef HAVE_SYSTEMD
     res = sd_session_get_class (session_id, &session_class);
+    g_free (session_id);
+
     if (res < 0) {
         g_warning ("Could not get Systemd session class!");
         return NULL;
     }
-
-    g_free (session_id);
 #endif
 
     return session_class;
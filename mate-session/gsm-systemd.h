@@ -60,20 +60,10 @@ GQuark           gsm_systemd_error_quark     (void);
 
 GsmSystemd      *gsm_systemd_new             (void) G_GNUC_MALLOC;
 
-gboolean         gsm_systemd_can_switch_user (GsmSystemd *manager);
-
 gboolean         gsm_systemd_get_restart_privileges (GsmSystemd *manager);
 
 gboolean         gsm_systemd_get_stop_privileges    (GsmSystemd *manager);
 
-gboolean         gsm_systemd_can_stop        (GsmSystemd *manager);
-
-gboolean         gsm_systemd_can_restart     (GsmSystemd *manager);
-
-gboolean         gsm_systemd_can_hibernate     (GsmSystemd *manager);
-
-gboolean         gsm_systemd_can_suspend     (GsmSystemd *manager);
-
 gboolean         gsm_systemd_is_last_session_for_user (GsmSystemd *manager);
 
 void             gsm_systemd_attempt_stop    (GsmSystemd *manager);
@@ -19,6 +19,7 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <sys/types.h>
@@ -139,43 +140,6 @@ ensure_dir_exists (const char *dir)
         return FALSE;
 }
 
-gchar *
-gsm_util_get_empty_tmp_session_dir (void)
-{
-        char *tmp;
-        gboolean exists;
-
-        tmp = g_build_filename (g_get_user_config_dir (),
-                                "mate-session",
-                                "saved-session.new",
-                                NULL);
-
-        exists = ensure_dir_exists (tmp);
-
-        if (G_UNLIKELY (!exists)) {
-                g_warning ("GsmSessionSave: could not create directory for saved session: %s", tmp);
-                g_free (tmp);
-                return NULL;
-        } else {
-                /* make sure it's empty */
-                GDir       *dir;
-                const char *filename;
-
-                dir = g_dir_open (tmp, 0, NULL);
-                if (dir) {
-                        while ((filename = g_dir_read_name (dir))) {
-                                gchar *path = g_build_filename (tmp, filename,
-                                                               NULL);
-                                g_unlink (path);
-                                g_free (path);
-                        }
-                        g_dir_close (dir);
-                }
-        }
-
-        return tmp;
-}
-
 const gchar *
 gsm_util_get_saved_session_dir (void)
 {
@@ -689,6 +653,33 @@ gsm_util_setenv (const char *variable,
 #endif
 }
 
+/* 0 if unknown */
+GPid
+gsm_util_get_parent_pid (GPid pid)
+{
+        char  *path;
+        char  *contents;
+        char  *p;
+        int    ppid;
+
+        path = g_strdup_printf ("/proc/%d/stat", (int) pid);
+        if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+                g_free (path);
+                return 0;
+        }
+        g_free (path);
+
+        /* "pid (comm) state ppid ...", and comm may contain anything */
+        ppid = 0;
+        p = strrchr (contents, ')');
+        if (p != NULL) {
+                sscanf (p, ") %*c %d", &ppid);
+        }
+        g_free (contents);
+
+        return ppid;
+}
+
 GtkWidget*
 gsm_util_dialog_add_button (GtkDialog   *dialog,
                             const gchar *button_text,
@@ -32,8 +32,6 @@ extern "C" {
 char *      gsm_util_find_desktop_file_for_app_name (const char  *app_name,
                                                      char       **dirs);
 
-gchar      *gsm_util_get_empty_tmp_session_dir      (void);
-
 const char *gsm_util_get_saved_session_dir          (void);
 
 gchar**     gsm_util_get_app_dirs                   (void);
@@ -58,6 +56,8 @@ gboolean    gsm_util_export_user_environment        (GError     **error);
 void        gsm_util_setenv                         (const char *variable,
                                                      const char *value);
 
+GPid        gsm_util_get_parent_pid                 (GPid        pid);
+
 GtkWidget*  gsm_util_dialog_add_button              (GtkDialog   *dialog,
                                                      const gchar *button_text,
                                                      const gchar *icon_name,
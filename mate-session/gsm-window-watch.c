@@ -0,0 +1,252 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+#include "gsm-window-watch.h"
+#include "gsm-util.h"
+
+/* Watches the root window for toplevels being mapped, and tells the
+ * owner of a watch when the first one whose _NET_WM_PID is the watched
+ * process (or one of its descendants) shows up.  Once a window manager
+ * runs, the window mapped on the root window is its frame, so the
+ * frame's children are looked at too.
+ */
+
+#define WINDOW_WATCH_MAX_ANCESTORS 8
+
+typedef struct {
+        guint               id;
+        GPid                pid;
+        GsmWindowMappedFunc func;
+        gpointer            user_data;
+} WindowWatch;
+
+static GSList       *watches = NULL;
+static guint         next_watch_id = 1;
+static gboolean      filter_installed = FALSE;
+static GdkEventMask  saved_root_events = 0;
+
+static GPid
+get_window_pid (Display *xdisplay,
+                Window   xwindow)
+{
+        Atom           type;
+        int            format;
+        unsigned long  n_items;
+        unsigned long  bytes_after;
+        unsigned char *data;
+        GPid           pid;
+        int            result;
+
+        pid = 0;
+        data = NULL;
+        result = XGetWindowProperty (xdisplay,
+                                     xwindow,
+                                     gdk_x11_get_xatom_by_name ("_NET_WM_PID"),
+                                     0, 1,
+                                     False,
+                                     XA_CARDINAL,
+                                     &type, &format, &n_items, &bytes_after,
+                                     &data);
+        if (result == Success
+            && type == XA_CARDINAL
+            && format == 32
+            && n_items == 1) {
+                /* format 32 properties come back as longs */
+                pid = (GPid) *(unsigned long *) data;
+        }
+
+        if (data != NULL) {
+                XFree (data);
+        }
+
+        return pid;
+}
+
+static GPid
+find_window_pid (Display *xdisplay,
+                 Window   xwindow)
+{
+        Window        root;
+        Window        parent;
+        Window       *children;
+        unsigned int  n_children;
+        unsigned int  i;
+        GPid          pid;
+
+        pid = get_window_pid (xdisplay, xwindow);
+        if (pid > 0) {
+                return pid;
+        }
+
+        children = NULL;
+        if (! XQueryTree (xdisplay, xwindow, &root, &parent, &children, &n_children)) {
+                return 0;
+        }
+
+        for (i = 0; i < n_children && pid <= 0; i++) {
+                pid = get_window_pid (xdisplay, children[i]);
+        }
+
+        if (children != NULL) {
+                XFree (children);
+        }
+
+        return pid;
+}
+
+static WindowWatch *
+find_watch (GPid pid)
+{
+        GSList *l;
+        int     i;
+
+        for (i = 0; i < WINDOW_WATCH_MAX_ANCESTORS && pid > 1; i++) {
+                for (l = watches; l != NULL; l = l->next) {
+                        WindowWatch *watch = l->data;
+
+                        if (watch->pid == pid) {
+                                return watch;
+                        }
+                }
+
+                pid = gsm_util_get_parent_pid (pid);
+        }
+
+        return NULL;
+}
+
+static GdkFilterReturn
+on_root_event (GdkXEvent *gdk_xevent,
+               GdkEvent  *event,
+               gpointer   data)
+{
+        XEvent      *xevent = gdk_xevent;
+        GdkDisplay  *gdkdisplay;
+        WindowWatch *watch;
+        GPid         pid;
+
+        if (xevent->type != MapNotify
+            || xevent->xmap.override_redirect
+            || watches == NULL) {
+                return GDK_FILTER_CONTINUE;
+        }
+
+        gdkdisplay = gdk_display_get_default ();
+
+        /* the window may well be gone already */
+        gdk_x11_display_error_trap_push (gdkdisplay);
+        pid = find_window_pid (GDK_DISPLAY_XDISPLAY (gdkdisplay), xevent->xmap.window);
+        gdk_x11_display_error_trap_pop_ignored (gdkdisplay);
+
+        if (pid <= 0) {
+                return GDK_FILTER_CONTINUE;
+        }
+
+        watch = find_watch (pid);
+        if (watch != NULL) {
+                g_debug ("GsmWindowWatch: pid %d mapped window 0x%lx",
+                         (int) watch->pid, (unsigned long) xevent->xmap.window);
+                /* the callback may well remove the watch */
+                watch->func (watch->user_data);
+        }
+
+        return GDK_FILTER_CONTINUE;
+}
+
+static void
+install_filter (void)
+{
+        GdkWindow *root;
+
+        root = gdk_get_default_root_window ();
+
+        /* Selecting SubstructureNotify on the root window makes the X
+         * server send us every map in the session; only do it for as
+         * long as somebody is waiting */
+        saved_root_events = gdk_window_get_events (root);
+        gdk_window_set_events (root, saved_root_events | GDK_SUBSTRUCTURE_MASK);
+        gdk_window_add_filter (root, on_root_event, NULL);
+
+        filter_installed = TRUE;
+}
+
+static void
+remove_filter (void)
+{
+        GdkWindow *root;
+
+        root = gdk_get_default_root_window ();
+
+        gdk_window_remove_filter (root, on_root_event, NULL);
+        gdk_window_set_events (root, saved_root_events);
+
+        filter_installed = FALSE;
+}
+
+guint
+gsm_window_watch_add (GPid                pid,
+                      GsmWindowMappedFunc func,
+                      gpointer            user_data)
+{
+        WindowWatch *watch;
+
+        g_return_val_if_fail (func != NULL, 0);
+
+        if (! filter_installed) {
+                install_filter ();
+        }
+
+        watch = g_new0 (WindowWatch, 1);
+        watch->id = next_watch_id++;
+        watch->pid = pid;
+        watch->func = func;
+        watch->user_data = user_data;
+
+        watches = g_slist_prepend (watches, watch);
+
+        return watch->id;
+}
+
+void
+gsm_window_watch_remove (guint id)
+{
+        GSList *l;
+
+        for (l = watches; l != NULL; l = l->next) {
+                WindowWatch *watch = l->data;
+
+                if (watch->id == id) {
+                        watches = g_slist_delete_link (watches, l);
+                        g_free (watch);
+                        break;
+                }
+        }
+
+        if (watches == NULL && filter_installed) {
+                remove_filter ();
+        }
+}
@@ -40,6 +40,45 @@
 
 #define GsmDesktopFile "_GSM_DesktopFile"
 
+/* Minimum time between two initial SaveYourself messages, in ms */
+#define INITIAL_SAVE_INTERVAL 250
+
+/* Properties we look at ourselves get a fixed slot, everything else
+ * the client sets goes into a hash table keyed by name. */
+typedef enum {
+        PROP_SLOT_PROGRAM,
+        PROP_SLOT_RESTART_COMMAND,
+        PROP_SLOT_DISCARD_COMMAND,
+        PROP_SLOT_RESTART_STYLE_HINT,
+        PROP_SLOT_PROCESS_ID,
+        PROP_SLOT_DESKTOP_FILE,
+        PROP_SLOT_CLONE_COMMAND,
+        PROP_SLOT_CURRENT_DIRECTORY,
+        PROP_SLOT_ENVIRONMENT,
+        PROP_SLOT_RESIGN_COMMAND,
+        PROP_SLOT_SHUTDOWN_COMMAND,
+        PROP_SLOT_USER_ID,
+        N_PROP_SLOTS,
+        PROP_SLOT_NONE = N_PROP_SLOTS
+} PropSlot;
+
+static const char *prop_slot_names[N_PROP_SLOTS] = {
+        SmProgram,
+        SmRestartCommand,
+        SmDiscardCommand,
+        SmRestartStyleHint,
+        SmProcessID,
+        GsmDesktopFile,
+        SmCloneCommand,
+        SmCurrentDirectory,
+        SmEnvironment,
+        SmResignCommand,
+        SmShutdownCommand,
+        SmUserID
+};
+
+static GQuark prop_slot_quarks[N_PROP_SLOTS] = { 0 };
+
 typedef struct {
         GsmClient  parent;
         SmsConn    conn;
@@ -48,12 +87,23 @@ typedef struct {
         guint      watch_id;
 
         char      *description;
-        GPtrArray *props;
+        SmProp    *props[N_PROP_SLOTS];
+        GHashTable *custom_props;
+
+        /* values parsed from the properties above */
+        char      *restart_command;
+        char      *discard_command;
+        GsmClientRestartStyle restart_style;
+        guint      pid;
 
         /* SaveYourself state */
         int        current_save_yourself;
         int        next_save_yourself;
         guint      next_save_yourself_allow_interact : 1;
+
+        /* initial SaveYourself, see queue_initial_save() */
+        guint      initial_save_queued : 1;
+        gint64     initial_save_start;
 } GsmXSMPClientPrivate;
 
 enum {
@@ -69,6 +119,16 @@ enum {
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* Clients waiting for their initial SaveYourself; no references are
+ * held, clients remove themselves when they go away. */
+static GQueue   initial_save_queue = G_QUEUE_INIT;
+static gboolean initial_saves_allowed = FALSE;
+static guint    initial_save_timeout_id = 0;
+static guint    initial_saves_in_flight = 0;
+static guint    initial_saves_done = 0;
+static gint64   initial_saves_total_time = 0;
+static gint64   initial_saves_max_time = 0;
+
 G_DEFINE_TYPE_WITH_PRIVATE (GsmXSMPClient, gsm_xsmp_client, GSM_TYPE_CLIENT)
 
 static gboolean
@@ -112,29 +172,105 @@ client_iochannel_watch (GIOChannel    *channel,
         return keep_going;
 }
 
+static char *   prop_to_command      (SmProp     *prop);
+static gboolean _parse_value_as_uint (const char *value,
+                                      guint      *uintval);
+
+static PropSlot
+prop_slot_for_name (const char *name)
+{
+        GQuark quark;
+        int    i;
+
+        /* a name that was never interned can't be a well-known one */
+        quark = g_quark_try_string (name);
+        if (quark == 0) {
+                return PROP_SLOT_NONE;
+        }
+
+        for (i = 0; i < N_PROP_SLOTS; i++) {
+                if (prop_slot_quarks[i] == quark) {
+                        return i;
+                }
+        }
+
+        return PROP_SLOT_NONE;
+}
+
 static SmProp *
 find_property (GsmXSMPClient *client,
-               const char    *name,
-               int           *index)
+               PropSlot       slot)
+{
+        GsmXSMPClientPrivate *priv;
+
+        priv = gsm_xsmp_client_get_instance_private (client);
+
+        return priv->props[slot];
+}
+
+static void
+update_cached_property (GsmXSMPClient *client,
+                        PropSlot       slot)
 {
         SmProp *prop;
-        int i;
         GsmXSMPClientPrivate *priv;
 
         priv = gsm_xsmp_client_get_instance_private (client);
+        prop = priv->props[slot];
+
+        switch (slot) {
+        case PROP_SLOT_RESTART_COMMAND:
+                g_free (priv->restart_command);
+                priv->restart_command = NULL;
+                if (prop != NULL && strcmp (prop->type, SmLISTofARRAY8) == 0) {
+                        priv->restart_command = prop_to_command (prop);
+                }
+                break;
+
+        case PROP_SLOT_DISCARD_COMMAND:
+                g_free (priv->discard_command);
+                priv->discard_command = NULL;
+                if (prop != NULL && strcmp (prop->type, SmLISTofARRAY8) == 0) {
+                        priv->discard_command = prop_to_command (prop);
+                }
+                break;
+
+        case PROP_SLOT_RESTART_STYLE_HINT:
+                priv->restart_style = GSM_CLIENT_RESTART_IF_RUNNING;
+                if (prop == NULL || strcmp (prop->type, SmCARD8) != 0) {
+                        break;
+                }
 
-        for (i = 0; i < priv->props->len; i++) {
-                prop = priv->props->pdata[i];
+                switch (((unsigned char *)prop->vals[0].value)[0]) {
+                case SmRestartIfRunning:
+                        priv->restart_style = GSM_CLIENT_RESTART_IF_RUNNING;
+                        break;
+                case SmRestartAnyway:
+                        priv->restart_style = GSM_CLIENT_RESTART_ANYWAY;
+                        break;
+                case SmRestartImmediately:
+                        priv->restart_style = GSM_CLIENT_RESTART_IMMEDIATELY;
+                        break;
+                case SmRestartNever:
+                        priv->restart_style = GSM_CLIENT_RESTART_NEVER;
+                        break;
+                default:
+                        break;
+                }
+                break;
 
-                if (!strcmp (prop->name, name)) {
-                        if (index) {
-                                *index = i;
+        case PROP_SLOT_PROCESS_ID:
+                priv->pid = 0;
+                if (prop != NULL && strcmp (prop->type, SmARRAY8) == 0) {
+                        if (! _parse_value_as_uint ((char *)prop->vals[0].value, &priv->pid)) {
+                                priv->pid = 0;
                         }
-                        return prop;
                 }
-        }
+                break;
 
-        return NULL;
+        default:
+                break;
+        }
 }
 
 static void
@@ -145,7 +281,7 @@ set_description (GsmXSMPClient *client)
         GsmXSMPClientPrivate *priv;
 
         priv = gsm_xsmp_client_get_instance_private (client);
-        prop = find_property (client, SmProgram, NULL);
+        prop = find_property (client, PROP_SLOT_PROGRAM);
         id = gsm_client_peek_startup_id (GSM_CLIENT (client));
 
         g_free (priv->description);
@@ -208,7 +344,11 @@ gsm_xsmp_client_init (GsmXSMPClient *client)
 
         priv = gsm_xsmp_client_get_instance_private (client);
 
-        priv->props = g_ptr_array_new ();
+        priv->custom_props = g_hash_table_new_full (g_str_hash,
+                                                    g_str_equal,
+                                                    NULL,
+                                                    (GDestroyNotify) SmFreeProperty);
+        priv->restart_style = GSM_CLIENT_RESTART_IF_RUNNING;
         priv->current_save_yourself = -1;
         priv->next_save_yourself = -1;
         priv->next_save_yourself_allow_interact = FALSE;
@@ -219,17 +359,11 @@ static void
 delete_property (GsmXSMPClient *client,
                  const char    *name)
 {
-        int     index;
-        SmProp *prop;
+        PropSlot slot;
         GsmXSMPClientPrivate *priv;
 
         priv = gsm_xsmp_client_get_instance_private (client);
 
-        prop = find_property (client, name, &index);
-        if (!prop) {
-                return;
-        }
-
 #if 0
         /* This is wrong anyway; we can't unconditionally run the current
          * discard command; if this client corresponds to a GsmAppResumed,
@@ -243,8 +377,20 @@ delete_property (GsmXSMPClient *client,
         }
 #endif
 
-        g_ptr_array_remove_index_fast (priv->props, index);
-        SmFreeProperty (prop);
+        slot = prop_slot_for_name (name);
+        if (slot == PROP_SLOT_NONE) {
+                g_hash_table_remove (priv->custom_props, name);
+                return;
+        }
+
+        if (priv->props[slot] == NULL) {
+                return;
+        }
+
+        SmFreeProperty (priv->props[slot]);
+        priv->props[slot] = NULL;
+
+        update_cached_property (client, slot);
 }
 
 
@@ -295,12 +441,28 @@ set_properties_callback (SmsConn     conn,
         g_debug ("GsmXSMPClient: Set properties from client '%s'", priv->description);
 
         for (i = 0; i < num_props; i++) {
-                delete_property (client, props[i]->name);
-                g_ptr_array_add (priv->props, props[i]);
+                PropSlot slot;
 
                 debug_print_property (props[i]);
 
-                if (!strcmp (props[i]->name, SmProgram))
+                slot = prop_slot_for_name (props[i]->name);
+                if (slot == PROP_SLOT_NONE) {
+                        /* the table frees the old property, whose name
+                         * is the key being replaced */
+                        g_hash_table_replace (priv->custom_props,
+                                              props[i]->name,
+                                              props[i]);
+                        continue;
+                }
+
+                if (priv->props[slot] != NULL) {
+                        SmFreeProperty (priv->props[slot]);
+                }
+                priv->props[slot] = props[i];
+
+                update_cached_property (client, slot);
+
+                if (slot == PROP_SLOT_PROGRAM)
                         set_description (client);
         }
 
@@ -335,6 +497,10 @@ static void
 get_properties_callback (SmsConn   conn,
                          SmPointer manager_data)
 {
+        GPtrArray      *props;
+        GHashTableIter  iter;
+        gpointer        value;
+        int             i;
         GsmXSMPClientPrivate *priv;
         GsmXSMPClient *client = manager_data;
 
@@ -342,9 +508,24 @@ get_properties_callback (SmsConn   conn,
 
         g_debug ("GsmXSMPClient: Get properties request from '%s'", priv->description);
 
+        props = g_ptr_array_sized_new (N_PROP_SLOTS + g_hash_table_size (priv->custom_props));
+
+        for (i = 0; i < N_PROP_SLOTS; i++) {
+                if (priv->props[i] != NULL) {
+                        g_ptr_array_add (props, priv->props[i]);
+                }
+        }
+
+        g_hash_table_iter_init (&iter, priv->custom_props);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                g_ptr_array_add (props, value);
+        }
+
         SmsReturnProperties (conn,
-                             priv->props->len,
-                             (SmProp **)priv->props->pdata);
+                             props->len,
+                             (SmProp **)props->pdata);
+
+        g_ptr_array_free (props, TRUE);
 }
 
 static char *
@@ -395,29 +576,21 @@ prop_to_command (SmProp *prop)
 static char *
 xsmp_get_restart_command (GsmClient *client)
 {
-        SmProp *prop;
-
-        prop = find_property (GSM_XSMP_CLIENT (client), SmRestartCommand, NULL);
+        GsmXSMPClientPrivate *priv;
 
-        if (!prop || strcmp (prop->type, SmLISTofARRAY8) != 0) {
-                return NULL;
-        }
+        priv = gsm_xsmp_client_get_instance_private (GSM_XSMP_CLIENT (client));
 
-        return prop_to_command (prop);
+        return g_strdup (priv->restart_command);
 }
 
 static char *
 xsmp_get_discard_command (GsmClient *client)
 {
-        SmProp *prop;
-
-        prop = find_property (GSM_XSMP_CLIENT (client), SmDiscardCommand, NULL);
+        GsmXSMPClientPrivate *priv;
 
-        if (!prop || strcmp (prop->type, SmLISTofARRAY8) != 0) {
-                return NULL;
-        }
+        priv = gsm_xsmp_client_get_instance_private (GSM_XSMP_CLIENT (client));
 
-        return prop_to_command (prop);
+        return g_strdup (priv->discard_command);
 }
 
 static void
@@ -430,6 +603,16 @@ do_save_yourself (GsmXSMPClient *client,
         priv = gsm_xsmp_client_get_instance_private (client);
         g_assert (priv->conn != NULL);
 
+        if (priv->initial_save_queued) {
+                /* This SaveYourself collects the restart info just as
+                 * well, so the deferred initial one is no longer needed.
+                 */
+                g_debug ("GsmXSMPClient:   dropping queued initial SaveYourself for '%s'",
+                         priv->description);
+                g_queue_remove (&initial_save_queue, client);
+                priv->initial_save_queued = FALSE;
+        }
+
         if (priv->next_save_yourself != -1) {
                 /* Either we're currently doing a shutdown and there's a checkpoint
                  * queued after it, or vice versa. Either way, the new SaveYourself
@@ -478,6 +661,142 @@ do_save_yourself (GsmXSMPClient *client,
         }
 }
 
+static void schedule_initial_saves (void);
+
+static gboolean
+dispatch_initial_save (gpointer data)
+{
+        GsmXSMPClient        *client;
+        GsmXSMPClientPrivate *priv;
+
+        client = g_queue_pop_head (&initial_save_queue);
+        if (client != NULL) {
+                priv = gsm_xsmp_client_get_instance_private (client);
+                priv->initial_save_queued = FALSE;
+
+                g_debug ("GsmXSMPClient: Sending initial SaveYourself to '%s' (%u still queued)",
+                         priv->description,
+                         initial_save_queue.length);
+
+                priv->initial_save_start = g_get_monotonic_time ();
+                initial_saves_in_flight++;
+                do_save_yourself (client, SmSaveLocal, FALSE);
+        }
+
+        if (g_queue_is_empty (&initial_save_queue)) {
+                initial_save_timeout_id = 0;
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static void
+schedule_initial_saves (void)
+{
+        if (!initial_saves_allowed
+            || initial_save_timeout_id > 0
+            || g_queue_is_empty (&initial_save_queue)) {
+                return;
+        }
+
+        initial_save_timeout_id = g_timeout_add (INITIAL_SAVE_INTERVAL,
+                                                 dispatch_initial_save,
+                                                 NULL);
+}
+
+/* A client registering without a previous id gets a SaveYourself so
+ * that it tells us how to restart it.  At login lots of clients do
+ * that at the same time, so rather than having them all write their
+ * state to a busy disk we queue the requests and hand them out at a
+ * steady pace once the session is running or the user is idle.
+ */
+static void
+queue_initial_save (GsmXSMPClient *client)
+{
+        GsmXSMPClientPrivate *priv;
+
+        priv = gsm_xsmp_client_get_instance_private (client);
+
+        g_debug ("GsmXSMPClient: Queuing initial SaveYourself for '%s'",
+                 priv->description);
+
+        priv->initial_save_queued = TRUE;
+        g_queue_push_tail (&initial_save_queue, client);
+
+        schedule_initial_saves ();
+}
+
+static void
+finish_initial_save (GsmXSMPClient *client,
+                     gboolean       completed)
+{
+        GsmXSMPClientPrivate *priv;
+        gint64                elapsed;
+
+        priv = gsm_xsmp_client_get_instance_private (client);
+
+        if (priv->initial_save_queued) {
+                g_queue_remove (&initial_save_queue, client);
+                priv->initial_save_queued = FALSE;
+        }
+
+        if (priv->initial_save_start == 0) {
+                return;
+        }
+
+        elapsed = g_get_monotonic_time () - priv->initial_save_start;
+        priv->initial_save_start = 0;
+        initial_saves_in_flight--;
+
+        if (completed) {
+                g_debug ("GsmXSMPClient: Initial SaveYourself of '%s' took %" G_GINT64_FORMAT " ms",
+                         priv->description,
+                         elapsed / 1000);
+
+                initial_saves_done++;
+                initial_saves_total_time += elapsed;
+                initial_saves_max_time = MAX (initial_saves_max_time, elapsed);
+        }
+
+        if (initial_saves_in_flight == 0 && g_queue_is_empty (&initial_save_queue)) {
+                g_debug ("GsmXSMPClient: %u initial SaveYourself done, %" G_GINT64_FORMAT " ms in total, slowest %" G_GINT64_FORMAT " ms",
+                         initial_saves_done,
+                         initial_saves_total_time / 1000,
+                         initial_saves_max_time / 1000);
+        }
+}
+
+/**
+ * gsm_xsmp_client_get_initial_save_stats:
+ * @count: return location for the number of initial saves completed
+ * @total_time: return location for their total duration, in ms
+ * @max_time: return location for the longest of them, in ms
+ **/
+void
+gsm_xsmp_client_get_initial_save_stats (guint *count,
+                                        guint *total_time,
+                                        guint *max_time)
+{
+        *count = initial_saves_done;
+        *total_time = MIN (initial_saves_total_time / 1000, G_MAXUINT);
+        *max_time = MIN (initial_saves_max_time / 1000, G_MAXUINT);
+}
+
+void
+gsm_xsmp_client_allow_initial_saves (void)
+{
+        if (initial_saves_allowed) {
+                return;
+        }
+
+        g_debug ("GsmXSMPClient: Allowing initial SaveYourself (%u queued)",
+                 initial_save_queue.length);
+
+        initial_saves_allowed = TRUE;
+        schedule_initial_saves ();
+}
+
 static void
 xsmp_save_yourself_phase2 (GsmClient *client)
 {
@@ -540,7 +859,7 @@ get_desktop_file_path (GsmXSMPClient *client)
 
         /* XSMP clients using eggsmclient defines a special property
          * pointing to their respective desktop entry file */
-        prop = find_property (client, GsmDesktopFile, NULL);
+        prop = find_property (client, PROP_SLOT_DESKTOP_FILE);
 
         if (prop) {
                 GFile *file = g_file_new_for_uri (prop->vals[0].value);
@@ -551,7 +870,7 @@ get_desktop_file_path (GsmXSMPClient *client)
 
         /* If we can't get desktop file from GsmDesktopFile then we
          * try to find the desktop file from its program name */
-        prop = find_property (client, SmProgram, NULL);
+        prop = find_property (client, PROP_SLOT_PROGRAM);
 
         if (!prop) {
                 goto out;
@@ -583,7 +902,7 @@ set_desktop_file_keys_from_client (GsmClient *client,
         const char   *name;
         char         *comment;
 
-        prop = find_property (GSM_XSMP_CLIENT (client), SmProgram, NULL);
+        prop = find_property (GSM_XSMP_CLIENT (client), PROP_SLOT_PROGRAM);
 
         if (prop) {
                 name = prop->vals[0].value;
@@ -830,7 +1149,7 @@ xsmp_get_app_name (GsmClient *client)
         SmProp *prop;
         char   *name = NULL;
 
-        prop = find_property (GSM_XSMP_CLIENT (client), SmProgram, NULL);
+        prop = find_property (GSM_XSMP_CLIENT (client), PROP_SLOT_PROGRAM);
         if (prop) {
                 name = prop_to_command (prop);
         }
@@ -898,6 +1217,8 @@ gsm_xsmp_client_disconnect (GsmXSMPClient *client)
                 g_source_remove (priv->watch_id);
         }
 
+        finish_initial_save (client, FALSE);
+
         if (priv->conn != NULL) {
                 SmsCleanUp (priv->conn);
         }
@@ -913,6 +1234,7 @@ gsm_xsmp_client_finalize (GObject *object)
 {
         GsmXSMPClientPrivate *priv;
         GsmXSMPClient *client;
+        int            i;
 
         client = GSM_XSMP_CLIENT(object);
 
@@ -922,8 +1244,14 @@ gsm_xsmp_client_finalize (GObject *object)
         gsm_xsmp_client_disconnect (client);
 
         g_free (priv->description);
-        g_ptr_array_foreach (priv->props, (GFunc)SmFreeProperty, NULL);
-        g_ptr_array_free (priv->props, TRUE);
+        for (i = 0; i < N_PROP_SLOTS; i++) {
+                if (priv->props[i] != NULL) {
+                        SmFreeProperty (priv->props[i]);
+                }
+        }
+        g_hash_table_destroy (priv->custom_props);
+        g_free (priv->restart_command);
+        g_free (priv->discard_command);
 
         G_OBJECT_CLASS (gsm_xsmp_client_parent_class)->finalize (object);
 }
@@ -947,36 +1275,11 @@ _boolean_handled_accumulator (GSignalInvocationHint *ihint,
 static GsmClientRestartStyle
 xsmp_get_restart_style_hint (GsmClient *client)
 {
-        SmProp               *prop;
-        GsmClientRestartStyle hint;
-
-        g_debug ("GsmXSMPClient: getting restart style");
-        hint = GSM_CLIENT_RESTART_IF_RUNNING;
-
-        prop = find_property (GSM_XSMP_CLIENT (client), SmRestartStyleHint, NULL);
+        GsmXSMPClientPrivate *priv;
 
-        if (!prop || strcmp (prop->type, SmCARD8) != 0) {
-                return GSM_CLIENT_RESTART_IF_RUNNING;
-        }
+        priv = gsm_xsmp_client_get_instance_private (GSM_XSMP_CLIENT (client));
 
-        switch (((unsigned char *)prop->vals[0].value)[0]) {
-        case SmRestartIfRunning:
-                hint = GSM_CLIENT_RESTART_IF_RUNNING;
-                break;
-        case SmRestartAnyway:
-                hint = GSM_CLIENT_RESTART_ANYWAY;
-                break;
-        case SmRestartImmediately:
-                hint = GSM_CLIENT_RESTART_IMMEDIATELY;
-                break;
-        case SmRestartNever:
-                hint = GSM_CLIENT_RESTART_NEVER;
-                break;
-        default:
-                break;
-        }
-
-        return hint;
+        return priv->restart_style;
 }
 
 static gboolean
@@ -1007,25 +1310,11 @@ _parse_value_as_uint (const char *value,
 static guint
 xsmp_get_unix_process_id (GsmClient *client)
 {
-        SmProp  *prop;
-        guint    pid;
-        gboolean res;
-
-        g_debug ("GsmXSMPClient: getting pid");
-
-        prop = find_property (GSM_XSMP_CLIENT (client), SmProcessID, NULL);
-
-        if (!prop || strcmp (prop->type, SmARRAY8) != 0) {
-                return 0;
-        }
+        GsmXSMPClientPrivate *priv;
 
-        pid = 0;
-        res = _parse_value_as_uint ((char *)prop->vals[0].value, &pid);
-        if (! res) {
-                pid = 0;
-        }
+        priv = gsm_xsmp_client_get_instance_private (GSM_XSMP_CLIENT (client));
 
-        return pid;
+        return priv->pid;
 }
 
 static void
@@ -1033,6 +1322,11 @@ gsm_xsmp_client_class_init (GsmXSMPClientClass *klass)
 {
         GObjectClass   *object_class = G_OBJECT_CLASS (klass);
         GsmClientClass *client_class = GSM_CLIENT_CLASS (klass);
+        int             i;
+
+        for (i = 0; i < N_PROP_SLOTS; i++) {
+                prop_slot_quarks[i] = g_quark_from_static_string (prop_slot_names[i]);
+        }
 
         object_class->finalize             = gsm_xsmp_client_finalize;
         object_class->constructor          = gsm_xsmp_client_constructor;
@@ -1138,10 +1432,7 @@ register_client_callback (SmsConn    conn,
         SmsRegisterClientReply (conn, id);
 
         if (IS_STRING_EMPTY (previous_id)) {
-                /* Send the initial SaveYourself. */
-                g_debug ("GsmXSMPClient: Sending initial SaveYourself");
-                SmsSaveYourself (conn, SmSaveLocal, False, SmInteractStyleNone, False);
-                priv->current_save_yourself = SmSaveLocal;
+                queue_initial_save (client);
         }
 
         gsm_client_set_status (GSM_CLIENT (client), GSM_CLIENT_REGISTERED);
@@ -1315,6 +1606,8 @@ save_yourself_done_callback (SmsConn   conn,
                 priv->current_save_yourself = -1;
         }
 
+        finish_initial_save (client, TRUE);
+
         /* If success is false then the application couldn't save data. Nothing
          * the session manager can do about, though. FIXME: we could display a
          * dialog about this, I guess. */
@@ -1322,12 +1615,12 @@ save_yourself_done_callback (SmsConn   conn,
                                          TRUE, FALSE, FALSE,
                                          NULL);
 
-        if (priv->next_save_yourself) {
+        if (priv->next_save_yourself != -1) {
                 int      save_type = priv->next_save_yourself;
                 gboolean allow_interact = priv->next_save_yourself_allow_interact;
 
                 priv->next_save_yourself = -1;
-                priv->next_save_yourself_allow_interact = -1;
+                priv->next_save_yourself_allow_interact = FALSE;
                 do_save_yourself (client, save_type, allow_interact);
         }
 }
@@ -67,6 +67,11 @@ void        gsm_xsmp_client_save_yourself_phase2 (GsmXSMPClient  *client);
 void        gsm_xsmp_client_interact             (GsmXSMPClient  *client);
 void        gsm_xsmp_client_shutdown_cancelled   (GsmXSMPClient  *client);
 
+void        gsm_xsmp_client_allow_initial_saves  (void);
+void        gsm_xsmp_client_get_initial_save_stats (guint *count,
+                                                    guint *total_time,
+                                                    guint *max_time);
+
 G_END_DECLS
 
 #endif /* __GSM_XSMP_CLIENT_H__ */
@@ -424,17 +424,123 @@ auth_entry_new (const char *protocol,
         return file_entry;
 }
 
+/* Returns the host part of a local ICE network id such as
+ * "local/myhost:/tmp/.ICE-unix/1234", or NULL for other transports.
+ */
+static char *
+local_network_id_host (const char  *network_id,
+                       const char **path)
+{
+        const char *host;
+        const char *colon;
+
+        if (g_str_has_prefix (network_id, "local/")) {
+                host = network_id + strlen ("local/");
+        } else if (g_str_has_prefix (network_id, "unix/")) {
+                host = network_id + strlen ("unix/");
+        } else {
+                return NULL;
+        }
+
+        colon = strchr (host, ':');
+        if (colon == NULL) {
+                return NULL;
+        }
+
+        if (path != NULL) {
+                *path = colon + 1;
+        }
+
+        return g_strndup (host, colon - host);
+}
+
+/* An entry is stale when it points at a socket on this host that no
+ * longer exists, which is what crashed sessions leave behind.  Entries
+ * for other hosts (a home directory shared over NFS) are left alone.
+ * ICE and XSMP entries come in pairs, so results are cached per path.
+ */
+static gboolean
+auth_entry_is_stale (IceAuthFileEntry *auth_entry,
+                     const char       *our_host,
+                     GHashTable       *checked_paths)
+{
+        const char *path;
+        char       *host;
+        gpointer    alive;
+        gboolean    same_host;
+        struct stat st;
+
+        host = local_network_id_host (auth_entry->network_id, &path);
+        if (host == NULL) {
+                return FALSE;
+        }
+
+        same_host = (our_host != NULL && strcmp (host, our_host) == 0);
+        g_free (host);
+
+        if (!same_host || path[0] != '/') {
+                return FALSE;
+        }
+
+        if (!g_hash_table_lookup_extended (checked_paths, path, NULL, &alive)) {
+                alive = GINT_TO_POINTER (stat (path, &st) == 0 && S_ISSOCK (st.st_mode));
+                g_hash_table_insert (checked_paths, g_strdup (path), alive);
+        }
+
+        return !GPOINTER_TO_INT (alive);
+}
+
+static gboolean
+write_auth_entries (FILE   *fp,
+                    GSList *entries)
+{
+        GSList *e;
+
+        for (e = entries; e; e = e->next) {
+                if (!IceWriteAuthFileEntry (fp, e->data)) {
+                        return FALSE;
+                }
+        }
+
+        return fflush (fp) == 0;
+}
+
+static FILE *
+open_auth_file (const char *filename,
+                int         flags)
+{
+        FILE *fp;
+        int   fd;
+
+        fd = open (filename, O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0600);
+        if (fd == -1) {
+                return NULL;
+        }
+
+        fp = fdopen (fd, (flags & O_APPEND) ? "a" : "w");
+        if (fp == NULL) {
+                close (fd);
+        }
+
+        return fp;
+}
+
 static gboolean
 update_iceauthority (GsmXsmpServer *server,
                      gboolean       adding)
 {
         char             *filename;
+        char             *tmp_filename;
         char            **our_network_ids;
+        char             *our_host;
+        GHashTable       *checked_paths;
         FILE             *fp;
         IceAuthFileEntry *auth_entry;
         GSList           *entries;
-        GSList           *e;
+        GSList           *our_entries;
         int               i;
+        guint             n_kept;
+        guint             n_dropped;
         gboolean          ok = FALSE;
 
         filename = IceAuthFileName ();
@@ -449,10 +555,16 @@ update_iceauthority (GsmXsmpServer *server,
         for (i = 0; i < server->num_local_xsmp_sockets; i++) {
                 our_network_ids[i] = IceGetListenConnectionString (server->xsmp_sockets[i]);
         }
+        our_host = local_network_id_host (our_network_ids[0], NULL);
 
+        checked_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        tmp_filename = NULL;
         entries = NULL;
+        our_entries = NULL;
+        n_kept = 0;
+        n_dropped = 0;
 
-        fp = fopen (filename, "r+");
+        fp = fopen (filename, "r");
         if (fp != NULL) {
                 while ((auth_entry = IceReadAuthFileEntry (fp)) != NULL) {
                         /* Skip/delete entries with no network ID (invalid), or with
@@ -463,67 +575,110 @@ update_iceauthority (GsmXsmpServer *server,
                          */
                         if (!auth_entry->network_id) {
                                 IceFreeAuthFileEntry (auth_entry);
+                                n_dropped++;
                                 continue;
                         }
 
                         for (i = 0; i < server->num_local_xsmp_sockets; i++) {
                                 if (!strcmp (auth_entry->network_id, our_network_ids[i])) {
-                                        IceFreeAuthFileEntry (auth_entry);
                                         break;
                                 }
                         }
-                        if (i != server->num_local_xsmp_sockets) {
+                        if (i != server->num_local_xsmp_sockets
+                            || auth_entry_is_stale (auth_entry, our_host, checked_paths)) {
+                                IceFreeAuthFileEntry (auth_entry);
+                                n_dropped++;
                                 continue;
                         }
 
                         entries = g_slist_prepend (entries, auth_entry);
+                        n_kept++;
                 }
 
-                rewind (fp);
-        } else {
-                int fd;
+                fclose (fp);
+        } else if (g_file_test (filename, G_FILE_TEST_EXISTS)) {
+                g_warning ("Unable to read ICE authority file: %s", filename);
+                goto cleanup;
+        }
+
+        entries = g_slist_reverse (entries);
+
+        if (adding) {
+                for (i = 0; i < server->num_local_xsmp_sockets; i++) {
+                        our_entries = g_slist_prepend (our_entries,
+                                                       auth_entry_new ("ICE", our_network_ids[i]));
+                        our_entries = g_slist_prepend (our_entries,
+                                                       auth_entry_new ("XSMP", our_network_ids[i]));
+                }
+        }
+
+        if (n_dropped == 0) {
+                /* Nothing to remove, so there is no need to rewrite
+                 * the entries that are already there.
+                 */
+                g_debug ("GsmXsmpServer: ICE authority file is clean (%u entries), appending", n_kept);
 
-                if (g_file_test (filename, G_FILE_TEST_EXISTS)) {
-                        g_warning ("Unable to read ICE authority file: %s", filename);
+                if (our_entries == NULL) {
+                        ok = TRUE;
                         goto cleanup;
                 }
 
-                fd = open (filename, O_CREAT | O_WRONLY, 0600);
-                fp = fdopen (fd, "w");
-                if (!fp) {
+                fp = open_auth_file (filename, O_APPEND);
+                if (fp == NULL) {
                         g_warning ("Unable to write to ICE authority file: %s", filename);
-                        if (fd != -1) {
-                                close (fd);
-                        }
                         goto cleanup;
                 }
-        }
 
-        if (adding) {
-                for (i = 0; i < server->num_local_xsmp_sockets; i++) {
-                        entries = g_slist_append (entries,
-                                                  auth_entry_new ("ICE", our_network_ids[i]));
-                        entries = g_slist_prepend (entries,
-                                                   auth_entry_new ("XSMP", our_network_ids[i]));
+                ok = write_auth_entries (fp, our_entries);
+                if (fclose (fp) != 0) {
+                        ok = FALSE;
+                }
+                if (!ok) {
+                        g_warning ("Unable to write to ICE authority file: %s", filename);
                 }
+                goto cleanup;
         }
 
-        for (e = entries; e; e = e->next) {
-                IceAuthFileEntry *auth_entry = e->data;
-                IceWriteAuthFileEntry (fp, auth_entry);
-                IceFreeAuthFileEntry (auth_entry);
+        g_debug ("GsmXsmpServer: compacting ICE authority file, keeping %u entries, dropping %u",
+                 n_kept, n_dropped);
+
+        /* Write a new file next to the old one and move it into
+         * place, so that a crash never leaves a truncated file.
+         */
+        tmp_filename = g_strconcat (filename, "-n", NULL);
+        fp = open_auth_file (tmp_filename, O_TRUNC);
+        if (fp == NULL) {
+                g_warning ("Unable to write to ICE authority file: %s", tmp_filename);
+                goto cleanup;
+        }
+
+        ok = write_auth_entries (fp, entries)
+                && write_auth_entries (fp, our_entries)
+                && fsync (fileno (fp)) == 0;
+        if (fclose (fp) != 0) {
+                ok = FALSE;
+        }
+
+        if (ok && rename (tmp_filename, filename) != 0) {
+                ok = FALSE;
         }
-        g_slist_free (entries);
 
-        fclose (fp);
-        ok = TRUE;
+        if (!ok) {
+                g_warning ("Unable to write to ICE authority file: %s", filename);
+                unlink (tmp_filename);
+        }
 
  cleanup:
         IceUnlockAuthFile (filename);
+        g_slist_free_full (entries, (GDestroyNotify) IceFreeAuthFileEntry);
+        g_slist_free_full (our_entries, (GDestroyNotify) IceFreeAuthFileEntry);
+        g_hash_table_destroy (checked_paths);
         for (i = 0; i < server->num_local_xsmp_sockets; i++) {
                 free (our_network_ids[i]);
         }
         g_free (our_network_ids);
+        g_free (our_host);
+        g_free (tmp_filename);
 
         return ok;
 }
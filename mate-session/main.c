@@ -41,6 +41,7 @@
 
 #include "mdm-signal-handler.h"
 #include "mdm-log.h"
+#include "mdm.h"
 
 #include "gsm-consolekit.h"
 #ifdef HAVE_SYSTEMD
@@ -50,6 +51,10 @@
 #include "gsm-manager.h"
 #include "gsm-xsmp-server.h"
 #include "gsm-store.h"
+#include "gsm-session-save.h"
+#include "gsm-flight-recorder.h"
+#include "gsm-prefetch.h"
+#include "gsm-notify-socket.h"
 
 #include "msm-gnome.h"
 
@@ -64,6 +69,8 @@
 #define DEBUG_SCHEMA          "org.mate.debug"
 #define DEBUG_KEY             "mate-session"
 
+#define LOG_LEVELS_KEY        "log-levels"
+
 #define VISUAL_SCHEMA         "org.mate.applications-at-visual"
 #define VISUAL_KEY            "exec"
 #define VISUAL_STARTUP_KEY    "startup"
@@ -384,7 +391,23 @@ static void maybe_load_saved_session_apps(GsmManager* manager)
 		g_object_unref (settings);
 
 		if (autostart == TRUE)
-			gsm_manager_add_autostart_apps_from_dir(manager, gsm_util_get_saved_session_dir());
+		{
+			const char* saved_dir = gsm_util_get_saved_session_dir();
+
+			if (saved_dir != NULL)
+			{
+				char* manifest = g_build_filename(saved_dir, GSM_SESSION_MANIFEST_FILE, NULL);
+
+				/* The manifest is missing if the last save did not
+				 * complete; fall back to the individual files. */
+				if (!gsm_manager_add_autostart_apps_from_manifest(manager, manifest))
+				{
+					gsm_manager_add_autostart_apps_from_dir(manager, saved_dir);
+				}
+
+				g_free(manifest);
+			}
+		}
 	}
 
 	if (consolekit != NULL)
@@ -438,6 +461,7 @@ static gboolean signal_cb(int signo, gpointer data)
 	GsmManager* manager;
 
 	g_debug("Got callback for signal %d", signo);
+	gsm_flight_recorder_record(GSM_FLIGHT_EVENT_SIGNAL, signo, NULL);
 
 	ret = TRUE;
 
@@ -465,8 +489,14 @@ static gboolean signal_cb(int signo, gpointer data)
 		case SIGUSR1:
 			g_debug("Got USR1 signal");
 			ret = TRUE;
+			gsm_flight_recorder_dump(signo);
 			mdm_log_toggle_debug();
 			break;
+		case SIGUSR2:
+			g_debug("Got USR2 signal, dumping flight recorder");
+			ret = TRUE;
+			gsm_flight_recorder_dump(signo);
+			break;
 		default:
 			g_debug("Caught unhandled signal %d", signo);
 			ret = TRUE;
@@ -477,6 +507,11 @@ static gboolean signal_cb(int signo, gpointer data)
 	return ret;
 }
 
+static void crash_cb(int signo)
+{
+	gsm_flight_recorder_dump(signo);
+}
+
 static void shutdown_cb(gpointer data)
 {
 	GsmManager* manager = (GsmManager*) data;
@@ -541,6 +576,16 @@ debug_changed (GSettings *settings, gchar *key, gpointer user_data)
 	mdm_log_set_debug (debug);
 }
 
+static void
+log_levels_changed (GSettings *settings, gchar *key, gpointer user_data)
+{
+	char* levels;
+
+	levels = g_settings_get_string (settings, LOG_LEVELS_KEY);
+	mdm_log_set_domain_levels (levels);
+	g_free (levels);
+}
+
 static gboolean
 schema_exists (const gchar* schema_name)
 {
@@ -602,6 +647,7 @@ int main(int argc, char** argv)
 	GsmStore* client_store;
 	GsmXsmpServer* xsmp_server;
 	GSettings* debug_settings = NULL;
+	GSettings* log_settings = NULL;
 	GSettings* accessibility_settings;
 	MdmSignalHandler* signal_handler;
 	static char** override_autostart_dirs = NULL;
@@ -653,6 +699,7 @@ int main(int argc, char** argv)
 #endif
 
 	mdm_log_init();
+	gsm_flight_recorder_init();
 
 	/* Allows to enable/disable debug from GSettings only if it is not set from argument */
 	if (!debug && schema_exists(DEBUG_SCHEMA))
@@ -664,6 +711,19 @@ int main(int argc, char** argv)
 
 	mdm_log_set_debug(debug);
 
+	/* Per-component levels, e.g. "GsmManager=debug,GsmStore=none"; the
+	 * environment wins, otherwise they follow GSettings at runtime */
+	if (g_getenv("MATE_SESSION_LOG_LEVELS") != NULL)
+	{
+		mdm_log_set_domain_levels(g_getenv("MATE_SESSION_LOG_LEVELS"));
+	}
+	else
+	{
+		log_settings = g_settings_new (GSM_SCHEMA);
+		g_signal_connect (log_settings, "changed::" LOG_LEVELS_KEY, G_CALLBACK (log_levels_changed), NULL);
+		log_levels_changed (log_settings, LOG_LEVELS_KEY, NULL);
+	}
+
 	if (disable_acceleration_check) {
 		g_debug ("hardware acceleration check is disabled");
 	} else {
@@ -712,6 +772,9 @@ int main(int argc, char** argv)
 	if (initialize_gsettings () != TRUE)
 		exit (1);
 
+	/* Start reading the files the last login needed */
+	gsm_prefetch_init();
+
 	/* Look if accessibility is enabled */
 	accessibility_settings = g_settings_new (ACCESSIBILITY_SCHEMA);
 	if (g_settings_get_boolean (accessibility_settings, ACCESSIBILITY_KEY))
@@ -742,9 +805,11 @@ int main(int argc, char** argv)
 	mdm_signal_handler_add(signal_handler, SIGFPE, signal_cb, NULL);
 	mdm_signal_handler_add(signal_handler, SIGHUP, signal_cb, NULL);
 	mdm_signal_handler_add(signal_handler, SIGUSR1, signal_cb, NULL);
+	mdm_signal_handler_add(signal_handler, SIGUSR2, signal_cb, NULL);
 	mdm_signal_handler_add(signal_handler, SIGTERM, signal_cb, manager);
 	mdm_signal_handler_add(signal_handler, SIGINT, signal_cb, manager);
 	mdm_signal_handler_set_fatal_func(signal_handler, shutdown_cb, manager);
+	mdm_signal_handler_set_crash_func(signal_handler, crash_cb);
 
 	if (override_autostart_dirs != NULL)
 	{
@@ -761,6 +826,8 @@ int main(int argc, char** argv)
 
 	gtk_main();
 
+	mdm_flush();
+
 	if (xsmp_server != NULL)
 	{
 		g_object_unref(xsmp_server);
@@ -787,6 +854,13 @@ int main(int argc, char** argv)
 		g_object_unref(debug_settings);
 	}
 
+	if (log_settings != NULL)
+	{
+		g_object_unref(log_settings);
+	}
+
+	gsm_notify_socket_shutdown();
+
 	msm_gnome_stop();
 	mdm_log_shutdown();
 
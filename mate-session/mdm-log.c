@@ -28,6 +28,8 @@
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <syslog.h>
 
@@ -36,8 +38,58 @@
 
 #include "mdm-log.h"
 
+/* Messages are formatted on the calling thread, pushed into a fixed
+ * size ring and written out by a separate thread, so that a busy debug
+ * log never blocks the main loop on syslog or the journal.  Errors and
+ * criticals are still written synchronously.
+ *
+ * When the journal is available records are sent to it directly, with
+ * the component ("GsmManager"), the session phase and, where the
+ * caller knows them, the client and app ids as separate fields.
+ */
+
+#define LOG_RING_SIZE        1024 /* must be a power of two */
+#define LOG_RING_MASK        (LOG_RING_SIZE - 1)
+#define LOG_COMPONENT_MAX    48
+#define LOG_SYNC_LEVELS      (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL)
+#define JOURNAL_SOCKET       "/run/systemd/journal/socket"
+
+typedef struct {
+        GLogLevelFlags  log_level;
+        const char     *phase;
+        char           *log_domain;
+        char           *component;
+        char           *client_id;
+        char           *app_id;
+        char           *message;
+} LogRecord;
+
+typedef struct {
+        guint      sequence;
+        LogRecord *record;
+} LogSlot;
+
 static gboolean initialized = FALSE;
-static int      syslog_levels = (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_WARNING);
+static guint     syslog_levels = (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_WARNING);
+
+/* component -> level mask, overriding syslog_levels */
+static GRWLock     domain_levels_lock;
+static GHashTable *domain_levels = NULL;
+
+static const char *current_phase = NULL;
+
+static LogSlot   ring[LOG_RING_SIZE];
+static guint     ring_enqueue_pos = 0;
+static guint     ring_dequeue_pos = 0;
+static gint      ring_dropped = 0;
+
+static GThread  *writer_thread = NULL;
+static GMutex    writer_mutex;
+static GCond     writer_cond;
+static gint      writer_waiting = 0;
+static gboolean  writer_stop = FALSE;
+
+static int       journal_fd = -1;
 
 static void
 log_level_to_priority_and_prefix (GLogLevelFlags log_level,
@@ -76,7 +128,7 @@ log_level_to_priority_and_prefix (GLogLevelFlags log_level,
         case G_LOG_LEVEL_DEBUG:
                 /* if debug was requested then bump this up to ERROR
                  * to ensure it is seen in a log */
-                if (syslog_levels & G_LOG_LEVEL_DEBUG) {
+                if (g_atomic_int_get (&syslog_levels) & G_LOG_LEVEL_DEBUG) {
                         priority = LOG_WARNING;
                         prefix = "DEBUG(+)";
                 } else {
@@ -98,69 +150,521 @@ log_level_to_priority_and_prefix (GLogLevelFlags log_level,
         }
 }
 
-void
-mdm_log_default_handler (const gchar   *log_domain,
-                         GLogLevelFlags log_level,
-                         const gchar   *message,
-                         gpointer       unused_data)
+/* "GsmManager: starting app" -> "GsmManager" */
+static gboolean
+component_from_message (const char *message,
+                        char       *buf,
+                        gsize       len)
 {
-        GString     *gstring;
-        int          priority;
-        const char  *level_prefix;
-        char        *string;
-        gboolean     do_log;
-        gboolean     is_fatal;
+        gsize i;
+
+        if (message == NULL) {
+                return FALSE;
+        }
+
+        for (i = 0; i < len - 1 && g_ascii_isalnum (message[i]); i++) {
+                buf[i] = message[i];
+        }
+
+        if (i == 0 || message[i] != ':') {
+                return FALSE;
+        }
+
+        buf[i] = '\0';
+        return TRUE;
+}
+
+static guint
+levels_for_component (const char *component)
+{
+        gpointer levels;
+        gboolean found;
+
+        if (component == NULL || g_atomic_pointer_get (&domain_levels) == NULL) {
+                return g_atomic_int_get (&syslog_levels);
+        }
+
+        g_rw_lock_reader_lock (&domain_levels_lock);
+        found = domain_levels != NULL
+                && g_hash_table_lookup_extended (domain_levels, component, NULL, &levels);
+        g_rw_lock_reader_unlock (&domain_levels_lock);
+
+        return found ? GPOINTER_TO_UINT (levels) : g_atomic_int_get (&syslog_levels);
+}
+
+gboolean
+mdm_log_is_enabled (const char     *component,
+                    GLogLevelFlags  log_level)
+{
+        return (levels_for_component (component) & log_level) != 0;
+}
+
+static void
+log_record_free (LogRecord *record)
+{
+        g_free (record->log_domain);
+        g_free (record->component);
+        g_free (record->client_id);
+        g_free (record->app_id);
+        g_free (record->message);
+        g_free (record);
+}
+
+static void
+ring_init (void)
+{
+        int i;
+
+        for (i = 0; i < LOG_RING_SIZE; i++) {
+                ring[i].sequence = (guint) i;
+                ring[i].record = NULL;
+        }
+        ring_enqueue_pos = 0;
+        ring_dequeue_pos = 0;
+}
+
+/* Bounded multi-producer queue: each slot carries a sequence number
+ * telling whether it is free for the producer at that position or
+ * filled for the consumer.  Only the writer thread dequeues.
+ */
+static gboolean
+ring_push (LogRecord *record)
+{
+        LogSlot *slot;
+        guint    pos;
+        gint     diff;
+
+        pos = g_atomic_int_get (&ring_enqueue_pos);
+        for (;;) {
+                slot = &ring[pos & LOG_RING_MASK];
+                diff = (gint) (g_atomic_int_get (&slot->sequence) - pos);
+
+                if (diff == 0) {
+                        if (g_atomic_int_compare_and_exchange (&ring_enqueue_pos, pos, pos + 1)) {
+                                break;
+                        }
+                } else if (diff < 0) {
+                        return FALSE;
+                }
+
+                pos = g_atomic_int_get (&ring_enqueue_pos);
+        }
 
-        is_fatal = (log_level & G_LOG_FLAG_FATAL) != 0;
+        slot->record = record;
+        g_atomic_int_set (&slot->sequence, pos + 1);
 
-        do_log = (log_level & syslog_levels);
-        if (! do_log) {
+        return TRUE;
+}
+
+static LogRecord *
+ring_pop (void)
+{
+        LogSlot   *slot;
+        LogRecord *record;
+        guint      pos;
+
+        pos = ring_dequeue_pos;
+        slot = &ring[pos & LOG_RING_MASK];
+        if (g_atomic_int_get (&slot->sequence) != pos + 1) {
+                return NULL;
+        }
+
+        record = slot->record;
+        slot->record = NULL;
+        g_atomic_int_set (&ring_dequeue_pos, pos + 1);
+        g_atomic_int_set (&slot->sequence, pos + LOG_RING_SIZE);
+
+        return record;
+}
+
+static gboolean
+ring_is_empty (void)
+{
+        guint pos;
+
+        pos = g_atomic_int_get (&ring_dequeue_pos);
+
+        return g_atomic_int_get (&ring[pos & LOG_RING_MASK].sequence) != pos + 1;
+}
+
+static void
+journal_append_field (GString    *buf,
+                      const char *key,
+                      const char *value)
+{
+        guint64 len;
+        int     i;
+
+        if (value == NULL) {
                 return;
         }
 
-        if (! initialized) {
-                mdm_log_init ();
+        if (strchr (value, '\n') == NULL) {
+                g_string_append_printf (buf, "%s=%s\n", key, value);
+                return;
+        }
+
+        /* Values with newlines use the binary form: the key, a
+         * newline, a little endian 64 bit length and the data */
+        len = strlen (value);
+        g_string_append (buf, key);
+        g_string_append_c (buf, '\n');
+        for (i = 0; i < 8; i++) {
+                g_string_append_c (buf, (char) ((len >> (i * 8)) & 0xff));
+        }
+        g_string_append_len (buf, value, len);
+        g_string_append_c (buf, '\n');
+}
+
+static gboolean
+journal_send (LogRecord *record,
+              int        priority,
+              GString   *buf)
+{
+        char priority_str[2];
+
+        if (journal_fd == -1) {
+                return FALSE;
+        }
+
+        /* the journal stores every priority, so don't bump debug */
+        if (record->log_level & G_LOG_LEVEL_DEBUG) {
+                priority = LOG_DEBUG;
         }
+        priority_str[0] = '0' + priority;
+        priority_str[1] = '\0';
+
+        g_string_truncate (buf, 0);
+        journal_append_field (buf, "MESSAGE", record->message != NULL ? record->message : "(NULL) message");
+        journal_append_field (buf, "PRIORITY", priority_str);
+        journal_append_field (buf, "SYSLOG_IDENTIFIER", g_get_prgname ());
+        journal_append_field (buf, "GLIB_DOMAIN", record->log_domain);
+        journal_append_field (buf, "MATE_SESSION_COMPONENT", record->component);
+        journal_append_field (buf, "MATE_SESSION_PHASE", record->phase);
+        journal_append_field (buf, "MATE_SESSION_CLIENT_ID", record->client_id);
+        journal_append_field (buf, "MATE_SESSION_APP_ID", record->app_id);
+
+        return send (journal_fd, buf->str, buf->len, MSG_NOSIGNAL) >= 0;
+}
+
+static void
+log_record_write (LogRecord *record,
+                  GString   *buf)
+{
+        int          priority;
+        const char  *level_prefix;
+        gboolean     is_fatal;
+        gboolean     journaled;
 
-        log_level_to_priority_and_prefix (log_level,
+        log_level_to_priority_and_prefix (record->log_level,
                                           &priority,
                                           &level_prefix);
 
-        gstring = g_string_new (NULL);
+        journaled = journal_send (record, priority, buf);
+
+        is_fatal = (record->log_level & G_LOG_FLAG_FATAL) != 0;
 
-        if (log_domain != NULL) {
-                g_string_append (gstring, log_domain);
-                g_string_append_c (gstring, '-');
+        g_string_truncate (buf, 0);
+
+        if (record->log_domain != NULL) {
+                g_string_append (buf, record->log_domain);
+                g_string_append_c (buf, '-');
         }
-        g_string_append (gstring, level_prefix);
+        g_string_append (buf, level_prefix);
 
-        g_string_append (gstring, ": ");
-        if (message == NULL) {
-                g_string_append (gstring, "(NULL) message");
+        g_string_append (buf, ": ");
+        if (record->message == NULL) {
+                g_string_append (buf, "(NULL) message");
         } else {
-                g_string_append (gstring, message);
+                g_string_append (buf, record->message);
         }
         if (is_fatal) {
-                g_string_append (gstring, "\naborting...\n");
+                g_string_append (buf, "\naborting...\n");
+        } else {
+                g_string_append (buf, "\n");
+        }
+
+        if (! journaled) {
+                syslog (priority, "%s", buf->str);
+                return;
+        }
+
+        /* syslog's LOG_PERROR copy is what ends up in ~/.xsession-errors,
+         * so keep it when the journal takes the message instead */
+#ifdef LOG_PERROR
+        fprintf (stderr, "%s[%d]: %s", g_get_prgname (), (int) getpid (), buf->str);
+#endif
+}
+
+static void
+write_dropped_notice (GString *buf)
+{
+        LogRecord record = { 0 };
+        gint      dropped;
+
+        do {
+                dropped = g_atomic_int_get (&ring_dropped);
+                if (dropped == 0) {
+                        return;
+                }
+        } while (!g_atomic_int_compare_and_exchange (&ring_dropped, dropped, 0));
+
+        record.log_level = G_LOG_LEVEL_WARNING;
+        record.message = g_strdup_printf ("%d log messages dropped, log buffer full", dropped);
+        log_record_write (&record, buf);
+        g_free (record.message);
+}
+
+static gpointer
+writer_thread_func (gpointer data)
+{
+        GString   *buf;
+        LogRecord *record;
+        gboolean   stop;
+
+        buf = g_string_sized_new (512);
+
+        do {
+                while ((record = ring_pop ()) != NULL) {
+                        log_record_write (record, buf);
+                        log_record_free (record);
+                }
+                write_dropped_notice (buf);
+
+                g_mutex_lock (&writer_mutex);
+                stop = writer_stop;
+                if (!stop) {
+                        g_atomic_int_set (&writer_waiting, 1);
+                        if (ring_is_empty ()) {
+                                g_cond_wait_until (&writer_cond,
+                                                   &writer_mutex,
+                                                   g_get_monotonic_time () + G_TIME_SPAN_SECOND);
+                        }
+                        g_atomic_int_set (&writer_waiting, 0);
+                }
+                g_mutex_unlock (&writer_mutex);
+        } while (!stop);
+
+        while ((record = ring_pop ()) != NULL) {
+                log_record_write (record, buf);
+                log_record_free (record);
+        }
+        write_dropped_notice (buf);
+
+        g_string_free (buf, TRUE);
+
+        return NULL;
+}
+
+static void
+wake_writer (void)
+{
+        if (g_atomic_int_get (&writer_waiting)) {
+                g_mutex_lock (&writer_mutex);
+                g_cond_signal (&writer_cond);
+                g_mutex_unlock (&writer_mutex);
+        }
+}
+
+/* Give the writer a moment to catch up before we abort, so the
+ * messages leading up to a fatal error make it to the log. */
+static void
+wait_for_writer (void)
+{
+        int i;
+
+        if (writer_thread == NULL || g_thread_self () == writer_thread) {
+                return;
+        }
+
+        wake_writer ();
+        for (i = 0; i < 100 && !ring_is_empty (); i++) {
+                g_usleep (1000);
+        }
+}
+
+static void
+log_record_dispatch (LogRecord *record)
+{
+        GString *buf;
+
+        if (!initialized) {
+                mdm_log_init ();
+        }
+
+        if (writer_thread != NULL && !(record->log_level & LOG_SYNC_LEVELS)) {
+                if (ring_push (record)) {
+                        wake_writer ();
+                } else {
+                        g_atomic_int_inc (&ring_dropped);
+                        log_record_free (record);
+                }
+                return;
+        }
+
+        if (record->log_level & G_LOG_FLAG_FATAL) {
+                wait_for_writer ();
+        }
+
+        buf = g_string_sized_new (512);
+        log_record_write (record, buf);
+        g_string_free (buf, TRUE);
+        log_record_free (record);
+}
+
+void
+mdm_log_default_handler (const gchar   *log_domain,
+                         GLogLevelFlags log_level,
+                         const gchar   *message,
+                         gpointer       unused_data)
+{
+        LogRecord *record;
+        char       component[LOG_COMPONENT_MAX];
+        gboolean   has_component;
+
+        has_component = component_from_message (message, component, sizeof (component));
+
+        if (! mdm_log_is_enabled (has_component ? component : log_domain, log_level)) {
+                return;
+        }
+
+        record = g_new0 (LogRecord, 1);
+        record->log_level = log_level;
+        record->phase = g_atomic_pointer_get (&current_phase);
+        record->log_domain = g_strdup (log_domain);
+        record->component = has_component ? g_strdup (component) : NULL;
+        record->message = g_strdup (message);
+
+        log_record_dispatch (record);
+}
+
+void
+mdm_log_structured_real (GLogLevelFlags  log_level,
+                         const char     *component,
+                         const char     *client_id,
+                         const char     *app_id,
+                         const char     *format,
+                         ...)
+{
+        LogRecord *record;
+        va_list    args;
+        char      *message;
+
+        va_start (args, format);
+        message = g_strdup_vprintf (format, args);
+        va_end (args);
+
+        record = g_new0 (LogRecord, 1);
+        record->log_level = log_level;
+        record->phase = g_atomic_pointer_get (&current_phase);
+        record->component = g_strdup (component);
+        record->client_id = g_strdup (client_id);
+        record->app_id = g_strdup (app_id);
+        if (component != NULL) {
+                record->message = g_strconcat (component, ": ", message, NULL);
+                g_free (message);
         } else {
-                g_string_append (gstring, "\n");
+                record->message = message;
+        }
+
+        log_record_dispatch (record);
+}
+
+void
+mdm_log_set_phase (const char *phase)
+{
+        g_atomic_pointer_set (&current_phase, phase);
+}
+
+static int
+parse_level (const char *name)
+{
+        static const struct {
+                const char *name;
+                int         levels;
+        } level_names[] = {
+                { "none",     0 },
+                { "error",    G_LOG_LEVEL_ERROR },
+                { "critical", G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL },
+                { "warning",  G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_WARNING },
+                { "message",  G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_WARNING | G_LOG_LEVEL_MESSAGE },
+                { "info",     G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_WARNING | G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO },
+                { "debug",    G_LOG_LEVEL_MASK }
+        };
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (level_names); i++) {
+                if (g_ascii_strcasecmp (name, level_names[i].name) == 0) {
+                        return level_names[i].levels;
+                }
         }
 
-        string = g_string_free (gstring, FALSE);
+        return -1;
+}
+
+/* Takes a list such as "GsmManager=debug,GsmXSMPClient=warning,*=message";
+ * "*" sets the level for everything not listed.  NULL or an empty
+ * string drops all the per-component levels.
+ */
+void
+mdm_log_set_domain_levels (const char *spec)
+{
+        GHashTable *table;
+        GHashTable *old;
+        char      **items;
+        int         i;
+
+        table = NULL;
+        items = g_strsplit (spec != NULL ? spec : "", ",", -1);
+        for (i = 0; items[i] != NULL; i++) {
+                char *name;
+                char *eq;
+                int   levels;
+
+                name = g_strstrip (items[i]);
+                eq = strchr (name, '=');
+                if (eq == NULL) {
+                        continue;
+                }
+                *eq = '\0';
+                g_strchomp (name);
+
+                levels = parse_level (g_strstrip (eq + 1));
+                if (levels < 0) {
+                        g_warning ("Unknown log level '%s' for '%s'", eq + 1, name);
+                        continue;
+                }
+
+                if (strcmp (name, "*") == 0) {
+                        g_atomic_int_set (&syslog_levels, levels);
+                        continue;
+                }
+
+                if (table == NULL) {
+                        table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+                }
+                g_hash_table_insert (table, g_strdup (name), GUINT_TO_POINTER (levels));
+        }
+        g_strfreev (items);
 
-        syslog (priority, "%s", string);
+        g_rw_lock_writer_lock (&domain_levels_lock);
+        old = domain_levels;
+        g_atomic_pointer_set (&domain_levels, table);
+        g_rw_lock_writer_unlock (&domain_levels_lock);
 
-        g_free (string);
+        if (old != NULL) {
+                g_hash_table_destroy (old);
+        }
 }
 
 void
 mdm_log_toggle_debug (void)
 {
-        if (syslog_levels & G_LOG_LEVEL_DEBUG) {
+        if (g_atomic_int_get (&syslog_levels) & G_LOG_LEVEL_DEBUG) {
                 g_debug ("Debugging disabled");
-                syslog_levels &= ~G_LOG_LEVEL_DEBUG;
+                g_atomic_int_and (&syslog_levels, ~G_LOG_LEVEL_DEBUG);
         } else {
-                syslog_levels |= G_LOG_LEVEL_DEBUG;
+                g_atomic_int_or (&syslog_levels, G_LOG_LEVEL_DEBUG);
                 g_debug ("Debugging enabled");
         }
 }
@@ -169,12 +673,35 @@ void
 mdm_log_set_debug (gboolean debug)
 {
         if (debug) {
-                syslog_levels |= G_LOG_LEVEL_DEBUG;
+                g_atomic_int_or (&syslog_levels, G_LOG_LEVEL_DEBUG);
                 g_debug ("Enabling debugging");
         } else {
                 g_debug ("Disabling debugging");
-                syslog_levels &= ~G_LOG_LEVEL_DEBUG;
+                g_atomic_int_and (&syslog_levels, ~G_LOG_LEVEL_DEBUG);
+        }
+}
+
+static void
+journal_connect (void)
+{
+        struct sockaddr_un addr;
+        int                fd;
+
+        fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+                return;
+        }
+
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strncpy (addr.sun_path, JOURNAL_SOCKET, sizeof (addr.sun_path) - 1);
+
+        if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0) {
+                close (fd);
+                return;
         }
+
+        journal_fd = fd;
 }
 
 void
@@ -183,6 +710,10 @@ mdm_log_init (void)
         const char *prg_name;
         int         options;
 
+        if (initialized) {
+                return;
+        }
+
         g_log_set_default_handler (mdm_log_default_handler, NULL);
 
         prg_name = g_get_prgname ();
@@ -194,13 +725,36 @@ mdm_log_init (void)
 
         openlog (prg_name, options, LOG_DAEMON);
 
+        journal_connect ();
+
         initialized = TRUE;
+
+        ring_init ();
+        writer_stop = FALSE;
+        writer_thread = g_thread_new ("mdm-log", writer_thread_func, NULL);
 }
 
 void
 mdm_log_shutdown (void)
 {
+        GThread *thread;
+
+        thread = writer_thread;
+        if (thread != NULL) {
+                g_mutex_lock (&writer_mutex);
+                writer_stop = TRUE;
+                g_cond_signal (&writer_cond);
+                g_mutex_unlock (&writer_mutex);
+
+                g_thread_join (thread);
+                writer_thread = NULL;
+        }
+
+        if (journal_fd != -1) {
+                close (journal_fd);
+                journal_fd = -1;
+        }
+
         closelog ();
         initialized = FALSE;
 }
-
@@ -39,6 +39,29 @@ void      mdm_log_toggle_debug    (void);
 void      mdm_log_init            (void);
 void      mdm_log_shutdown        (void);
 
+void      mdm_log_set_domain_levels (const char   *spec);
+void      mdm_log_set_phase         (const char   *phase);
+gboolean  mdm_log_is_enabled        (const char   *component,
+                                     GLogLevelFlags log_level);
+void      mdm_log_structured_real   (GLogLevelFlags log_level,
+                                     const char   *component,
+                                     const char   *client_id,
+                                     const char   *app_id,
+                                     const char   *format,
+                                     ...) G_GNUC_PRINTF (5, 6);
+
+/* Like g_log(), but records the client and app ids (either may be
+ * NULL) as separate journal fields, and skips formatting altogether
+ * when the component's level filters the message out. */
+#define   mdm_log_structured(log_level, component, client_id, app_id, ...) \
+        G_STMT_START { \
+                if (mdm_log_is_enabled ((component), (log_level))) \
+                        mdm_log_structured_real ((log_level), (component), (client_id), (app_id), __VA_ARGS__); \
+        } G_STMT_END
+
+#define   mdm_log_debug_for(component, client_id, app_id, ...) \
+        mdm_log_structured (G_LOG_LEVEL_DEBUG, (component), (client_id), (app_id), __VA_ARGS__)
+
 /* compatibility */
 #define   mdm_fail               g_critical
 #define   mdm_error              g_warning
@@ -27,16 +27,22 @@
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
 #if HAVE_EXECINFO_H
 	#include <execinfo.h>
 #endif
 #include <syslog.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#endif
 
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <glib-object.h>
 
 #include "mdm-signal-handler.h"
@@ -47,19 +53,51 @@
 #define UNUSED_VARIABLE
 #endif
 
+/* The signal handler proper only marks the signal as pending and, if
+ * nothing was pending yet, writes one byte to a pipe.  The main loop
+ * then runs the callbacks of every pending signal once, however many
+ * times it was delivered in between.  signalfd would need the signals
+ * blocked in the whole process, and that mask would be inherited by
+ * every application we spawn.
+ *
+ * Children are watched through a pidfd each where the kernel has them:
+ * all the pidfds sit in one epoll set, which is a single main loop
+ * source, and signals are sent through the pidfd so they can never hit
+ * a recycled pid.  Without pidfds, children are reaped from the SIGCHLD
+ * dispatch instead, so that we still don't need one GLib child watch
+ * (and its own SIGCHLD handling) per app.
+ */
+
+#if defined(__linux__) && defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+#define HAVE_PIDFD 1
+#endif
+
 typedef struct {
-	int signal_number;
 	MdmSignalHandlerFunc func;
 	gpointer data;
 	guint id;
 } CallbackData;
 
+typedef struct {
+	GPid pid;
+	int pidfd;
+	GChildWatchFunc func;
+	gpointer data;
+	guint id;
+	guint kill_timeout_id;
+} ChildWatch;
+
 struct _MdmSignalHandler {
 	GObject    parent_instance;
-	GHashTable* lookup;
-	GHashTable* id_lookup;
-	GHashTable* action_lookup;
+	GArray* callbacks[NSIG];
+	struct sigaction* old_actions[NSIG];
+	GArray* child_watches;
+	int epoll_fd;
+	guint epoll_watch_id;
 	guint next_id;
+	guint watch_id;
+	int dispatching;
+	gboolean needs_compact;
 	GDestroyNotify fatal_func;
 	gpointer fatal_data;
 };
@@ -67,88 +105,352 @@ struct _MdmSignalHandler {
 static void mdm_signal_handler_finalize (GObject* object);
 
 static gpointer signal_handler_object = NULL;
-static int signal_pipes[2];
-static int signals_blocked = 0;
-static sigset_t signals_block_mask;
-static sigset_t signals_oldmask;
+static int signal_pipes[2] = { -1, -1 };
+static volatile sig_atomic_t signals_pending[NSIG];
+static volatile sig_atomic_t any_signal_pending = 0;
+static MdmCrashHandlerFunc crash_func = NULL;
 
 G_DEFINE_TYPE(MdmSignalHandler, mdm_signal_handler, G_TYPE_OBJECT)
 
-static void block_signals_push(void)
+static void wake_up(int signo)
 {
-	signals_blocked++;
+	int UNUSED_VARIABLE ignore;
+	char c = 0;
+
+	signals_pending[signo] = 1;
 
-	if (signals_blocked == 1)
+	if (!any_signal_pending)
 	{
-		/* Set signal mask */
-		sigemptyset(&signals_block_mask);
-		sigfillset(&signals_block_mask);
-		sigprocmask(SIG_BLOCK, &signals_block_mask, &signals_oldmask);
+		any_signal_pending = 1;
+		ignore = write(signal_pipes[1], &c, 1);
 	}
 }
 
-static void block_signals_pop(void)
+static void compact_callbacks(MdmSignalHandler* handler)
 {
-	signals_blocked--;
+	guint signo;
+	guint i;
+
+	for (signo = 1; signo < NSIG; signo++)
+	{
+		GArray* array = handler->callbacks[signo];
+
+		if (array == NULL)
+		{
+			continue;
+		}
+
+		for (i = array->len; i > 0; i--)
+		{
+			if (g_array_index(array, CallbackData, i - 1).id == 0)
+			{
+				g_array_remove_index(array, i - 1);
+			}
+		}
+	}
 
-	if (signals_blocked == 0)
+	if (handler->child_watches != NULL)
 	{
-		/* Set signal mask */
-		sigprocmask(SIG_SETMASK, &signals_oldmask, NULL);
+		for (i = handler->child_watches->len; i > 0; i--)
+		{
+			if (g_array_index(handler->child_watches, ChildWatch, i - 1).id == 0)
+			{
+				g_array_remove_index(handler->child_watches, i - 1);
+			}
+		}
 	}
+
+	handler->needs_compact = FALSE;
 }
 
-static gboolean signal_io_watch(GIOChannel* ioc, GIOCondition condition, MdmSignalHandler* handler)
+static ChildWatch* find_child_watch(MdmSignalHandler* handler, guint id, guint* index)
 {
-	char buf[256];
-	gboolean is_fatal;
-	gsize bytes_read;
-	int i;
+	guint i;
 
-	block_signals_push();
+	if (id == 0 || handler->child_watches == NULL)
+	{
+		return NULL;
+	}
 
-	g_io_channel_read_chars(ioc, buf, sizeof(buf), &bytes_read, NULL);
+	for (i = 0; i < handler->child_watches->len; i++)
+	{
+		ChildWatch* watch = &g_array_index(handler->child_watches, ChildWatch, i);
 
-	is_fatal = FALSE;
+		if (watch->id == id)
+		{
+			if (index != NULL)
+			{
+				*index = i;
+			}
+
+			return watch;
+		}
+	}
 
-	for (i = 0; i < bytes_read; i++)
+	return NULL;
+}
+
+static void clear_child_watch(MdmSignalHandler* handler, ChildWatch* watch)
+{
+	if (watch->kill_timeout_id > 0)
+	{
+		g_source_remove(watch->kill_timeout_id);
+		watch->kill_timeout_id = 0;
+	}
+
+	if (watch->pidfd >= 0)
+	{
+#ifdef HAVE_PIDFD
+		epoll_ctl(handler->epoll_fd, EPOLL_CTL_DEL, watch->pidfd, NULL);
+#endif
+		close(watch->pidfd);
+		watch->pidfd = -1;
+	}
+}
+
+static void drop_child_watch(MdmSignalHandler* handler, guint index)
+{
+	if (handler->dispatching > 0)
+	{
+		g_array_index(handler->child_watches, ChildWatch, index).id = 0;
+		handler->needs_compact = TRUE;
+	}
+	else
 	{
-		int signum;
-		GSList* handlers;
-		GSList* l;
+		g_array_remove_index(handler->child_watches, index);
+	}
+}
 
-		signum = (gint32) buf[i];
+/* Reaps the child if it is gone and runs its callback */
+static void try_reap_child(MdmSignalHandler* handler, guint index)
+{
+	ChildWatch* watch;
+	ChildWatch  copy;
+	int status;
+	pid_t res;
 
-		g_debug("MdmSignalHandler: handling signal %d", signum);
-		handlers = g_hash_table_lookup(handler->lookup, GINT_TO_POINTER(signum));
+	watch = &g_array_index(handler->child_watches, ChildWatch, index);
 
-		g_debug("MdmSignalHandler: Found %u callbacks", g_slist_length(handlers));
+	if (watch->id == 0)
+	{
+		return;
+	}
+
+	status = 0;
+
+	do
+	{
+		res = waitpid(watch->pid, &status, WNOHANG);
+	} while (res == -1 && errno == EINTR);
+
+	if (res == 0 || (res == -1 && errno != ECHILD))
+	{
+		return;
+	}
+
+	/* someone else reaped it, we can't know how it ended; don't make
+	 * it look like a clean exit */
+	if (res == -1)
+	{
+		g_debug("MdmSignalHandler: child %d was already reaped", (int) watch->pid);
+		status = MDM_SIGNAL_HANDLER_STATUS_UNKNOWN;
+	}
+
+	clear_child_watch(handler, watch);
+	copy = *watch;
+	drop_child_watch(handler, index);
+
+	copy.func(copy.pid, status, copy.data);
+}
+
+static void reap_children(MdmSignalHandler* handler)
+{
+	guint i;
+
+	if (handler->child_watches == NULL)
+	{
+		return;
+	}
 
-		for (l = handlers; l != NULL; l = l->next)
+	/* Only wait for the children we were asked about, anything else
+	 * (g_spawn_sync and friends) reaps its own.  Children with a
+	 * pidfd are handled by child_epoll_dispatch(). */
+	for (i = 0; i < handler->child_watches->len; i++)
+	{
+		if (g_array_index(handler->child_watches, ChildWatch, i).pidfd < 0)
 		{
-			gboolean res;
-			CallbackData* data;
+			try_reap_child(handler, i);
+		}
+	}
+}
 
-			data = g_hash_table_lookup(handler->id_lookup, l->data);
+#ifdef HAVE_PIDFD
+static gboolean child_epoll_dispatch(int fd, GIOCondition condition, MdmSignalHandler* handler)
+{
+	struct epoll_event events[32];
+	int n;
+	int i;
 
-			if (data != NULL)
-			{
-				if (data->func != NULL)
-				{
-					g_debug("MdmSignalHandler: running %d handler: %p", signum, data->func);
+	g_object_ref(handler);
+	handler->dispatching++;
+
+	do
+	{
+		n = epoll_wait(fd, events, G_N_ELEMENTS(events), 0);
 
-					res = data->func(signum, data->data);
+		for (i = 0; i < n; i++)
+		{
+			guint index;
 
-					if (!res)
-					{
-						is_fatal = TRUE;
-					}
-				}
+			if (find_child_watch(handler, events[i].data.u32, &index) != NULL)
+			{
+				try_reap_child(handler, index);
 			}
 		}
+	} while (n == G_N_ELEMENTS(events));
+
+	handler->dispatching--;
+
+	if (handler->dispatching == 0 && handler->needs_compact)
+	{
+		compact_callbacks(handler);
+	}
+
+	g_object_unref(handler);
+
+	return TRUE;
+}
+
+static int open_pidfd(MdmSignalHandler* handler, GPid pid, guint id)
+{
+	struct epoll_event event;
+	int pidfd;
+
+	pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+	if (pidfd < 0)
+	{
+		return -1;
+	}
+
+	fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+
+	if (handler->epoll_fd < 0)
+	{
+		handler->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+		if (handler->epoll_fd < 0)
+		{
+			close(pidfd);
+			return -1;
+		}
+
+		handler->epoll_watch_id = g_unix_fd_add_full(G_PRIORITY_HIGH, handler->epoll_fd, G_IO_IN, (GUnixFDSourceFunc) child_epoll_dispatch, handler, NULL);
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = id;
+
+	if (epoll_ctl(handler->epoll_fd, EPOLL_CTL_ADD, pidfd, &event) != 0)
+	{
+		close(pidfd);
+		return -1;
+	}
+
+	return pidfd;
+}
+#endif
+
+static gboolean dispatch_signal(MdmSignalHandler* handler, int signo)
+{
+	GArray* array;
+	gboolean is_fatal = FALSE;
+	guint i;
+
+	g_debug("MdmSignalHandler: handling signal %d", signo);
+
+	if (signo == SIGCHLD)
+	{
+		reap_children(handler);
+	}
+
+	array = handler->callbacks[signo];
+
+	if (array == NULL)
+	{
+		return FALSE;
+	}
+
+	/* callbacks added while dispatching are appended and run too,
+	 * removed ones have their id cleared */
+	for (i = 0; i < array->len; i++)
+	{
+		CallbackData* data = &g_array_index(array, CallbackData, i);
+		MdmSignalHandlerFunc func = data->func;
+
+		if (data->id == 0 || func == NULL)
+		{
+			continue;
+		}
+
+		g_debug("MdmSignalHandler: running %d handler: %p", signo, func);
+
+		if (!func(signo, data->data))
+		{
+			is_fatal = TRUE;
+		}
+
+		/* the array may have been reallocated */
+		array = handler->callbacks[signo];
+	}
+
+	return is_fatal;
+}
+
+static gboolean signal_fd_dispatch(int fd, GIOCondition condition, MdmSignalHandler* handler)
+{
+	char buf[64];
+	gboolean is_fatal;
+	int signo;
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+	{
+		/* drain */
+	}
+
+	/* clear this first, so that signals arriving while we dispatch
+	 * wake us up again */
+	any_signal_pending = 0;
+
+	is_fatal = FALSE;
+
+	g_object_ref(handler);
+	handler->dispatching++;
+
+	for (signo = 1; signo < NSIG; signo++)
+	{
+		if (!signals_pending[signo])
+		{
+			continue;
+		}
+
+		signals_pending[signo] = 0;
+
+		if (dispatch_signal(handler, signo))
+		{
+			is_fatal = TRUE;
+		}
+	}
+
+	handler->dispatching--;
+
+	if (handler->dispatching == 0 && handler->needs_compact)
+	{
+		compact_callbacks(handler);
 	}
 
-	block_signals_pop();
+	g_object_unref(handler);
 
 	if (is_fatal)
 	{
@@ -162,8 +464,6 @@ static gboolean signal_io_watch(GIOChannel* ioc, GIOCondition condition, MdmSign
 			g_debug("MdmSignalHandler: Caught termination signal - exiting");
 			exit (1);
 		}
-
-		return FALSE;
 	}
 
 	g_debug("MdmSignalHandler: Done handling signals");
@@ -256,8 +556,7 @@ static void mdm_signal_handler_backtrace(void)
 static void signal_handler(int signo)
 {
 	static int in_fatal = 0;
-	int UNUSED_VARIABLE ignore;
-	guchar signo_byte = signo;
+	int saved_errno;
 
 	/* avoid loops */
 	if (in_fatal > 0)
@@ -266,6 +565,7 @@ static void signal_handler(int signo)
 	}
 
 	++in_fatal;
+	saved_errno = errno;
 
 	switch (signo)
 	{
@@ -274,6 +574,10 @@ static void signal_handler(int signo)
 		case SIGILL:
 		case SIGABRT:
 		case SIGTRAP:
+			if (crash_func != NULL)
+			{
+				crash_func(signo);
+			}
 			mdm_signal_handler_backtrace();
 			exit(1);
 			break;
@@ -281,14 +585,20 @@ static void signal_handler(int signo)
 		case SIGPIPE:
 			/* let the fatal signals interrupt us */
 			--in_fatal;
+			if (crash_func != NULL)
+			{
+				crash_func(signo);
+			}
 			mdm_signal_handler_backtrace();
-			ignore = write(signal_pipes [1], &signo_byte, 1);
+			wake_up(signo);
 			break;
 		default:
 			--in_fatal;
-			ignore = write(signal_pipes [1], &signo_byte, 1);
+			wake_up(signo);
 			break;
 	}
+
+	errno = saved_errno;
 }
 
 static void catch_signal(MdmSignalHandler *handler, int signal_number)
@@ -296,62 +606,105 @@ static void catch_signal(MdmSignalHandler *handler, int signal_number)
 	struct sigaction action;
 	struct sigaction* old_action;
 
+	if (handler->old_actions[signal_number] != NULL)
+	{
+		return;
+	}
+
 	g_debug("MdmSignalHandler: Registering for %d signals", signal_number);
 
 	action.sa_handler = signal_handler;
 	sigemptyset(&action.sa_mask);
 	action.sa_flags = 0;
 
+	if (signal_number == SIGCHLD)
+	{
+		action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	}
+
 	old_action = g_new0(struct sigaction, 1);
 
 	sigaction(signal_number, &action, old_action);
 
-	g_hash_table_insert(handler->action_lookup, GINT_TO_POINTER(signal_number), old_action);
+	handler->old_actions[signal_number] = old_action;
 }
 
 static void uncatch_signal(MdmSignalHandler* handler, int signal_number)
 {
 	struct sigaction* old_action;
 
-	g_debug("MdmSignalHandler: Unregistering for %d signals", signal_number);
+	old_action = handler->old_actions[signal_number];
+
+	if (old_action == NULL)
+	{
+		return;
+	}
 
-	old_action = g_hash_table_lookup(handler->action_lookup, GINT_TO_POINTER(signal_number));
-	g_hash_table_remove(handler->action_lookup, GINT_TO_POINTER(signal_number));
+	g_debug("MdmSignalHandler: Unregistering for %d signals", signal_number);
 
 	sigaction(signal_number, old_action, NULL);
 
 	g_free(old_action);
+	handler->old_actions[signal_number] = NULL;
 }
 
-guint mdm_signal_handler_add(MdmSignalHandler* handler, int signal_number, MdmSignalHandlerFunc callback, gpointer data)
+static gboolean signal_has_handlers(MdmSignalHandler* handler, int signal_number)
 {
-	CallbackData* cdata;
-	GSList* list;
+	GArray* array = handler->callbacks[signal_number];
+	guint i;
 
-	g_return_val_if_fail(MDM_IS_SIGNAL_HANDLER(handler), 0);
+	if (signal_number == SIGCHLD && handler->child_watches != NULL)
+	{
+		for (i = 0; i < handler->child_watches->len; i++)
+		{
+			ChildWatch* watch = &g_array_index(handler->child_watches, ChildWatch, i);
 
-	cdata = g_new0(CallbackData, 1);
-	cdata->signal_number = signal_number;
-	cdata->func = callback;
-	cdata->data = data;
-	cdata->id = handler->next_id++;
+			if (watch->id != 0 && watch->pidfd < 0)
+			{
+				return TRUE;
+			}
+		}
+	}
 
-	g_debug("MdmSignalHandler: Adding handler %u: signum=%d %p", cdata->id, cdata->signal_number, cdata->func);
+	if (array == NULL)
+	{
+		return FALSE;
+	}
 
-	if (g_hash_table_lookup(handler->action_lookup, GINT_TO_POINTER(signal_number)) == NULL)
+	for (i = 0; i < array->len; i++)
 	{
-		catch_signal(handler, signal_number);
+		if (g_array_index(array, CallbackData, i).id != 0)
+		{
+			return TRUE;
+		}
 	}
 
-	/* ID lookup owns the CallbackData */
-	g_hash_table_insert(handler->id_lookup, GUINT_TO_POINTER(cdata->id), cdata);
+	return FALSE;
+}
+
+guint mdm_signal_handler_add(MdmSignalHandler* handler, int signal_number, MdmSignalHandlerFunc callback, gpointer data)
+{
+	CallbackData cdata;
+
+	g_return_val_if_fail(MDM_IS_SIGNAL_HANDLER(handler), 0);
+	g_return_val_if_fail(signal_number > 0 && signal_number < NSIG, 0);
+
+	cdata.func = callback;
+	cdata.data = data;
+	cdata.id = handler->next_id++;
+
+	g_debug("MdmSignalHandler: Adding handler %u: signum=%d %p", cdata.id, signal_number, cdata.func);
 
-	list = g_hash_table_lookup(handler->lookup, GINT_TO_POINTER(signal_number));
-	list = g_slist_prepend(list, GUINT_TO_POINTER (cdata->id));
+	catch_signal(handler, signal_number);
 
-	g_hash_table_insert(handler->lookup, GINT_TO_POINTER(signal_number), list);
+	if (handler->callbacks[signal_number] == NULL)
+	{
+		handler->callbacks[signal_number] = g_array_new(FALSE, FALSE, sizeof(CallbackData));
+	}
+
+	g_array_append_val(handler->callbacks[signal_number], cdata);
 
-	return cdata->id;
+	return cdata.id;
 }
 
 void mdm_signal_handler_add_fatal(MdmSignalHandler* handler)
@@ -365,103 +718,235 @@ void mdm_signal_handler_add_fatal(MdmSignalHandler* handler)
 	mdm_signal_handler_add(handler, SIGTRAP, NULL, NULL);
 }
 
-static void callback_data_free(CallbackData* d)
+static void remove_callback(MdmSignalHandler* handler, int signal_number, guint index)
 {
-	g_free(d);
+	CallbackData* cdata = &g_array_index(handler->callbacks[signal_number], CallbackData, index);
+
+	g_debug("MdmSignalHandler: Removing handler %u: signum=%d %p", cdata->id, signal_number, cdata->func);
+
+	if (handler->dispatching > 0)
+	{
+		cdata->id = 0;
+		handler->needs_compact = TRUE;
+	}
+	else
+	{
+		g_array_remove_index(handler->callbacks[signal_number], index);
+	}
+
+	if (!signal_has_handlers(handler, signal_number))
+	{
+		uncatch_signal(handler, signal_number);
+	}
 }
 
-static void mdm_signal_handler_remove_and_free_data(MdmSignalHandler* handler, CallbackData* cdata)
+void mdm_signal_handler_remove(MdmSignalHandler* handler, guint id)
 {
-	GSList* list;
+	int signo;
+	guint i;
 
 	g_return_if_fail(MDM_IS_SIGNAL_HANDLER(handler));
 
-	list = g_hash_table_lookup(handler->lookup, GINT_TO_POINTER(cdata->signal_number));
-	list = g_slist_remove_all(list, GUINT_TO_POINTER(cdata->id));
-
-	if (list == NULL)
+	if (id == 0)
 	{
-		uncatch_signal(handler, cdata->signal_number);
+		return;
 	}
 
-	g_debug("MdmSignalHandler: Removing handler %u: signum=%d %p", cdata->signal_number, cdata->id, cdata->func);
-	/* put changed list back in */
-	g_hash_table_insert(handler->lookup, GINT_TO_POINTER(cdata->signal_number), list);
+	for (signo = 1; signo < NSIG; signo++)
+	{
+		GArray* array = handler->callbacks[signo];
+
+		if (array == NULL)
+		{
+			continue;
+		}
 
-	g_hash_table_remove(handler->id_lookup, GUINT_TO_POINTER(cdata->id));
+		for (i = 0; i < array->len; i++)
+		{
+			if (g_array_index(array, CallbackData, i).id == id)
+			{
+				remove_callback(handler, signo, i);
+				return;
+			}
+		}
+	}
 }
 
-void mdm_signal_handler_remove(MdmSignalHandler* handler, guint id)
+void mdm_signal_handler_remove_func(MdmSignalHandler* handler, guint signal_number, MdmSignalHandlerFunc callback, gpointer data)
 {
-	CallbackData* found;
+	GArray* array;
+	guint i;
 
 	g_return_if_fail(MDM_IS_SIGNAL_HANDLER(handler));
+	g_return_if_fail(signal_number > 0 && signal_number < NSIG);
 
-	found = g_hash_table_lookup(handler->id_lookup, GUINT_TO_POINTER(id));
+	array = handler->callbacks[signal_number];
+
+	if (array == NULL)
+	{
+		return;
+	}
 
-	if (found != NULL)
+	for (i = 0; i < array->len; i++)
 	{
-		mdm_signal_handler_remove_and_free_data(handler, found);
-		found = NULL;
+		CallbackData* d = &g_array_index(array, CallbackData, i);
+
+		if (d->id != 0 && d->func == callback && d->data == data)
+		{
+			remove_callback(handler, signal_number, i);
+			return;
+		}
 	}
 }
 
-static CallbackData* find_callback_data_by_func(MdmSignalHandler* handler, guint signal_number, MdmSignalHandlerFunc callback, gpointer data)
+guint mdm_signal_handler_add_child_watch(MdmSignalHandler* handler, GPid pid, GChildWatchFunc func, gpointer data)
 {
-	GSList* list;
-	GSList* l;
-	CallbackData* found;
+	ChildWatch watch;
 
-	found = NULL;
+	g_return_val_if_fail(MDM_IS_SIGNAL_HANDLER(handler), 0);
+	g_return_val_if_fail(pid > 0, 0);
+	g_return_val_if_fail(func != NULL, 0);
+
+	watch.pid = pid;
+	watch.pidfd = -1;
+	watch.func = func;
+	watch.data = data;
+	watch.id = handler->next_id++;
+	watch.kill_timeout_id = 0;
+
+#ifdef HAVE_PIDFD
+	/* the child can't be reaped behind our back, so the pid still
+	 * refers to it even if it has exited already; the pidfd is then
+	 * readable straight away */
+	watch.pidfd = open_pidfd(handler, pid, watch.id);
+#endif
 
-	list = g_hash_table_lookup(handler->lookup, GINT_TO_POINTER(signal_number));
+	g_debug("MdmSignalHandler: Watching child %d (%u)%s", (int) pid, watch.id, watch.pidfd >= 0 ? " through a pidfd" : "");
 
-	for (l = list; l != NULL; l = l->next)
+	if (handler->child_watches == NULL)
 	{
-		guint id;
-		CallbackData* d;
+		handler->child_watches = g_array_new(FALSE, FALSE, sizeof(ChildWatch));
+	}
 
-		id = GPOINTER_TO_UINT(l->data);
+	g_array_append_val(handler->child_watches, watch);
 
-		d = g_hash_table_lookup(handler->id_lookup, GUINT_TO_POINTER (id));
+	if (watch.pidfd < 0)
+	{
+		catch_signal(handler, SIGCHLD);
 
-		if (d != NULL && d->func == callback && d->data == data)
-		{
-			found = d;
-			break;
-		}
+		/* The child may have exited before we were watching it, in
+		 * which case its SIGCHLD is already gone: check once anyway */
+		wake_up(SIGCHLD);
 	}
 
-	return found;
+	return watch.id;
 }
 
-void mdm_signal_handler_remove_func(MdmSignalHandler* handler, guint signal_number, MdmSignalHandlerFunc callback, gpointer data)
+void mdm_signal_handler_remove_child_watch(MdmSignalHandler* handler, guint id)
 {
-	CallbackData* found;
+	ChildWatch* watch;
+	guint index;
 
 	g_return_if_fail(MDM_IS_SIGNAL_HANDLER(handler));
 
-	found = find_callback_data_by_func(handler, signal_number, callback, data);
+	watch = find_child_watch(handler, id, &index);
 
-	if (found != NULL)
+	if (watch == NULL)
 	{
-		mdm_signal_handler_remove_and_free_data(handler, found);
-		found = NULL;
+		return;
 	}
 
-	/* FIXME: once all handlers are removed deregister signum handler */
+	g_debug("MdmSignalHandler: No longer watching child %d (%u)", (int) watch->pid, id);
+
+	clear_child_watch(handler, watch);
+	drop_child_watch(handler, index);
+
+	if (!signal_has_handlers(handler, SIGCHLD))
+	{
+		uncatch_signal(handler, SIGCHLD);
+	}
 }
 
-static void mdm_signal_handler_class_init(MdmSignalHandlerClass* klass)
+/* Like kill(), but through the pidfd when there is one */
+int mdm_signal_handler_signal_child(MdmSignalHandler* handler, guint id, int signal_number)
 {
-	GObjectClass* object_class = G_OBJECT_CLASS(klass);
+	ChildWatch* watch;
 
-	object_class->finalize = mdm_signal_handler_finalize;
+	g_return_val_if_fail(MDM_IS_SIGNAL_HANDLER(handler), -1);
+
+	watch = find_child_watch(handler, id, NULL);
+
+	if (watch == NULL)
+	{
+		errno = ESRCH;
+		return -1;
+	}
+
+	g_debug("MdmSignalHandler: sending signal %d to child %d", signal_number, (int) watch->pid);
+
+#ifdef HAVE_PIDFD
+	if (watch->pidfd >= 0)
+	{
+		return syscall(SYS_pidfd_send_signal, watch->pidfd, signal_number, NULL, 0);
+	}
+#endif
+
+	return kill(watch->pid, signal_number);
 }
 
-static void signal_list_free(GSList *list)
+static gboolean kill_child_timeout(gpointer data)
 {
-	g_slist_free(list);
+	MdmSignalHandler* handler = signal_handler_object;
+	ChildWatch* watch;
+
+	if (handler == NULL)
+	{
+		return FALSE;
+	}
+
+	watch = find_child_watch(handler, GPOINTER_TO_UINT(data), NULL);
+
+	if (watch != NULL)
+	{
+		watch->kill_timeout_id = 0;
+		g_debug("MdmSignalHandler: child %d did not exit in time, killing it", (int) watch->pid);
+		mdm_signal_handler_signal_child(handler, watch->id, SIGKILL);
+	}
+
+	return FALSE;
+}
+
+/* Sends SIGTERM, and SIGKILL if the child is still there after
+ * timeout_ms (unless that is 0) */
+int mdm_signal_handler_terminate_child(MdmSignalHandler* handler, guint id, guint timeout_ms)
+{
+	ChildWatch* watch;
+	int res;
+
+	g_return_val_if_fail(MDM_IS_SIGNAL_HANDLER(handler), -1);
+
+	res = mdm_signal_handler_signal_child(handler, id, SIGTERM);
+
+	if (res != 0 || timeout_ms == 0)
+	{
+		return res;
+	}
+
+	watch = find_child_watch(handler, id, NULL);
+
+	if (watch != NULL && watch->kill_timeout_id == 0)
+	{
+		watch->kill_timeout_id = g_timeout_add(timeout_ms, kill_child_timeout, GUINT_TO_POINTER(id));
+	}
+
+	return 0;
+}
+
+static void mdm_signal_handler_class_init(MdmSignalHandlerClass* klass)
+{
+	GObjectClass* object_class = G_OBJECT_CLASS(klass);
+
+	object_class->finalize = mdm_signal_handler_finalize;
 }
 
 void mdm_signal_handler_set_fatal_func(MdmSignalHandler* handler, MdmShutdownHandlerFunc func, gpointer user_data)
@@ -472,32 +957,35 @@ void mdm_signal_handler_set_fatal_func(MdmSignalHandler* handler, MdmShutdownHan
 	handler->fatal_data = user_data;
 }
 
+void mdm_signal_handler_set_crash_func(MdmSignalHandler* handler, MdmCrashHandlerFunc func)
+{
+	g_return_if_fail(MDM_IS_SIGNAL_HANDLER(handler));
+
+	crash_func = func;
+}
+
 static void mdm_signal_handler_init(MdmSignalHandler* handler)
 {
-	GIOChannel* ioc;
+	GError* error = NULL;
 
 	handler->next_id = 1;
+	handler->epoll_fd = -1;
 
-	handler->lookup = g_hash_table_new(NULL, NULL);
-	handler->id_lookup = g_hash_table_new(NULL, NULL);
-	handler->action_lookup = g_hash_table_new(NULL, NULL);
-
-	if (pipe(signal_pipes) == -1)
+	if (!g_unix_open_pipe(signal_pipes, FD_CLOEXEC, &error))
 	{
-		g_error ("Could not create pipe() for signal handling");
+		g_error ("Could not create pipe() for signal handling: %s", error->message);
 	}
 
-	ioc = g_io_channel_unix_new(signal_pipes[0]);
-	g_io_channel_set_flags(ioc, G_IO_FLAG_NONBLOCK, NULL);
-	g_io_add_watch_full(ioc, G_PRIORITY_HIGH, G_IO_IN, (GIOFunc) signal_io_watch, handler, NULL);
-	g_io_channel_set_close_on_unref(ioc, TRUE);
-	g_io_channel_unref(ioc);
+	g_unix_set_fd_nonblocking(signal_pipes[0], TRUE, NULL);
+	g_unix_set_fd_nonblocking(signal_pipes[1], TRUE, NULL);
+
+	handler->watch_id = g_unix_fd_add_full(G_PRIORITY_HIGH, signal_pipes[0], G_IO_IN, (GUnixFDSourceFunc) signal_fd_dispatch, handler, NULL);
 }
 
 static void mdm_signal_handler_finalize(GObject* object)
 {
 	MdmSignalHandler* handler;
-	GList* l;
+	int signo;
 
 	g_return_if_fail(object != NULL);
 	g_return_if_fail(MDM_IS_SIGNAL_HANDLER(object));
@@ -506,29 +994,46 @@ static void mdm_signal_handler_finalize(GObject* object)
 
 	g_debug("MdmSignalHandler: Finalizing signal handler");
 
-	for (l = g_hash_table_get_values(handler->lookup); l != NULL; l = l->next)
+	for (signo = 1; signo < NSIG; signo++)
 	{
-		signal_list_free((GSList*) l->data);
-	}
+		uncatch_signal(handler, signo);
 
-	g_hash_table_destroy(handler->lookup);
+		if (handler->callbacks[signo] != NULL)
+		{
+			g_array_free(handler->callbacks[signo], TRUE);
+		}
+	}
 
-	for (l = g_hash_table_get_values(handler->id_lookup); l != NULL; l = l->next)
+	if (handler->child_watches != NULL)
 	{
-		callback_data_free((CallbackData*) l->data);
+		guint i;
+
+		for (i = 0; i < handler->child_watches->len; i++)
+		{
+			clear_child_watch(handler, &g_array_index(handler->child_watches, ChildWatch, i));
+		}
+
+		g_array_free(handler->child_watches, TRUE);
 	}
 
-	g_hash_table_destroy(handler->id_lookup);
+	if (handler->epoll_watch_id > 0)
+	{
+		g_source_remove(handler->epoll_watch_id);
+	}
 
-	for (l = g_hash_table_get_values(handler->action_lookup); l != NULL; l = l->next)
+	if (handler->epoll_fd >= 0)
 	{
-		g_free(l->data);
+		close(handler->epoll_fd);
 	}
 
-	g_hash_table_destroy(handler->action_lookup);
+	if (handler->watch_id > 0)
+	{
+		g_source_remove(handler->watch_id);
+	}
 
 	close(signal_pipes[0]);
 	close(signal_pipes[1]);
+	signal_pipes[0] = signal_pipes[1] = -1;
 
 	G_OBJECT_CLASS(mdm_signal_handler_parent_class)->finalize(object);
 }
@@ -32,16 +32,29 @@ typedef gboolean (*MdmSignalHandlerFunc)(int signal, gpointer data);
 
 typedef void (*MdmShutdownHandlerFunc)(gpointer data);
 
+/* Called from the signal handler itself: must be async-signal-safe */
+typedef void (*MdmCrashHandlerFunc)(int signal);
+
 typedef struct MdmSignalHandlerPrivate MdmSignalHandlerPrivate;
 
 MdmSignalHandler* mdm_signal_handler_new(void);
 void mdm_signal_handler_set_fatal_func(MdmSignalHandler* handler, MdmShutdownHandlerFunc func, gpointer user_data);
+void mdm_signal_handler_set_crash_func(MdmSignalHandler* handler, MdmCrashHandlerFunc func);
 
 void mdm_signal_handler_add_fatal(MdmSignalHandler* handler);
 guint mdm_signal_handler_add(MdmSignalHandler* handler, int signal_number, MdmSignalHandlerFunc callback, gpointer data);
 void mdm_signal_handler_remove(MdmSignalHandler* handler, guint id);
 void mdm_signal_handler_remove_func(MdmSignalHandler* handler, guint signal_number, MdmSignalHandlerFunc callback, gpointer data);
 
+/* Passed as the status of a child somebody else reaped; neither
+ * WIFEXITED() nor WIFSIGNALED() is true for it */
+#define MDM_SIGNAL_HANDLER_STATUS_UNKNOWN (-1)
+
+guint mdm_signal_handler_add_child_watch(MdmSignalHandler* handler, GPid pid, GChildWatchFunc func, gpointer data);
+void mdm_signal_handler_remove_child_watch(MdmSignalHandler* handler, guint id);
+int mdm_signal_handler_signal_child(MdmSignalHandler* handler, guint id, int signal_number);
+int mdm_signal_handler_terminate_child(MdmSignalHandler* handler, guint id, guint timeout_ms);
+
 G_END_DECLS
 
 #endif /* __MDM_SIGNAL_HANDLER_H */
@@ -38,11 +38,14 @@
 #include <sys/un.h>
 
 #include <X11/Xauth.h>
+#include <glib-unix.h>
 #include <gdk/gdk.h>
 
 #include "mdm.h"
 
-#define MDM_PROTOCOL_UPDATE_INTERVAL 1 /* seconds */
+#define MDM_PROTOCOL_RETRY_INTERVAL 1 /* seconds */
+#define MDM_PROTOCOL_RECONNECT_DELAY 2 /* seconds */
+#define MDM_PROTOCOL_TIMEOUT 10 /* seconds */
 
 #define MDM_PROTOCOL_SOCKET_PATH "/var/run/mdm_socket"
 
@@ -58,72 +61,106 @@
 #define MDM_ACTION_STR_REBOOT "REBOOT"
 #define MDM_ACTION_STR_SUSPEND "SUSPEND"
 
+/* The connection to MDM is opened once, authenticated once and then
+ * kept around.  MDM answers every command with one line, in order, so
+ * commands are written as soon as they are issued and the answers are
+ * matched against the queue of commands already sent.  Commands issued
+ * while the connection is still being authenticated wait in a second
+ * queue.  If MDM goes away (typically because it was restarted), the
+ * connection is reopened a little later.  Nothing waits for an answer
+ * while the main loop runs: the logout actions are cached once known,
+ * and mdm_flush() lets the last commands out when the session ends.
+ */
+
+typedef enum {
+	MDM_CONNECTION_CLOSED,
+	MDM_CONNECTION_HANDSHAKE,
+	MDM_CONNECTION_READY
+} MdmConnectionState;
+
+typedef struct _MdmProtocolData MdmProtocolData;
+
+typedef void (*MdmResponseFunc)(MdmProtocolData* data, const char* response, gpointer user_data);
+
 typedef struct {
+	char* msg;
+	MdmResponseFunc func;
+	gpointer user_data;
+} MdmRequest;
+
+typedef struct {
+	MdmLogoutActionsFunc func;
+	gpointer user_data;
+} MdmActionsWaiter;
+
+typedef struct {
+	gboolean done;
+	char* response;
+} MdmSyncReply;
+
+struct _MdmProtocolData {
 	int fd;
+	MdmConnectionState state;
+	guint in_watch_id;
+	guint out_watch_id;
+	guint reconnect_id;
+	GString* inbuf;
+	GString* outbuf;
+	GQueue sent;
+	GQueue pending;
+	gboolean dispatching;
+	gboolean protocol_error;
+
 	char* auth_cookie;
+	GSList* auth_candidates;
+
+	time_t last_failure;
 
+	gboolean actions_known;
+	gboolean query_in_flight;
+	GSList* actions_waiters;
 	MdmLogoutAction available_actions;
 	MdmLogoutAction current_actions;
-
-	time_t last_update;
-} MdmProtocolData;
+};
 
 static MdmProtocolData mdm_protocol_data = {
-	0,
-	NULL,
-	MDM_LOGOUT_ACTION_NONE,
-	MDM_LOGOUT_ACTION_NONE,
-	0
+	-1,
+	MDM_CONNECTION_CLOSED
 };
 
-static char* mdm_send_protocol_msg(MdmProtocolData* data, const char* msg)
-{
-	GString* retval;
-	char buf[256];
-	char* p;
-	int len;
-
-	p = g_strconcat(msg, "\n", NULL);
+static void mdm_close_connection(MdmProtocolData* data, gboolean reconnect);
+static gboolean mdm_flush_output(MdmProtocolData* data);
+static void mdm_request_logout_actions(MdmProtocolData* data);
 
-	if (write(data->fd, p, strlen(p)) < 0)
+static void mdm_complete_request(MdmProtocolData* data, MdmRequest* request, const char* response)
+{
+	if (request->func)
 	{
-		g_free(p);
-
-		g_warning("Failed to send message to MDM: %s", g_strerror(errno));
-
-		return NULL;
+		request->func(data, response, request->user_data);
 	}
 
-	g_free(p);
-
-	p = NULL;
-	retval = NULL;
+	g_free(request->msg);
+	g_free(request);
+}
 
-	while ((len = read(data->fd, buf, sizeof(buf) - 1)) > 0)
-	{
-		buf[len] = '\0';
+static void mdm_send_request(MdmProtocolData* data, MdmRequest* request)
+{
+	g_string_append(data->outbuf, request->msg);
+	g_string_append_c(data->outbuf, '\n');
 
-		if (!retval)
-		{
-			retval = g_string_new(buf);
-		}
-		else
-		{
-			retval = g_string_append(retval, buf);
-		}
+	g_queue_push_tail(&data->sent, request);
+}
 
-		if ((p = strchr(retval->str, '\n')))
-		{
-			break;
-		}
-	}
+static void mdm_send_new_request(MdmProtocolData* data, const char* msg, MdmResponseFunc func, gpointer user_data)
+{
+	MdmRequest* request;
 
-	if (p)
-	{
-		*p = '\0';
-	}
+	request = g_new0(MdmRequest, 1);
+	request->msg = g_strdup(msg);
+	request->func = func;
+	request->user_data = user_data;
 
-	return retval ? g_string_free(retval, FALSE) : NULL;
+	mdm_send_request(data, request);
 }
 
 static char* get_display_number(void)
@@ -158,7 +195,7 @@ static char* get_display_number(void)
 	return retval;
 }
 
-static gboolean mdm_authenticate_connection(MdmProtocolData* data)
+static GSList* mdm_read_auth_cookies(MdmProtocolData* data)
 {
 	#define MDM_MIT_MAGIC_COOKIE_LEN 16
 
@@ -166,48 +203,31 @@ static gboolean mdm_authenticate_connection(MdmProtocolData* data)
 	FILE* f;
 	Xauth* xau;
 	char* display_number;
-	gboolean retval;
+	GSList* cookies;
 
+	cookies = NULL;
+
+	/* The cookie that worked last time goes first */
 	if (data->auth_cookie)
 	{
-		char* msg;
-		char* response;
-
-		msg = g_strdup_printf(MDM_PROTOCOL_MSG_AUTHENTICATE " %s", data->auth_cookie);
-		response = mdm_send_protocol_msg(data, msg);
-		g_free(msg);
-
-		if (response && !strcmp(response, "OK"))
-		{
-			g_free(response);
-			return TRUE;
-		}
-		else
-		{
-			g_free(response);
-			g_free(data->auth_cookie);
-			data->auth_cookie = NULL;
-		}
+		cookies = g_slist_append(cookies, g_strdup(data->auth_cookie));
 	}
 
 	if (!(xau_path = XauFileName()))
 	{
-		return FALSE;
+		return cookies;
 	}
 
 	if (!(f = fopen(xau_path, "r")))
 	{
-		return FALSE;
+		return cookies;
 	}
 
-	retval = FALSE;
 	display_number = get_display_number();
 
 	while ((xau = XauReadAuth(f)))
 	{
 		char buffer[40]; /* 2*16 == 32, so 40 is enough */
-		char* msg;
-		char* response;
 		int   i;
 
 		if (xau->family != FamilyLocal || strncmp(xau->number, display_number, xau->number_length) || strncmp(xau->name, "MIT-MAGIC-COOKIE-1", xau->name_length) || xau->data_length != MDM_MIT_MAGIC_COOKIE_LEN)
@@ -223,46 +243,336 @@ static gboolean mdm_authenticate_connection(MdmProtocolData* data)
 
 		XauDisposeAuth(xau);
 
-		msg = g_strdup_printf(MDM_PROTOCOL_MSG_AUTHENTICATE " %s", buffer);
-		response = mdm_send_protocol_msg(data, msg);
-		g_free(msg);
-
-		if (response && !strcmp(response, "OK"))
+		if (g_strcmp0(buffer, data->auth_cookie) != 0)
 		{
-			data->auth_cookie = g_strdup(buffer);
-			g_free(response);
-			retval = TRUE;
-			break;
+			cookies = g_slist_append(cookies, g_strdup(buffer));
 		}
-
-		g_free(response);
 	}
 
 	g_free(display_number);
 
 	fclose(f);
 
-	return retval;
+	return cookies;
 
 	#undef MDM_MIT_MAGIC_COOKIE_LEN
 }
 
-static void mdm_shutdown_protocol_connection(MdmProtocolData *data)
+static void mdm_send_auth_request(MdmProtocolData* data);
+
+static void mdm_version_response_cb(MdmProtocolData* data, const char* response, gpointer user_data)
 {
-	if (data->fd)
+	if (!response)
 	{
-		close(data->fd);
+		return;
+	}
+
+	if (strncmp(response, "MDM ", strlen("MDM ")) != 0)
+	{
+		g_warning("Failed to get protocol version from MDM");
+		data->protocol_error = TRUE;
+	}
+}
+
+static void mdm_auth_response_cb(MdmProtocolData* data, const char* response, gpointer user_data)
+{
+	char* cookie;
+	MdmRequest* request;
+
+	if (!response || data->protocol_error)
+	{
+		return;
+	}
+
+	cookie = data->auth_candidates->data;
+	data->auth_candidates = g_slist_delete_link(data->auth_candidates, data->auth_candidates);
+
+	if (strcmp(response, "OK") != 0)
+	{
+		g_free(cookie);
+
+		if (!data->auth_candidates)
+		{
+			g_warning("Failed to authenticate with MDM");
+			data->protocol_error = TRUE;
+			return;
+		}
+
+		mdm_send_auth_request(data);
+		return;
+	}
+
+	g_free(data->auth_cookie);
+	data->auth_cookie = cookie;
+
+	g_slist_free_full(data->auth_candidates, g_free);
+	data->auth_candidates = NULL;
+
+	data->state = MDM_CONNECTION_READY;
+
+	while ((request = g_queue_pop_head(&data->pending)))
+	{
+		mdm_send_request(data, request);
+	}
+}
+
+static void mdm_send_auth_request(MdmProtocolData* data)
+{
+	char* msg;
+
+	msg = g_strdup_printf(MDM_PROTOCOL_MSG_AUTHENTICATE " %s", (char*) data->auth_candidates->data);
+	mdm_send_new_request(data, msg, mdm_auth_response_cb, NULL);
+	g_free(msg);
+}
+
+static gboolean mdm_read_input(MdmProtocolData* data)
+{
+	char buf[256];
+	ssize_t len;
+
+	for (;;)
+	{
+		len = read(data->fd, buf, sizeof(buf));
+
+		if (len > 0)
+		{
+			g_string_append_len(data->inbuf, buf, len);
+			continue;
+		}
+
+		if (len == 0)
+		{
+			g_debug("MDM closed the connection");
+			return FALSE;
+		}
+
+		if (errno == EINTR)
+		{
+			continue;
+		}
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			return TRUE;
+		}
+
+		g_warning("Failed to read from MDM: %s", g_strerror(errno));
+
+		return FALSE;
+	}
+}
+
+static void mdm_dispatch_responses(MdmProtocolData* data)
+{
+	char* p;
+
+	data->dispatching = TRUE;
+
+	while (data->inbuf->len > 0 && (p = memchr(data->inbuf->str, '\n', data->inbuf->len)))
+	{
+		MdmRequest* request;
+		char* line;
+
+		line = g_strndup(data->inbuf->str, p - data->inbuf->str);
+		g_string_erase(data->inbuf, 0, p - data->inbuf->str + 1);
+
+		request = g_queue_pop_head(&data->sent);
+
+		if (!request)
+		{
+			g_debug("Ignoring unexpected message from MDM: %s", line);
+		}
+		else
+		{
+			mdm_complete_request(data, request, line);
+		}
+
+		g_free(line);
+	}
+
+	data->dispatching = FALSE;
+}
+
+static gboolean mdm_process_input(MdmProtocolData* data)
+{
+	gboolean alive;
+
+	alive = mdm_read_input(data);
+
+	/* Answers that arrived before a hangup are still good */
+	mdm_dispatch_responses(data);
+
+	if (!alive || data->protocol_error)
+	{
+		mdm_close_connection(data, !alive);
+		return FALSE;
+	}
+
+	if (!mdm_flush_output(data))
+	{
+		mdm_close_connection(data, TRUE);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean mdm_input_cb(int fd, GIOCondition condition, gpointer user_data)
+{
+	MdmProtocolData* data = user_data;
+
+	if (!mdm_process_input(data))
+	{
+		/* mdm_close_connection() already removed this source */
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean mdm_output_cb(int fd, GIOCondition condition, gpointer user_data)
+{
+	MdmProtocolData* data = user_data;
+
+	if (!mdm_flush_output(data))
+	{
+		mdm_close_connection(data, TRUE);
+		return G_SOURCE_REMOVE;
+	}
+
+	if (data->outbuf->len == 0)
+	{
+		data->out_watch_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean mdm_flush_output(MdmProtocolData* data)
+{
+	ssize_t len;
+
+	while (data->outbuf->len > 0)
+	{
+		len = send(data->fd, data->outbuf->str, data->outbuf->len, MSG_NOSIGNAL);
+
+		if (len < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				break;
+			}
+
+			g_warning("Failed to send message to MDM: %s", g_strerror(errno));
+
+			return FALSE;
+		}
+
+		g_string_erase(data->outbuf, 0, len);
+	}
+
+	if (data->outbuf->len > 0 && data->out_watch_id == 0)
+	{
+		data->out_watch_id = g_unix_fd_add(data->fd, G_IO_OUT, mdm_output_cb, data);
 	}
 
-	data->fd = 0;
+	return TRUE;
 }
 
-static gboolean mdm_init_protocol_connection(MdmProtocolData* data)
+static gboolean mdm_reconnect_cb(gpointer user_data)
+{
+	MdmProtocolData* data = user_data;
+
+	data->reconnect_id = 0;
+
+	/* Reconnect and learn what the new MDM can do before anybody asks */
+	mdm_request_logout_actions(data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void mdm_close_connection(MdmProtocolData* data, gboolean reconnect)
+{
+	GQueue failed = G_QUEUE_INIT;
+	MdmRequest* request;
+
+	if (data->fd < 0)
+	{
+		return;
+	}
+
+	if (data->in_watch_id)
+	{
+		g_source_remove(data->in_watch_id);
+		data->in_watch_id = 0;
+	}
+
+	if (data->out_watch_id)
+	{
+		g_source_remove(data->out_watch_id);
+		data->out_watch_id = 0;
+	}
+
+	close(data->fd);
+	data->fd = -1;
+
+	data->state = MDM_CONNECTION_CLOSED;
+	data->protocol_error = FALSE;
+
+	g_string_free(data->inbuf, TRUE);
+	data->inbuf = NULL;
+	g_string_free(data->outbuf, TRUE);
+	data->outbuf = NULL;
+
+	g_slist_free_full(data->auth_candidates, g_free);
+	data->auth_candidates = NULL;
+
+	/* A restarted MDM may be configured differently */
+	data->actions_known = FALSE;
+
+	/* Commands already written may or may not have been carried out,
+	 * so they are reported as failed instead of being sent again */
+	while ((request = g_queue_pop_head(&data->sent)))
+	{
+		g_queue_push_tail(&failed, request);
+	}
+
+	while ((request = g_queue_pop_head(&data->pending)))
+	{
+		g_queue_push_tail(&failed, request);
+	}
+
+	while ((request = g_queue_pop_head(&failed)))
+	{
+		mdm_complete_request(data, request, NULL);
+	}
+
+	if (reconnect && !data->reconnect_id)
+	{
+		data->reconnect_id = g_timeout_add_seconds(MDM_PROTOCOL_RECONNECT_DELAY, mdm_reconnect_cb, data);
+	}
+}
+
+static gboolean mdm_open_connection(MdmProtocolData* data)
 {
 	struct sockaddr_un addr;
-	char* response;
+	time_t current_time;
 
-	g_assert(data->fd <= 0);
+	g_assert(data->fd < 0);
+
+	/* Don't hammer a display manager that just refused us */
+	current_time = time(NULL);
+
+	if (current_time <= (data->last_failure + MDM_PROTOCOL_RETRY_INTERVAL))
+	{
+		return FALSE;
+	}
 
 	if (g_file_test(MDM_PROTOCOL_SOCKET_PATH, G_FILE_TEST_EXISTS))
 	{
@@ -274,16 +584,16 @@ static gboolean mdm_init_protocol_connection(MdmProtocolData* data)
 	}
 	else
 	{
+		data->last_failure = current_time;
 		return FALSE;
 	}
 
-	data->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	data->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
 
 	if (data->fd < 0)
 	{
 		g_warning("Failed to create MDM socket: %s", g_strerror(errno));
-
-		mdm_shutdown_protocol_connection(data);
+		data->last_failure = current_time;
 
 		return FALSE;
 	}
@@ -294,35 +604,139 @@ static gboolean mdm_init_protocol_connection(MdmProtocolData* data)
 	{
 		g_warning("Failed to establish a connection with MDM: %s", g_strerror(errno));
 
-		mdm_shutdown_protocol_connection(data);
+		close(data->fd);
+		data->fd = -1;
+		data->last_failure = current_time;
 
 		return FALSE;
 	}
 
-	response = mdm_send_protocol_msg(data, MDM_PROTOCOL_MSG_VERSION);
+	g_unix_set_fd_nonblocking(data->fd, TRUE, NULL);
+
+	data->state = MDM_CONNECTION_HANDSHAKE;
+	data->inbuf = g_string_new(NULL);
+	data->outbuf = g_string_new(NULL);
+	data->in_watch_id = g_unix_fd_add(data->fd, G_IO_IN | G_IO_HUP | G_IO_ERR, mdm_input_cb, data);
 
-	if (!response || strncmp(response, "MDM ", strlen("MDM ")) != 0)
+	data->auth_candidates = mdm_read_auth_cookies(data);
+
+	if (!data->auth_candidates)
 	{
-		g_free(response);
+		g_warning("Failed to authenticate with MDM");
 
-		g_warning("Failed to get protocol version from MDM");
-		mdm_shutdown_protocol_connection(data);
+		mdm_close_connection(data, FALSE);
+		data->last_failure = current_time;
 
 		return FALSE;
 	}
 
-	g_free(response);
+	/* The handshake is pipelined too; only the answer to the
+	 * authentication tells us whether the queued commands can go */
+	mdm_send_new_request(data, MDM_PROTOCOL_MSG_VERSION, mdm_version_response_cb, NULL);
+	mdm_send_auth_request(data);
 
-	if (!mdm_authenticate_connection(data))
+	if (!mdm_flush_output(data))
 	{
-		g_warning("Failed to authenticate with MDM");
-		mdm_shutdown_protocol_connection(data);
+		mdm_close_connection(data, FALSE);
+		data->last_failure = current_time;
+
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
+static void mdm_queue_request(MdmProtocolData* data, const char* msg, MdmResponseFunc func, gpointer user_data)
+{
+	MdmRequest* request;
+
+	request = g_new0(MdmRequest, 1);
+	request->msg = g_strdup(msg);
+	request->func = func;
+	request->user_data = user_data;
+
+	if (data->state == MDM_CONNECTION_CLOSED && !mdm_open_connection(data))
+	{
+		mdm_complete_request(data, request, NULL);
+		return;
+	}
+
+	if (data->state != MDM_CONNECTION_READY)
+	{
+		g_queue_push_tail(&data->pending, request);
+		return;
+	}
+
+	mdm_send_request(data, request);
+
+	/* While dispatching, the output is flushed once all the answers
+	 * have been handled */
+	if (!data->dispatching && !mdm_flush_output(data))
+	{
+		mdm_close_connection(data, TRUE);
+	}
+}
+
+/* Blocks until *done is set, looking at nothing but the MDM socket */
+static void mdm_wait(MdmProtocolData* data, gboolean* done)
+{
+	gint64 deadline;
+
+	g_return_if_fail(!data->dispatching);
+
+	deadline = g_get_monotonic_time() + MDM_PROTOCOL_TIMEOUT * G_USEC_PER_SEC;
+
+	while (!*done && data->fd >= 0)
+	{
+		GPollFD pfd;
+		gint64 remaining;
+
+		remaining = deadline - g_get_monotonic_time();
+
+		if (remaining <= 0)
+		{
+			g_warning("Timed out waiting for MDM");
+			mdm_close_connection(data, TRUE);
+			break;
+		}
+
+		pfd.fd = data->fd;
+		pfd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+		pfd.revents = 0;
+
+		if (data->outbuf->len > 0)
+		{
+			pfd.events |= G_IO_OUT;
+		}
+
+		if (g_poll(&pfd, 1, remaining / 1000 + 1) < 0 && errno != EINTR)
+		{
+			mdm_close_connection(data, TRUE);
+			break;
+		}
+
+		if ((pfd.revents & G_IO_OUT) && !mdm_flush_output(data))
+		{
+			mdm_close_connection(data, TRUE);
+			break;
+		}
+
+		if (pfd.revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))
+		{
+			mdm_process_input(data);
+		}
+	}
+}
+
+static void mdm_sync_response_cb(MdmProtocolData* data, const char* response, gpointer user_data)
+{
+	MdmSyncReply* reply = user_data;
+
+	reply->done = TRUE;
+	reply->response = g_strdup(response);
+}
+
+
 static void mdm_parse_query_response(MdmProtocolData* data, const char* response)
 {
 	char** actions;
@@ -384,70 +798,123 @@ static void mdm_parse_query_response(MdmProtocolData* data, const char* response
 	g_strfreev(actions);
 }
 
-static void mdm_update_logout_actions(MdmProtocolData* data)
+static void mdm_query_response_cb(MdmProtocolData* data, const char* response, gpointer user_data)
 {
-	time_t current_time;
-	char* response;
+	GSList* waiters;
+	GSList* l;
 
-	current_time = time(NULL);
+	data->query_in_flight = FALSE;
 
-	if (current_time <= (data->last_update + MDM_PROTOCOL_UPDATE_INTERVAL))
+	if (response)
 	{
-		return;
+		mdm_parse_query_response(data, response);
+		data->actions_known = TRUE;
 	}
 
-	data->last_update = current_time;
+	waiters = data->actions_waiters;
+	data->actions_waiters = NULL;
 
-	if (!mdm_init_protocol_connection(data))
+	for (l = waiters; l; l = l->next)
 	{
-		return;
+		MdmActionsWaiter* waiter = l->data;
+
+		waiter->func(data->available_actions, waiter->user_data);
+		g_free(waiter);
 	}
 
-	if ((response = mdm_send_protocol_msg(data, MDM_PROTOCOL_MSG_QUERY_ACTION)))
+	g_slist_free(waiters);
+}
+
+static void mdm_request_logout_actions(MdmProtocolData* data)
+{
+	/* One query on the wire is enough for everybody */
+	if (data->query_in_flight)
 	{
-		mdm_parse_query_response(data, response);
-		g_free(response);
+		return;
 	}
 
-	mdm_shutdown_protocol_connection(data);
+	data->query_in_flight = TRUE;
+	mdm_queue_request(data, MDM_PROTOCOL_MSG_QUERY_ACTION, mdm_query_response_cb, NULL);
 }
 
 gboolean mdm_is_available(void)
 {
-	if (!mdm_init_protocol_connection(&mdm_protocol_data))
+	if (mdm_protocol_data.state == MDM_CONNECTION_READY)
 	{
-		return FALSE;
+		return TRUE;
 	}
 
-	mdm_shutdown_protocol_connection(&mdm_protocol_data);
+	/* Get the connection going for next time */
+	if (mdm_protocol_data.state == MDM_CONNECTION_CLOSED)
+	{
+		mdm_queue_request(&mdm_protocol_data, MDM_PROTOCOL_MSG_VERSION, NULL, NULL);
+	}
 
-	return TRUE;
+	return FALSE;
 }
 
+void mdm_query_logout_actions(MdmLogoutActionsFunc func, gpointer user_data)
+{
+	if (mdm_protocol_data.actions_known)
+	{
+		if (func)
+		{
+			func(mdm_protocol_data.available_actions, user_data);
+		}
+
+		return;
+	}
+
+	if (func)
+	{
+		MdmActionsWaiter* waiter;
+
+		waiter = g_new0(MdmActionsWaiter, 1);
+		waiter->func = func;
+		waiter->user_data = user_data;
+		mdm_protocol_data.actions_waiters = g_slist_append(mdm_protocol_data.actions_waiters, waiter);
+	}
+
+	mdm_request_logout_actions(&mdm_protocol_data);
+}
+
+/* Until MDM has answered, nothing is supported; the answer is asked for
+ * and comes in through the main loop */
 gboolean mdm_supports_logout_action(MdmLogoutAction action)
 {
-	mdm_update_logout_actions(&mdm_protocol_data);
+	if (!mdm_protocol_data.actions_known)
+	{
+		mdm_request_logout_actions(&mdm_protocol_data);
+		return FALSE;
+	}
 
 	return (mdm_protocol_data.available_actions & action) != 0;
 }
 
 MdmLogoutAction mdm_get_logout_action(void)
 {
-	mdm_update_logout_actions(&mdm_protocol_data);
+	if (!mdm_protocol_data.actions_known)
+	{
+		mdm_request_logout_actions(&mdm_protocol_data);
+		return MDM_LOGOUT_ACTION_NONE;
+	}
 
 	return mdm_protocol_data.current_actions;
 }
 
+static void mdm_set_action_response_cb(MdmProtocolData* data, const char* response, gpointer user_data)
+{
+	/* The available actions don't change, only the selected one */
+	if (response && !strcmp(response, "OK"))
+	{
+		data->current_actions = GPOINTER_TO_INT(user_data);
+	}
+}
+
 void mdm_set_logout_action(MdmLogoutAction action)
 {
 	char* action_str = NULL;
 	char* msg;
-	char* response;
-
-	if (!mdm_init_protocol_connection(&mdm_protocol_data))
-	{
-		return;
-	}
 
 	switch (action)
 	{
@@ -467,30 +934,32 @@ void mdm_set_logout_action(MdmLogoutAction action)
 
 	msg = g_strdup_printf(MDM_PROTOCOL_MSG_SET_ACTION " %s", action_str);
 
-	response = mdm_send_protocol_msg(&mdm_protocol_data, msg);
+	mdm_queue_request(&mdm_protocol_data, msg, mdm_set_action_response_cb, GINT_TO_POINTER(action));
 
 	g_free(msg);
-	g_free(response);
-
-	mdm_protocol_data.last_update = 0;
-
-	mdm_shutdown_protocol_connection(&mdm_protocol_data);
 }
 
 void mdm_new_login(void)
 {
-    char* response;
-
-    if (!mdm_init_protocol_connection(&mdm_protocol_data))
-    {
-        return;
-    }
+	mdm_queue_request(&mdm_protocol_data, MDM_PROTOCOL_MSG_FLEXI_XSERVER, NULL, NULL);
+}
 
-    response = mdm_send_protocol_msg(&mdm_protocol_data, MDM_PROTOCOL_MSG_FLEXI_XSERVER);
+/* Once the main loop is gone, give the commands still on their way
+ * (typically the logout action) a chance to reach MDM */
+void mdm_flush(void)
+{
+	MdmProtocolData* data = &mdm_protocol_data;
+	MdmSyncReply reply = { FALSE, NULL };
 
-    g_free(response);
+	if (data->state == MDM_CONNECTION_CLOSED ||
+	    (g_queue_is_empty(&data->sent) && g_queue_is_empty(&data->pending) && data->outbuf->len == 0))
+	{
+		return;
+	}
 
-    mdm_protocol_data.last_update = 0;
+	/* MDM answers in order, so once this is answered so is the rest */
+	mdm_queue_request(data, MDM_PROTOCOL_MSG_VERSION, mdm_sync_response_cb, &reply);
+	mdm_wait(data, &reply.done);
 
-    mdm_shutdown_protocol_connection(&mdm_protocol_data);
+	g_free(reply.response);
 }
@@ -41,6 +41,8 @@ typedef enum {
 	MDM_LOGOUT_ACTION_SUSPEND = 1 << 2
 } MdmLogoutAction;
 
+typedef void (*MdmLogoutActionsFunc)(MdmLogoutAction available_actions, gpointer user_data);
+
 gboolean mdm_is_available(void);
 
 void mdm_new_login(void);
@@ -51,6 +53,12 @@ MdmLogoutAction mdm_get_logout_action(void);
 
 gboolean mdm_supports_logout_action(MdmLogoutAction action);
 
+/* Calls func once the available actions are known, right away if they
+ * already are; a NULL func just gets the answer cached */
+void mdm_query_logout_actions(MdmLogoutActionsFunc func, gpointer user_data);
+
+void mdm_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,7 @@
 #include <gio/gio.h>
 
 #include "msm-gnome.h"
+#include "mdm-signal-handler.h"
 
 #define GSM_SCHEMA "org.mate.session"
 #define GSM_GNOME_COMPAT_STARTUP_KEY "gnome-compat-startup"
@@ -49,13 +50,20 @@
 
 static gboolean gnome_compat_started = FALSE;
 static Window gnome_smproxy_window = None;
+static MdmSignalHandler *keyring_signal_handler = NULL;
 
 static void
 gnome_keyring_daemon_finished (GPid pid,
                                gint status,
                                gpointer user_data)
 {
-  if (WEXITSTATUS (status) != 0)
+  g_clear_object (&keyring_signal_handler);
+
+  if (status == MDM_SIGNAL_HANDLER_STATUS_UNKNOWN)
+    {
+      g_printerr ("gnome-keyring-daemon exited, status unknown\n");
+    }
+  else if (WEXITSTATUS (status) != 0)
     {
       /* daemon failed for some reason */
       g_printerr ("gnome-keyring-daemon failed to start correctly, "
@@ -87,7 +95,9 @@ gnome_keyring_daemon_startup (void)
       return;
     }
 
-  g_child_watch_add (pid, gnome_keyring_daemon_finished, NULL);
+  keyring_signal_handler = mdm_signal_handler_new ();
+  mdm_signal_handler_add_child_watch (keyring_signal_handler, pid,
+                                      gnome_keyring_daemon_finished, NULL);
 }
 
 